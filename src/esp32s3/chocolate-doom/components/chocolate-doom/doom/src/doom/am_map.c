@@ -1358,6 +1358,11 @@ void AM_Drawer (void)
 {
     if (!automapactive) return;
 
+#ifdef ESP32_DOOM
+    // I_VideoBuffer moves to the other driver buffer after every frame
+    fb = I_VideoBuffer;
+#endif
+
     AM_clearFB(BACKGROUND);
     if (grid)
 	AM_drawGrid(GRIDCOLORS);
@@ -205,6 +205,9 @@ boolean D_Display (void)
 	    redrawsbar = true;
 	if (inhelpscreensstate && !inhelpscreens)
 	    redrawsbar = true;              // just put away the help screen
+#ifdef ESP32_DOOM
+	redrawsbar = true;              // the two driver buffers alternate, a diff would miss the older one
+#endif
 	ST_Drawer (viewheight == SCREENHEIGHT, redrawsbar );
 	fullscreen = viewheight == SCREENHEIGHT;
 	break;
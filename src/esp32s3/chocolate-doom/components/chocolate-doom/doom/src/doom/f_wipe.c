@@ -211,6 +211,30 @@ wipe_doMelt
 	}
     }
 
+#ifdef ESP32_DOOM
+    // The columns above only move the parts that changed since the last
+    // tick, which is two frames ago in the driver buffer drawn now. Draw
+    // every column from its position instead.
+    for (i=0;i<width;i++)
+    {
+	dy = y[i] < 0 ? 0 : y[i];
+	s = &((dpixel_t *)wipe_scr_end)[i*height];
+	d = &((dpixel_t *)wipe_scr)[i];
+	idx = 0;
+	for (j=dy;j;j--)
+	{
+	    d[idx] = *(s++);
+	    idx += width;
+	}
+	s = &((dpixel_t *)wipe_scr_start)[i*height];
+	for (j=height-dy;j;j--)
+	{
+	    d[idx] = *(s++);
+	    idx += width;
+	}
+    }
+#endif
+
     return done;
 
 }
@@ -235,7 +259,12 @@ wipe_StartScreen
   int	height )
 {
     wipe_scr_start = Z_Malloc(SCREENWIDTH * SCREENHEIGHT * sizeof(*wipe_scr_start), PU_STATIC, NULL);
+#ifdef ESP32_DOOM
+    // I_VideoBuffer still holds the frame before the one on screen
+    I_ReadPresentedScreen(wipe_scr_start);
+#else
     I_ReadScreen(wipe_scr_start);
+#endif
     return 0;
 }
 
@@ -277,6 +306,11 @@ wipe_ScreenWipe
 	(*wipes[wipeno*3])(width, height, ticks);
     }
 
+#ifdef ESP32_DOOM
+    // I_VideoBuffer moves to the other driver buffer after every frame
+    wipe_scr = I_VideoBuffer;
+#endif
+
     // do a piece of wipe-in
     V_MarkRect(0, 0, width, height);
     rc = (*wipes[wipeno*3+1])(width, height, ticks);
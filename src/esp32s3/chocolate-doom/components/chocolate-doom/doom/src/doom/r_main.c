@@ -861,6 +861,11 @@ void R_SetupFrame (player_t* player)
 //
 void R_RenderPlayerView (player_t* player)
 {	
+#ifdef ESP32_DOOM
+    // I_VideoBuffer moves to the other driver buffer after every frame
+    R_InitBuffer (scaledviewwidth, viewheight);
+#endif
+
     R_SetupFrame (player);
 
     // Clear buffers.
@@ -55,10 +55,19 @@
 
 #ifdef ESP32_DOOM
 
+//doom draws straight into the driver buffers, I_VideoBuffer follows the one that is not being presented
 static uint8_t *fpga_framebuffer;
 static uint8_t *fpga_palette;
+static uint8_t *fpga_presented_framebuffer;
 
-static EXT_RAM_BSS_ATTR uint8_t spare_framebuffer[320*200];
+//native 320x200 layout, only the 200 active rows are uploaded
+static fpga_driver_frame_t fpga_frame = { .width = 320, .height = 200, .stride = 320 };
+
+//rows above the doom screen, 20 when the fpga has no 320x200 mode and the screen is centred in 320x240
+static int fpga_row_offset;
+
+//driver buffers whose rows around a centred screen still need clearing
+static int letterbox_to_clear;
 
 static RingbufHandle_t hid_ringbuf;
 
@@ -164,6 +173,7 @@ void I_GetEvent(void)
             {
                 case FPGA_DRIVER_HID_EVENT_KEY_DOWN:
                 case FPGA_DRIVER_HID_EVENT_KEY_UP:
+                case FPGA_DRIVER_HID_EVENT_KEY_REPEAT:
                     I_HandleKeyboardEvent(hid_event);
                     break;
                 case FPGA_DRIVER_HID_EVENT_MOUSE_BUTTON_DOWN:
@@ -247,18 +257,32 @@ void I_FinishUpdate (void)
     // Draw disk icon before blit, if necessary.
     V_DrawDiskIcon();
 
-    memcpy(fpga_framebuffer + 20*FPGA_DRIVER_FRAME_WIDTH, spare_framebuffer, sizeof(spare_framebuffer));
+    if (letterbox_to_clear > 0)
+    {
+        memset(fpga_framebuffer, 0, fpga_row_offset * SCREENWIDTH);
+        memset(fpga_framebuffer + (fpga_row_offset + SCREENHEIGHT) * SCREENWIDTH, 0, fpga_row_offset * SCREENWIDTH);
+        --letterbox_to_clear;
+    }
 
     if (palette_to_set > 0)
     {
         memcpy(fpga_palette, buffered_palette, sizeof(buffered_palette));
         --palette_to_set;
     }
-    
-    fpga_driver_present_frame(&fpga_palette, &fpga_framebuffer, FPGA_DRIVER_VSYNC_DONT_WAIT_OVERWRITE_PREVIOUS);
 
-    // Restore background and undo the disk indicator, if it was drawn.
-    V_RestoreDiskBackground();
+    fpga_presented_framebuffer = fpga_framebuffer;
+
+    fpga_driver_present_frame(&fpga_palette, &fpga_framebuffer, &fpga_frame, FPGA_DRIVER_VSYNC_DONT_WAIT_OVERWRITE_PREVIOUS);
+
+    // The next frame is drawn into the other driver buffer, which still holds
+    // the frame before this one. Everything that keeps a pointer into the
+    // screen picks the new one up: the view (R_RenderPlayerView), the automap
+    // (AM_Drawer) and the wipe (wipe_ScreenWipe). The status bar is refreshed
+    // on every frame and every screen doom draws covers the corner the disk
+    // icon sits in, so its background is not restored here, that would write
+    // into the buffer the driver is presenting.
+    I_VideoBuffer = fpga_framebuffer + fpga_row_offset * SCREENWIDTH;
+    V_RestoreBuffer();
 }
 
 //
@@ -269,6 +293,15 @@ void I_ReadScreen (pixel_t* scr)
     memcpy(scr, I_VideoBuffer, SCREENWIDTH*SCREENHEIGHT*sizeof(*scr));
 }
 
+//
+// I_ReadPresentedScreen
+// The screen last passed to I_FinishUpdate, I_VideoBuffer is a frame older.
+//
+void I_ReadPresentedScreen (pixel_t* scr)
+{
+    memcpy(scr, fpga_presented_framebuffer + fpga_row_offset * SCREENWIDTH, SCREENWIDTH*SCREENHEIGHT*sizeof(*scr));
+}
+
 //
 // I_SetPalette
 //
@@ -365,9 +398,20 @@ void I_InitGraphics(void)
     // 32-bit RGBA screen buffer that gets loaded into a texture that gets
     // finally rendered into our window or full screen in I_FinishUpdate().
 
+    if (!fpga_driver_set_mode(FPGA_DRIVER_MODE_320X200))
+    {
+        printf("I_InitGraphics: unable to switch fpga to 320x200, frame will be centred in 320x240\n");
+
+        fpga_row_offset = (FPGA_DRIVER_FRAME_HEIGHT - SCREENHEIGHT) / 2;
+        fpga_frame.height = FPGA_DRIVER_FRAME_HEIGHT;
+        letterbox_to_clear = 2;
+    }
+
     fpga_driver_get_framebuffer(&fpga_palette, &fpga_framebuffer);
 
-    I_VideoBuffer = spare_framebuffer;
+    fpga_presented_framebuffer = fpga_framebuffer;
+
+    I_VideoBuffer = fpga_framebuffer + fpga_row_offset * SCREENWIDTH;
     V_RestoreBuffer();
 
     // Clear the screen to black.
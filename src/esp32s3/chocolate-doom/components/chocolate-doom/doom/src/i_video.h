@@ -49,6 +49,10 @@ void I_FinishUpdate (void);
 
 void I_ReadScreen (pixel_t* scr);
 
+#ifdef ESP32_DOOM
+void I_ReadPresentedScreen (pixel_t* scr);
+#endif
+
 void I_BeginRead (void);
 
 void I_DisplayFPSDots(boolean dots_on);
@@ -1,7 +1,15 @@
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
+#include "freertos/semphr.h"
 #include "esp_log.h"
 #include "driver/gptimer.h"
+#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "esp_heap_caps.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include <stdio.h>
 
 #include "fpga_driver.h"
 #include "fpga_api_gpu.h"
@@ -27,6 +35,7 @@ static const char TAG[] = "fpga_driver";
 #define FPGA_DRIVER_MAIN_TASK_PINNED_CORE   0
 
 #define FPGA_DRIVER_MAIN_TASK_TICK_US       500
+#define FPGA_DRIVER_RACE_PALETTE_US         100 //raster read and palette write at 20 MHz, what is left of the vblank has to hold both
 
 #define FPGA_DRIVER_AUDIO_TASK_PRIORITY     11
 #define FPGA_DRIVER_AUDIO_TASK_STACKSIZE    4 * 1024
@@ -38,7 +47,16 @@ static const char TAG[] = "fpga_driver";
 #define FPGA_DRIVER_HID_TASK_NAME           "fpga_drv_hid"
 #define FPGA_DRIVER_HID_TASK_PINNED_CORE    0
 
-#define FPGA_DRIVER_HID_KEY_IS_ERROR(code)  ((code) >= 1 && (code) <= 3)
+#define FPGA_DRIVER_BLIT_QUEUE_SIZE         64 //blits waiting for room in the fpga queue
+
+#define FPGA_DRIVER_UPLOAD_PIECE_SIZE_BYTES 4096 //compressed and delta uploads, one is encoded while the other is sent
+
+#define FPGA_DRIVER_NVS_NAMESPACE               "fpga_driver"
+#define FPGA_DRIVER_NVS_LINK_CALIBRATION        "link_cal"
+#define FPGA_DRIVER_LINK_CALIBRATION_VERSION    2
+#define FPGA_DRIVER_LINK_TEST_ROUNDS            4 //echo patterns per tested setting = 8 * rounds
+#define FPGA_DRIVER_LINK_MIN_WINDOW             3 //consecutive passing input delays a clock needs, the middle one is taken
+#define FPGA_DRIVER_LINK_VERIFY_ROUNDS          (2*FPGA_QSPI_LINK_WINDOW_CHECKS) //echo and status bundle pairs checked at boot
 
 static bool init = false;
 
@@ -55,12 +73,82 @@ static uint32_t fpga_connected = 0;
 //video
 
 static int32_t framebuffer_idx_to_present = -1;
+static fpga_driver_frame_t frame_to_present;
 static bool present_in_progress = false;
+static fpga_driver_present_mode_t present_mode = FPGA_DRIVER_PRESENT_VBLANK;
 
 static DMA_ATTR uint8_t palette0[FPGA_DRIVER_PALETTE_SIZE_BYTES];
 static DMA_ATTR uint8_t palette1[FPGA_DRIVER_PALETTE_SIZE_BYTES];
 static DMA_ATTR uint8_t framebuffer0[FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES];
 static DMA_ATTR uint8_t framebuffer1[FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES];
+static int vblank_upload_us = 0; //written by the main task only
+
+//compressed and delta uploads, main task only
+static DMA_ATTR uint8_t upload_pieces[2][FPGA_DRIVER_UPLOAD_PIECE_SIZE_BYTES];
+static int upload_piece_idx = 0;
+static int upload_encode_us = 0;
+
+static bool octal_requested = false; //by init, octal and lz_upload follow the capabilities of the fpga on every geometry read
+static bool lz_requested = false;
+static bool vblank_irq_requested = false; //by init, an fpga whose SPI_CS1_IRQ build does not match is refused
+static bool vblank_irq_mismatch_logged = false;
+static bool lz_upload = false;
+static int lz_skip = 0; //raw uploads left before the encoder gets another try
+static fpga_driver_lz_encoder_t lz_encoder;
+static int lz_cycles_percent = 0;
+static uint32_t lz_encode_cycles = 0;
+static int lz_encode_cycles_per_byte = 0;
+
+static fpga_driver_delta_encoder_t delta_encoder;
+static uint8_t *delta_shadow = NULL;        //framebuffer contents from index 0 as last sent
+static int delta_shadow_size = 0;           //0 once the framebuffer was written some other way
+static uint32_t delta_shadow_link_errors = 0; //a link error since the shadow was taken may have corrupted what the fpga holds
+static int delta_bytes = 0;
+
+//video timing reported by the fpga, main task only
+static int raster_screen_lines = 720;
+static int raster_total_lines = 750;
+static int race_palette_lines = (FPGA_DRIVER_RACE_PALETTE_US * 1000 + 22221) / 22222;
+
+static fpga_driver_geometry_t geometry = 
+{
+    .mode = FPGA_DRIVER_MODE_320X240,
+    .width = FPGA_DRIVER_FRAME_WIDTH,
+    .height = FPGA_DRIVER_FRAME_HEIGHT,
+    .bitsPerPixel = 8,
+    .rowSizeBytes = FPGA_DRIVER_FRAME_WIDTH,
+    .frameSizeBytes = FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES,
+    .pageCount = 1
+};
+
+//gpu registers, shadowed here and flushed by the main task
+
+static uint8_t gpu_registers[FPGA_API_GPU_REGISTER_COUNT];
+static int gpu_registers_dirty_first = FPGA_API_GPU_REGISTER_COUNT, gpu_registers_dirty_last = -1;
+
+static DMA_ATTR uint8_t sprite_image_buffer[FPGA_API_GPU_SPRITE_IMAGE_SIZE_BYTES]; //guarded by driver_request_mutex
+static int sprite_image_idx = 0; //guarded by driver_request_mutex
+
+static DMA_ATTR uint8_t line_table_buffer[FPGA_API_GPU_LINE_TABLE_SIZE]; //guarded by driver_request_mutex
+
+static DMA_ATTR uint8_t secondary_palette_buffer[FPGA_DRIVER_PALETTE_SIZE_BYTES]; //guarded by driver_request_mutex
+
+static DMA_ATTR uint8_t edid_buffer[FPGA_API_IO_EDID_READ_SIZE_BYTES]; //guarded by driver_request_mutex
+
+static DMA_ATTR uint8_t copper_list_buffer[FPGA_API_GPU_COPPER_ENTRY_COUNT*FPGA_API_GPU_COPPER_ENTRY_SIZE_BYTES]; //guarded by driver_request_mutex
+
+static fpga_api_gpu_raster_t raster_result; //guarded by driver_request_mutex
+
+static uint8_t blit_queue[FPGA_DRIVER_BLIT_QUEUE_SIZE][FPGA_API_GPU_BLIT_PARAMS_SIZE_BYTES];
+static uint32_t blit_queue_head = 0, blit_queue_tail = 0; //free running, guarded by driver_spinlock
+static bool blit_fpga_busy = false; //sent blits are not confirmed finished yet, guarded by driver_spinlock
+static uint32_t blit_crc_result; //guarded by driver_request_mutex
+static DMA_ATTR uint8_t blit_send_buffer[FPGA_API_GPU_BLIT_QUEUE_DEPTH*FPGA_API_GPU_BLIT_PARAMS_SIZE_BYTES]; //main task only
+
+//generic parameters of the line table, framebuffer rows, copper list and blit store requests, guarded by driver_request_mutex
+static const uint8_t *request_write_data = NULL;
+static uint8_t *request_read_data = NULL;
+static int request_write_start = 0, request_write_count = 0;
 
 //audio
 
@@ -75,13 +163,84 @@ static fpga_driver_audio_requested_cb_t audio_requested_callback = NULL;
 
 //hid
 
+static fpga_driver_hid_merge_t hid_merge; //main task only
+
 static fpga_driver_hid_status_t previous_hid_status, current_hid_status;
 static fpga_driver_hid_event_cb_t hid_event_callback = NULL;
 
+static int hid_key_repeat_delay_ms = FPGA_DRIVER_HID_KEY_REPEAT_DELAY_MS;
+static int hid_key_repeat_rate_ms = FPGA_DRIVER_HID_KEY_REPEAT_RATE_MS;
+static const fpga_driver_hid_layout_t *hid_layout = &fpga_driver_hid_layout_us;
+
+//usb trace
+
+static DMA_ATTR uint8_t usb_trace_buffer[FPGA_API_IO_USB_TRACE_SIZE_BYTES];
+static uint32_t usb_trace_read_count = 0; //guarded by driver_request_mutex
+
+//statistics, written by the main task unless noted
+
+static uint32_t stats_frames_presented = 0;
+static uint32_t stats_frames_dropped = 0; //guarded by driver_spinlock
+static uint32_t stats_vblanks_missed = 0;
+static uint32_t stats_audio_underruns = 0;
+static uint32_t stats_audio_overruns = 0;
+static uint32_t stats_hid_polls = 0;
+
+static fpga_qspi_trace_entry_t *trace_ring = NULL; //guarded by driver_request_mutex
+
+//link calibration, stored in nvs
+
+typedef struct
+{
+    uint8_t version;
+    uint8_t freqLevel;
+    uint8_t inputDelayNs;
+    uint8_t readDummyCycles;
+} driver_link_calibration_t;
+
+//requests from user tasks, served by the main task as the only one talking to the fpga
+
+typedef enum
+{
+    DRIVER_REQUEST_NONE,
+    DRIVER_REQUEST_USB_TRACE_READ,
+    DRIVER_REQUEST_SPRITE_WRITE_IMAGE,
+    DRIVER_REQUEST_LINE_TABLE_WRITE,
+    DRIVER_REQUEST_FRAMEBUFFER_WRITE_ROWS,
+    DRIVER_REQUEST_GEOMETRY_READ,
+    DRIVER_REQUEST_SECONDARY_PALETTE_WRITE,
+    DRIVER_REQUEST_EDID_READ,
+    DRIVER_REQUEST_RASTER_READ,
+    DRIVER_REQUEST_COPPER_LIST_WRITE,
+    DRIVER_REQUEST_BLIT_STORE_WRITE,
+    DRIVER_REQUEST_FRAMEBUFFER_READ_ROWS,
+    DRIVER_REQUEST_BLIT_CRC_READ
+} driver_request_t;
+
+static SemaphoreHandle_t driver_request_mutex = NULL;
+static SemaphoreHandle_t driver_request_done = NULL;
+
+static driver_request_t driver_request = DRIVER_REQUEST_NONE;
+static bool driver_request_result = false;
+
 static bool driver_timer_tick(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *userCtx);
+static void driver_vblank_irq(void *arg);
 static void driver_task_function_main(void *arg);
 static void driver_task_function_audio(void *arg);
 static void driver_task_function_hid(void *arg);
+static void driver_helper_gpu_registers_write(int startRegister, const uint8_t *values, int count);
+static void driver_helper_gpu_registers_update(int reg, uint8_t mask, uint8_t value);
+static bool driver_helper_read_geometry(void);
+static bool driver_helper_upload_frame(const uint8_t *pixels, const fpga_driver_frame_t *frame, const fpga_driver_geometry_t *current, uint32_t startIdx, int firstRow, int rowCount);
+static bool driver_helper_present_frame(uint8_t *palette, const uint8_t *pixels, const fpga_driver_frame_t *frame, const fpga_driver_geometry_t *current);
+static bool driver_helper_upload_lz(const uint8_t *pixels, int size, int rowBytes, uint32_t startIdx);
+static bool driver_helper_upload_delta(const uint8_t *pixels, int size);
+static void driver_helper_copper_pack(uint8_t *entry, int row, int op, uint8_t index, uint8_t v0, uint8_t v1, uint8_t v2);
+static bool driver_helper_blit_rect(int x, int y, int width, int height, uint32_t *address, int *rowBytes, int *stride);
+static bool driver_helper_blit_enqueue(uint8_t op, uint8_t value, uint32_t src, int srcStride, uint32_t dst, int dstStride, int width, int height);
+static void driver_helper_link_calibrate(bool force);
+static bool driver_helper_request(driver_request_t request);
+static void driver_helper_serve_request(bool connected);
 
 bool fpga_driver_init(fpga_driver_config_t *config)
 {
@@ -90,7 +249,37 @@ bool fpga_driver_init(fpga_driver_config_t *config)
     if (init)
         return false;
 
-    if (!fpga_qspi_init(&qspi, config->pinCsGpu, config->pinCsIo, config->pinSclk, config->pinD0, config->pinD1, config->pinD2, config->pinD3))
+    if (!fpga_qspi_init(&qspi, config->pinCsGpu, config->vblankIrq ? -1 : config->pinCsIo, config->pinSclk, config->pinD0, config->pinD1, config->pinD2, config->pinD3,
+                        config->octal ? config->pinD4 : -1, 
+                        config->octal ? config->pinD5 : -1, 
+                        config->octal ? config->pinD6 : -1, 
+                        config->octal ? config->pinD7 : -1))
+        return false;
+
+    fpga_qspi_set_io_on_gpu_cs(&qspi, config->ioOnGpuCs);
+
+    octal_requested = config->octal;
+    lz_requested = config->lzUpload;
+    vblank_irq_requested = config->vblankIrq;
+    lz_skip = 0;
+
+    if (config->deltaUpload)
+    {
+        delta_shadow = heap_caps_malloc(FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+
+        if (delta_shadow == NULL)
+            delta_shadow = heap_caps_malloc(FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES, MALLOC_CAP_8BIT);
+
+        if (delta_shadow == NULL)
+            ESP_LOGW(TAG, "no memory for the delta upload shadow frame, frames are sent whole");
+    }
+
+    driver_helper_link_calibrate(config->recalibrateLink);
+
+    driver_request_mutex = xSemaphoreCreateMutex();
+    driver_request_done = xSemaphoreCreateBinary();
+
+    if (driver_request_mutex == NULL || driver_request_done == NULL)
         return false;
 
     if (xTaskCreatePinnedToCore(driver_task_function_main, 
@@ -133,6 +322,24 @@ bool fpga_driver_init(fpga_driver_config_t *config)
 
     if (gptimer_start(driver_timer) != ESP_OK)
         return false;
+
+    if (config->vblankIrq)
+    {   //the tick still runs, the irq only shortens the wait for vblank
+        gpio_config_t irq_config = 
+        {
+            .pin_bit_mask = 1ULL << config->pinCsIo,
+            .mode = GPIO_MODE_INPUT,
+            .intr_type = GPIO_INTR_POSEDGE
+        };
+
+        if (gpio_config(&irq_config) != ESP_OK)
+            return false;
+
+        esp_err_t err = gpio_install_isr_service(0);
+
+        if ((err != ESP_OK && err != ESP_ERR_INVALID_STATE) || gpio_isr_handler_add(config->pinCsIo, driver_vblank_irq, NULL) != ESP_OK)
+            return false;
+    }
         
     if (xTaskCreatePinnedToCore(driver_task_function_audio, 
                                 FPGA_DRIVER_AUDIO_TASK_NAME, 
@@ -167,6 +374,47 @@ bool fpga_driver_is_connected(void)
     return connected;
 }
 
+bool fpga_driver_set_mode(fpga_driver_mode_t mode)
+{
+    if (!init || mode < FPGA_DRIVER_MODE_320X240 || mode > FPGA_DRIVER_MODE_160X120)
+        return false;
+
+    uint8_t value = mode;
+
+    driver_helper_gpu_registers_write(FPGA_API_GPU_REGISTER_MODE, &value, 1);
+
+    //register is flushed on the next tick and latched by the fpga at the next vblank
+    for (int i = 0; i < 10; ++i)
+    {
+        vTaskDelay(pdMS_TO_TICKS(10));
+
+        xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
+
+        bool result = driver_helper_request(DRIVER_REQUEST_GEOMETRY_READ);
+
+        xSemaphoreGive(driver_request_mutex);
+
+        fpga_driver_geometry_t current;
+
+        fpga_driver_get_geometry(&current);
+
+        if (result && current.mode == mode)
+            return true;
+    }
+
+    ESP_LOGE(TAG, "set mode: fpga did not switch to mode %d", mode);
+    return false;
+}
+
+void fpga_driver_get_geometry(fpga_driver_geometry_t *result)
+{
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    *result = geometry;
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+}
+
 void fpga_driver_get_framebuffer(uint8_t **palette, uint8_t **framebuffer)
 {
     taskENTER_CRITICAL(&driver_spinlock);
@@ -177,10 +425,30 @@ void fpga_driver_get_framebuffer(uint8_t **palette, uint8_t **framebuffer)
     taskEXIT_CRITICAL(&driver_spinlock);
 }
 
-void fpga_driver_present_frame(uint8_t **palette, uint8_t **framebuffer, fpga_driver_vsync_mode_t vsync)
+void fpga_driver_present_frame(uint8_t **palette, uint8_t **framebuffer, const fpga_driver_frame_t *frame, fpga_driver_vsync_mode_t vsync)
 {
     int framebuffer_idx;
 
+    fpga_driver_geometry_t current;
+
+    fpga_driver_get_geometry(&current);
+
+    fpga_driver_frame_t descriptor = frame != NULL 
+        ? *frame 
+        : (fpga_driver_frame_t) { .width = current.width, .height = current.height, .stride = current.rowSizeBytes };
+
+    int rowBytes = descriptor.width * current.bitsPerPixel / 8;
+
+    if (descriptor.width <= 0 || descriptor.width > current.width || (descriptor.width * current.bitsPerPixel) % 8 != 0 || 
+        descriptor.height <= 0 || descriptor.height > current.height || 
+        descriptor.stride < rowBytes || 
+        (descriptor.height - 1) * descriptor.stride + rowBytes > FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES)
+    {
+        ESP_LOGE(TAG, "present frame: frame %dx%d stride %d does not fit geometry %dx%d", 
+            descriptor.width, descriptor.height, descriptor.stride, current.width, current.height);
+        return;
+    }
+
     if (*palette == palette0 && *framebuffer == framebuffer0)
         framebuffer_idx = 0;
     else if (*palette == palette1 && *framebuffer == framebuffer1)
@@ -201,7 +469,11 @@ void fpga_driver_present_frame(uint8_t **palette, uint8_t **framebuffer, fpga_dr
         {
             if (!present_in_progress)
             {
+                if (framebuffer_idx_to_present >= 0)
+                    ++stats_frames_dropped;
+
                 framebuffer_idx_to_present = framebuffer_idx;
+                frame_to_present = descriptor;
                 done = true;
             }
         }
@@ -210,6 +482,7 @@ void fpga_driver_present_frame(uint8_t **palette, uint8_t **framebuffer, fpga_dr
             if (framebuffer_idx_to_present < 0 && !present_in_progress)
             {
                 framebuffer_idx_to_present = framebuffer_idx;
+                frame_to_present = descriptor;
                 done = true;
             }
         }
@@ -230,349 +503,1944 @@ void fpga_driver_present_frame(uint8_t **palette, uint8_t **framebuffer, fpga_dr
     *framebuffer = framebuffer_idx ? framebuffer0 : framebuffer1;
 }
 
-void fpga_driver_register_audio_requested_cb(fpga_driver_audio_requested_cb_t callback)
+void fpga_driver_set_present_mode(fpga_driver_present_mode_t mode)
 {
     taskENTER_CRITICAL(&driver_spinlock);
 
-    audio_requested_callback = callback;
+    present_mode = mode;
 
     taskEXIT_CRITICAL(&driver_spinlock);
 }
 
-void fpga_driver_hid_get_status(fpga_driver_hid_status_t *status)
+void fpga_driver_set_palette_bank(int bank)
 {
-    taskENTER_CRITICAL(&driver_spinlock);
-
-    *status = current_hid_status;
+    uint8_t value = bank < 0 ? 0 : (bank > 63 ? 63 : bank);
 
-    taskEXIT_CRITICAL(&driver_spinlock);
+    driver_helper_gpu_registers_write(FPGA_API_GPU_REGISTER_PALETTE_BANK, &value, 1);
 }
 
-void fpga_driver_register_hid_event_cb(fpga_driver_hid_event_cb_t callback)
+bool fpga_driver_display_get_info(fpga_driver_display_info_t *info)
 {
-    taskENTER_CRITICAL(&driver_spinlock);
+    *info = (fpga_driver_display_info_t) { 0 };
 
-    hid_event_callback = callback;
+    if (!init)
+        return false;
 
-    taskEXIT_CRITICAL(&driver_spinlock);
-}
+    //fpga waits 100ms after hot plug, then needs ~25ms per attempt at 100khz
+    for (int i = 0; i < 50; ++i)
+    {
+        xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
 
-static bool IRAM_ATTR driver_timer_tick(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *userCtx)
-{
-    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    
-    vTaskNotifyGiveFromISR(driver_main_task, &xHigherPriorityTaskWoken);
+        bool result = driver_helper_request(DRIVER_REQUEST_EDID_READ);
+        uint8_t status = edid_buffer[0];
 
-    return xHigherPriorityTaskWoken == pdTRUE;
-}
+        if (result && !FPGA_API_IO_EDID_STATUS_GET_BUSY(status))
+        {
+            info->connected = FPGA_API_IO_EDID_STATUS_GET_HPD(status);
 
-static void IRAM_ATTR driver_task_function_main(void *arg)
-{
-    ESP_LOGI(TAG, "fpga driver main task started");
+            if (FPGA_API_IO_EDID_STATUS_GET_VALID(status))
+                fpga_driver_display_parse_edid(edid_buffer + 1, FPGA_API_IO_EDID_SIZE, info);
 
-    bool pollHid = true;
+            xSemaphoreGive(driver_request_mutex);
 
-    uint8_t status0;
-    uint16_t audio_buffer_status;
+            return true;
+        }
 
-    bool vblank = false;
+        xSemaphoreGive(driver_request_mutex);
 
-    for (;;)
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+
+    ESP_LOGE(TAG, "display info: ddc did not finish reading the edid");
+    return false;
+}
+
+void fpga_driver_set_dvi_output(bool dvi)
+{
+    driver_helper_gpu_registers_update(FPGA_API_GPU_REGISTER_OUTPUT_FLAGS, 
+                                       FPGA_API_GPU_OUTPUT_FLAGS_DVI, 
+                                       dvi ? FPGA_API_GPU_OUTPUT_FLAGS_DVI : 0);
+}
+
+void fpga_driver_set_link_check(bool enable)
+{
+    if (init)
+        fpga_qspi_set_link_check(&qspi, enable);
+}
+
+void fpga_driver_get_link_stats(fpga_driver_link_stats_t *stats)
+{
+    *stats = (fpga_driver_link_stats_t)
     {
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        .checks = qspi.link_checks,
+        .errors = qspi.link_errors,
+        .freqHz = fpga_qspi_get_freq_hz(&qspi),
+        .vblankUploadUs = vblank_upload_us,
+        .lzCyclesPercent = lz_cycles_percent,
+        .lzEncodeCyclesPerByte = lz_encode_cycles_per_byte,
+        .deltaBytes = delta_bytes,
+        .encodeUs = upload_encode_us
+    };
+}
 
-        if (!fpga_connected)
-        {
-            bool connected = false;
+void fpga_driver_get_stats(fpga_driver_stats_t *stats)
+{
+    fpga_qspi_stats_t qspi_stats = { 0 };
 
-            FPGA_DRIVER_ERROR_CHECK(fpga_api_gpu_read_magic_number(&qspi, &connected));
+    if (init)
+        fpga_qspi_get_stats(&qspi, &qspi_stats);
 
-            taskENTER_CRITICAL(&driver_spinlock);
+    taskENTER_CRITICAL(&driver_spinlock);
 
-            fpga_connected = connected;
+    uint32_t frames_dropped = stats_frames_dropped;
 
-            taskEXIT_CRITICAL(&driver_spinlock);
-            continue;
-        }
+    taskEXIT_CRITICAL(&driver_spinlock);
 
-        //framebuffer and palette
+    *stats = (fpga_driver_stats_t)
+    {
+        .framesPresented = stats_frames_presented,
+        .framesDropped = frames_dropped,
+        .vblanksMissed = stats_vblanks_missed,
+        .audioUnderruns = stats_audio_underruns,
+        .audioOverruns = stats_audio_overruns,
+        .hidPolls = stats_hid_polls,
+        .transactions = qspi_stats.transactions,
+        .transactionErrors = qspi_stats.errors,
+        .bytes = qspi_stats.bytes,
+        .busUs = qspi_stats.busUs,
+        .busWaitUs = qspi_stats.waitUs
+    };
+}
 
-        FPGA_DRIVER_ERROR_CHECK(fpga_api_gpu_read_status0(&qspi, &status0));
+bool fpga_driver_trace_start(int entryCount)
+{
+    if (!init || entryCount <= 0)
+        return false;
 
-        if (!vblank && FPGA_API_GPU_STATUS0_GET_VBLANK(status0))
-        {   //at most one tick after the vblank started - only chance to update the frame
-            taskENTER_CRITICAL(&driver_spinlock);
+    fpga_qspi_trace_entry_t *ring = heap_caps_malloc(entryCount * sizeof(fpga_qspi_trace_entry_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
 
-            int buffer_to_present = framebuffer_idx_to_present;
-            present_in_progress = framebuffer_idx_to_present >= 0;
+    if (ring == NULL)
+        ring = heap_caps_malloc(entryCount * sizeof(fpga_qspi_trace_entry_t), MALLOC_CAP_8BIT);
 
-            taskEXIT_CRITICAL(&driver_spinlock);
+    if (ring == NULL)
+        return false;
 
-            if (present_in_progress)
-            {   
-                FPGA_DRIVER_ERROR_CHECK(fpga_api_gpu_set_palette(&qspi, buffer_to_present ? palette1 : palette0));
-                FPGA_DRIVER_ERROR_CHECK(fpga_api_gpu_framebuffer_write(&qspi, 0, buffer_to_present ? framebuffer1 : framebuffer0, FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES));
-                
-                taskENTER_CRITICAL(&driver_spinlock);
+    xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
 
-                framebuffer_idx_to_present = -1;
-                present_in_progress = false;
+    fpga_qspi_set_trace(&qspi, ring, entryCount); //transactions stop touching the old ring once this returns
 
-                taskEXIT_CRITICAL(&driver_spinlock);
-            }
-        }
+    heap_caps_free(trace_ring);
+    trace_ring = ring;
 
-        vblank = FPGA_API_GPU_STATUS0_GET_VBLANK(status0);
+    xSemaphoreGive(driver_request_mutex);
 
-        //audio buffers
+    return true;
+}
 
-        taskENTER_CRITICAL(&driver_spinlock);
+void fpga_driver_trace_stop(void)
+{
+    if (!init)
+        return;
 
-        if (next_audio_buffer_ready_samples > 0)
-            audio_send_in_progress = true;
-        
-        taskEXIT_CRITICAL(&driver_spinlock);
+    xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
 
-        if (audio_send_in_progress)
-        {
-            FPGA_DRIVER_ERROR_CHECK(fpga_api_gpu_audio_buffer_write(&qspi, next_audio_buffer, next_audio_buffer_ready_samples, &audio_buffer_status));
-            
-            taskENTER_CRITICAL(&driver_spinlock);
+    fpga_qspi_set_trace(&qspi, NULL, 0);
 
-            next_audio_buffer_ready_samples = 0;
-            audio_hdmi_fifo_wnum = FPGA_API_GPU_AUDIO_BUFFER_STATUS_GET_WNUM(audio_buffer_status);
-            audio_send_in_progress = false;
+    heap_caps_free(trace_ring);
+    trace_ring = NULL;
 
-            taskEXIT_CRITICAL(&driver_spinlock);
-        }
-        else
-        {
-            FPGA_DRIVER_ERROR_CHECK(fpga_api_gpu_audio_buffer_read_status(&qspi, &audio_buffer_status));
+    xSemaphoreGive(driver_request_mutex);
+}
 
-            taskENTER_CRITICAL(&driver_spinlock);
+bool fpga_driver_trace_export_chrome(void)
+{
+    if (!init)
+        return false;
 
-            audio_hdmi_fifo_wnum = FPGA_API_GPU_AUDIO_BUFFER_STATUS_GET_WNUM(audio_buffer_status);
+    xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
 
-            taskEXIT_CRITICAL(&driver_spinlock);
-        }
+    int count = 0;
+    fpga_qspi_trace_entry_t *entries = NULL;
 
-        if (audio_hdmi_fifo_wnum < (FPGA_DRIVER_AUDIO_HDMI_FIFO_SAMPLES - FPGA_DRIVER_AUDIO_BUFFER_WRITE_MAX_SAMPLES - 10))
-            xTaskNotifyGive(driver_audio_task);
+    if (trace_ring != NULL)
+    {   //copied out, printing over the uart takes far longer than the ring lasts
+        entries = heap_caps_malloc(qspi.trace_size * sizeof(fpga_qspi_trace_entry_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
 
-        //hid kb&mouse
+        if (entries == NULL)
+            entries = heap_caps_malloc(qspi.trace_size * sizeof(fpga_qspi_trace_entry_t), MALLOC_CAP_8BIT);
 
-        if (pollHid)
-        {
-            WORD_ALIGNED_ATTR uint8_t hid_status_buffer[6*4];
+        if (entries != NULL)
+            count = fpga_qspi_get_trace(&qspi, entries, qspi.trace_size);
+    }
 
-            FPGA_DRIVER_ERROR_CHECK(fpga_api_io_hid_get_status(&qspi, hid_status_buffer));
+    xSemaphoreGive(driver_request_mutex);
 
-            taskENTER_CRITICAL(&driver_spinlock);
+    if (entries == NULL)
+        return false;
 
-            fpga_driver_hid_status_t previous_current = current_hid_status;
+    printf("{\"traceEvents\":[\n");
+    printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"qspi\"}},\n");
+    printf("{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"bus wait\"}}");
 
-            current_hid_status = (fpga_driver_hid_status_t)
-            {
-                .mouseKeys = hid_status_buffer[4],
-                .keyboardModifiers = hid_status_buffer[5],
-                .keyboardKeys = 
-                { 
-                    hid_status_buffer[6], 
-                    hid_status_buffer[7], 
-                    hid_status_buffer[8],
-                    hid_status_buffer[9], 
-                    hid_status_buffer[10],
-                    hid_status_buffer[11] 
-                },
-                .mouseX = (int32_t)(hid_status_buffer[12] << 24 | hid_status_buffer[13] << 16 | hid_status_buffer[14] << 8 | hid_status_buffer[15]),
-                .mouseY = (int32_t)(hid_status_buffer[16] << 24 | hid_status_buffer[17] << 16 | hid_status_buffer[18] << 8 | hid_status_buffer[19]),
-                .mouseWheel = (int32_t)(hid_status_buffer[20] << 24 | hid_status_buffer[21] << 16 | hid_status_buffer[22] << 8 | hid_status_buffer[23])
-            };
+    for (int i = 0; i < count; ++i)
+    {
+        fpga_qspi_trace_entry_t *e = entries + i;
 
-            taskEXIT_CRITICAL(&driver_spinlock);
+        const char *category = (e->flags & FPGA_QSPI_TRACE_FLAG_CHAIN) ? "chain" : (e->flags & FPGA_QSPI_TRACE_FLAG_IO) ? "io" : "gpu";
 
-            if (memcmp(&previous_current, &current_hid_status, sizeof(fpga_driver_hid_status_t)))
-                xTaskNotifyGive(driver_hid_task);
-        }
+        printf(",\n{\"name\":\"0x%02X\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%lld,\"dur\":%lld,\"args\":{\"bytes\":%lu,\"error\":%d}}",
+               e->command, category, (long long)e->startUs, (long long)(e->endUs - e->startUs), (unsigned long)e->bytes, (e->flags & FPGA_QSPI_TRACE_FLAG_ERROR) ? 1 : 0);
 
-        pollHid = !pollHid; //every second tick - no hid device works at 2000hz...
+        if (e->waitUs > 0)
+            printf(",\n{\"name\":\"wait 0x%02X\",\"cat\":\"wait\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%lld,\"dur\":%u}",
+                   e->command, (long long)(e->startUs - e->waitUs), e->waitUs);
     }
 
-    vTaskDelete(NULL);
+    printf("\n]}\n");
+
+    heap_caps_free(entries);
+
+    return true;
 }
 
-static void IRAM_ATTR driver_task_function_audio(void *arg)
-{    
-    ESP_LOGI(TAG, "fpga driver audio task started");
+bool fpga_driver_palette_set_secondary(const uint8_t *palette)
+{
+    if (!init)
+        return false;
 
-    for (;;)
-    {
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
 
-        taskENTER_CRITICAL(&driver_spinlock);
+    memcpy(secondary_palette_buffer, palette, FPGA_DRIVER_PALETTE_SIZE_BYTES);
 
-        fpga_driver_audio_requested_cb_t callback = audio_requested_callback;
-        uint32_t bufferedSamples = next_audio_buffer_ready_samples;
-        
-        taskEXIT_CRITICAL(&driver_spinlock);
+    bool result = driver_helper_request(DRIVER_REQUEST_SECONDARY_PALETTE_WRITE);
 
-        if (bufferedSamples != 0 || callback == NULL)
-            continue;
-        
-        int generatedSampleCount;
+    xSemaphoreGive(driver_request_mutex);
 
-        callback((uint32_t*)next_audio_buffer, &generatedSampleCount, FPGA_DRIVER_AUDIO_BUFFER_WRITE_MAX_SAMPLES);
+    return result;
+}
 
-        if (generatedSampleCount == 0)
-            continue;
+void fpga_driver_palette_fade(int level, int speed)
+{
+    uint8_t fade[2] = 
+    { 
+        level < 0 ? 0 : (level > FPGA_DRIVER_PALETTE_FADE_MAX ? FPGA_DRIVER_PALETTE_FADE_MAX : level), 
+        speed < 0 ? 0 : (speed > 255 ? 255 : speed) 
+    };
 
-        if (generatedSampleCount < 0 || generatedSampleCount > FPGA_DRIVER_AUDIO_BUFFER_WRITE_MAX_SAMPLES)
-        {
-            ESP_LOGE(TAG, "audio requested callback returned sampleCount %d out of range", generatedSampleCount);
-            continue;
-        }
+    driver_helper_gpu_registers_write(FPGA_API_GPU_REGISTER_FADE_TARGET, fade, sizeof(fade));
+}
 
-        taskENTER_CRITICAL(&driver_spinlock);
+void fpga_driver_palette_rotate(int range, int first, int last, int framesPerStep, bool reverse)
+{
+    if (range < 0 || range >= FPGA_DRIVER_PALETTE_ROTATION_COUNT || first < 0 || last > 255)
+        return;
 
-        next_audio_buffer_ready_samples = generatedSampleCount;
-        
-        taskEXIT_CRITICAL(&driver_spinlock);
-    }
+    uint8_t rotation[4] = 
+    { 
+        first, 
+        last, 
+        framesPerStep < 0 ? 0 : (framesPerStep > 255 ? 255 : framesPerStep), 
+        reverse ? FPGA_API_GPU_ROTATION_FLAGS_REVERSE : 0 
+    };
+
+    driver_helper_gpu_registers_write(FPGA_API_GPU_REGISTER_ROTATION(range), rotation, sizeof(rotation));
 }
 
-static inline void driver_helper_hid_map_keys(const uint8_t oldKeys[6], const uint8_t newKeys[6], uint8_t unmappedNewKeys[6], int *unmappedNewKeysCount)
+bool fpga_driver_sprite_set_image(int sprite, const uint8_t *pixels, uint8_t transparentIdx)
 {
-    *unmappedNewKeysCount = 0;
+    if (!init || sprite < 0 || sprite >= FPGA_DRIVER_SPRITE_COUNT)
+        return false;
 
-    for (int i = 0; i < 6; ++i)
-    {
-        if (newKeys[i] == 0)
-            continue;
+    driver_helper_gpu_registers_write(FPGA_API_GPU_REGISTER_SPRITE(sprite) + FPGA_API_GPU_REGISTER_SPRITE_TRANSPARENT, &transparentIdx, 1);
 
-        bool keyFound = false;
+    xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
 
-        for (int j = 0; j < 6; ++j)
-        {
-            if (newKeys[i] != oldKeys[j])
-                continue;
+    memcpy(sprite_image_buffer, pixels, FPGA_DRIVER_SPRITE_IMAGE_SIZE_BYTES);
+    sprite_image_idx = sprite;
 
-            keyFound = true;
-            break;
-        }
+    bool result = driver_helper_request(DRIVER_REQUEST_SPRITE_WRITE_IMAGE);
 
-        if (keyFound)
-            continue;
+    xSemaphoreGive(driver_request_mutex);
 
-        unmappedNewKeys[*unmappedNewKeysCount] = newKeys[i];
-        ++(*unmappedNewKeysCount);
-    }
+    return result;
 }
 
-static void IRAM_ATTR driver_task_function_hid(void *arg)
+void fpga_driver_sprite_set_position(int sprite, int x, int y)
 {
-    ESP_LOGI(TAG, "fpga driver hid task started");
+    if (sprite < 0 || sprite >= FPGA_DRIVER_SPRITE_COUNT)
+        return;
 
-    for (;;)
-    {
-        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    x = x < INT16_MIN ? INT16_MIN : (x > INT16_MAX ? INT16_MAX : x);
+    y = y < INT16_MIN ? INT16_MIN : (y > INT16_MAX ? INT16_MAX : y);
 
-        taskENTER_CRITICAL(&driver_spinlock);
+    uint8_t position[4] = { x & 0xFF, (x >> 8) & 0xFF, y & 0xFF, (y >> 8) & 0xFF };
 
-        fpga_driver_hid_event_cb_t callback = hid_event_callback;
+    driver_helper_gpu_registers_write(FPGA_API_GPU_REGISTER_SPRITE(sprite) + FPGA_API_GPU_REGISTER_SPRITE_X, position, sizeof(position));
+}
+
+void fpga_driver_sprite_set_visible(int sprite, bool visible)
+{
+    if (sprite < 0 || sprite >= FPGA_DRIVER_SPRITE_COUNT)
+        return;
+
+    driver_helper_gpu_registers_update(FPGA_API_GPU_REGISTER_SPRITE(sprite) + FPGA_API_GPU_REGISTER_SPRITE_FLAGS, 
+                                       FPGA_API_GPU_SPRITE_FLAGS_ENABLE, 
+                                       visible ? FPGA_API_GPU_SPRITE_FLAGS_ENABLE : 0);
+}
+
+void fpga_driver_sprite_set_priority(int sprite, fpga_driver_sprite_priority_t priority)
+{
+    if (sprite < 0 || sprite >= FPGA_DRIVER_SPRITE_COUNT)
+        return;
+
+    driver_helper_gpu_registers_update(FPGA_API_GPU_REGISTER_SPRITE(sprite) + FPGA_API_GPU_REGISTER_SPRITE_FLAGS, 
+                                       FPGA_API_GPU_SPRITE_FLAGS_BEHIND, 
+                                       priority == FPGA_DRIVER_SPRITE_PRIORITY_BEHIND ? FPGA_API_GPU_SPRITE_FLAGS_BEHIND : 0);
+}
+
+void fpga_driver_scroll_set(int x, int y)
+{
+    fpga_driver_geometry_t current;
+
+    fpga_driver_get_geometry(&current);
+
+    x %= current.width;
+    y %= current.height;
+
+    if (x < 0)
+        x += current.width;
+    if (y < 0)
+        y += current.height;
+
+    uint8_t scroll[4] = { x & 0xFF, x >> 8, y & 0xFF, y >> 8 };
+
+    driver_helper_gpu_registers_write(FPGA_API_GPU_REGISTER_SCROLL_X, scroll, sizeof(scroll));
+}
+
+bool fpga_driver_scroll_set_line_table(const uint8_t *rows, int firstLine, int lineCount)
+{
+    fpga_driver_geometry_t current;
+
+    fpga_driver_get_geometry(&current);
+
+    if (!init || firstLine < 0 || lineCount <= 0 || firstLine + lineCount > current.height)
+        return false;
+
+    for (int i = 0; i < lineCount; ++i)
+    {
+        if (rows[i] >= current.height)
+        {
+            ESP_LOGE(TAG, "line table: row %d out of range", rows[i]);
+            return false;
+        }
+    }
+
+    xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
+
+    memcpy(line_table_buffer, rows, lineCount);
+    request_write_data = line_table_buffer;
+    request_write_start = firstLine;
+    request_write_count = lineCount;
+
+    bool result = driver_helper_request(DRIVER_REQUEST_LINE_TABLE_WRITE);
+
+    xSemaphoreGive(driver_request_mutex);
+
+    return result;
+}
+
+void fpga_driver_scroll_enable_line_table(bool enable)
+{
+    driver_helper_gpu_registers_update(FPGA_API_GPU_REGISTER_SCROLL_FLAGS, 
+                                       FPGA_API_GPU_SCROLL_FLAGS_LINE_TABLE, 
+                                       enable ? FPGA_API_GPU_SCROLL_FLAGS_LINE_TABLE : 0);
+}
+
+bool fpga_driver_framebuffer_write_rows(const uint8_t *pixels, int firstRow, int rowCount)
+{
+    fpga_driver_geometry_t current;
+
+    fpga_driver_get_geometry(&current);
+
+    if (!init || firstRow < 0 || rowCount <= 0 || firstRow + rowCount > current.height)
+        return false;
+
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    int page = current.pageCount >= 2 ? gpu_registers[FPGA_API_GPU_REGISTER_PAGE] : 0; //rows go to the displayed page
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+
+    xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
+
+    request_write_data = pixels;
+    request_write_start = page*current.frameSizeBytes + firstRow*current.rowSizeBytes;
+    request_write_count = rowCount*current.rowSizeBytes;
+
+    bool result = driver_helper_request(DRIVER_REQUEST_FRAMEBUFFER_WRITE_ROWS);
+
+    xSemaphoreGive(driver_request_mutex);
+
+    return result;
+}
+
+bool fpga_driver_framebuffer_read_rows(uint8_t *pixels, int firstRow, int rowCount)
+{
+    fpga_driver_geometry_t current;
+
+    fpga_driver_get_geometry(&current);
+
+    if (!init || firstRow < 0 || rowCount <= 0 || firstRow + rowCount > current.height)
+        return false;
+
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    int page = current.pageCount >= 2 ? gpu_registers[FPGA_API_GPU_REGISTER_PAGE] : 0; //rows come from the displayed page
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+
+    xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
+
+    request_read_data = pixels;
+    request_write_start = page*current.frameSizeBytes + firstRow*current.rowSizeBytes;
+    request_write_count = rowCount*current.rowSizeBytes;
+
+    bool result = driver_helper_request(DRIVER_REQUEST_FRAMEBUFFER_READ_ROWS);
+
+    xSemaphoreGive(driver_request_mutex);
+
+    return result;
+}
+
+bool fpga_driver_wait_line(int row)
+{
+    fpga_driver_geometry_t current;
+
+    fpga_driver_get_geometry(&current);
+
+    if (!init || row < 0 || row >= current.height)
+        return false;
+
+    int previousRowsDone = -1;
+
+    for (;;)
+    {
+        xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
+
+        bool result = driver_helper_request(DRIVER_REQUEST_RASTER_READ);
+        int rowsDone = raster_result.rowsDone;
+
+        xSemaphoreGive(driver_request_mutex);
+
+        if (!result)
+            return false;
+
+        //rows done only goes back when it is cleared at vblank, then the frame we waited on is over
+        if (rowsDone > row || rowsDone < previousRowsDone)
+            return true;
+
+        previousRowsDone = rowsDone;
+    }
+}
+
+bool fpga_driver_copper_set_list(const fpga_driver_copper_entry_t *entries, int count)
+{
+    fpga_driver_geometry_t current;
+
+    fpga_driver_get_geometry(&current);
+
+    if (!init || count < 0)
+        return false;
+
+    xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
+
+    int writes = 0;
+
+    for (int i = 0; i < count; ++i)
+    {
+        const fpga_driver_copper_entry_t *e = entries + i;
+        int needed = e->op == FPGA_DRIVER_COPPER_SET_SCROLL ? 4 : 1;
+
+        if (e->row < 0 || e->row >= current.height || (i > 0 && e->row < entries[i-1].row) || writes + needed > FPGA_DRIVER_COPPER_MAX_WRITES)
+        {
+            ESP_LOGE(TAG, "copper list: entry %d is out of order or does not fit", i);
+            xSemaphoreGive(driver_request_mutex);
+            return false;
+        }
+
+        uint8_t *dst = copper_list_buffer + writes*FPGA_API_GPU_COPPER_ENTRY_SIZE_BYTES;
+
+        switch (e->op)
+        {
+            case FPGA_DRIVER_COPPER_SET_PALETTE_ENTRY:
+                driver_helper_copper_pack(dst, e->row, FPGA_API_GPU_COPPER_OP_PALETTE, e->paletteEntry.index, e->paletteEntry.r, e->paletteEntry.g, e->paletteEntry.b);
+                break;
+            case FPGA_DRIVER_COPPER_SET_SCROLL:
+            {
+                int x = e->scroll.x % current.width;
+                int y = e->scroll.y % current.height;
+
+                if (x < 0)
+                    x += current.width;
+                if (y < 0)
+                    y += current.height;
+
+                uint8_t scroll[4] = { x & 0xFF, x >> 8, y & 0xFF, y >> 8 };
+
+                for (int j = 0; j < 4; ++j)
+                    driver_helper_copper_pack(dst + j*FPGA_API_GPU_COPPER_ENTRY_SIZE_BYTES, e->row, FPGA_API_GPU_COPPER_OP_REGISTER, FPGA_API_GPU_REGISTER_SCROLL_X + j, scroll[j], 0, 0);
+                break;
+            }
+            case FPGA_DRIVER_COPPER_SET_PALETTE_BANK:
+                driver_helper_copper_pack(dst, e->row, FPGA_API_GPU_COPPER_OP_REGISTER, FPGA_API_GPU_REGISTER_PALETTE_BANK, e->paletteBank < 0 ? 0 : (e->paletteBank > 63 ? 63 : e->paletteBank), 0, 0);
+                break;
+        }
+
+        writes += needed;
+    }
+
+    driver_helper_copper_pack(copper_list_buffer + writes*FPGA_API_GPU_COPPER_ENTRY_SIZE_BYTES, 0, FPGA_API_GPU_COPPER_OP_END, 0, 0, 0, 0);
+
+    bool result = true;
+
+    if (count > 0)
+    {
+        request_write_count = writes + 1;
+        result = driver_helper_request(DRIVER_REQUEST_COPPER_LIST_WRITE);
+    }
+
+    xSemaphoreGive(driver_request_mutex);
+
+    //the fpga restarts the list every frame, so a list rewritten while enabled may run half old, half new for one frame
+    driver_helper_gpu_registers_update(FPGA_API_GPU_REGISTER_COPPER_FLAGS, 
+                                       FPGA_API_GPU_COPPER_FLAGS_ENABLE, 
+                                       result && count > 0 ? FPGA_API_GPU_COPPER_FLAGS_ENABLE : 0);
+
+    return result;
+}
+
+bool fpga_driver_blit_fill(int x, int y, int width, int height, uint8_t value)
+{
+    uint32_t dst;
+    int rowBytes, stride;
+
+    if (!driver_helper_blit_rect(x, y, width, height, &dst, &rowBytes, &stride))
+        return false;
+
+    return driver_helper_blit_enqueue(FPGA_API_GPU_BLIT_OP_FILL, value, 0, 0, dst, stride, rowBytes, height);
+}
+
+bool fpga_driver_blit_copy(int srcX, int srcY, int dstX, int dstY, int width, int height)
+{
+    uint32_t src, dst;
+    int rowBytes, stride;
+
+    if (!driver_helper_blit_rect(srcX, srcY, width, height, &src, &rowBytes, &stride) || 
+        !driver_helper_blit_rect(dstX, dstY, width, height, &dst, &rowBytes, &stride))
+        return false;
+
+    //overlapping copy to a higher address has to start from the end
+    uint8_t op = FPGA_API_GPU_BLIT_OP_COPY | (dst > src ? FPGA_API_GPU_BLIT_FLAGS_REVERSE : 0);
+
+    return driver_helper_blit_enqueue(op, 0, src, stride, dst, stride, rowBytes, height);
+}
+
+bool fpga_driver_blit_store_write(int offset, const uint8_t *data, int size)
+{
+    if (!init || offset < 0 || size <= 0 || offset + size > FPGA_DRIVER_BLIT_STORE_SIZE)
+        return false;
+
+    xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
+
+    request_write_data = data;
+    request_write_start = offset;
+    request_write_count = size;
+
+    bool result = driver_helper_request(DRIVER_REQUEST_BLIT_STORE_WRITE);
+
+    xSemaphoreGive(driver_request_mutex);
+
+    return result;
+}
+
+bool fpga_driver_blit_store_copy(int offset, int stride, int dstX, int dstY, int width, int height, int transparentIdx)
+{
+    uint32_t dst;
+    int rowBytes, dstStride;
+
+    if (!driver_helper_blit_rect(dstX, dstY, width, height, &dst, &rowBytes, &dstStride))
+        return false;
+
+    if (offset < 0 || stride < rowBytes || offset + (height - 1) * stride + rowBytes > FPGA_DRIVER_BLIT_STORE_SIZE)
+    {
+        ESP_LOGE(TAG, "blit: store source out of bounds");
+        return false;
+    }
+
+    uint8_t op = FPGA_API_GPU_BLIT_OP_STORE_COPY | (transparentIdx >= 0 ? FPGA_API_GPU_BLIT_FLAGS_TRANSPARENT : 0);
+
+    return driver_helper_blit_enqueue(op, transparentIdx >= 0 ? transparentIdx : 0, offset, stride, dst, dstStride, rowBytes, height);
+}
+
+bool fpga_driver_blit_wait(void)
+{
+    if (!init)
+        return false;
+
+    for (;;)
+    {
+        taskENTER_CRITICAL(&driver_spinlock);
+
+        bool done = blit_queue_head == blit_queue_tail && !blit_fpga_busy;
+        bool connected = fpga_connected;
+
+        taskEXIT_CRITICAL(&driver_spinlock);
+
+        if (done)
+            return true;
+
+        if (!connected)
+            return false;
+
+        taskYIELD();
+    }
+}
+
+bool fpga_driver_framebuffer_crc(int x, int y, int width, int height, uint32_t *crc)
+{
+    uint32_t src;
+    int rowBytes, stride;
+
+    if (!driver_helper_blit_rect(x, y, width, height, &src, &rowBytes, &stride))
+        return false;
+
+    //the mutex keeps other crc blits out until this result is read
+    xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
+
+    bool result = driver_helper_blit_enqueue(FPGA_API_GPU_BLIT_OP_CRC, 0, src, stride, 0, 0, rowBytes, height) && 
+                  fpga_driver_blit_wait() && 
+                  driver_helper_request(DRIVER_REQUEST_BLIT_CRC_READ);
+
+    if (result)
+        *crc = blit_crc_result;
+
+    xSemaphoreGive(driver_request_mutex);
+
+    return result;
+}
+
+void fpga_driver_register_audio_requested_cb(fpga_driver_audio_requested_cb_t callback)
+{
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    audio_requested_callback = callback;
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+}
+
+void fpga_driver_hid_get_status(fpga_driver_hid_status_t *status)
+{
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    *status = current_hid_status;
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+}
+
+void fpga_driver_register_hid_event_cb(fpga_driver_hid_event_cb_t callback)
+{
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    hid_event_callback = callback;
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+}
+
+void fpga_driver_hid_set_key_repeat(int delayMs, int rateMs)
+{
+    if (delayMs < 0 || rateMs <= 0)
+    {
+        ESP_LOGE(TAG, "key repeat: delayMs must be >= 0 and rateMs > 0");
+        return;
+    }
+
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    hid_key_repeat_delay_ms = delayMs;
+    hid_key_repeat_rate_ms = rateMs;
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+}
+
+void fpga_driver_hid_set_layout(const fpga_driver_hid_layout_t *layout)
+{
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    hid_layout = layout != NULL ? layout : &fpga_driver_hid_layout_us;
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+}
+
+char IRAM_ATTR fpga_driver_hid_key_to_char(uint8_t keyCode, uint8_t modifiers)
+{
+    if (keyCode >= FPGA_DRIVER_HID_LAYOUT_KEYS)
+        return 0;
+
+    const fpga_driver_hid_layout_t *layout = hid_layout; //pointer read is atomic
+
+    return (modifiers & FPGA_DRIVER_HID_KEY_MODIFIERS_SHIFT) ? layout->shifted[keyCode] : layout->normal[keyCode];
+}
+
+int fpga_driver_usb_trace_read(fpga_driver_usb_trace_entry_t *entries, int maxEntries, uint32_t *lostCount)
+{
+    if (!init || maxEntries < 0)
+        return -1;
+
+    xSemaphoreTake(driver_request_mutex, portMAX_DELAY);
+
+    int count = -1;
+
+    if (driver_helper_request(DRIVER_REQUEST_USB_TRACE_READ))
+    {
+        uint32_t totalCount = usb_trace_buffer[0] << 24 | usb_trace_buffer[1] << 16 | usb_trace_buffer[2] << 8 | usb_trace_buffer[3];
+
+        if (totalCount < usb_trace_read_count) //usb softcore was reset
+            usb_trace_read_count = 0;
+
+        uint32_t available = totalCount - usb_trace_read_count;
+        uint32_t lost = 0;
+
+        if (available > FPGA_API_IO_USB_TRACE_ENTRIES)
+        {
+            lost = available - FPGA_API_IO_USB_TRACE_ENTRIES;
+            available = FPGA_API_IO_USB_TRACE_ENTRIES;
+        }
+
+        uint32_t first = totalCount - available;
+
+        count = available > maxEntries ? maxEntries : available;
+
+        for (int i = 0; i < count; ++i)
+        {
+            uint8_t *entry = usb_trace_buffer + 4 + ((first + i) % FPGA_API_IO_USB_TRACE_ENTRIES)*4;
+
+            entries[i] = (fpga_driver_usb_trace_entry_t)
+            {
+                .event = entry[0],
+                .timestampMs = entry[1],
+                .arg = entry[2] << 8 | entry[3]
+            };
+        }
+
+        usb_trace_read_count = first + count; //entries that didn't fit stay for the next call
+
+        if (lostCount != NULL)
+            *lostCount = lost;
+    }
+
+    xSemaphoreGive(driver_request_mutex);
+
+    return count;
+}
+
+static bool IRAM_ATTR driver_timer_tick(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *userCtx)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    
+    vTaskNotifyGiveFromISR(driver_main_task, &xHigherPriorityTaskWoken);
+
+    return xHigherPriorityTaskWoken == pdTRUE;
+}
+
+static void IRAM_ATTR driver_vblank_irq(void *arg)
+{
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    
+    vTaskNotifyGiveFromISR(driver_main_task, &xHigherPriorityTaskWoken);
+
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+static void IRAM_ATTR driver_task_function_main(void *arg)
+{
+    ESP_LOGI(TAG, "fpga driver main task started");
+
+    bool pollHid = true; //initial poll after connecting
+
+    fpga_api_gpu_status_bundle_t status_bundle;
+    uint16_t audio_buffer_status;
+
+    bool vblank = false;
+
+    //page flipping: pixels of the presented frame are in the hidden page, palette and flip wait for vblank
+    bool page_uploaded = false;
+    bool page_flip_latched = true; //hidden page is no longer scanned out, safe to upload to
+    uint16_t page_flip_frame = 0;
+
+    //beam racing: rows of the presented frame follow the beam through the frame that starts after the claim,
+    //the palette switches at the vblank after it so the next frame is shown whole
+    fpga_driver_race_t race = { .row = -1 };
+
+    //statistics: frame counter of the previous bundle, it advances when a vblank starts
+    bool stats_frame_valid = false;
+    uint16_t stats_frame = 0;
+    uint32_t stats_audio_wnum = 0;
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        if (!fpga_connected)
+        {
+            bool connected = false;
+
+            FPGA_DRIVER_ERROR_CHECK(fpga_api_gpu_read_magic_number(&qspi, &connected));
+
+            //geometry first, an fpga it refuses stays disconnected and is asked again on the next tick
+            if (connected && !driver_helper_read_geometry())
+                connected = false;
+
+            taskENTER_CRITICAL(&driver_spinlock);
+
+            fpga_connected = connected;
+
+            if (connected) //fpga could have been reconfigured, resend all registers
+            {
+                stats_frame_valid = false;
+                delta_shadow_size = 0;
+                gpu_registers_dirty_first = 0;
+                gpu_registers_dirty_last = FPGA_API_GPU_REGISTER_COUNT - 1;
+            }
+
+            taskEXIT_CRITICAL(&driver_spinlock);
+
+            driver_helper_serve_request(false);
+            continue;
+        }
+
+        //vblank, audio buffer and hid state in one transaction
+
+        FPGA_DRIVER_ERROR_CHECK(fpga_api_gpu_read_status_bundle(&qspi, &status_bundle));
+
+        audio_buffer_status = status_bundle.audioBufferStatus;
+
+        if (stats_frame_valid && status_bundle.frameCounter != stats_frame)
+        {   //vblank in progress is the one just counted, every other one started and ended unseen
+            uint16_t started = status_bundle.frameCounter - stats_frame;
+
+            stats_vblanks_missed += started - (FPGA_API_GPU_STATUS0_GET_VBLANK(status_bundle.status0) ? 1 : 0);
+        }
+
+        stats_frame = status_bundle.frameCounter;
+        stats_frame_valid = true;
+
+        //framebuffer and palette
+
+        bool presented = false;
+        bool page_flipped = false;
+
+        taskENTER_CRITICAL(&driver_spinlock);
+
+        int buffer_to_present = framebuffer_idx_to_present;
+        fpga_driver_frame_t frame = frame_to_present;
+        fpga_driver_geometry_t current = geometry;
+        int page = gpu_registers[FPGA_API_GPU_REGISTER_PAGE];
+        fpga_driver_present_mode_t current_present_mode = present_mode;
+
+        taskEXIT_CRITICAL(&driver_spinlock);
+
+        if (current.pageCount < 2)
+        {
+            page_uploaded = false; //mode switched away while the frame waited for the flip, it stays pending
+
+            if (race.row >= 0)
+            {
+                if (race.row < frame.height)
+                {   //rows of the frame the race started in are free once scanned out, all of them after it has ended
+                    fpga_api_gpu_raster_t raster;
+
+                    FPGA_DRIVER_ERROR_CHECK(fpga_api_gpu_read_raster(&qspi, &raster));
+
+                    int free_rows = fpga_driver_race_free_rows(&race, status_bundle.frameCounter, raster.rowsDone, frame.height);
+
+                    if (free_rows > race.row)
+                    {
+                        FPGA_DRIVER_ERROR_CHECK(driver_helper_upload_frame(buffer_to_present ? framebuffer1 : framebuffer0, &frame, &current, 0, race.row, free_rows - race.row));
+
+                        race.row = free_rows;
+                        presented = true;
+                    }
+                }
+
+                //last rows went out in this vblank, the palette follows in the same tick so the frame after it is not
+                //shown new with the old palette. it goes straight into the palette ram: the raster is read again after
+                //the row uploads and a vblank without room left for it is passed on to the next one
+                fpga_api_gpu_raster_t palette_raster = { .line = 0 };
+
+                if (fpga_driver_race_can_finish(&race, status_bundle.frameCounter, FPGA_API_GPU_STATUS0_GET_VBLANK(status_bundle.status0), frame.height) &&
+                    fpga_api_gpu_read_raster(&qspi, &palette_raster) &&
+                    fpga_driver_race_palette_fits(palette_raster.line, raster_screen_lines, raster_total_lines, race_palette_lines))
+                {
+                    FPGA_DRIVER_ERROR_CHECK(fpga_api_gpu_set_palette(&qspi, buffer_to_present ? palette1 : palette0));
+
+                    taskENTER_CRITICAL(&driver_spinlock);
+
+                    framebuffer_idx_to_present = -1;
+                    present_in_progress = false;
+                    ++stats_frames_presented;
+
+                    taskEXIT_CRITICAL(&driver_spinlock);
+
+                    race.row = -1;
+                    presented = true;
+                }
+            }
+            else if (!vblank && FPGA_API_GPU_STATUS0_GET_VBLANK(status_bundle.status0))
+            {   //at most one tick after the vblank started - only chance to update the frame
+                taskENTER_CRITICAL(&driver_spinlock);
+
+                present_in_progress = framebuffer_idx_to_present >= 0;
+
+                taskEXIT_CRITICAL(&driver_spinlock);
+
+                if (present_in_progress && current_present_mode == FPGA_DRIVER_PRESENT_RACE_BEAM)
+                {
+                    fpga_driver_race_start(&race, status_bundle.frameCounter);
+                }
+                else if (present_in_progress)
+                {   
+                    FPGA_DRIVER_ERROR_CHECK(driver_helper_present_frame(buffer_to_present ? palette1 : palette0, buffer_to_present ? framebuffer1 : framebuffer0, &frame, &current));
+                    
+                    taskENTER_CRITICAL(&driver_spinlock);
+
+                    framebuffer_idx_to_present = -1;
+                    present_in_progress = false;
+                    ++stats_frames_presented;
+
+                    taskEXIT_CRITICAL(&driver_spinlock);
+
+                    presented = true;
+                }
+            }
+        }
+        else
+        {
+            race.row = -1; //mode switched to a paged layout mid race, the frame is uploaded again to the hidden page
+
+            if (!page_flip_latched && status_bundle.frameCounter != page_flip_frame)
+                page_flip_latched = true;
+
+            if (page_uploaded && !vblank && FPGA_API_GPU_STATUS0_GET_VBLANK(status_bundle.status0))
+            {   //palette is not paged, it goes together with the flip
+                FPGA_DRIVER_ERROR_CHECK(fpga_api_gpu_set_palette(&qspi, buffer_to_present ? palette1 : palette0));
+
+                uint8_t next_page = page ^ 1;
+
+                driver_helper_gpu_registers_write(FPGA_API_GPU_REGISTER_PAGE, &next_page, 1);
+
+                taskENTER_CRITICAL(&driver_spinlock);
+
+                framebuffer_idx_to_present = -1;
+                present_in_progress = false;
+                ++stats_frames_presented;
+
+                taskEXIT_CRITICAL(&driver_spinlock);
+
+                page_uploaded = false;
+                page_flip_latched = false;
+                page_flip_frame = status_bundle.frameCounter;
+                page_flipped = true;
+            }
+            else if (!page_uploaded && page_flip_latched && buffer_to_present >= 0)
+            {   //any time during the frame, the hidden page is not scanned out
+                taskENTER_CRITICAL(&driver_spinlock);
+
+                present_in_progress = true;
+
+                taskEXIT_CRITICAL(&driver_spinlock);
+
+                FPGA_DRIVER_ERROR_CHECK(driver_helper_upload_frame(buffer_to_present ? framebuffer1 : framebuffer0, &frame, &current, (page ^ 1) * current.frameSizeBytes, 0, frame.height));
+
+                page_uploaded = true;
+                presented = true;
+            }
+        }
+
+        vblank = FPGA_API_GPU_STATUS0_GET_VBLANK(status_bundle.status0);
+
+        //gpu registers, fpga applies them at the next vblank
+
+        WORD_ALIGNED_ATTR uint8_t gpu_registers_buffer[FPGA_API_GPU_REGISTER_COUNT];
+
+        taskENTER_CRITICAL(&driver_spinlock);
+
+        int gpu_registers_first = gpu_registers_dirty_first;
+        int gpu_registers_count = gpu_registers_dirty_last - gpu_registers_dirty_first + 1;
+
+        if (gpu_registers_count > 0)
+            memcpy(gpu_registers_buffer, gpu_registers + gpu_registers_first, gpu_registers_count);
+
+        gpu_registers_dirty_first = FPGA_API_GPU_REGISTER_COUNT;
+        gpu_registers_dirty_last = -1;
+
+        taskEXIT_CRITICAL(&driver_spinlock);
+
+        if (gpu_registers_count > 0)
+            FPGA_DRIVER_ERROR_CHECK(fpga_api_gpu_write_registers(&qspi, gpu_registers_first, gpu_registers_buffer, gpu_registers_count));
+
+        if (page_flipped)
+        {   //fpga copies the registers during vblank, still in vblank after the write means the flip is already latched
+            uint8_t status0 = 0;
+
+            if (fpga_api_gpu_read_status0(&qspi, &status0) && FPGA_API_GPU_STATUS0_GET_VBLANK(status0))
+                page_flip_latched = true;
+        }
+
+        //blits, as many as the fpga queue has room for
+
+        taskENTER_CRITICAL(&driver_spinlock);
+
+        int blits_pending = blit_queue_head - blit_queue_tail;
+        bool blits_outstanding = blit_fpga_busy;
+
+        taskEXIT_CRITICAL(&driver_spinlock);
+
+        uint8_t blit_status = 0;
+
+        if ((blits_pending > 0 || blits_outstanding) && fpga_api_gpu_read_blit_status(&qspi, &blit_status))
+        {
+            int blit_free = FPGA_API_GPU_BLIT_QUEUE_DEPTH - FPGA_API_GPU_BLIT_STATUS_GET_QUEUED(blit_status);
+            int blit_count = blits_pending < blit_free ? blits_pending : blit_free;
+
+            taskENTER_CRITICAL(&driver_spinlock);
+
+            for (int i = 0; i < blit_count; ++i)
+                memcpy(blit_send_buffer + i*FPGA_API_GPU_BLIT_PARAMS_SIZE_BYTES, 
+                       blit_queue[(blit_queue_tail + i) % FPGA_DRIVER_BLIT_QUEUE_SIZE], 
+                       FPGA_API_GPU_BLIT_PARAMS_SIZE_BYTES);
+
+            taskEXIT_CRITICAL(&driver_spinlock);
+
+            bool sent = blit_count > 0 && fpga_api_gpu_blit(&qspi, blit_send_buffer, blit_count);
+
+            if (blit_count > 0)
+                delta_shadow_size = 0;
+
+            taskENTER_CRITICAL(&driver_spinlock);
+
+            if (sent)
+                blit_queue_tail += blit_count;
+
+            blit_fpga_busy = sent || FPGA_API_GPU_BLIT_STATUS_GET_BUSY(blit_status);
+
+            taskEXIT_CRITICAL(&driver_spinlock);
+        }
+
+        //audio buffers
+
+        taskENTER_CRITICAL(&driver_spinlock);
+
+        if (next_audio_buffer_ready_samples > 0)
+            audio_send_in_progress = true;
+        
+        taskEXIT_CRITICAL(&driver_spinlock);
+
+        if (audio_send_in_progress)
+        {
+            FPGA_DRIVER_ERROR_CHECK(fpga_api_gpu_audio_buffer_write(&qspi, next_audio_buffer, next_audio_buffer_ready_samples, &audio_buffer_status));
+
+            if (FPGA_API_GPU_AUDIO_BUFFER_STATUS_GET_FULL_OCCURRED(audio_buffer_status)) //sticky for the duration of the write
+                ++stats_audio_overruns;
+            
+            taskENTER_CRITICAL(&driver_spinlock);
+
+            next_audio_buffer_ready_samples = 0;
+            audio_hdmi_fifo_wnum = FPGA_API_GPU_AUDIO_BUFFER_STATUS_GET_WNUM(audio_buffer_status);
+            audio_send_in_progress = false;
+
+            taskEXIT_CRITICAL(&driver_spinlock);
+        }
+        else
+        {
+            if (presented) //bundle status is stale after a frame upload
+                FPGA_DRIVER_ERROR_CHECK(fpga_api_gpu_audio_buffer_read_status(&qspi, &audio_buffer_status));
+
+            taskENTER_CRITICAL(&driver_spinlock);
+
+            audio_hdmi_fifo_wnum = FPGA_API_GPU_AUDIO_BUFFER_STATUS_GET_WNUM(audio_buffer_status);
+
+            taskEXIT_CRITICAL(&driver_spinlock);
+        }
+
+        if (audio_hdmi_fifo_wnum == 0 && stats_audio_wnum > 0 && audio_requested_callback != NULL)
+            ++stats_audio_underruns;
+
+        stats_audio_wnum = audio_hdmi_fifo_wnum;
+
+        if (audio_hdmi_fifo_wnum < (FPGA_DRIVER_AUDIO_HDMI_FIFO_SAMPLES - FPGA_DRIVER_AUDIO_BUFFER_WRITE_MAX_SAMPLES - 10))
+            xTaskNotifyGive(driver_audio_task);
+
+        //hid kb&mouse, io is touched only when the firmware reported new state. all slots in one command list,
+        //a read that failed or arrived corrupted is retried on the next tick
+
+        WORD_ALIGNED_ATTR uint8_t hid_status_buffer[FPGA_API_IO_HID_DEVICE_SLOTS*FPGA_API_IO_HID_STATUS_SIZE_BYTES];
+        bool hid_read = false;
+
+        if (pollHid || FPGA_API_GPU_STATUS_BUNDLE_FLAGS_GET_HID_CHANGED(status_bundle.flags))
+        {
+            hid_read = fpga_api_io_hid_get_all_status(&qspi, hid_status_buffer);
+            FPGA_DRIVER_ERROR_CHECK(hid_read);
+
+            ++stats_hid_polls;
+
+            pollHid |= !hid_read;
+        }
+
+        if (hid_read)
+        {
+            fpga_driver_hid_status_t new_status = { 0 };
+
+            //every slot status carries masks of all connected devices
+            uint8_t device_mask = FPGA_API_IO_HID_STATUS_GET_KEYBOARD_MASK(hid_status_buffer) | 
+                                  FPGA_API_IO_HID_STATUS_GET_MOUSE_MASK(hid_status_buffer);
+
+            for (int slot = 0; slot < FPGA_DRIVER_HID_MAX_DEVICES; ++slot)
+                fpga_driver_hid_merge_device(&hid_merge, &new_status, slot, hid_status_buffer + slot * FPGA_API_IO_HID_STATUS_SIZE_BYTES, device_mask & (1 << slot));
+
+            new_status.mouseX = hid_merge.mouseX;
+            new_status.mouseY = hid_merge.mouseY;
+            new_status.mouseWheel = hid_merge.mouseWheel;
+
+            taskENTER_CRITICAL(&driver_spinlock);
+
+            fpga_driver_hid_status_t previous_current = current_hid_status;
+
+            current_hid_status = new_status;
+
+            taskEXIT_CRITICAL(&driver_spinlock);
+
+            if (memcmp(&previous_current, &new_status, sizeof(fpga_driver_hid_status_t)))
+                xTaskNotifyGive(driver_hid_task);
+
+            pollHid = false;
+        }
+
+        //requests from other tasks go last so they don't delay the present window
+
+        driver_helper_serve_request(true);
+    }
+
+    vTaskDelete(NULL);
+}
+
+static void IRAM_ATTR driver_task_function_audio(void *arg)
+{    
+    ESP_LOGI(TAG, "fpga driver audio task started");
+
+    for (;;)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        taskENTER_CRITICAL(&driver_spinlock);
+
+        fpga_driver_audio_requested_cb_t callback = audio_requested_callback;
+        uint32_t bufferedSamples = next_audio_buffer_ready_samples;
+        
+        taskEXIT_CRITICAL(&driver_spinlock);
+
+        if (bufferedSamples != 0 || callback == NULL)
+            continue;
+        
+        int generatedSampleCount;
+
+        callback((uint32_t*)next_audio_buffer, &generatedSampleCount, FPGA_DRIVER_AUDIO_BUFFER_WRITE_MAX_SAMPLES);
+
+        if (generatedSampleCount == 0)
+            continue;
+
+        if (generatedSampleCount < 0 || generatedSampleCount > FPGA_DRIVER_AUDIO_BUFFER_WRITE_MAX_SAMPLES)
+        {
+            ESP_LOGE(TAG, "audio requested callback returned sampleCount %d out of range", generatedSampleCount);
+            continue;
+        }
+
+        taskENTER_CRITICAL(&driver_spinlock);
+
+        next_audio_buffer_ready_samples = generatedSampleCount;
+        
+        taskEXIT_CRITICAL(&driver_spinlock);
+    }
+}
+
+static inline void driver_helper_hid_map_keys(const uint8_t oldKeys[FPGA_DRIVER_HID_MAX_KEYS], const uint8_t newKeys[FPGA_DRIVER_HID_MAX_KEYS], uint8_t unmappedNewKeys[FPGA_DRIVER_HID_MAX_KEYS], int *unmappedNewKeysCount)
+{
+    *unmappedNewKeysCount = 0;
+
+    for (int i = 0; i < FPGA_DRIVER_HID_MAX_KEYS; ++i)
+    {
+        if (newKeys[i] == 0)
+            continue;
+
+        bool keyFound = false;
+
+        for (int j = 0; j < FPGA_DRIVER_HID_MAX_KEYS; ++j)
+        {
+            if (newKeys[i] != oldKeys[j])
+                continue;
+
+            keyFound = true;
+            break;
+        }
+
+        if (keyFound)
+            continue;
+
+        unmappedNewKeys[*unmappedNewKeysCount] = newKeys[i];
+        ++(*unmappedNewKeysCount);
+    }
+}
+
+static void IRAM_ATTR driver_task_function_hid(void *arg)
+{
+    ESP_LOGI(TAG, "fpga driver hid task started");
+
+    uint8_t repeatKey = 0; //0 - nothing to repeat
+    int64_t repeatDeadline = 0;
+
+    for (;;)
+    {
+        TickType_t timeout = portMAX_DELAY;
+
+        if (repeatKey != 0)
+        {
+            int64_t remainingUs = repeatDeadline - esp_timer_get_time();
+
+            timeout = remainingUs > 0 ? pdMS_TO_TICKS((remainingUs + 999) / 1000) : 0;
+
+            if (remainingUs > 0 && timeout == 0)
+                timeout = 1;
+        }
+
+        ulTaskNotifyTake(pdTRUE, timeout);
+
+        taskENTER_CRITICAL(&driver_spinlock);
+
+        fpga_driver_hid_event_cb_t callback = hid_event_callback;
         fpga_driver_hid_status_t currentStatus = current_hid_status;
+        int repeatDelayMs = hid_key_repeat_delay_ms;
+        int repeatRateMs = hid_key_repeat_rate_ms;
+
+        taskEXIT_CRITICAL(&driver_spinlock);
+
+        fpga_driver_hid_event_t event;
+
+        if (memcmp(&currentStatus, &previous_hid_status, sizeof(fpga_driver_hid_status_t)))
+        {
+            //key events, keys are tracked even without a callback so repeat doesn't start from stale state
+
+            event.keyEvent.modifiers = currentStatus.keyboardModifiers; //whatever
+
+            if (currentStatus.keyboardModifiers != previous_hid_status.keyboardModifiers)
+                for (int i = 1; i < 256; i <<= 1)
+                {
+                    if ((currentStatus.keyboardModifiers & i) == (previous_hid_status.keyboardModifiers & i))
+                        continue;
+
+                    event.type = currentStatus.keyboardModifiers & i 
+                        ? FPGA_DRIVER_HID_EVENT_KEY_DOWN 
+                        : FPGA_DRIVER_HID_EVENT_KEY_UP;
+
+                    event.keyEvent.keyCode = FPGA_DRIVER_HID_KEY_MODIFIER_TO_CODE(i);
+                    event.keyEvent.character = 0;
+
+                    if (callback != NULL)
+                        callback(event);
+                }
+
+            //rollover errors are filtered per device when merging
+            {
+                uint8_t unmappedKeys[FPGA_DRIVER_HID_MAX_KEYS];
+                int unmappedKeysCount;
+
+                //dont feel like writing super optimized code for this
+                driver_helper_hid_map_keys(currentStatus.keyboardKeys, previous_hid_status.keyboardKeys, unmappedKeys, &unmappedKeysCount);
+
+                event.type = FPGA_DRIVER_HID_EVENT_KEY_UP;
+
+                for (int i = 0; i < unmappedKeysCount; ++i)
+                {
+                    event.keyEvent.keyCode = unmappedKeys[i];
+                    event.keyEvent.character = fpga_driver_hid_key_to_char(unmappedKeys[i], currentStatus.keyboardModifiers);
+
+                    if (unmappedKeys[i] == repeatKey)
+                        repeatKey = 0;
+
+                    if (callback != NULL)
+                        callback(event);
+                }
+
+                driver_helper_hid_map_keys(previous_hid_status.keyboardKeys, currentStatus.keyboardKeys, unmappedKeys, &unmappedKeysCount);
+                
+                event.type = FPGA_DRIVER_HID_EVENT_KEY_DOWN;
+
+                for (int i = 0; i < unmappedKeysCount; ++i)
+                {
+                    event.keyEvent.keyCode = unmappedKeys[i];
+                    event.keyEvent.character = fpga_driver_hid_key_to_char(unmappedKeys[i], currentStatus.keyboardModifiers);
+
+                    //last pressed key repeats, like on a pc
+                    if (repeatDelayMs > 0)
+                    {
+                        repeatKey = unmappedKeys[i];
+                        repeatDeadline = esp_timer_get_time() + repeatDelayMs * 1000LL;
+                    }
+
+                    if (callback != NULL)
+                        callback(event);
+                }
+            }
+
+            //mouse events
+
+            if (callback != NULL)
+            {
+                if (currentStatus.mouseKeys != previous_hid_status.mouseKeys)
+                    for (int i = 1; i < 256; i <<= 1)
+                    {
+                        if ((currentStatus.mouseKeys & i) == (previous_hid_status.mouseKeys & i))
+                            continue;
+
+                        event.type = currentStatus.mouseKeys & i 
+                            ? FPGA_DRIVER_HID_EVENT_MOUSE_BUTTON_DOWN 
+                            : FPGA_DRIVER_HID_EVENT_MOUSE_BUTTON_UP;
+
+                        event.mouseButtonEvent.buttonCode = i;
+
+                        callback(event);
+                    }
+
+                event.mouseMoveEvent.moveX = currentStatus.mouseX - previous_hid_status.mouseX; //this should work even when int32 overflows
+                event.mouseMoveEvent.moveY = currentStatus.mouseY - previous_hid_status.mouseY;
+                event.mouseMoveEvent.moveWheel = currentStatus.mouseWheel - previous_hid_status.mouseWheel;
+
+                if (event.mouseMoveEvent.moveX != 0 || 
+                    event.mouseMoveEvent.moveY != 0 || 
+                    event.mouseMoveEvent.moveWheel != 0)
+                {
+                    event.type = FPGA_DRIVER_HID_EVENT_MOUSE_MOVE;
+
+                    event.mouseMoveEvent.pressedButtons = currentStatus.mouseKeys;
+                    callback(event);
+                }
+            }
+
+            previous_hid_status = currentStatus;
+        }
+
+        //typematic repeat
+
+        if (repeatKey != 0 && repeatDelayMs <= 0)
+            repeatKey = 0;
+
+        if (repeatKey != 0 && esp_timer_get_time() >= repeatDeadline)
+        {
+            repeatDeadline += (repeatRateMs > 0 ? repeatRateMs : 1) * 1000LL;
+
+            if (repeatDeadline < esp_timer_get_time()) //don't burst after a long callback
+                repeatDeadline = esp_timer_get_time() + repeatRateMs * 1000LL;
+
+            if (callback != NULL)
+            {
+                event.type = FPGA_DRIVER_HID_EVENT_KEY_REPEAT;
+                event.keyEvent.keyCode = repeatKey;
+                event.keyEvent.modifiers = currentStatus.keyboardModifiers;
+                event.keyEvent.character = fpga_driver_hid_key_to_char(repeatKey, currentStatus.keyboardModifiers);
+
+                callback(event);
+            }
+        }
+    }
+}
+
+//call with driver_spinlock held
+static inline void driver_helper_gpu_registers_mark_dirty(int startRegister, int count)
+{
+    if (startRegister < gpu_registers_dirty_first)
+        gpu_registers_dirty_first = startRegister;
+    if (startRegister + count - 1 > gpu_registers_dirty_last)
+        gpu_registers_dirty_last = startRegister + count - 1;
+}
+
+static void driver_helper_gpu_registers_write(int startRegister, const uint8_t *values, int count)
+{
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    memcpy(gpu_registers + startRegister, values, count);
+    driver_helper_gpu_registers_mark_dirty(startRegister, count);
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+}
+
+static void driver_helper_gpu_registers_update(int reg, uint8_t mask, uint8_t value)
+{
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    gpu_registers[reg] = (gpu_registers[reg] & ~mask) | (value & mask);
+    driver_helper_gpu_registers_mark_dirty(reg, 1);
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+}
+
+//main task only
+static bool driver_helper_read_geometry(void)
+{
+    fpga_api_gpu_geometry_t result;
+
+    if (!fpga_api_gpu_read_geometry(&qspi, &result))
+        return false;
+
+    int frameSizeBytes = result.width * result.height * result.bitsPerPixel / 8;
+
+    if (result.bitsPerPixel == 0 || frameSizeBytes == 0 || frameSizeBytes > FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES)
+    {
+        ESP_LOGE(TAG, "fpga reported invalid geometry %dx%d %dbpp", result.width, result.height, result.bitsPerPixel);
+        return false;
+    }
+
+    //the cs1 pin is an esp output without vblankIrq and an fpga output with SPI_CS1_IRQ, a mismatch either has both
+    //driving it or leaves the irq input and the fpga's io chip select floating
+    bool cs1Irq = result.capabilities & FPGA_API_GPU_CAPABILITIES_CS1_IRQ;
+
+    if (cs1Irq != vblank_irq_requested)
+    {
+        if (cs1Irq)
+            fpga_qspi_release_io_cs(&qspi);
+
+        if (!vblank_irq_mismatch_logged)
+            ESP_LOGE(TAG, cs1Irq ? "fpga is built with SPI_CS1_IRQ but vblankIrq is off, io chip select released, fpga refused"
+                                 : "vblankIrq is on but the fpga is not built with SPI_CS1_IRQ, fpga refused");
+
+        vblank_irq_mismatch_logged = true;
+        return false;
+    }
+
+    int lineNs = result.capabilities & FPGA_API_GPU_CAPABILITIES_1080P ? 14815 : 22222;
+
+    raster_screen_lines = result.capabilities & FPGA_API_GPU_CAPABILITIES_1080P ? 1080 : 720;
+    raster_total_lines = result.capabilities & FPGA_API_GPU_CAPABILITIES_1080P ? 1125 : 750;
+    race_palette_lines = (FPGA_DRIVER_RACE_PALETTE_US * 1000 + lineNs - 1) / lineNs;
+
+    //a quad only fpga ignores octal writes, frames go on 4 lines until an fpga built with SPI_OCTAL is connected.
+    //octal writes already run at the byte per clock the lz decoder is limited to
+    bool octal = octal_requested && (result.capabilities & FPGA_API_GPU_CAPABILITIES_OCTAL);
+
+    if (octal_requested && !octal)
+        ESP_LOGW(TAG, "octal link requested but the fpga is not built with SPI_OCTAL, framebuffer writes use 4 lines");
+
+    fpga_qspi_set_octal(&qspi, octal);
+    lz_upload = lz_requested && !octal;
+
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    geometry = (fpga_driver_geometry_t)
+    {
+        .mode = result.mode,
+        .width = result.width,
+        .height = result.height,
+        .bitsPerPixel = result.bitsPerPixel,
+        .rowSizeBytes = result.width * result.bitsPerPixel / 8,
+        .frameSizeBytes = frameSizeBytes,
+        .pageCount = FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES / frameSizeBytes > 4 ? 4 : FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES / frameSizeBytes
+    };
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+
+    return true;
+}
+
+//the decoder writes no faster than a byte per clock, only a link running below 80 MHz gains from it. the encoder
+//has to keep up too: a raw byte takes 2 sclk cycles, 12 cpu cycles at 40 MHz and 24 at 20 MHz. what it takes on the
+//esp is measured on every compressed upload (lzEncodeCyclesPerByte, and the testapp's TESTAPP_LZ_BENCH without an
+//fpga). an upload it fell behind on turns it off for FPGA_DRIVER_LZ_RETRY_UPLOADS uploads. evaluated once per upload
+static inline bool driver_helper_lz_active(void)
+{
+    if (!lz_upload || fpga_qspi_get_freq_hz(&qspi) >= fpga_qspi_get_level_freq_hz(0))
+        return false;
+
+    if (lz_skip > 0)
+    {
+        --lz_skip;
+        return false;
+    }
+
+    return true;
+}
+
+//main task only, frame rows go to consecutive fpga rows starting at startIdx
+static bool IRAM_ATTR driver_helper_upload_frame(const uint8_t *pixels, const fpga_driver_frame_t *frame, const fpga_driver_geometry_t *current, uint32_t startIdx, int firstRow, int rowCount)
+{
+    int row_bytes = frame->width * current->bitsPerPixel / 8;
+
+    delta_shadow_size = 0;
+
+    if (row_bytes == current->rowSizeBytes && frame->stride == row_bytes && driver_helper_lz_active())
+        return driver_helper_upload_lz(pixels + firstRow * row_bytes, rowCount * row_bytes, row_bytes, startIdx + firstRow * row_bytes);
+
+    if (row_bytes == current->rowSizeBytes && frame->stride == row_bytes) //only the active rows in one go
+        return fpga_api_gpu_framebuffer_write(&qspi, startIdx + firstRow * row_bytes, (uint8_t*)pixels + firstRow * row_bytes, rowCount * row_bytes);
+
+    for (int row = firstRow; row < firstRow + rowCount; ++row)
+        if (!fpga_api_gpu_framebuffer_write(&qspi, startIdx + row * current->rowSizeBytes, (uint8_t*)pixels + row * frame->stride, row_bytes))
+            return false;
+
+    return true;
+}
+
+//main task only, palette and the whole frame inside vblank. a tightly packed frame goes out in one transaction,
+//otherwise it pays a transaction setup per row
+static bool IRAM_ATTR driver_helper_present_frame(uint8_t *palette, const uint8_t *pixels, const fpga_driver_frame_t *frame, const fpga_driver_geometry_t *current)
+{
+    int row_bytes = frame->width * current->bitsPerPixel / 8;
+    int size = frame->height * row_bytes;
+    bool packed = row_bytes == current->rowSizeBytes && frame->stride == row_bytes;
+    bool delta = packed && delta_shadow != NULL && delta_shadow_size == size && qspi.link_errors == delta_shadow_link_errors;
+    int64_t start = esp_timer_get_time();
+    bool result;
+
+    if (delta)
+        result = fpga_api_gpu_set_palette(&qspi, palette) && driver_helper_upload_delta(pixels, size);
+    else if (packed && !driver_helper_lz_active())
+        result = fpga_api_gpu_framebuffer_present(&qspi, palette, 0, (uint8_t*)pixels, size);
+    else
+        result = fpga_api_gpu_set_palette(&qspi, palette) && driver_helper_upload_frame(pixels, frame, current, 0, 0, frame->height);
+
+    vblank_upload_us = (int)(esp_timer_get_time() - start);
+
+    //whole frame went out, the next one can be a delta against it. copied after the timing, vblank is not waiting for it
+    if (packed && delta_shadow != NULL && !delta && result)
+    {
+        memcpy(delta_shadow, pixels, size);
+        delta_shadow_size = size;
+        delta_shadow_link_errors = qspi.link_errors;
+    }
+
+    return result;
+}
+
+static int IRAM_ATTR driver_helper_lz_fill(void *context, uint8_t **data, bool *last)
+{
+    int64_t start = esp_timer_get_time();
+    uint32_t startCycles = esp_cpu_get_cycle_count();
+
+    *data = upload_pieces[upload_piece_idx];
+    upload_piece_idx ^= 1;
+
+    int count = fpga_driver_lz_encode(&lz_encoder, *data, FPGA_DRIVER_UPLOAD_PIECE_SIZE_BYTES);
+
+    *last = fpga_driver_lz_done(&lz_encoder);
+    lz_encode_cycles += esp_cpu_get_cycle_count() - startCycles;
+    upload_encode_us += (int)(esp_timer_get_time() - start);
+
+    return count;
+}
+
+//main task only, the next piece is encoded while the previous one is sent
+static bool IRAM_ATTR driver_helper_upload_lz(const uint8_t *pixels, int size, int rowBytes, uint32_t startIdx)
+{
+    if (size <= 0)
+        return true;
+
+    fpga_driver_lz_init(&lz_encoder, pixels, size, rowBytes);
+    upload_encode_us = 0;
+    lz_encode_cycles = 0;
+
+    int64_t start = esp_timer_get_time();
+    bool result = fpga_api_gpu_framebuffer_write_lz(&qspi, startIdx, driver_helper_lz_fill, NULL);
+    int64_t elapsed = esp_timer_get_time() - start;
+
+    lz_cycles_percent = lz_encoder.out.nibbles * 100 / (size * 2);
+    lz_encode_cycles_per_byte = (lz_encode_cycles + size - 1) / size;
+
+    //slower than the raw bytes would have been on the wire
+    if (result && elapsed > (int64_t)size * 2 * 1000000 / fpga_qspi_get_freq_hz(&qspi))
+        lz_skip = FPGA_DRIVER_LZ_RETRY_UPLOADS;
+
+    return result;
+}
+
+static int IRAM_ATTR driver_helper_delta_fill(void *context, uint8_t **data, bool *last)
+{
+    int64_t start = esp_timer_get_time();
+
+    *data = upload_pieces[upload_piece_idx];
+    upload_piece_idx ^= 1;
+
+    int count = fpga_driver_delta_encode(&delta_encoder, *data, FPGA_DRIVER_UPLOAD_PIECE_SIZE_BYTES);
+
+    *last = fpga_driver_delta_done(&delta_encoder);
+    upload_encode_us += (int)(esp_timer_get_time() - start);
+
+    return count;
+}
+
+//main task only, the shadow is updated as literals are encoded and dropped if the upload fails
+static bool IRAM_ATTR driver_helper_upload_delta(const uint8_t *pixels, int size)
+{
+    fpga_driver_delta_init(&delta_encoder, pixels, delta_shadow, size);
+    upload_encode_us = 0;
+
+    bool result = fpga_api_gpu_framebuffer_write_delta(&qspi, 0, driver_helper_delta_fill, NULL);
+
+    delta_bytes = (delta_encoder.out.nibbles + 1) / 2;
+
+    if (!result)
+        delta_shadow_size = 0;
+
+    return result;
+}
+
+//one fpga copper list entry, see FPGA_API_GPU_COPPER_ENTRY_SIZE_BYTES
+static void driver_helper_copper_pack(uint8_t *entry, int row, int op, uint8_t index, uint8_t v0, uint8_t v1, uint8_t v2)
+{
+    entry[0] = row & 0xFF;
+    entry[1] = row >> 8;
+    entry[2] = op;
+    entry[3] = index;
+    entry[4] = v0;
+    entry[5] = v1;
+    entry[6] = v2;
+    entry[7] = 0;
+}
+
+//byte address of a rectangle in the displayed page of the active layout, x and width are in pixels and must cover whole bytes
+static bool driver_helper_blit_rect(int x, int y, int width, int height, uint32_t *address, int *rowBytes, int *stride)
+{
+    fpga_driver_geometry_t current;
+
+    fpga_driver_get_geometry(&current);
+
+    int pixelsPerByte = 8 / current.bitsPerPixel;
+
+    if (!init || x < 0 || y < 0 || width <= 0 || height <= 0 || x + width > current.width || y + height > current.height || 
+        x % pixelsPerByte != 0 || width % pixelsPerByte != 0)
+    {
+        ESP_LOGE(TAG, "blit: rectangle %d,%d %dx%d out of bounds or not byte aligned", x, y, width, height);
+        return false;
+    }
+
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    int page = current.pageCount >= 2 ? gpu_registers[FPGA_API_GPU_REGISTER_PAGE] : 0;
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+
+    *address = page*current.frameSizeBytes + y*current.rowSizeBytes + x/pixelsPerByte;
+    *rowBytes = width/pixelsPerByte;
+    *stride = current.rowSizeBytes;
+
+    return true;
+}
+
+//waits for room in the driver queue, the main task forwards blits to the fpga queue
+static bool driver_helper_blit_enqueue(uint8_t op, uint8_t value, uint32_t src, int srcStride, uint32_t dst, int dstStride, int width, int height)
+{
+    uint8_t block[FPGA_API_GPU_BLIT_PARAMS_SIZE_BYTES] = 
+    { 
+        op, value, 
+        src & 0xFF, (src >> 8) & 0xFF, src >> 16, srcStride & 0xFF, srcStride >> 8,
+        dst & 0xFF, (dst >> 8) & 0xFF, dst >> 16, dstStride & 0xFF, dstStride >> 8,
+        width & 0xFF, width >> 8, height & 0xFF, height >> 8
+    };
+
+    for (;;)
+    {
+        bool done = false;
+
+        taskENTER_CRITICAL(&driver_spinlock);
+
+        if (blit_queue_head - blit_queue_tail < FPGA_DRIVER_BLIT_QUEUE_SIZE)
+        {
+            memcpy(blit_queue[blit_queue_head % FPGA_DRIVER_BLIT_QUEUE_SIZE], block, sizeof(block));
+            ++blit_queue_head;
+            done = true;
+        }
+
+        bool connected = fpga_connected;
 
         taskEXIT_CRITICAL(&driver_spinlock);
 
-        if (!memcmp(&currentStatus, &previous_hid_status, sizeof(fpga_driver_hid_status_t)))
-            continue;
+        if (done)
+            return true;
+
+        if (!connected)
+            return false;
+
+        taskYIELD();
+    }
+}
+
+static bool driver_helper_link_test(void)
+{
+    static const uint32_t patterns[] = { 0x00000000, 0xFFFFFFFF, 0xA5A5A5A5, 0x5A5A5A5A, 0x0F0F0F0F, 0xF0F0F0F0, 0x12345678, 0xEDCBA987 };
+
+    bool magic = false;
+
+    if (!fpga_api_gpu_read_magic_number(&qspi, &magic) || !magic)
+        return false;
 
-        if (callback != NULL)
+    for (int i = 0; i < FPGA_DRIVER_LINK_TEST_ROUNDS; ++i)
+    {
+        for (int j = 0; j < sizeof(patterns)/sizeof(patterns[0]); ++j)
         {
-            fpga_driver_hid_event_t event;
+            bool ok = false;
 
-            //key events
+            if (!fpga_api_gpu_echo(&qspi, patterns[j] ^ (i * 0x01010101u), &ok) || !ok)
+                return false;
+        }
+    }
 
-            event.keyEvent.modifiers = currentStatus.keyboardModifiers; //whatever
+    return true;
+}
 
-            if (currentStatus.keyboardModifiers != previous_hid_status.keyboardModifiers)
-                for (int i = 1; i < 256; i <<= 1)
-                {
-                    if ((currentStatus.keyboardModifiers & i) == (previous_hid_status.keyboardModifiers & i))
-                        continue;
+//echo and status bundle pairs through the link integrity check at the configured timing,
+//false if an echo fails or enough bundles mismatch for the fallback to step the clock down
+static bool driver_helper_link_verify(void)
+{
+    int level = qspi.freq_level;
 
-                    event.type = currentStatus.keyboardModifiers & i 
-                        ? FPGA_DRIVER_HID_EVENT_KEY_DOWN 
-                        : FPGA_DRIVER_HID_EVENT_KEY_UP;
+    for (int i = 0; i < FPGA_DRIVER_LINK_VERIFY_ROUNDS && qspi.freq_level == level; ++i)
+    {
+        fpga_api_gpu_status_bundle_t bundle;
+        bool ok = false;
 
-                    event.keyEvent.keyCode = FPGA_DRIVER_HID_KEY_MODIFIER_TO_CODE(i);
+        if (!fpga_api_gpu_echo(&qspi, 0xA5C33C5Au ^ (i * 0x01020408u), &ok) || !ok)
+            return false;
 
-                    callback(event);
-                }
+        fpga_api_gpu_read_status_bundle(&qspi, &bundle);
+    }
 
-            if (!(FPGA_DRIVER_HID_KEY_IS_ERROR(currentStatus.keyboardKeys[0]) || 
-                  FPGA_DRIVER_HID_KEY_IS_ERROR(currentStatus.keyboardKeys[1]) || 
-                  FPGA_DRIVER_HID_KEY_IS_ERROR(currentStatus.keyboardKeys[2]) || 
-                  FPGA_DRIVER_HID_KEY_IS_ERROR(currentStatus.keyboardKeys[3]) || 
-                  FPGA_DRIVER_HID_KEY_IS_ERROR(currentStatus.keyboardKeys[4]) || 
-                  FPGA_DRIVER_HID_KEY_IS_ERROR(currentStatus.keyboardKeys[5])))  //if rollover error or else just skip keys
-            {
-                uint8_t unmappedKeys[6];
-                int unmappedKeysCount;
+    return qspi.freq_level == level;
+}
 
-                //dont feel like writing super optimized code for this
-                driver_helper_hid_map_keys(currentStatus.keyboardKeys, previous_hid_status.keyboardKeys, unmappedKeys, &unmappedKeysCount);
+//sweeps clock, input delay and dummy cycles against the echo command, fastest clock first, and takes the middle 
+//of the widest passing input delay range once it is FPGA_DRIVER_LINK_MIN_WINDOW wide. the result is kept in nvs 
+//and the sweep only runs without one, or when the stored one makes the link fallback step down at boot
+static void driver_helper_link_calibrate(bool force)
+{
+    static const int delays[] = { 0, 5, 10, 15, 20, 25, 30 };
+    static const int dummies[] = { FPGA_QSPI_READ_DUMMY_CYCLES, FPGA_QSPI_READ_DUMMY_CYCLES + 1 };
 
-                event.type = FPGA_DRIVER_HID_EVENT_KEY_UP;
+    #define DELAY_COUNT (sizeof(delays)/sizeof(delays[0]))
+    #define DUMMY_COUNT (sizeof(dummies)/sizeof(dummies[0]))
 
-                for (int i = 0; i < unmappedKeysCount; ++i)
-                {
-                    event.keyEvent.keyCode = unmappedKeys[i];
-                    callback(event);
-                }
+    driver_link_calibration_t calibration = { 0 };
+    size_t size = sizeof(calibration);
+    nvs_handle_t nvs;
 
-                driver_helper_hid_map_keys(previous_hid_status.keyboardKeys, currentStatus.keyboardKeys, unmappedKeys, &unmappedKeysCount);
-                
-                event.type = FPGA_DRIVER_HID_EVENT_KEY_DOWN;
+    //nvs_flash_init returns ESP_OK if the app already initialized it. a full or newer format partition has to be
+    //erased first, as the idf examples do, nothing would be kept in it otherwise
+    esp_err_t nvsInit = nvs_flash_init();
 
-                for (int i = 0; i < unmappedKeysCount; ++i)
-                {
-                    event.keyEvent.keyCode = unmappedKeys[i];
-                    callback(event);
-                }
-            }
+    if (nvsInit == ESP_ERR_NVS_NO_FREE_PAGES || nvsInit == ESP_ERR_NVS_NEW_VERSION_FOUND)
+    {
+        ESP_LOGW(TAG, "nvs partition full or of a newer format, erasing it");
 
-            //mouse events
+        if (nvs_flash_erase() == ESP_OK)
+            nvsInit = nvs_flash_init();
+    }
 
-            if (currentStatus.mouseKeys != previous_hid_status.mouseKeys)
-                for (int i = 1; i < 256; i <<= 1)
-                {
-                    if ((currentStatus.mouseKeys & i) == (previous_hid_status.mouseKeys & i))
-                        continue;
+    bool nvsOpen = nvsInit == ESP_OK && nvs_open(FPGA_DRIVER_NVS_NAMESPACE, NVS_READWRITE, &nvs) == ESP_OK;
 
-                    event.type = currentStatus.mouseKeys & i 
-                        ? FPGA_DRIVER_HID_EVENT_MOUSE_BUTTON_DOWN 
-                        : FPGA_DRIVER_HID_EVENT_MOUSE_BUTTON_UP;
+    if (!nvsOpen)
+        ESP_LOGW(TAG, "nvs not available, link calibration will not be kept");
 
-                    event.mouseButtonEvent.buttonCode = i;
+    if (!force && nvsOpen && nvs_get_blob(nvs, FPGA_DRIVER_NVS_LINK_CALIBRATION, &calibration, &size) == ESP_OK && 
+        size == sizeof(calibration) && calibration.version == FPGA_DRIVER_LINK_CALIBRATION_VERSION)
+    {
+        ESP_LOGI(TAG, "link calibration from nvs: %d Hz, input delay %d ns, %d dummy cycles", 
+                 fpga_qspi_get_level_freq_hz(calibration.freqLevel), calibration.inputDelayNs, calibration.readDummyCycles);
 
-                    callback(event);
-                }
+        if (fpga_qspi_configure(&qspi, calibration.freqLevel, calibration.inputDelayNs, calibration.readDummyCycles) && driver_helper_link_verify())
+        {
+            nvs_close(nvs);
+            return;
+        }
+
+        ESP_LOGW(TAG, "stored link calibration fails verification, sweeping again");
+    }
+
+    bool found = false;
+
+    for (int level = 0; level < FPGA_QSPI_FREQ_LEVELS && !found; ++level)
+    {
+        int bestStart = 0, bestLength = 0, bestDummy = 0;
 
-            event.mouseMoveEvent.moveX = currentStatus.mouseX - previous_hid_status.mouseX; //this should work even when int32 overflows
-            event.mouseMoveEvent.moveY = currentStatus.mouseY - previous_hid_status.mouseY;
-            event.mouseMoveEvent.moveWheel = currentStatus.mouseWheel - previous_hid_status.mouseWheel;
+        for (int d = 0; d < DUMMY_COUNT; ++d)
+        {
+            int runStart = 0, runLength = 0;
 
-            if (event.mouseMoveEvent.moveX != 0 || 
-                event.mouseMoveEvent.moveY != 0 || 
-                event.mouseMoveEvent.moveWheel != 0)
+            for (int i = 0; i < DELAY_COUNT; ++i)
             {
-                event.type = FPGA_DRIVER_HID_EVENT_MOUSE_MOVE;
+                bool ok = fpga_qspi_configure(&qspi, level, delays[i], dummies[d]) && driver_helper_link_test();
 
-                event.mouseMoveEvent.pressedButtons = currentStatus.mouseKeys;
-                callback(event);
+                runStart = ok && runLength == 0 ? i : runStart;
+                runLength = ok ? runLength + 1 : 0;
+
+                if (runLength > bestLength)
+                {
+                    bestStart = runStart;
+                    bestLength = runLength;
+                    bestDummy = dummies[d];
+                }
             }
         }
 
-        previous_hid_status = currentStatus;
+        if (bestLength >= FPGA_DRIVER_LINK_MIN_WINDOW)
+        {
+            calibration = (driver_link_calibration_t)
+            {
+                .version = FPGA_DRIVER_LINK_CALIBRATION_VERSION,
+                .freqLevel = level,
+                .inputDelayNs = delays[bestStart + (bestLength - 1)/2],
+                .readDummyCycles = bestDummy
+            };
+
+            found = true;
+        }
+    }
+
+    #undef DELAY_COUNT
+    #undef DUMMY_COUNT
+
+    if (!found)
+    {
+        ESP_LOGW(TAG, "link calibration failed, fpga not ready? using defaults");
+
+        fpga_qspi_configure(&qspi, 0, SPI_INPUT_DELAY_NS, FPGA_QSPI_READ_DUMMY_CYCLES);
+
+        if (nvsOpen)
+            nvs_close(nvs);
+
+        return;
+    }
+
+    ESP_LOGI(TAG, "link calibrated: %d Hz, input delay %d ns, %d dummy cycles", 
+             fpga_qspi_get_level_freq_hz(calibration.freqLevel), calibration.inputDelayNs, calibration.readDummyCycles);
+
+    fpga_qspi_configure(&qspi, calibration.freqLevel, calibration.inputDelayNs, calibration.readDummyCycles);
+
+    //the fallback keeps whatever clock it stepped down to and probes back up later
+    if (!driver_helper_link_verify())
+        ESP_LOGW(TAG, "link calibration fails verification, now at %d Hz", fpga_qspi_get_freq_hz(&qspi));
+
+    if (nvsOpen)
+    {
+        if (nvs_set_blob(nvs, FPGA_DRIVER_NVS_LINK_CALIBRATION, &calibration, sizeof(calibration)) != ESP_OK || nvs_commit(nvs) != ESP_OK)
+            ESP_LOGW(TAG, "link calibration could not be stored");
+
+        nvs_close(nvs);
+    }
+}
+
+//posts a request to the main task and waits for it to be served, caller must hold driver_request_mutex
+static bool driver_helper_request(driver_request_t request)
+{
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    driver_request = request;
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+
+    xSemaphoreTake(driver_request_done, portMAX_DELAY);
+
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    bool result = driver_request_result;
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+
+    return result;
+}
+
+//main task only
+static void IRAM_ATTR driver_helper_serve_request(bool connected)
+{
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    driver_request_t request = driver_request;
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+
+    if (request == DRIVER_REQUEST_NONE)
+        return;
+
+    bool result = false;
+
+    if (connected)
+    {
+        switch (request)
+        {
+            case DRIVER_REQUEST_USB_TRACE_READ:
+                result = fpga_api_io_usb_trace_read(&qspi, usb_trace_buffer);
+                FPGA_DRIVER_ERROR_CHECK(result);
+                break;
+            case DRIVER_REQUEST_SPRITE_WRITE_IMAGE:
+                result = fpga_api_gpu_sprite_write_image(&qspi, sprite_image_idx, sprite_image_buffer);
+                FPGA_DRIVER_ERROR_CHECK(result);
+                break;
+            case DRIVER_REQUEST_LINE_TABLE_WRITE:
+                result = fpga_api_gpu_write_line_table(&qspi, request_write_start, (uint8_t*)request_write_data, request_write_count);
+                FPGA_DRIVER_ERROR_CHECK(result);
+                break;
+            case DRIVER_REQUEST_FRAMEBUFFER_WRITE_ROWS:
+                result = fpga_api_gpu_framebuffer_write(&qspi, request_write_start, (uint8_t*)request_write_data, request_write_count);
+                delta_shadow_size = 0;
+                FPGA_DRIVER_ERROR_CHECK(result);
+                break;
+            case DRIVER_REQUEST_GEOMETRY_READ:
+                result = driver_helper_read_geometry();
+                FPGA_DRIVER_ERROR_CHECK(result);
+                break;
+            case DRIVER_REQUEST_SECONDARY_PALETTE_WRITE:
+                result = fpga_api_gpu_set_secondary_palette(&qspi, secondary_palette_buffer);
+                FPGA_DRIVER_ERROR_CHECK(result);
+                break;
+            case DRIVER_REQUEST_EDID_READ:
+                result = fpga_api_io_edid_read(&qspi, edid_buffer);
+                FPGA_DRIVER_ERROR_CHECK(result);
+                break;
+            case DRIVER_REQUEST_RASTER_READ:
+                result = fpga_api_gpu_read_raster(&qspi, &raster_result);
+                FPGA_DRIVER_ERROR_CHECK(result);
+                break;
+            case DRIVER_REQUEST_COPPER_LIST_WRITE:
+                result = fpga_api_gpu_write_copper_list(&qspi, 0, copper_list_buffer, request_write_count);
+                FPGA_DRIVER_ERROR_CHECK(result);
+                break;
+            case DRIVER_REQUEST_BLIT_STORE_WRITE:
+                result = fpga_api_gpu_write_blit_store(&qspi, request_write_start, (uint8_t*)request_write_data, request_write_count);
+                FPGA_DRIVER_ERROR_CHECK(result);
+                break;
+            case DRIVER_REQUEST_FRAMEBUFFER_READ_ROWS:
+                result = fpga_api_gpu_framebuffer_read(&qspi, request_write_start, request_read_data, request_write_count);
+                FPGA_DRIVER_ERROR_CHECK(result);
+                break;
+            case DRIVER_REQUEST_BLIT_CRC_READ:
+                result = fpga_api_gpu_read_blit_crc(&qspi, &blit_crc_result);
+                FPGA_DRIVER_ERROR_CHECK(result);
+                break;
+            default:
+                ESP_LOGE(TAG, "unknown driver request %d", request);
+                break;
+        }
     }
+
+    taskENTER_CRITICAL(&driver_spinlock);
+
+    driver_request = DRIVER_REQUEST_NONE;
+    driver_request_result = result;
+
+    taskEXIT_CRITICAL(&driver_spinlock);
+
+    xSemaphoreGive(driver_request_done);
 }
\ No newline at end of file
@@ -5,10 +5,21 @@
 #include "fpga_driver_hid_events.h"
 
 #define FPGA_DRIVER_PALETTE_SIZE_BYTES      (256*3)
+#define FPGA_DRIVER_PALETTE_FADE_MAX        (128)
+#define FPGA_DRIVER_PALETTE_ROTATION_COUNT  (2)
 
+//default FPGA_DRIVER_MODE_320X240 geometry, use fpga_driver_get_geometry for the active one
 #define FPGA_DRIVER_FRAME_WIDTH             (320)
 #define FPGA_DRIVER_FRAME_HEIGHT            (240)
-#define FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES  (FPGA_DRIVER_FRAME_WIDTH*FPGA_DRIVER_FRAME_HEIGHT)
+#define FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES  (FPGA_DRIVER_FRAME_WIDTH*FPGA_DRIVER_FRAME_HEIGHT) //every mode fits
+
+#define FPGA_DRIVER_SPRITE_COUNT            (4)
+#define FPGA_DRIVER_SPRITE_SIZE             (32)
+#define FPGA_DRIVER_SPRITE_IMAGE_SIZE_BYTES (FPGA_DRIVER_SPRITE_SIZE*FPGA_DRIVER_SPRITE_SIZE)
+
+#define FPGA_DRIVER_COPPER_MAX_WRITES       (63) //fpga list size minus the end marker, a scroll entry takes 4 writes
+
+#define FPGA_DRIVER_BLIT_STORE_SIZE         (8192)
 
 #define FPGA_DRIVER_AUDIO_HDMI_FIFO_SAMPLES (1024)
 #define FPGA_DRIVER_AUDIO_BUFFER_WRITE_MAX_SAMPLES  (256)
@@ -16,6 +27,19 @@
 
 #define FPGA_DRIVER_AUDIO_SAMPLE_RATE       (48000)
 
+#define FPGA_DRIVER_HID_MAX_DEVICES         (4)
+#define FPGA_DRIVER_HID_MAX_KEYS            (6*FPGA_DRIVER_HID_MAX_DEVICES) //keys of all keyboards are merged
+
+#define FPGA_DRIVER_USB_TRACE_MAX_ENTRIES   (64)
+
+#define FPGA_DRIVER_LZ_WINDOW               (512) //history kept by the fpga decoder
+#define FPGA_DRIVER_LZ_MIN_MATCH            (6)
+#define FPGA_DRIVER_LZ_HASH_BITS            (10)
+#define FPGA_DRIVER_LZ_RETRY_UPLOADS        (256) //raw uploads after one the encoder fell behind on
+
+#define FPGA_DRIVER_HID_KEY_REPEAT_DELAY_MS (500)
+#define FPGA_DRIVER_HID_KEY_REPEAT_RATE_MS  (33)
+
 typedef struct 
 {
     int pinCsGpu;
@@ -25,6 +49,16 @@ typedef struct
     int pinD1;
     int pinD2;
     int pinD3;
+    bool octal;             //d4-d7 are wired and the fpga is built with SPI_OCTAL, framebuffer uploads take half the time. they stay on 4 lines while the connected fpga doesn't report it
+    int pinD4;
+    int pinD5;
+    int pinD6;
+    int pinD7;
+    bool ioOnGpuCs;         //io commands go in command lists on the gpu chip select, pinCsIo stays wired for older fpga builds
+    bool vblankIrq;         //fpga built with SPI_CS1_IRQ, pinCsIo is the vblank input and wakes the driver at vblank start. implies ioOnGpuCs. an fpga built the other way is refused
+    bool recalibrateLink;   //sweep the spi timing again instead of using the one stored in nvs, after wiring changes. init initializes the default nvs partition if the app has not, erasing it if it is full
+    bool lzUpload;          //fpga built with the lz decoder, tightly packed frames are sent compressed while the quad link runs below 80 MHz and the encoder keeps up with it
+    bool deltaUpload;       //single page layouts send only the pixels that changed since the last frame, keeps a copy of it (psram if there is any)
 } fpga_driver_config_t;
 
 typedef enum 
@@ -33,10 +67,54 @@ typedef enum
     FPGA_DRIVER_VSYNC_WAIT_IF_PREVIOUS_NOT_PRESENTED
 } fpga_driver_vsync_mode_t;
 
+typedef enum
+{
+    FPGA_DRIVER_PRESENT_VBLANK,     //pixels are uploaded at vblank start, a frame must fit into the blanking window to avoid tearing
+    FPGA_DRIVER_PRESENT_RACE_BEAM   //single page layouts: pixels follow the beam through the next frame and are shown one frame later
+} fpga_driver_present_mode_t;
+
+typedef enum 
+{
+    FPGA_DRIVER_MODE_320X240 = 0,       //8bpp, integer scaled, letterboxed
+    FPGA_DRIVER_MODE_320X200 = 1,       //8bpp, 4:3 aspect correct, fills screen height
+    FPGA_DRIVER_MODE_640X240_4BPP = 2,  //4bpp, left pixel in the high nibble, palette bank entries, fills the screen
+    FPGA_DRIVER_MODE_320X240_4BPP = 3,  //4bpp, left pixel in the high nibble, palette bank entries, page flipped
+    FPGA_DRIVER_MODE_320X240_2BPP = 4,  //2bpp, leftmost pixel in the high bits, palette bank entries, page flipped
+    FPGA_DRIVER_MODE_160X120 = 5        //8bpp, pixel and line doubled 320x240, page flipped
+} fpga_driver_mode_t;
+
+typedef struct
+{
+    fpga_driver_mode_t mode;
+    int width;
+    int height;
+    int bitsPerPixel;
+    int rowSizeBytes;
+    int frameSizeBytes;
+    int pageCount;      //frames fitting the fpga framebuffer, present_frame flips pages when there are at least 2
+} fpga_driver_geometry_t;
+
+//layout of the pixels in a framebuffer passed to fpga_driver_present_frame
+typedef struct
+{
+    int width;  //pixels, <= active geometry width
+    int height; //rows, <= active geometry height, only these are transmitted
+    int stride; //bytes between row starts in the buffer
+} fpga_driver_frame_t;
+
+typedef enum 
+{
+    FPGA_DRIVER_SPRITE_PRIORITY_FRONT,  //drawn over the framebuffer
+    FPGA_DRIVER_SPRITE_PRIORITY_BEHIND  //drawn only over framebuffer pixels with value 0, palette bank is not applied
+} fpga_driver_sprite_priority_t;
+
 typedef struct
 {
     uint8_t keyboardModifiers;
-    uint8_t keyboardKeys[6];
+    uint8_t keyboardKeys[FPGA_DRIVER_HID_MAX_KEYS];
+
+    uint8_t keyboardCount;
+    uint8_t mouseCount;
 
     uint8_t mouseKeys;
     int32_t mouseX;
@@ -56,19 +134,303 @@ typedef struct
     };
 } fpga_driver_hid_event_t;
 
+//monitor capabilities parsed from its edid
+typedef struct
+{
+    bool connected;             //hot plug detect
+    bool valid;                 //edid was read and its base block checksum matches
+    bool hdmi;                  //hdmi vendor block present, false means a dvi-only sink
+    bool audio;                 //hdmi sink with basic audio
+    bool supports720p60;
+    bool supports1080p60;
+    int preferredWidth;         //first detailed timing, 0 if none
+    int preferredHeight;
+    int preferredRefreshHz;
+    char name[14];              //monitor name descriptor, empty if none
+} fpga_driver_display_info_t;
+
+typedef struct
+{
+    uint32_t checks;            //status bundles checked against the crcs of all gpu data sent and received since the previous one, io read trailers
+    uint32_t errors;            //mismatches and corrupted status bundles
+    int freqHz;                 //current spi clock, lowered on errors and probed back up
+    int vblankUploadUs;         //bus time of the last palette and frame upload done inside vblank, 0 if none yet
+    int lzCyclesPercent;        //sclk cycles of the last compressed frame upload against a raw one, 0 if none yet
+    int lzEncodeCyclesPerByte;  //cpu cycles per frame byte the encoder took for it, 2 sclk cycles worth keeps up with a raw upload
+    int deltaBytes;             //token bytes of the last inter-frame delta upload, 0 if none yet
+    int encodeUs;               //cpu time spent encoding the last compressed or delta upload, overlapped with it
+} fpga_driver_link_stats_t;
+
+//counters since init, all free running
+typedef struct
+{
+    uint32_t framesPresented;   //frames shown, a page flip or the end of a vblank or raced upload
+    uint32_t framesDropped;     //pending frames replaced by FPGA_DRIVER_VSYNC_DONT_WAIT_OVERWRITE_PREVIOUS before they were shown
+    uint32_t vblanksMissed;     //vblanks that started and ended between two driver ticks, no upload was possible in them
+    uint32_t audioUnderruns;    //times the hdmi audio fifo ran empty while a callback was registered
+    uint32_t audioOverruns;     //audio writes that filled the fifo, samples past it were dropped
+    uint32_t hidPolls;          //io hid status reads
+    uint32_t transactions;      //qspi transactions on both chip selects, a command list counts once
+    uint32_t transactionErrors;
+    uint64_t bytes;             //command, address and data bytes, no dummy cycles
+    uint64_t busUs;             //time spent inside transactions
+    uint64_t busWaitUs;         //time spent waiting for another task's transaction to finish
+} fpga_driver_stats_t;
+
+typedef enum
+{
+    FPGA_DRIVER_COPPER_SET_PALETTE_ENTRY, //permanent, restore the entry with a row 0 entry if the change should not carry over
+    FPGA_DRIVER_COPPER_SET_SCROLL,        //lasts until the next vblank, 4 writes
+    FPGA_DRIVER_COPPER_SET_PALETTE_BANK   //lasts until the next vblank
+} fpga_driver_copper_op_t;
+
+//scanline register write, applied in the hblank before the first screen line of the row
+typedef struct
+{
+    int row;
+    fpga_driver_copper_op_t op;
+
+    union
+    {
+        struct { uint8_t index, r, g, b; } paletteEntry;
+        struct { int x, y; } scroll;
+        int paletteBank;
+    };
+} fpga_driver_copper_entry_t;
+
+typedef struct
+{
+    uint8_t event;          //TRACE_* id from the usb softcore firmware log.h
+    uint8_t timestampMs;    //low 8 bits of the usb softcore millisecond timer
+    uint16_t arg;
+} fpga_driver_usb_trace_entry_t;
+
+typedef struct
+{
+    bool keyboard;
+    bool mouse;
+
+    uint8_t keys[6];        //last valid keys, kept over rollover errors
+    int32_t mouseX;
+    int32_t mouseY;
+    int32_t mouseWheel;
+} fpga_driver_hid_device_t;
+
+typedef struct
+{
+    fpga_driver_hid_device_t devices[FPGA_DRIVER_HID_MAX_DEVICES];
+    int32_t mouseX;         //accumulated from per-device deltas
+    int32_t mouseY;
+    int32_t mouseWheel;
+} fpga_driver_hid_merge_t;
+
+typedef struct
+{
+    int row;                //next row to upload, -1 when no frame is being raced
+    uint16_t frame;         //frame counter at the vblank the race was claimed in
+} fpga_driver_race_t;
+
+typedef struct
+{
+    bool halfByte;          //tokens are nibble aligned, one is carried to the next piece
+    uint8_t pendingNibble;
+    int nibbles;            //sclk cycles of the stream so far
+} fpga_driver_token_writer_t;
+
+typedef struct
+{
+    const uint8_t *src;
+    int size;
+    int rowBytes;
+    int pos;
+    int literalStart;       //-1 once the stream is finished
+    fpga_driver_token_writer_t out;
+    int minMatch;           //FPGA_DRIVER_LZ_* unless set by fpga_driver_lz_init_params
+    int hashBits;
+    int window;
+    int32_t *hash;          //1 << hashBits entries, hashTable unless set by fpga_driver_lz_init_params
+    int32_t hashTable[1 << FPGA_DRIVER_LZ_HASH_BITS];
+} fpga_driver_lz_encoder_t;
+
+typedef struct
+{
+    const uint8_t *src;
+    uint8_t *shadow;        //what the fpga holds, literals sent are copied into it
+    int size;
+    int pos;
+    bool done;
+    fpga_driver_token_writer_t out;
+} fpga_driver_delta_encoder_t;
+
 typedef void (*fpga_driver_audio_requested_cb_t)(uint32_t *buffer, int *sampleCount, int maxSampleCount);
 typedef void (*fpga_driver_hid_event_cb_t)(fpga_driver_hid_event_t hidEvent);
 
+//calibrates the spi link timing on first use and keeps it in nvs, call nvs_flash_init before for it to be kept
 bool fpga_driver_init(fpga_driver_config_t *config);
 
 bool fpga_driver_is_connected(void);
 
+//switches the layout at the next vblank, blocks until the fpga reports it. present_frame then uploads only frameSizeBytes
+bool fpga_driver_set_mode(fpga_driver_mode_t mode);
+
+//geometry of the active layout as reported by the fpga
+void fpga_driver_get_geometry(fpga_driver_geometry_t *geometry);
+
 void fpga_driver_get_framebuffer(uint8_t **palette, uint8_t **framebuffer);
 
-void fpga_driver_present_frame(uint8_t **palette, uint8_t **framebuffer, fpga_driver_vsync_mode_t vsync);
+//frame can be NULL for a tightly packed frame of the active geometry
+//in page flipped modes the pixels are uploaded outside of vblank to the hidden page, only palette and flip wait for vblank
+void fpga_driver_present_frame(uint8_t **palette, uint8_t **framebuffer, const fpga_driver_frame_t *frame, fpga_driver_vsync_mode_t vsync);
+
+//default FPGA_DRIVER_PRESENT_VBLANK, page flipped layouts ignore it and always upload to the hidden page
+void fpga_driver_set_present_mode(fpga_driver_present_mode_t mode);
+
+//palette entries used by 4bpp (bank*16 + pixel, bank 0-15) and 2bpp (bank*4 + pixel, bank 0-63) modes, applied at the next vblank
+void fpga_driver_set_palette_bank(int bank);
+
+//pack kernels from one palette index per byte to the packed modes, leftmost pixel goes to the high bits
+//only the low bits of each index are kept, a partial last byte is padded with zero pixels, dst may alias src
+void fpga_driver_pack_4bpp(uint8_t *dst, const uint8_t *src, int pixelCount);
+void fpga_driver_pack_2bpp(uint8_t *dst, const uint8_t *src, int pixelCount);
+
+//lz token stream for compressed framebuffer uploads, see fpga_driver_lz.c.
+//encoded in steps so that a piece can be sent while the next one is encoded
+void fpga_driver_lz_init(fpga_driver_lz_encoder_t *lz, const uint8_t *src, int size, int rowBytes);
+//the same encoder with other constants, for host/lz_bench. hash has 1 << hashBits entries, 0 leaves the hash candidate
+//out. minMatch 4..8 and window up to 4096 keep the stream decodable, the fpga decoder only takes the driver's ones
+void fpga_driver_lz_init_params(fpga_driver_lz_encoder_t *lz, const uint8_t *src, int size, int rowBytes, int minMatch, int hashBits, int window, int32_t *hash);
+//returns the bytes put in dst, fewer than dstSize when it cannot fit another step. a 512 byte dst always makes progress
+int fpga_driver_lz_encode(fpga_driver_lz_encoder_t *lz, uint8_t *dst, int dstSize);
+bool fpga_driver_lz_done(const fpga_driver_lz_encoder_t *lz);
+
+//skip and literal token stream against the previous frame, same stepping as the lz encoder.
+//src and shadow must be word aligned, 4 pixels are compared at a time
+void fpga_driver_delta_init(fpga_driver_delta_encoder_t *delta, const uint8_t *src, uint8_t *shadow, int size);
+int fpga_driver_delta_encode(fpga_driver_delta_encoder_t *delta, uint8_t *dst, int dstSize);
+bool fpga_driver_delta_done(const fpga_driver_delta_encoder_t *delta);
+
+//merges one slot of fpga_api_io_hid_get_all_status into merged, see fpga_driver_hid_merge.c.
+//keys of all keyboards are combined without duplicates, mouseX/Y/Wheel of merge follow the sum of device movements
+void fpga_driver_hid_merge_device(fpga_driver_hid_merge_t *merge, fpga_driver_hid_status_t *merged, int slot, const uint8_t *status, bool present);
+
+//beam racing state of the main task, see fpga_driver_race.c. rows [race->row, free rows) may be uploaded,
+//the palette is switched and the race ends once can_finish is true and palette_fits for a raster read after the rows
+void fpga_driver_race_start(fpga_driver_race_t *race, uint16_t frameCounter);
+int fpga_driver_race_free_rows(const fpga_driver_race_t *race, uint16_t frameCounter, int rowsDone, int height);
+bool fpga_driver_race_can_finish(const fpga_driver_race_t *race, uint16_t frameCounter, bool vblank, int height);
+bool fpga_driver_race_palette_fits(int line, int screenLines, int totalLines, int paletteLines);
+
+//reads the monitor edid the fpga fetched over ddc after hot plug and parses it
+//blocks until the fpga has finished reading, false if the fpga is not connected or ddc did not finish in time
+bool fpga_driver_display_get_info(fpga_driver_display_info_t *info);
+
+//edid is the base block followed by up to one extension block, size is 128 or 256 bytes
+bool fpga_driver_display_parse_edid(const uint8_t *edid, int size, fpga_driver_display_info_t *info);
+
+//plain dvi without audio and infoframes for sinks that reject hdmi data islands, applied at the next vblank
+void fpga_driver_set_dvi_output(bool dvi);
+
+//link integrity check costs a crc-16 over every byte sent and received, enabled by default
+void fpga_driver_set_link_check(bool enable);
+
+void fpga_driver_get_link_stats(fpga_driver_link_stats_t *stats);
+
+void fpga_driver_get_stats(fpga_driver_stats_t *stats);
+
+//records the last entryCount qspi transactions with opcode, size and esp_timer timestamps, a previous trace is discarded
+bool fpga_driver_trace_start(int entryCount);
+void fpga_driver_trace_stop(void);
+
+//prints the recorded transactions as chrome trace event json (chrome://tracing, ui.perfetto.dev) to stdout, usually the uart console.
+//transactions go to thread 1, time spent waiting for the bus to thread 2. recording continues afterwards
+bool fpga_driver_trace_export_chrome(void);
+
+//palette animation runs on the fpga, once set up it takes no cpu time and no bus traffic
+
+//fade target palette, blocks until the driver has sent it
+bool fpga_driver_palette_set_secondary(const uint8_t *palette);
+
+//shown color = palette + (secondary - palette) * level / FPGA_DRIVER_PALETTE_FADE_MAX
+//the fpga moves the level towards the target by speed every frame, speed 0 jumps to it at the next frame
+void fpga_driver_palette_fade(int level, int speed);
+
+//entries first..last are rotated by one every framesPerStep frames, 0 stops and restores the order. ranges must not overlap
+void fpga_driver_palette_rotate(int range, int first, int last, int framesPerStep, bool reverse);
+
+//sprites are 32x32 palette index overlays positioned in framebuffer pixels, lower sprite index is drawn on top
+//position, visibility and priority changes are sent by the driver and applied by the fpga at the next vblank
+
+//uploads the image, blocks until the driver has sent it. sprite stays hidden until fpga_driver_sprite_set_visible
+bool fpga_driver_sprite_set_image(int sprite, const uint8_t *pixels, uint8_t transparentIdx);
+
+void fpga_driver_sprite_set_position(int sprite, int x, int y);
+
+void fpga_driver_sprite_set_visible(int sprite, bool visible);
+
+void fpga_driver_sprite_set_priority(int sprite, fpga_driver_sprite_priority_t priority);
+
+//hardware scroll, framebuffer wraps around in both directions. applied by the fpga at the next vblank
+void fpga_driver_scroll_set(int x, int y);
+
+//line-start table: screen line y shows framebuffer row rows[y] (0..FRAME_HEIGHT-1) + scroll y, blocks until the driver has sent it
+bool fpga_driver_scroll_set_line_table(const uint8_t *rows, int firstLine, int lineCount);
+
+void fpga_driver_scroll_enable_line_table(bool enable);
+
+//writes whole framebuffer rows directly, bypassing fpga_driver_present_frame double buffering
+//meant for scrolling apps that only upload newly exposed lines. blocks until the driver has sent them, pixels should be DMA capable
+bool fpga_driver_framebuffer_write_rows(const uint8_t *pixels, int firstRow, int rowCount);
+
+//reads whole framebuffer rows of the displayed page as stored, packed in the 2 and 4bpp layouts
+//for screenshots and regression tests against golden frames. blocks until received, pixels should be DMA capable
+bool fpga_driver_framebuffer_read_rows(uint8_t *pixels, int firstRow, int rowCount);
+
+//blocks until the fpga has scanned out frame row `row` of the current frame, so it can be rewritten for the next one
+//writing rows just behind the beam leaves the whole frame time for uploads instead of vblank only
+//polled once per driver tick (500us, a few rows), returns at once if the row is already done
+bool fpga_driver_wait_line(int row);
+
+//blitter: fills and copies done by the fpga in the displayed page while the scanout leaves the framebuffer idle
+//x and width are in pixels and must cover whole bytes in packed layouts, fill value is a whole byte
+//blits are queued and return at once, order with direct framebuffer writes and presents is only kept by fpga_driver_blit_wait
+bool fpga_driver_blit_fill(int x, int y, int width, int height, uint8_t value);
+
+//overlapping rectangles are fine, for scrolling and moving windows
+bool fpga_driver_blit_copy(int srcX, int srcY, int dstX, int dstY, int width, int height);
+
+//blit store holds glyphs, tiles and icons for fpga_driver_blit_store_copy. blocks until sent, data should be DMA capable
+//queued store copies read the store when executed, wait for them before overwriting what they use
+bool fpga_driver_blit_store_write(int offset, const uint8_t *data, int size);
+
+//copies a width x height block from the store at offset, rows stride bytes apart. transparentIdx -1 copies every byte
+bool fpga_driver_blit_store_copy(int offset, int stride, int dstX, int dstY, int width, int height, int transparentIdx);
+
+//blocks until every queued blit has been executed
+bool fpga_driver_blit_wait(void);
+
+//crc-32 of a rectangle of the displayed page computed by the blitter, verifies an upload without reading it back
+//rows are hashed one after another as stored, compare with esp_rom_crc32_le(0, ...) over the same bytes
+//queued after pending blits and waits for all of them
+bool fpga_driver_framebuffer_crc(int x, int y, int width, int height, uint32_t *crc);
+
+//copper list: scroll and palette changes executed by the fpga during hblank, for split screens and raster effects
+//entries must be sorted by row, count 0 disables the list. blocks until the driver has sent it, takes effect at the next frame
+bool fpga_driver_copper_set_list(const fpga_driver_copper_entry_t *entries, int count);
 
 void fpga_driver_register_audio_requested_cb(fpga_driver_audio_requested_cb_t callback);
 
 void fpga_driver_hid_get_status(fpga_driver_hid_status_t *status);
 
 void fpga_driver_register_hid_event_cb(fpga_driver_hid_event_cb_t callback);
+
+//delayMs 0 disables repeat, defaults are FPGA_DRIVER_HID_KEY_REPEAT_DELAY_MS/RATE_MS
+void fpga_driver_hid_set_key_repeat(int delayMs, int rateMs);
+
+//layout used for fpga_driver_hid_key_event_t.character, default is fpga_driver_hid_layout_us
+void fpga_driver_hid_set_layout(const fpga_driver_hid_layout_t *layout);
+
+char fpga_driver_hid_key_to_char(uint8_t keyCode, uint8_t modifiers);
+
+//copies usb softcore trace events logged since the previous call, oldest first, blocks until the driver has read the ring
+//returns number of copied entries or -1 on error, lostCount (optional) is set to the number of events overwritten before they were read
+int fpga_driver_usb_trace_read(fpga_driver_usb_trace_entry_t *entries, int maxEntries, uint32_t *lostCount);
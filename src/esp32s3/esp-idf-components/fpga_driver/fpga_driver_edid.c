@@ -0,0 +1,169 @@
+#include "fpga_driver.h"
+#include <string.h>
+
+//edid 1.3/1.4 base block and cea-861 extension, only what is needed to pick an output
+
+#define EDID_BLOCK_SIZE             (128)
+#define EDID_DESCRIPTOR_SIZE        (18)
+#define EDID_DESCRIPTOR_NAME        (0xFC)
+
+#define CEA_EXTENSION_TAG           (0x02)
+#define CEA_BASIC_AUDIO             (0b01000000)
+#define CEA_BLOCK_AUDIO             (1)
+#define CEA_BLOCK_VIDEO             (2)
+#define CEA_BLOCK_VENDOR            (3)
+#define CEA_HDMI_OUI                (0x000C03)
+
+#define CEA_VIC_720P60              (4)
+#define CEA_VIC_1080P60             (16)
+
+static bool edid_checksum_ok(const uint8_t *block)
+{
+    uint8_t sum = 0;
+
+    for (int i = 0; i < EDID_BLOCK_SIZE; ++i)
+        sum += block[i];
+
+    return sum == 0;
+}
+
+static void edid_check_timing(fpga_driver_display_info_t *info, int width, int height, int refreshHz)
+{
+    if (refreshHz < 59 || refreshHz > 61)
+        return;
+
+    if (width == 1280 && height == 720)
+        info->supports720p60 = true;
+    else if (width == 1920 && height == 1080)
+        info->supports1080p60 = true;
+}
+
+static void edid_parse_descriptor(fpga_driver_display_info_t *info, const uint8_t *d)
+{
+    int pixelClock10khz = d[0] | d[1] << 8;
+
+    if (pixelClock10khz == 0) //display descriptor
+    {
+        if (d[3] == EDID_DESCRIPTOR_NAME && info->name[0] == 0)
+        {
+            for (int i = 0; i < sizeof(info->name) - 1 && d[5 + i] != '\n'; ++i)
+                info->name[i] = d[5 + i];
+        }
+
+        return;
+    }
+
+    int width = d[2] | (d[4] & 0xF0) << 4;
+    int hblank = d[3] | (d[4] & 0x0F) << 8;
+    int height = d[5] | (d[7] & 0xF0) << 4;
+    int vblank = d[6] | (d[7] & 0x0F) << 8;
+
+    int totalPixels = (width + hblank) * (height + vblank);
+    int refreshHz = totalPixels > 0 ? (int)((pixelClock10khz * 10000LL + totalPixels / 2) / totalPixels) : 0;
+
+    if (info->preferredWidth == 0) //first detailed timing is the preferred one
+    {
+        info->preferredWidth = width;
+        info->preferredHeight = height;
+        info->preferredRefreshHz = refreshHz;
+    }
+
+    edid_check_timing(info, width, height, refreshHz);
+}
+
+static void edid_parse_cea(fpga_driver_display_info_t *info, const uint8_t *block)
+{
+    int descriptorsOffset = block[2];
+
+    if (descriptorsOffset < 4 || descriptorsOffset > EDID_BLOCK_SIZE - 1)
+        descriptorsOffset = 4;
+
+    bool basicAudio = block[3] & CEA_BASIC_AUDIO;
+    bool audioBlock = false;
+
+    for (int i = 4; i < descriptorsOffset; )
+    {
+        int tag = block[i] >> 5;
+        int length = block[i] & 0x1F;
+
+        if (i + 1 + length > descriptorsOffset)
+            break;
+
+        const uint8_t *payload = block + i + 1;
+
+        if (tag == CEA_BLOCK_AUDIO)
+            audioBlock = true;
+        else if (tag == CEA_BLOCK_VIDEO)
+        {
+            for (int j = 0; j < length; ++j)
+            {
+                int vic = payload[j] & 0x7F; //bit 7 marks native formats for vic 1-64
+
+                if (vic == CEA_VIC_720P60)
+                    info->supports720p60 = true;
+                else if (vic == CEA_VIC_1080P60)
+                    info->supports1080p60 = true;
+            }
+        }
+        else if (tag == CEA_BLOCK_VENDOR && length >= 3)
+        {
+            if ((payload[0] | payload[1] << 8 | payload[2] << 16) == CEA_HDMI_OUI)
+                info->hdmi = true;
+        }
+
+        i += 1 + length;
+    }
+
+    for (int i = descriptorsOffset; i + EDID_DESCRIPTOR_SIZE <= EDID_BLOCK_SIZE - 1; i += EDID_DESCRIPTOR_SIZE)
+    {
+        if (block[i] == 0 && block[i + 1] == 0)
+            break; //padding
+
+        edid_parse_descriptor(info, block + i);
+    }
+
+    info->audio = info->hdmi && (basicAudio || audioBlock);
+}
+
+bool fpga_driver_display_parse_edid(const uint8_t *edid, int size, fpga_driver_display_info_t *info)
+{
+    static const uint8_t header[8] = { 0x00, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0x00 };
+
+    info->valid = false;
+    info->hdmi = false;
+    info->audio = false;
+    info->supports720p60 = false;
+    info->supports1080p60 = false;
+    info->preferredWidth = 0;
+    info->preferredHeight = 0;
+    info->preferredRefreshHz = 0;
+    memset(info->name, 0, sizeof(info->name));
+
+    if (size < EDID_BLOCK_SIZE || memcmp(edid, header, sizeof(header)) != 0 || !edid_checksum_ok(edid))
+        return false;
+
+    info->valid = true;
+
+    for (int i = 54; i < 54 + 4*EDID_DESCRIPTOR_SIZE; i += EDID_DESCRIPTOR_SIZE)
+        edid_parse_descriptor(info, edid + i);
+
+    //standard timings, 2 bytes each: (width/8 - 31), aspect ratio in bits 7-6 and refresh - 60 in bits 5-0
+    for (int i = 38; i < 54; i += 2)
+    {
+        if (edid[i] == 0x01 && edid[i + 1] == 0x01)
+            continue; //unused
+
+        int width = (edid[i] + 31) * 8;
+        int aspect = edid[i + 1] >> 6;
+        int height = aspect == 0 ? width * 10 / 16 : (aspect == 1 ? width * 3 / 4 : (aspect == 2 ? width * 4 / 5 : width * 9 / 16));
+
+        edid_check_timing(info, width, height, (edid[i + 1] & 0x3F) + 60);
+    }
+
+    const uint8_t *extension = edid + EDID_BLOCK_SIZE;
+
+    if (edid[126] > 0 && size >= 2*EDID_BLOCK_SIZE && extension[0] == CEA_EXTENSION_TAG && edid_checksum_ok(extension))
+        edid_parse_cea(info, extension);
+
+    return true;
+}
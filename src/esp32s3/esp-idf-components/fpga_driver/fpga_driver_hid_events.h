@@ -10,6 +10,30 @@
 
 typedef enum 
 {
+    FPGA_DRIVER_HID_KEY_CODE_ENTER          = 0x28,
+    FPGA_DRIVER_HID_KEY_CODE_ESCAPE         = 0x29,
+    FPGA_DRIVER_HID_KEY_CODE_BACKSPACE      = 0x2A,
+    FPGA_DRIVER_HID_KEY_CODE_TAB            = 0x2B,
+    FPGA_DRIVER_HID_KEY_CODE_SPACE          = 0x2C,
+    FPGA_DRIVER_HID_KEY_CODE_CAPS_LOCK      = 0x39,
+    FPGA_DRIVER_HID_KEY_CODE_F1             = 0x3A, //F1-F12 are consecutive
+    FPGA_DRIVER_HID_KEY_CODE_F12            = 0x45,
+    FPGA_DRIVER_HID_KEY_CODE_PRINT_SCREEN   = 0x46,
+    FPGA_DRIVER_HID_KEY_CODE_SCROLL_LOCK    = 0x47,
+    FPGA_DRIVER_HID_KEY_CODE_PAUSE          = 0x48,
+    FPGA_DRIVER_HID_KEY_CODE_INSERT         = 0x49,
+    FPGA_DRIVER_HID_KEY_CODE_HOME           = 0x4A,
+    FPGA_DRIVER_HID_KEY_CODE_PAGE_UP        = 0x4B,
+    FPGA_DRIVER_HID_KEY_CODE_DELETE         = 0x4C,
+    FPGA_DRIVER_HID_KEY_CODE_END            = 0x4D,
+    FPGA_DRIVER_HID_KEY_CODE_PAGE_DOWN      = 0x4E,
+    FPGA_DRIVER_HID_KEY_CODE_RIGHT          = 0x4F,
+    FPGA_DRIVER_HID_KEY_CODE_LEFT           = 0x50,
+    FPGA_DRIVER_HID_KEY_CODE_DOWN           = 0x51,
+    FPGA_DRIVER_HID_KEY_CODE_UP             = 0x52,
+    FPGA_DRIVER_HID_KEY_CODE_NUM_LOCK       = 0x53,
+    FPGA_DRIVER_HID_KEY_CODE_KEYPAD_FIRST   = 0x54,
+
     FPGA_DRIVER_HID_KEY_CODE_LEFT_CTRL      = 0xE0,
     FPGA_DRIVER_HID_KEY_CODE_LEFT_SHIFT     = 0xE1,
     FPGA_DRIVER_HID_KEY_CODE_LEFT_ALT       = 0xE2,
@@ -20,6 +44,8 @@ typedef enum
     FPGA_DRIVER_HID_KEY_CODE_RIGHT_GUI      = 0xE7,
 } fpga_driver_hid_key_codes_t;
 
+#define FPGA_DRIVER_HID_KEY_MODIFIERS_SHIFT (FPGA_DRIVER_HID_KEY_MODIFIER_LEFT_SHIFT | FPGA_DRIVER_HID_KEY_MODIFIER_RIGHT_SHIFT)
+
 typedef enum 
 {
     FPGA_DRIVER_HID_KEY_MODIFIER_LEFT_CTRL      = 1,
@@ -51,14 +77,26 @@ typedef enum
     FPGA_DRIVER_HID_EVENT_MOUSE_MOVE,
     FPGA_DRIVER_HID_EVENT_MOUSE_BUTTON_DOWN,
     FPGA_DRIVER_HID_EVENT_MOUSE_BUTTON_UP,
+    FPGA_DRIVER_HID_EVENT_KEY_REPEAT, //typematic repeat of the last pressed key, see fpga_driver_hid_set_key_repeat
 } fpga_driver_hid_event_type_t;
 
 typedef struct
 {
     uint8_t keyCode;
     uint8_t modifiers;
+    char character; //keyCode+modifiers translated with the current layout, 0 if the key has no character
 } fpga_driver_hid_key_event_t;
 
+#define FPGA_DRIVER_HID_LAYOUT_KEYS (0x64) //usage ids above the keypad have no characters
+
+typedef struct
+{
+    char normal[FPGA_DRIVER_HID_LAYOUT_KEYS];
+    char shifted[FPGA_DRIVER_HID_LAYOUT_KEYS];
+} fpga_driver_hid_layout_t;
+
+extern const fpga_driver_hid_layout_t fpga_driver_hid_layout_us;
+
 typedef struct
 {
     uint8_t buttonCode;
@@ -0,0 +1,29 @@
+#include "fpga_driver.h"
+
+//usb hid usage ids (keyboard page) to characters, keys without a character map to 0
+
+const fpga_driver_hid_layout_t fpga_driver_hid_layout_us = 
+{
+    .normal = 
+    {
+        [0x04] = 'a', 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i', 'j', 'k', 'l', 'm', 
+                 'n', 'o', 'p', 'q', 'r', 's', 't', 'u', 'v', 'w', 'x', 'y', 'z',
+        [0x1E] = '1', '2', '3', '4', '5', '6', '7', '8', '9', '0',
+        [0x28] = '\r', '\x1B', '\b', '\t', ' ',
+        [0x2D] = '-', '=', '[', ']', '\\', 0, ';', '\'', '`', ',', '.', '/',
+        [0x4C] = '\x7F',
+        [0x54] = '/', '*', '-', '+', '\r', 
+                 '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '.'
+    },
+    .shifted = 
+    {
+        [0x04] = 'A', 'B', 'C', 'D', 'E', 'F', 'G', 'H', 'I', 'J', 'K', 'L', 'M', 
+                 'N', 'O', 'P', 'Q', 'R', 'S', 'T', 'U', 'V', 'W', 'X', 'Y', 'Z',
+        [0x1E] = '!', '@', '#', '$', '%', '^', '&', '*', '(', ')',
+        [0x28] = '\r', '\x1B', '\b', '\t', ' ',
+        [0x2D] = '_', '+', '{', '}', '|', 0, ':', '"', '~', '<', '>', '?',
+        [0x4C] = '\x7F',
+        [0x54] = '/', '*', '-', '+', '\r', 
+                 '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '.'
+    }
+};
@@ -0,0 +1,91 @@
+#include "fpga_driver.h"
+#include <string.h>
+#include "esp_attr.h"
+
+//slot status layout of fpga_api_io_hid_get_all_status, see fpga_api_io.h and spi_io.sv:
+//0xAB, keyboard slots mask, mouse slots mask, slot index, mouse buttons, modifiers, 6 keys, then big endian x, y, wheel
+
+#define HID_STATUS_KEYBOARD_MASK(status)    ((status)[1])
+#define HID_STATUS_MOUSE_MASK(status)       ((status)[2])
+
+#define HID_KEY_IS_ERROR(code)              ((code) >= 1 && (code) <= 3)
+
+//merges one device slot into the combined status, mouse positions are accumulated from per-device deltas
+//so devices appearing and disappearing don't make the cursor jump
+void IRAM_ATTR fpga_driver_hid_merge_device(fpga_driver_hid_merge_t *merge, fpga_driver_hid_status_t *merged, int slot, const uint8_t *status, bool present)
+{
+    fpga_driver_hid_device_t *device = &merge->devices[slot];
+
+    if (!present)
+    {
+        *device = (fpga_driver_hid_device_t) { 0 };
+        return;
+    }
+
+    bool keyboard = HID_STATUS_KEYBOARD_MASK(status) & (1 << slot);
+    bool mouse = HID_STATUS_MOUSE_MASK(status) & (1 << slot);
+
+    int32_t mouseX = (int32_t)(status[12] << 24 | status[13] << 16 | status[14] << 8 | status[15]);
+    int32_t mouseY = (int32_t)(status[16] << 24 | status[17] << 16 | status[18] << 8 | status[19]);
+    int32_t mouseWheel = (int32_t)(status[20] << 24 | status[21] << 16 | status[22] << 8 | status[23]);
+
+    if (keyboard)
+    {
+        ++merged->keyboardCount;
+        merged->keyboardModifiers |= status[5];
+
+        //on rollover error keep the last valid keys of this device
+        bool rolloverError = false;
+
+        for (int i = 0; i < 6; ++i)
+            rolloverError |= HID_KEY_IS_ERROR(status[6 + i]);
+
+        if (!rolloverError)
+            memcpy(device->keys, &status[6], 6);
+
+        for (int i = 0; i < 6; ++i)
+        {
+            if (device->keys[i] == 0)
+                continue;
+
+            bool duplicate = false;
+            int freeIdx = -1;
+
+            for (int j = 0; j < FPGA_DRIVER_HID_MAX_KEYS; ++j)
+            {
+                if (merged->keyboardKeys[j] == device->keys[i])
+                {
+                    duplicate = true;
+                    break;
+                }
+
+                if (merged->keyboardKeys[j] == 0 && freeIdx < 0)
+                    freeIdx = j;
+            }
+
+            if (!duplicate && freeIdx >= 0)
+                merged->keyboardKeys[freeIdx] = device->keys[i];
+        }
+    }
+    else
+        memset(device->keys, 0, sizeof(device->keys));
+
+    if (mouse)
+    {
+        ++merged->mouseCount;
+        merged->mouseKeys |= status[4];
+
+        if (device->mouse)
+        {
+            merge->mouseX += mouseX - device->mouseX; //this should work even when int32 overflows
+            merge->mouseY += mouseY - device->mouseY;
+            merge->mouseWheel += mouseWheel - device->mouseWheel;
+        }
+    }
+
+    device->keyboard = keyboard;
+    device->mouse = mouse;
+    device->mouseX = mouseX;
+    device->mouseY = mouseY;
+    device->mouseWheel = mouseWheel;
+}
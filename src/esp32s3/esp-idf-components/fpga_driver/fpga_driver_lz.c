@@ -0,0 +1,316 @@
+#include "fpga_driver.h"
+#include <string.h>
+#include "esp_attr.h"
+
+//token stream of COMMAND_FRAMEBUFFER_LZ_WRITE, the decoder is in spi_gpu.sv:
+//0LLLLLLL then L+1 literal bytes, or 1LLLLLLL, 3 nibbles of distance-1 and L+FPGA_DRIVER_LZ_MIN_MATCH filler nibbles
+//during which the fpga copies a byte per clock. everything is counted in nibbles, one per sclk cycle.
+//COMMAND_FRAMEBUFFER_DELTA_WRITE shares the literals, 1SSSSSSS and 3 nibbles are a 19 bit skip-1 there
+
+#define LZ_LITERAL_MAX          (128)
+#define LZ_MATCH_MAX(minMatch)  (127 + (minMatch))
+
+//worst step flushes a full literal run and puts a match after it, plus a carried nibble
+#define LZ_STEP_MAX_BYTES(minMatch) ((1 + LZ_LITERAL_MAX) + (1 + 2 + LZ_MATCH_MAX(minMatch)/2) + 1)
+
+#define DELTA_SKIP_MAX          (1 << 19)
+#define DELTA_STEP_MAX_BYTES    ((1 + 2) + (1 + LZ_LITERAL_MAX) + 1)
+
+static inline uint32_t lz_hash(const uint8_t *p, int bits)
+{
+    uint32_t v = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+
+    return (v * 2654435761u) >> (32 - bits);
+}
+
+static inline int lz_match_length(const uint8_t *a, const uint8_t *b, int max)
+{
+    int length = 0;
+
+    while (length < max && a[length] == b[length])
+        ++length;
+
+    return length;
+}
+
+static inline void token_put_nibble(fpga_driver_token_writer_t *out, uint8_t *dst, int *size, uint8_t nibble)
+{
+    if (out->halfByte)
+        dst[(*size)++] = out->pendingNibble << 4 | (nibble & 0x0F);
+    else
+        out->pendingNibble = nibble & 0x0F;
+
+    out->halfByte = !out->halfByte;
+    out->nibbles += 1;
+}
+
+static inline void token_put_byte(fpga_driver_token_writer_t *out, uint8_t *dst, int *size, uint8_t byte)
+{
+    if (!out->halfByte)
+        dst[(*size)++] = byte;
+    else
+    {
+        dst[(*size)++] = out->pendingNibble << 4 | byte >> 4;
+        out->pendingNibble = byte & 0x0F;
+    }
+
+    out->nibbles += 2;
+}
+
+static void token_put_literals(fpga_driver_token_writer_t *out, uint8_t *dst, int *size, const uint8_t *literals, int count)
+{
+    token_put_byte(out, dst, size, count - 1);
+
+    for (int i = 0; i < count; ++i)
+        token_put_byte(out, dst, size, literals[i]);
+}
+
+//a lone trailing nibble is taken as half of a header that never completes
+static void token_finish(fpga_driver_token_writer_t *out, uint8_t *dst, int *size)
+{
+    if (out->halfByte)
+        token_put_nibble(out, dst, size, 0);
+}
+
+static void token_init(fpga_driver_token_writer_t *out)
+{
+    out->halfByte = false;
+    out->pendingNibble = 0;
+    out->nibbles = 0;
+}
+
+static void lz_flush_literals(fpga_driver_lz_encoder_t *lz, uint8_t *dst, int *size)
+{
+    int count = lz->pos - lz->literalStart;
+
+    if (count <= 0)
+        return;
+
+    token_put_literals(&lz->out, dst, size, lz->src + lz->literalStart, count);
+
+    lz->literalStart = lz->pos;
+}
+
+static void lz_put_match(fpga_driver_lz_encoder_t *lz, uint8_t *dst, int *size, int distance, int length)
+{
+    token_put_byte(&lz->out, dst, size, 0x80 | (length - lz->minMatch));
+
+    token_put_nibble(&lz->out, dst, size, (distance - 1) >> 8);
+    token_put_nibble(&lz->out, dst, size, (distance - 1) >> 4);
+    token_put_nibble(&lz->out, dst, size, distance - 1);
+
+    //the fpga copies while these go by
+    for (; length >= 2; length -= 2)
+        token_put_byte(&lz->out, dst, size, 0);
+
+    if (length > 0)
+        token_put_nibble(&lz->out, dst, size, 0);
+}
+
+void fpga_driver_lz_init_params(fpga_driver_lz_encoder_t *lz, const uint8_t *src, int size, int rowBytes, int minMatch, int hashBits, int window, int32_t *hash)
+{
+    lz->src = src;
+    lz->size = size;
+    lz->rowBytes = rowBytes;
+    lz->pos = 0;
+    lz->literalStart = 0;
+    lz->minMatch = minMatch;
+    lz->hashBits = hashBits;
+    lz->window = window;
+    lz->hash = hash;
+    token_init(&lz->out);
+
+    if (hashBits > 0)
+        memset(hash, 0xFF, sizeof(int32_t) << hashBits);
+}
+
+void fpga_driver_lz_init(fpga_driver_lz_encoder_t *lz, const uint8_t *src, int size, int rowBytes)
+{
+    fpga_driver_lz_init_params(lz, src, size, rowBytes, FPGA_DRIVER_LZ_MIN_MATCH, FPGA_DRIVER_LZ_HASH_BITS, FPGA_DRIVER_LZ_WINDOW, lz->hashTable);
+}
+
+//greedy: the best of the last byte repeated, the row above and the last position with the same 4 bytes.
+//a match of length n costs 5+n cycles against 2n as literals, shorter ones than FPGA_DRIVER_LZ_MIN_MATCH never pay off
+IRAM_ATTR int fpga_driver_lz_encode(fpga_driver_lz_encoder_t *lz, uint8_t *dst, int dstSize)
+{
+    int size = 0;
+
+    if (fpga_driver_lz_done(lz))
+        return 0;
+
+    const uint8_t *src = lz->src;
+    const int minMatch = lz->minMatch, matchMax = LZ_MATCH_MAX(minMatch), stepMaxBytes = LZ_STEP_MAX_BYTES(minMatch);
+
+    while (lz->pos < lz->size && size + stepMaxBytes <= dstSize)
+    {
+        int pos = lz->pos;
+        int max = lz->size - pos < matchMax ? lz->size - pos : matchMax;
+
+        int bestLength = 0, bestDistance = 0;
+
+        if (max >= minMatch)
+        {
+            int candidates[3] = { 1, lz->rowBytes, 0 };
+
+            if (lz->hashBits > 0)
+            {
+                uint32_t h = lz_hash(src + pos, lz->hashBits);
+
+                if (lz->hash[h] >= 0)
+                    candidates[2] = pos - lz->hash[h];
+
+                lz->hash[h] = pos;
+            }
+
+            for (int i = 0; i < 3; ++i)
+            {
+                int distance = candidates[i];
+
+                if (distance <= 0 || distance > pos || distance > lz->window || distance == bestDistance)
+                    continue;
+
+                int length = lz_match_length(src + pos, src + pos - distance, max);
+
+                if (length > bestLength)
+                {
+                    bestLength = length;
+                    bestDistance = distance;
+                }
+            }
+        }
+
+        if (bestLength >= minMatch)
+        {
+            lz_flush_literals(lz, dst, &size);
+            lz_put_match(lz, dst, &size, bestDistance, bestLength);
+
+            lz->pos += bestLength;
+            lz->literalStart = lz->pos;
+        }
+        else
+        {
+            ++lz->pos;
+
+            if (lz->pos - lz->literalStart == LZ_LITERAL_MAX)
+                lz_flush_literals(lz, dst, &size);
+        }
+    }
+
+    if (lz->pos >= lz->size && size + stepMaxBytes <= dstSize)
+    {
+        lz_flush_literals(lz, dst, &size);
+        token_finish(&lz->out, dst, &size);
+
+        lz->literalStart = -1; //done
+    }
+
+    return size;
+}
+
+bool fpga_driver_lz_done(const fpga_driver_lz_encoder_t *lz)
+{
+    return lz->literalStart < 0;
+}
+
+static void delta_put_skip(fpga_driver_delta_encoder_t *delta, uint8_t *dst, int *size, int count)
+{
+    count -= 1;
+
+    token_put_byte(&delta->out, dst, size, 0x80 | count >> 12);
+    token_put_nibble(&delta->out, dst, size, count >> 8);
+    token_put_nibble(&delta->out, dst, size, count >> 4);
+    token_put_nibble(&delta->out, dst, size, count);
+}
+
+//first word at or after pos that differs, bytes only in the tail after the last whole word.
+//4 words per step are or-ed together before the branch, the same shape a 128 bit simd compare would take
+static inline int delta_find_change(const uint8_t *src, const uint8_t *shadow, int pos, int size)
+{
+    const uint32_t *a = (const uint32_t*)src, *b = (const uint32_t*)shadow; //both word aligned
+
+    for (; pos + 16 <= size; pos += 16)
+    {
+        int w = pos / 4;
+
+        if (((a[w] ^ b[w]) | (a[w+1] ^ b[w+1]) | (a[w+2] ^ b[w+2]) | (a[w+3] ^ b[w+3])) != 0)
+            break;
+    }
+
+    for (; pos + 4 <= size && a[pos/4] == b[pos/4]; pos += 4)
+        ;
+
+    if (pos + 4 > size) //bytes of the tail, a run always starts word aligned before it
+        for (; pos < size && src[pos] == shadow[pos]; ++pos)
+            ;
+
+    return pos;
+}
+
+//end of a literal run starting at pos: a whole equal word is worth a skip (5 nibbles and a new header against 8 nibbles of literals)
+static inline int delta_find_same(const uint8_t *src, const uint8_t *shadow, int pos, int size)
+{
+    const uint32_t *a = (const uint32_t*)src, *b = (const uint32_t*)shadow;
+
+    int max = size - pos < LZ_LITERAL_MAX ? size : pos + LZ_LITERAL_MAX;
+
+    if (pos % 4 != 0) //unaligned tail only
+        return max;
+
+    for (; pos + 4 <= max && a[pos/4] != b[pos/4]; pos += 4)
+        ;
+
+    return pos + 4 <= max ? pos : max;
+}
+
+void fpga_driver_delta_init(fpga_driver_delta_encoder_t *delta, const uint8_t *src, uint8_t *shadow, int size)
+{
+    delta->src = src;
+    delta->shadow = shadow;
+    delta->size = size;
+    delta->pos = 0;
+    delta->done = false;
+
+    token_init(&delta->out);
+}
+
+IRAM_ATTR int fpga_driver_delta_encode(fpga_driver_delta_encoder_t *delta, uint8_t *dst, int dstSize)
+{
+    int size = 0;
+
+    if (delta->done)
+        return 0;
+
+    while (delta->pos < delta->size && size + DELTA_STEP_MAX_BYTES <= dstSize)
+    {
+        int pos = delta_find_change(delta->src, delta->shadow, delta->pos, delta->size);
+
+        if (pos >= delta->size)
+        {
+            delta->pos = pos; //unchanged until the end, nothing to send
+            break;
+        }
+
+        for (int skip = pos - delta->pos; skip > 0; skip -= DELTA_SKIP_MAX)
+            delta_put_skip(delta, dst, &size, skip > DELTA_SKIP_MAX ? DELTA_SKIP_MAX : skip);
+
+        int end = delta_find_same(delta->src, delta->shadow, pos, delta->size);
+
+        token_put_literals(&delta->out, dst, &size, delta->src + pos, end - pos);
+        memcpy(delta->shadow + pos, delta->src + pos, end - pos);
+
+        delta->pos = end;
+    }
+
+    if (delta->pos >= delta->size && size + 1 <= dstSize)
+    {
+        token_finish(&delta->out, dst, &size);
+        delta->done = true;
+    }
+
+    return size;
+}
+
+bool fpga_driver_delta_done(const fpga_driver_delta_encoder_t *delta)
+{
+    return delta->done;
+}
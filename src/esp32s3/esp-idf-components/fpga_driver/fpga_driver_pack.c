@@ -0,0 +1,45 @@
+#include "fpga_driver.h"
+#include "esp_attr.h"
+
+//8 pixels per iteration, all of them are loaded before storing so that dst can alias src
+
+void IRAM_ATTR fpga_driver_pack_4bpp(uint8_t *dst, const uint8_t *src, int pixelCount)
+{
+    for (; pixelCount >= 8; pixelCount -= 8, src += 8, dst += 4)
+    {
+        uint8_t b0 = (src[0] << 4) | (src[1] & 0x0F);
+        uint8_t b1 = (src[2] << 4) | (src[3] & 0x0F);
+        uint8_t b2 = (src[4] << 4) | (src[5] & 0x0F);
+        uint8_t b3 = (src[6] << 4) | (src[7] & 0x0F);
+
+        dst[0] = b0;
+        dst[1] = b1;
+        dst[2] = b2;
+        dst[3] = b3;
+    }
+
+    for (int i = 0; i < pixelCount; i += 2)
+        dst[i/2] = (src[i] << 4) | (i + 1 < pixelCount ? src[i+1] & 0x0F : 0);
+}
+
+void IRAM_ATTR fpga_driver_pack_2bpp(uint8_t *dst, const uint8_t *src, int pixelCount)
+{
+    for (; pixelCount >= 8; pixelCount -= 8, src += 8, dst += 2)
+    {
+        uint8_t b0 = (src[0] << 6) | ((src[1] & 0x03) << 4) | ((src[2] & 0x03) << 2) | (src[3] & 0x03);
+        uint8_t b1 = (src[4] << 6) | ((src[5] & 0x03) << 4) | ((src[6] & 0x03) << 2) | (src[7] & 0x03);
+
+        dst[0] = b0;
+        dst[1] = b1;
+    }
+
+    for (int i = 0; i < pixelCount; i += 4)
+    {
+        uint8_t b = 0;
+
+        for (int j = 0; j < 4 && i + j < pixelCount; ++j)
+            b |= (src[i+j] & 0x03) << (6 - 2*j);
+
+        dst[i/4] = b;
+    }
+}
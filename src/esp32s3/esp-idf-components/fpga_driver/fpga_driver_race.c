@@ -0,0 +1,30 @@
+#include "fpga_driver.h"
+#include "esp_attr.h"
+
+//beam racing: the claim happens at a vblank, rows of the presented frame are uploaded once the frame after it
+//has scanned them out, so that frame still shows the previous one whole. rows_done is cleared at the next vblank
+//together with the frame counter advancing, from then on every row is free
+
+void IRAM_ATTR fpga_driver_race_start(fpga_driver_race_t *race, uint16_t frameCounter)
+{
+    race->row = 0;
+    race->frame = frameCounter;
+}
+
+int IRAM_ATTR fpga_driver_race_free_rows(const fpga_driver_race_t *race, uint16_t frameCounter, int rowsDone, int height)
+{
+    if (frameCounter != race->frame || rowsDone > height)
+        return height;
+
+    return rowsDone;
+}
+
+bool IRAM_ATTR fpga_driver_race_can_finish(const fpga_driver_race_t *race, uint16_t frameCounter, bool vblank, int height)
+{
+    return race->row >= height && frameCounter != race->frame && vblank;
+}
+
+bool IRAM_ATTR fpga_driver_race_palette_fits(int line, int screenLines, int totalLines, int paletteLines)
+{
+    return line >= screenLines && totalLines - line > paletteLines;
+}
@@ -0,0 +1,4 @@
+#pragma once
+
+//host builds of the driver's pure logic, see run.sh
+#define IRAM_ATTR
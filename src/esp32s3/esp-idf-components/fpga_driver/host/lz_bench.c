@@ -0,0 +1,593 @@
+//COMMAND_FRAMEBUFFER_LZ_WRITE over game frames: sclk cycles against a raw quad upload, the choice of
+//FPGA_DRIVER_LZ_MIN_MATCH and FPGA_DRIVER_LZ_HASH_BITS, and at which link clocks the encoder can keep up.
+//frames are 8 bit pcx screenshots as doom (F1 with -devparm, or the screenshot key) and quake (screenshot command)
+//write them, or raw 320x200 / 320x240 index dumps, given on the command line. without any, synthetic frames in the
+//style of both are rendered: textured walls, floors and ceilings through 16 shade colormap ramps and a status bar.
+//every stream of fpga_driver_lz.c is decoded by a model of the spi_gpu decoder, which must give the frame back in
+//exactly the cycles the encoder counted. the parameter sweep runs the same encoder through fpga_driver_lz_init_params
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include "fpga_driver.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_TSC 1
+#endif
+
+#define FRAME_MAX_BYTES (320*240)
+#define MAX_FRAMES 64
+#define PIECE_BYTES 4096    //FPGA_DRIVER_UPLOAD_PIECE_SIZE_BYTES
+#define STREAM_MAX_BYTES (FRAME_MAX_BYTES*2 + PIECE_BYTES)
+#define CPU_MHZ 240.0
+
+typedef struct
+{
+    char name[64];
+    const char *set;
+    int width, height;
+    uint8_t pixels[FRAME_MAX_BYTES];
+} frame_t;
+
+static frame_t frames[MAX_FRAMES];
+static int frame_count = 0;
+
+static int errors = 0;
+
+static void fail(const char *fmt, const char *name, long a, long b)
+{
+    if (errors++ < 16)
+    {
+        printf("FAIL: %s: ", name);
+        printf(fmt, a, b);
+        printf("\n");
+    }
+}
+
+//frame dumps
+//
+
+static frame_t *frame_new(const char *set, const char *name, int width, int height)
+{
+    if (frame_count >= MAX_FRAMES || width * height > FRAME_MAX_BYTES)
+        return NULL;
+
+    frame_t *frame = &frames[frame_count++];
+
+    snprintf(frame->name, sizeof(frame->name), "%s", name);
+    frame->set = set;
+    frame->width = width;
+    frame->height = height;
+
+    return frame;
+}
+
+static const char *base_name(const char *path)
+{
+    const char *slash = strrchr(path, '/');
+
+    return slash ? slash + 1 : path;
+}
+
+//8 bit single plane rle pcx, the palette at the end is not needed
+static bool load_pcx(const char *path, const uint8_t *data, long size)
+{
+    if (size < 128 || data[0] != 0x0A || data[2] != 1 || data[3] != 8 || data[65] != 1)
+        return false;
+
+    int width = (data[8] | data[9] << 8) - (data[4] | data[5] << 8) + 1;
+    int height = (data[10] | data[11] << 8) - (data[6] | data[7] << 8) + 1;
+    int bytesPerLine = data[66] | data[67] << 8;
+
+    frame_t *frame = frame_new("dump", base_name(path), width, height);
+
+    if (frame == NULL || bytesPerLine < width)
+        return false;
+
+    long in = 128;
+
+    for (int y = 0; y < height; ++y)
+        for (int x = 0; x < bytesPerLine; )
+        {
+            if (in >= size)
+                return false;
+
+            int count = 1;
+            uint8_t value = data[in++];
+
+            if ((value & 0xC0) == 0xC0 && in < size)
+            {
+                count = value & 0x3F;
+                value = data[in++];
+            }
+
+            for (; count > 0 && x < bytesPerLine; --count, ++x)
+                if (x < width)
+                    frame->pixels[y * width + x] = value;
+        }
+
+    return true;
+}
+
+static bool load_frame(const char *path)
+{
+    static uint8_t data[1 << 20];
+    FILE *f = fopen(path, "rb");
+
+    if (f == NULL)
+        return false;
+
+    long size = (long)fread(data, 1, sizeof(data), f);
+
+    fclose(f);
+
+    if (size == 320*200 || size == 320*240)
+    {
+        frame_t *frame = frame_new("dump", base_name(path), 320, (int)size / 320);
+
+        if (frame == NULL)
+            return false;
+
+        memcpy(frame->pixels, data, size);
+        return true;
+    }
+
+    return load_pcx(path, data, size);
+}
+
+//synthetic frames: a grid map ray cast like wolf3d/doom, palette indices are ramp*16 + shade as in the doom and
+//quake colormaps, textures are procedural
+//
+
+static uint32_t noise(int x, int y, int seed)
+{
+    uint32_t h = (uint32_t)x * 374761393u + (uint32_t)y * 668265263u + (uint32_t)seed * 2246822519u;
+
+    h = (h ^ (h >> 13)) * 1274126177u;
+    return h ^ (h >> 16);
+}
+
+static const char world[16][17] = {
+    "################",
+    "#......#.......#",
+    "#..##..#..###..#",
+    "#..##.....#....#",
+    "#.........#..#.#",
+    "####..#####..#.#",
+    "#..............#",
+    "#..#...##...#..#",
+    "#..#...##...#..#",
+    "#..............#",
+    "#.####..####...#",
+    "#......##......#",
+    "#..#........#..#",
+    "#..###....###..#",
+    "#..............#",
+    "################",
+};
+
+static int shade_index(int ramp, int detail, double shade)
+{
+    int s = detail + (int)shade;
+
+    return ramp * 16 + (s < 0 ? 0 : (s > 15 ? 15 : s));
+}
+
+//doom: banded light diminishing, large bricks and flats with little detail.
+//quake: smooth lightmaps, noisier textures
+static void render_view(frame_t *frame, int viewHeight, double px, double py, double angle, bool quake)
+{
+    int width = frame->width;
+    double dx = cos(angle), dy = sin(angle);
+    double planeX = -dy * 0.66, planeY = dx * 0.66;
+
+    for (int x = 0; x < width; ++x)
+    {
+        double camera = 2.0 * x / width - 1;
+        double rx = dx + planeX * camera, ry = dy + planeY * camera;
+        int mx = (int)px, my = (int)py;
+        double ddx = fabs(1 / rx), ddy = fabs(1 / ry);
+        int sx = rx < 0 ? -1 : 1, sy = ry < 0 ? -1 : 1;
+        double sideX = (rx < 0 ? px - mx : mx + 1 - px) * ddx;
+        double sideY = (ry < 0 ? py - my : my + 1 - py) * ddy;
+        int side = 0;
+
+        while (world[my][mx] != '#')
+        {
+            if (sideX < sideY)
+            {
+                sideX += ddx;
+                mx += sx;
+                side = 0;
+            }
+            else
+            {
+                sideY += ddy;
+                my += sy;
+                side = 1;
+            }
+        }
+
+        double dist = side == 0 ? sideX - ddx : sideY - ddy;
+        double hitX = side == 0 ? py + dist * ry : px + dist * rx;
+        int texX = (int)((hitX - floor(hitX)) * 64);
+        int lineHeight = (int)(viewHeight / (dist > 0.05 ? dist : 0.05));
+        int top = viewHeight / 2 - lineHeight / 2;
+        int ramp = 1 + (mx * 7 + my * 3) % 5;
+
+        for (int y = 0; y < viewHeight; ++y)
+        {
+            uint8_t *pixel = &frame->pixels[y * width + x];
+
+            if (y >= top && y < top + lineHeight)
+            {
+                int texY = (y - top) * 64 / lineHeight;
+                int brick = (texY / 16) * 8 + ((texX + ((texY / 16) & 1) * 16) / 32);
+                bool mortar = texY % 16 == 0 || (texX + ((texY / 16) & 1) * 16) % 32 == 0;
+                int detail = mortar ? 9 : (quake ? (int)(noise(texX, texY, ramp) % 5) : (int)(noise(brick, 0, ramp) % 3));
+                double shade;
+
+                if (quake) //smooth lightmap across the wall
+                {
+                    double wx = mx + texX / 64.0, wy = texY / 64.0;
+                    shade = 3 + 4 * sin(wx * 1.3 + wy * 2.1) * cos(wy * 0.7) + dist * 0.8;
+                }
+                else
+                    shade = (int)(dist * 1.5) + side;
+
+                *pixel = shade_index(ramp, detail, shade);
+            }
+            else
+            {
+                bool floorRow = y > viewHeight / 2;
+                double rowDist = viewHeight / (2.0 * (floorRow ? y - viewHeight / 2 : viewHeight / 2 - y) + 1);
+                double fx = px + rowDist * rx, fy = py + rowDist * ry;
+                int tx = (int)(fx * 64) & 63, ty = (int)(fy * 64) & 63;
+                int detail = (((tx / 32) ^ (ty / 32)) & 1) * 2 + (quake ? (int)(noise(tx, ty, 99) % 4) : (int)(noise(tx / 8, ty / 8, 7) % 2));
+                double shade = quake ? 2 + rowDist * 0.9 + 2 * sin(fx * 0.9) : (int)(rowDist * 1.5);
+
+                *pixel = shade_index(floorRow ? 7 : 8, detail, shade);
+            }
+        }
+    }
+}
+
+//status bar: mostly the same every frame, the numbers change
+static void render_bar(frame_t *frame, int top, int frameIdx)
+{
+    for (int y = top; y < frame->height; ++y)
+        for (int x = 0; x < frame->width; ++x)
+        {
+            bool border = y == top || x % 64 == 0;
+            bool digit = x % 64 > 8 && x % 64 < 40 && y > top + 6 && y < frame->height - 6;
+            int detail = border ? 12 : (int)(noise(x / 2, y / 2, 5) % 3);
+
+            if (digit && ((noise(x / 6, y / 8, frameIdx * 13 + x / 64) & 3) == 0))
+                detail = 14;
+
+            frame->pixels[y * frame->width + x] = shade_index(digit ? 10 : 9, detail, 0);
+        }
+}
+
+static void render_synthetic(void)
+{
+    for (int i = 0; i < 8; ++i)
+    {
+        char name[32];
+        double px = 1.5 + (i * 1.7) - floor((i * 1.7) / 13) * 13, py = 6.5;
+        double angle = i * 0.8;
+
+        snprintf(name, sizeof(name), "doom-style %d", i);
+        frame_t *frame = frame_new("synthetic doom-style 320x200", name, 320, 200);
+        render_view(frame, 168, px, py, angle, false);
+        render_bar(frame, 168, i);
+
+        snprintf(name, sizeof(name), "quake-style %d", i);
+        frame = frame_new("synthetic quake-style 320x240", name, 320, 240);
+        render_view(frame, 192, px, py + 3, angle + 0.4, true);
+        render_bar(frame, 192, i);
+    }
+}
+
+//model of the spi_gpu decoder: header nibbles, literal bytes, 3 distance nibbles and a byte per clock of copy.
+//returns the nibbles taken up to the last pixel, -1 if the stream is broken
+//
+
+static int decode(const uint8_t *stream, int streamBytes, uint8_t *out, int size, int minMatch, int window)
+{
+    int nibble = 0, pos = 0;
+
+#define NEXT_NIBBLE() (nibble / 2 < streamBytes ? (nibble++ & 1 ? stream[nibble / 2 - 1] & 0x0F : stream[nibble / 2] >> 4) : -1)
+
+    while (pos < size)
+    {
+        int high = NEXT_NIBBLE(), low = NEXT_NIBBLE();
+
+        if (high < 0 || low < 0)
+            return -1;
+
+        int header = high << 4 | low;
+
+        if (!(header & 0x80))
+        {
+            for (int i = 0; i <= header; ++i)
+            {
+                int h = NEXT_NIBBLE(), l = NEXT_NIBBLE();
+
+                if (h < 0 || l < 0 || pos >= size)
+                    return -1;
+
+                out[pos++] = h << 4 | l;
+            }
+        }
+        else
+        {
+            int distance = 1;
+
+            for (int i = 0; i < 3; ++i)
+            {
+                int n = NEXT_NIBBLE();
+
+                if (n < 0)
+                    return -1;
+
+                distance += n << (4 * (2 - i));
+            }
+
+            if (distance > pos || distance > window)
+                return -1;
+
+            for (int i = 0; i < (header & 0x7F) + minMatch; ++i)
+            {
+                if (NEXT_NIBBLE() < 0 || pos >= size)
+                    return -1;
+
+                out[pos] = out[pos - distance];
+                ++pos;
+            }
+        }
+    }
+
+#undef NEXT_NIBBLE
+
+    return nibble;
+}
+
+//fpga_driver_lz.c as the driver runs it, 4 KB pieces
+static int encode_driver(const frame_t *frame, uint8_t *stream, int *nibbles)
+{
+    static fpga_driver_lz_encoder_t lz;
+    int size = 0;
+
+    fpga_driver_lz_init(&lz, frame->pixels, frame->width * frame->height, frame->width);
+
+    while (!fpga_driver_lz_done(&lz))
+        size += fpga_driver_lz_encode(&lz, stream + size, PIECE_BYTES);
+
+    *nibbles = lz.out.nibbles;
+    return size;
+}
+
+//the same encoder with other constants, hashBits 0 leaves the hash candidate out
+static int encode_params(const frame_t *frame, uint8_t *stream, int minMatch, int hashBits, int *nibbles)
+{
+    static fpga_driver_lz_encoder_t lz;
+    static int32_t hash[1 << 16];
+    int size = 0;
+
+    fpga_driver_lz_init_params(&lz, frame->pixels, frame->width * frame->height, frame->width, minMatch, hashBits, FPGA_DRIVER_LZ_WINDOW, hash);
+
+    while (!fpga_driver_lz_done(&lz))
+        size += fpga_driver_lz_encode(&lz, stream + size, PIECE_BYTES);
+
+    *nibbles = lz.out.nibbles;
+    return size;
+}
+
+static double now_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+//sets are printed in the order they first appear
+static const char *sets[MAX_FRAMES];
+static int set_count = 0;
+
+static void collect_sets(void)
+{
+    for (int i = 0; i < frame_count; ++i)
+    {
+        int s = 0;
+
+        while (s < set_count && strcmp(sets[s], frames[i].set) != 0)
+            ++s;
+
+        if (s == set_count)
+            sets[set_count++] = frames[i].set;
+    }
+}
+
+//raw cycles over lz cycles of a set, pooled over its frames
+static double set_percent(int s, int minMatch, int hashBits)
+{
+    static uint8_t stream[STREAM_MAX_BYTES], decoded[FRAME_MAX_BYTES];
+    long raw = 0, lz = 0;
+
+    for (int i = 0; i < frame_count; ++i)
+    {
+        if (strcmp(frames[i].set, sets[s]) != 0)
+            continue;
+
+        int nibbles;
+
+        int streamBytes = encode_params(&frames[i], stream, minMatch, hashBits, &nibbles);
+
+        if (decode(stream, streamBytes, decoded, frames[i].width * frames[i].height, minMatch, FPGA_DRIVER_LZ_WINDOW) < 0 ||
+            memcmp(decoded, frames[i].pixels, frames[i].width * frames[i].height) != 0)
+            fail("min match %ld, %ld hash bits: stream does not decode back to the frame", frames[i].name, minMatch, hashBits);
+
+        raw += frames[i].width * frames[i].height * 2;
+        lz += nibbles;
+    }
+
+    return 100.0 * lz / raw;
+}
+
+int main(int argc, char **argv)
+{
+    static uint8_t stream[STREAM_MAX_BYTES], decoded[FRAME_MAX_BYTES];
+
+    for (int i = 1; i < argc; ++i)
+        if (!load_frame(argv[i]))
+            printf("skipped %s: not an 8 bit pcx or a raw 320x200/320x240 dump\n", argv[i]);
+
+    if (frame_count == 0)
+    {
+        printf("no frame dumps given, synthetic frames only: numbers below are not doom or quake content\n");
+        render_synthetic();
+    }
+
+    collect_sets();
+
+    //round trip and per frame cycles
+    double encodeNs = 0;
+    double encodeCycles = 0;
+    long encodedBytes = 0;
+    long lzNibbles[MAX_FRAMES];
+
+    for (int i = 0; i < frame_count; ++i)
+    {
+        frame_t *frame = &frames[i];
+        int size = frame->width * frame->height;
+        int nibbles;
+
+        int streamBytes = encode_driver(frame, stream, &nibbles);
+
+        int cycles = decode(stream, streamBytes, decoded, size, FPGA_DRIVER_LZ_MIN_MATCH, FPGA_DRIVER_LZ_WINDOW);
+
+        //a lone last nibble is padded to a byte, the decoder is done before it
+        if (cycles < 0 || nibbles != streamBytes * 2 || nibbles - cycles > 1)
+            fail("decoder took %ld cycles, encoder counted %ld", frame->name, cycles, nibbles);
+        else if (memcmp(decoded, frame->pixels, size) != 0)
+            fail("decoded frame differs%.0ld%.0ld", frame->name, 0, 0);
+
+        lzNibbles[i] = nibbles;
+
+        //encode speed, best of a few runs
+        double best = 1e18, bestCycles = 0;
+
+        for (int run = 0; run < 5; ++run)
+        {
+            double start = now_ns();
+#ifdef HAVE_TSC
+            unsigned long long tsc = __rdtsc();
+#endif
+            encode_driver(frame, stream, &nibbles);
+#ifdef HAVE_TSC
+            double cycles = (double)(__rdtsc() - tsc);
+#else
+            double cycles = 0;
+#endif
+            double ns = now_ns() - start;
+
+            if (ns < best)
+            {
+                best = ns;
+                bestCycles = cycles;
+            }
+        }
+
+        encodeNs += best;
+        encodeCycles += bestCycles;
+        encodedBytes += size;
+    }
+
+    printf("\n%-32s  %6s  %12s  %12s  %12s\n", "frames", "count", "lz/raw mean", "best", "worst");
+
+    for (int s = 0; s < set_count; ++s)
+    {
+        double sum = 0, best = 1e9, worst = 0;
+        int count = 0;
+
+        for (int i = 0; i < frame_count; ++i)
+        {
+            if (strcmp(frames[i].set, sets[s]) != 0)
+                continue;
+
+            double percent = 100.0 * lzNibbles[i] / (frames[i].width * frames[i].height * 2);
+
+            sum += percent;
+            best = percent < best ? percent : best;
+            worst = percent > worst ? percent : worst;
+            ++count;
+        }
+
+        printf("%-32s  %6d  %11.1f%%  %11.1f%%  %11.1f%%\n", sets[s], count, sum / count, best, worst);
+    }
+
+    //FPGA_DRIVER_LZ_MIN_MATCH: a match of n costs 5+n cycles against 2n as literals and splits the literal run,
+    //FPGA_DRIVER_LZ_HASH_BITS: 4 bytes of internal ram per entry, cleared for every frame
+    static const int minMatches[] = { 4, 5, 6, 7, 8 };
+    static const int hashBits[] = { 0, 8, 10, 12, 14 };
+
+    for (int s = 0; s < set_count; ++s)
+    {
+        printf("\n%s, lz cycles in %% of raw, driver uses min match %d and %d hash bits\n", sets[s], FPGA_DRIVER_LZ_MIN_MATCH, FPGA_DRIVER_LZ_HASH_BITS);
+        printf("%-10s", "min match");
+
+        for (unsigned h = 0; h < sizeof(hashBits) / sizeof(hashBits[0]); ++h)
+        {
+            char label[32];
+
+            snprintf(label, sizeof(label), hashBits[h] ? "%d bits %dK" : "no hash", hashBits[h], (4 << hashBits[h]) / 1024);
+            printf("  %12s", label);
+        }
+
+        printf("\n");
+
+        for (unsigned m = 0; m < sizeof(minMatches) / sizeof(minMatches[0]); ++m)
+        {
+            printf("%-10d", minMatches[m]);
+
+            for (unsigned h = 0; h < sizeof(hashBits) / sizeof(hashBits[0]); ++h)
+                printf("  %11.1f%%", set_percent(s, minMatches[m], hashBits[h]));
+
+            printf("\n");
+        }
+    }
+
+    //enable: the encoder runs while the previous piece is on the wire, a frame takes the longer of the two.
+    //it only pays while encoding a byte takes fewer cpu cycles than sending it raw
+    double hostNsPerByte = encodeNs / encodedBytes;
+    long raw = 0, lz = 0;
+
+    for (int i = 0; i < frame_count; ++i)
+    {
+        raw += frames[i].width * frames[i].height * 2;
+        lz += lzNibbles[i];
+    }
+
+    printf("\nencoder on this host: %.2f ns per byte", hostNsPerByte);
+#ifdef HAVE_TSC
+    printf(", %.1f tsc cycles per byte", encodeCycles / encodedBytes);
+#endif
+    printf("\n%-8s  %14s  %14s  %24s\n", "link", "raw us/frame", "lz wire us", "cpu cycles/byte to match");
+
+    for (int mhz = 80; mhz >= 20; mhz /= 2)
+    {
+        double rawUs = (double)raw / frame_count / mhz;
+        double lzUs = (double)lz / frame_count / mhz;
+        double budget = rawUs * CPU_MHZ / ((double)raw / 2 / frame_count);
+
+        printf("%3d MHz   %14.0f  %14.0f  %24.1f\n", mhz, rawUs, lzUs, budget);
+    }
+
+    printf(errors ? "FAIL\n" : "PASS\n");
+    return errors ? 1 : 0;
+}
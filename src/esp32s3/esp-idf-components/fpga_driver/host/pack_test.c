@@ -0,0 +1,69 @@
+//pack kernels of fpga_driver_pack.c against a per pixel reference, every pixel count from 0 to 40 so that each
+//tail length of both the 8 pixel loop and the partial last byte is hit. checks the bytes written, zero padding
+//of a partial last byte, nothing written past it and packing in place with dst aliasing src. run.sh builds it
+//with -fsanitize=undefined, a shift by a negative amount stops it
+
+#include <stdio.h>
+#include <string.h>
+#include "fpga_driver.h"
+
+#define MAX_PIXELS 40
+#define CANARY 0xA5
+
+static void reference(uint8_t *dst, const uint8_t *src, int pixelCount, int bits)
+{
+    int perByte = 8 / bits;
+
+    memset(dst, 0, (pixelCount + perByte - 1) / perByte);
+
+    for (int i = 0; i < pixelCount; ++i)
+        dst[i / perByte] |= (src[i] & ((1 << bits) - 1)) << (8 - bits - bits * (i % perByte));
+}
+
+int main(void)
+{
+    uint8_t src[MAX_PIXELS], expected[MAX_PIXELS], packed[MAX_PIXELS + 1], inPlace[MAX_PIXELS + 1];
+    int errors = 0;
+
+    for (int i = 0; i < MAX_PIXELS; ++i)
+        src[i] = (uint8_t)(i * 37 + 11); //high bits set too, they must be dropped
+
+    for (int bits = 2; bits <= 4; bits += 2)
+        for (int count = 0; count <= MAX_PIXELS; ++count)
+        {
+            int bytes = (count * bits + 7) / 8;
+
+            reference(expected, src, count, bits);
+
+            memset(packed, CANARY, sizeof(packed));
+            memcpy(inPlace, src, MAX_PIXELS);
+            inPlace[MAX_PIXELS] = CANARY;
+
+            if (bits == 4)
+            {
+                fpga_driver_pack_4bpp(packed, src, count);
+                fpga_driver_pack_4bpp(inPlace, inPlace, count);
+            }
+            else
+            {
+                fpga_driver_pack_2bpp(packed, src, count);
+                fpga_driver_pack_2bpp(inPlace, inPlace, count);
+            }
+
+            if (memcmp(packed, expected, bytes) != 0 || memcmp(inPlace, expected, bytes) != 0)
+            {
+                printf("FAIL: %dbpp, %d pixels packed wrong\n", bits, count);
+                ++errors;
+            }
+
+            if (packed[bytes] != CANARY || memcmp(inPlace + bytes, src + bytes, MAX_PIXELS - bytes) != 0)
+            {
+                printf("FAIL: %dbpp, %d pixels wrote past %d bytes\n", bits, count, bytes);
+                ++errors;
+            }
+        }
+
+    printf("2bpp and 4bpp, 0..%d pixels: %d errors\n", MAX_PIXELS, errors);
+    printf(errors ? "FAIL\n" : "PASS\n");
+    return errors ? 1 : 0;
+}
@@ -0,0 +1,279 @@
+//beam racing against a model of the 720p raster: the main task tick with jitter and stalls of several frames,
+//status bundle, raster readback and row uploads as transactions that take time, the frame counter starting
+//just below its 16 bit wrap. every row upload is checked against the beam: when it starts, the frame the race
+//was claimed for must have scanned the row out, or have ended. rows go out once each in order and the palette
+//follows in a vblank after the race frame, the whole palette transaction inside it
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include "fpga_driver.h"
+
+//720p60, time in pixel clocks
+#define PIXEL_CLOCK_MHZ 74.25
+#define SCREEN_WIDTH 1280
+#define SCREEN_HEIGHT 720
+#define TOTAL_WIDTH 1650
+#define TOTAL_HEIGHT 750
+#define FRAME_CLOCKS ((int64_t)TOTAL_WIDTH * TOTAL_HEIGHT)
+
+#define US(x) ((int64_t)((x) * PIXEL_CLOCK_MHZ))
+
+#define TICK_US 500 //FPGA_DRIVER_MAIN_TASK_TICK_US
+#define PALETTE_LINES 5 //FPGA_DRIVER_RACE_PALETTE_US in 720p lines
+#define RACES 3000
+#define FRAME_COUNTER_START 65500
+
+typedef struct
+{
+    const char *name;
+    int height;
+    int num, den; //frame row shown by a screen line is line * num / den
+} layout_t;
+
+static const layout_t layouts[] = {
+    { "320x240", 240, 1, 3 },
+    { "320x200", 200, 5, 18 },
+    { "160x120", 120, 1, 6 },
+};
+
+static uint64_t rng_state = 0x2545f4914f6cdd1dull;
+
+static uint32_t rng(void)
+{
+    rng_state ^= rng_state << 13;
+    rng_state ^= rng_state >> 7;
+    rng_state ^= rng_state << 17;
+    return (uint32_t)(rng_state >> 32);
+}
+
+static int64_t rng_range(int64_t lo, int64_t hi)
+{
+    return lo + (int64_t)(rng() % (uint64_t)(hi - lo + 1));
+}
+
+//the beam, time 0 is vblank start with the frame counter just incremented to FRAME_COUNTER_START
+
+typedef struct
+{
+    uint16_t frameCounter;
+    int cx, cy;
+} beam_t;
+
+static beam_t beam_at(int64_t t)
+{
+    int64_t frame = t / FRAME_CLOCKS;
+    int64_t line = (t % FRAME_CLOCKS) / TOTAL_WIDTH;
+    beam_t beam;
+
+    beam.frameCounter = (uint16_t)(FRAME_COUNTER_START + frame);
+    beam.cy = line < TOTAL_HEIGHT - SCREEN_HEIGHT ? SCREEN_HEIGHT + line : line - (TOTAL_HEIGHT - SCREEN_HEIGHT);
+    beam.cx = (t % FRAME_CLOCKS) % TOTAL_WIDTH;
+
+    return beam;
+}
+
+static bool beam_vblank(beam_t beam)
+{
+    return beam.cy >= SCREEN_HEIGHT;
+}
+
+static int last_line[SCREEN_HEIGHT];
+
+static void prepare_layout(const layout_t *layout)
+{
+    for (int line = 0; line < SCREEN_HEIGHT; ++line)
+        last_line[line * layout->num / layout->den] = line;
+}
+
+//rows_done register: leading rows whose last line ended at a cx == screen width update, 0 through vblank
+static int rows_done_at(const layout_t *layout, beam_t beam)
+{
+    if (beam_vblank(beam))
+        return 0;
+
+    int line = beam.cx > SCREEN_WIDTH ? beam.cy : beam.cy - 1;
+    int done = 0;
+
+    while (done < layout->height && last_line[done] <= line)
+        ++done;
+
+    return done;
+}
+
+//ground truth, from the beam rather than the register: has the race frame shown row for the last time
+static bool row_free(beam_t beam, uint16_t raceFrame, int row)
+{
+    if (beam.frameCounter != raceFrame)
+        return true;
+
+    return beam.cy < SCREEN_HEIGHT && (beam.cy > last_line[row] || (beam.cy == last_line[row] && beam.cx >= SCREEN_WIDTH));
+}
+
+//a transaction of the given length starting at *now, its registers are sampled somewhere inside it
+static int64_t transaction(int64_t *now, int64_t length)
+{
+    int64_t sample = *now + rng_range(0, length);
+
+    *now += length;
+    return sample;
+}
+
+typedef struct
+{
+    int races, rows, errors;
+    int finished_late;   //palette set after the vblank following the race frame
+    int rows_torn;       //row written after the beam passed it in the frame after the race frame
+    int palettes_torn;   //palette transaction not inside a vblank
+    int64_t min_margin;  //closest a row write came to the beam, in clocks
+} result_t;
+
+static void error(result_t *result, const char *fmt, ...)
+{
+    if (result->errors++ < 16)
+    {
+        va_list args;
+
+        va_start(args, fmt);
+        printf("FAIL: ");
+        vprintf(fmt, args);
+        printf("\n");
+        va_end(args);
+    }
+}
+
+static void run_layout(const layout_t *layout, result_t *result)
+{
+    fpga_driver_race_t race = { .row = -1 };
+    bool vblank = false;
+    bool pending = true;
+    int64_t pending_at = 0;
+    int64_t tick = US(rng_range(0, TICK_US));
+    int next_row = 0;
+
+    prepare_layout(layout);
+
+    while (result->races < RACES)
+    {
+        int64_t now = tick;
+
+        //status bundle
+        beam_t status = beam_at(transaction(&now, US(rng_range(12, 30))));
+
+        if (race.row >= 0)
+        {
+            if (race.row < layout->height)
+            {
+                beam_t raster = beam_at(transaction(&now, US(rng_range(4, 10))));
+
+                int free_rows = fpga_driver_race_free_rows(&race, status.frameCounter, rows_done_at(layout, raster), layout->height);
+
+                for (int row = race.row; row < free_rows; ++row)
+                {
+                    beam_t write = beam_at(now);
+
+                    if (row != next_row)
+                        error(result, "row %d uploaded, expected %d (frame counter %d)", row, next_row, write.frameCounter);
+
+                    if (!row_free(write, race.frame, row))
+                        error(result, "row %d uploaded at line %d, its last line is %d", row, write.cy, last_line[row]);
+                    else if (write.frameCounter == race.frame)
+                    {
+                        int64_t margin = (int64_t)(write.cy - last_line[row]) * TOTAL_WIDTH + write.cx - SCREEN_WIDTH;
+
+                        if (margin < result->min_margin)
+                            result->min_margin = margin;
+                    }
+                    else if (write.frameCounter == (uint16_t)(race.frame + 1) && !beam_vblank(write) && write.cy > last_line[row])
+                        ++result->rows_torn;
+
+                    next_row = row + 1;
+                    ++result->rows;
+
+                    transaction(&now, US(rng_range(15, 30))); //320 bytes and the command
+                }
+
+                if (free_rows > race.row)
+                    race.row = free_rows;
+            }
+
+            bool finish = fpga_driver_race_can_finish(&race, status.frameCounter, beam_vblank(status), layout->height);
+
+            if (finish)
+            {
+                beam_t raster = beam_at(transaction(&now, US(rng_range(4, 10))));
+
+                finish = fpga_driver_race_palette_fits(raster.cy, SCREEN_HEIGHT, TOTAL_HEIGHT, PALETTE_LINES);
+            }
+
+            if (finish)
+            {
+                beam_t palette = beam_at(now);
+
+                if (next_row != layout->height)
+                    error(result, "palette set with %d of %d rows uploaded", next_row, layout->height);
+
+                if (palette.frameCounter == race.frame)
+                    error(result, "palette set in the race frame at line %d", palette.cy);
+
+                if (palette.frameCounter != (uint16_t)(race.frame + 1))
+                    ++result->finished_late;
+
+                transaction(&now, US(rng_range(40, 60))); //768 bytes
+
+                if (!beam_vblank(palette) || !beam_vblank(beam_at(now)) || beam_at(now).frameCounter != palette.frameCounter)
+                {
+                    error(result, "palette written from line %d to line %d", palette.cy, beam_at(now).cy);
+                    ++result->palettes_torn;
+                }
+
+                race.row = -1;
+                pending = false;
+                pending_at = now + US(rng_range(0, 30000));
+                ++result->races;
+            }
+        }
+        else if (!vblank && beam_vblank(status))
+        {
+            if (!pending && now >= pending_at)
+                pending = true;
+
+            if (pending)
+            {
+                fpga_driver_race_start(&race, status.frameCounter);
+                next_row = 0;
+            }
+        }
+
+        vblank = beam_vblank(status);
+
+        //next tick, late when this one overran it, now and then a stall of up to a few frames
+        int64_t next = tick + US(TICK_US + rng_range(-50, 150));
+
+        if (rng() % 100 < 2)
+            next += US(rng_range(0, 60000));
+
+        tick = next > now ? next : now;
+    }
+}
+
+int main(void)
+{
+    int errors = 0;
+
+    for (unsigned i = 0; i < sizeof(layouts) / sizeof(layouts[0]); ++i)
+    {
+        result_t result = { .min_margin = FRAME_CLOCKS };
+
+        run_layout(&layouts[i], &result);
+
+        printf("%s: %d races, %d rows, closest write %.1f us behind the beam, %d races finished late, %d rows written behind the beam of the next frame, %d palettes outside vblank, %d errors\n",
+               layouts[i].name, result.races, result.rows, result.min_margin / PIXEL_CLOCK_MHZ, result.finished_late, result.rows_torn, result.palettes_torn, result.errors);
+
+        errors += result.errors;
+    }
+
+    printf(errors ? "FAIL\n" : "PASS\n");
+    return errors ? 1 : 0;
+}
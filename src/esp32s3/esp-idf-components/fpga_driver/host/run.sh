@@ -0,0 +1,47 @@
+#!/bin/sh
+# host models of the driver logic, run.sh [model...], all of them by default
+
+cd "$(dirname "$0")"
+
+MODELS=${*:-"race_model upload_model lz_bench pack_test"}
+
+mkdir -p build
+
+failed=0
+
+for model in $MODELS
+do
+    args=""
+    cflags=""
+
+    case $model in
+    race_model)
+        sources="../fpga_driver_race.c"
+        ;;
+    upload_model)
+        sources=""
+        ;;
+    lz_bench)
+        sources="../fpga_driver_lz.c"
+        args=$(ls frames/*.pcx frames/*.PCX frames/*.raw 2>/dev/null)
+        ;;
+    pack_test)
+        sources="../fpga_driver_pack.c"
+        cflags="-fsanitize=undefined -fno-sanitize-recover=all"
+        ;;
+    *)
+        echo "unknown model $model"
+        exit 1
+        ;;
+    esac
+
+    echo "== $model"
+
+    cc -std=gnu11 -O2 -Wall $cflags -I. -I.. -o build/$model $model.c $sources -lm || exit 1
+
+    ./build/$model $args | tee build/$model.log
+
+    grep -q "^PASS" build/$model.log || failed=1
+done
+
+exit $failed
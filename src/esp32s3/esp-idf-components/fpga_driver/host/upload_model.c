@@ -0,0 +1,269 @@
+//bus time of a 320x240 palette and frame upload as the vblank path sends it, before and after
+//COMMAND_FRAMEBUFFER_PRESENT: the old palette write plus chunked framebuffer write, each chunk with its own
+//command, address and cs toggle, against the single present transaction whose pieces keep cs low, and the octal
+//path. pieces are split the way fpga_qspi_send_gpu_segments splits them and run through a model of the queue:
+//the task queues up to FPGA_QSPI_QUEUE_SIZE of them, the isr starts the next one, the task waits for the oldest
+//when the queue is full. the software costs are not measured here, they are inputs: each row of overheads is
+//an assumption about the esp32-s3 and the table shows how the saving depends on them.
+//checks that with no overheads every path takes exactly its sclk cycles, that the wire carries the same pixels
+//and palette, and that the single transaction is never slower
+
+#include <stdio.h>
+#include <stdbool.h>
+
+#define SPI_FREQ_MHZ 80.0
+#define SPI_MAX_TRANS_BYTES (4092*4)
+#define FPGA_QSPI_QUEUE_SIZE 4
+#define COMMAND_BITS 8
+#define ADDRESS_BITS 24
+
+#define FRAME_BYTES (320*240)
+#define PALETTE_BYTES 768
+#define MAX_PIECES 16
+
+//720p60 vblank: 30 lines of 1650 clocks at 74.25 MHz
+#define VBLANK_US (30 * 1650 / 74.25)
+
+typedef struct
+{
+    int commandBits, addressBits;
+    int bytes;
+    int lines;          //of the data phase, command and address always go on 4
+    bool keepCs;        //next piece continues the transaction
+} piece_t;
+
+//one fpga_qspi call: lock, acquire, its pieces, release
+typedef struct
+{
+    piece_t pieces[MAX_PIECES];
+    int count;
+} call_t;
+
+typedef struct
+{
+    const char *name;
+    double callUs;      //lock, acquire and release around a call
+    double queueUs;     //task time to queue one piece
+    double startUs;     //isr from the end of a piece to sclk of the next queued one
+    double wakeUs;      //from a finished piece to the task returning from get_trans_result
+    double csHighUs;    //cs high between two transactions
+} overheads_t;
+
+//assumptions, not measurements: vblankUploadUs in fpga_driver_link_stats_t has the real figure
+static const overheads_t overheads[] = {
+    { "none",    0,  0,  0,  0, 0    },
+    { "low",     5,  2,  2,  4, 0.05 },
+    { "typical", 10, 4,  5,  8, 0.05 },
+    { "high",    25, 8, 10, 20, 0.05 },
+};
+
+typedef struct
+{
+    const char *name;
+    call_t calls[2];
+    int count;
+} path_t;
+
+static double piece_us(const piece_t *piece)
+{
+    int cycles = (piece->commandBits + piece->addressBits) / 4 + piece->bytes * 8 / piece->lines;
+
+    return cycles / SPI_FREQ_MHZ;
+}
+
+static int path_cycles(const path_t *path)
+{
+    int cycles = 0;
+
+    for (int c = 0; c < path->count; ++c)
+        for (int i = 0; i < path->calls[c].count; ++i)
+            cycles += (int)(piece_us(&path->calls[c].pieces[i]) * SPI_FREQ_MHZ + 0.5);
+
+    return cycles;
+}
+
+//bytes of the data phases, command and address bits excluded
+static int path_bytes(const path_t *path)
+{
+    int bytes = 0;
+
+    for (int c = 0; c < path->count; ++c)
+        for (int i = 0; i < path->calls[c].count; ++i)
+            bytes += path->calls[c].pieces[i].bytes;
+
+    return bytes;
+}
+
+static double run_call(const call_t *call, const overheads_t *o, double now)
+{
+    double end[MAX_PIECES];
+    double task = now + o->callUs;
+    double bus = 0;
+    int completed = 0;
+
+    for (int i = 0; i < call->count; ++i)
+    {
+        //queue full: the task sleeps until the oldest piece is done
+        if (i - completed >= FPGA_QSPI_QUEUE_SIZE)
+        {
+            double woken = end[completed] + o->wakeUs;
+
+            task = task > woken ? task : woken;
+            ++completed;
+        }
+
+        task += o->queueUs;
+
+        double start = task;
+
+        //the isr starts a piece queued before the previous one finished, cs goes high between transactions
+        if (i > 0)
+        {
+            double after = end[i - 1] + o->startUs + (call->pieces[i - 1].keepCs ? 0 : o->csHighUs);
+
+            start = start > after ? start : after;
+        }
+
+        bus = start + piece_us(&call->pieces[i]);
+        end[i] = bus;
+    }
+
+    double woken = bus + o->wakeUs;
+
+    return (task > woken ? task : woken) + o->callUs;
+}
+
+static double run_path(const path_t *path, const overheads_t *o)
+{
+    double now = 0;
+
+    for (int c = 0; c < path->count; ++c)
+        now = run_call(&path->calls[c], o, now);
+
+    return now;
+}
+
+static void add_piece(call_t *call, int commandBits, int addressBits, int bytes, int lines)
+{
+    call->pieces[call->count++] = (piece_t){ commandBits, addressBits, bytes, lines, true };
+}
+
+static void end_call(call_t *call)
+{
+    call->pieces[call->count - 1].keepCs = false;
+}
+
+//fpga_qspi_send_gpu, palette up to 64 bytes would be polled but it never is
+static void palette_call(call_t *call)
+{
+    add_piece(call, COMMAND_BITS, 0, PALETTE_BYTES, 4);
+    end_call(call);
+}
+
+//fpga_qspi_send_gpu_chunked before the present command: command and address on every chunk
+static void chunked_call(call_t *call, int bytes)
+{
+    for (int offset = 0; offset < bytes; offset += SPI_MAX_TRANS_BYTES)
+    {
+        add_piece(call, COMMAND_BITS, ADDRESS_BITS, bytes - offset > SPI_MAX_TRANS_BYTES ? SPI_MAX_TRANS_BYTES : bytes - offset, 4);
+        end_call(call);
+    }
+}
+
+//fpga_qspi_send_gpu_segments: pieces never span two segments, only the first carries command and address,
+//an octal segment first sends command and address on their own
+static void segments_call(call_t *call, int addressBits, const int *segments, const bool *octal, int segmentCount)
+{
+    bool first = true;
+
+    for (int s = 0; s < segmentCount; ++s)
+    {
+        if (first && octal[s])
+        {
+            add_piece(call, COMMAND_BITS, addressBits, 0, 4);
+            first = false;
+        }
+
+        for (int offset = 0; offset < segments[s]; offset += SPI_MAX_TRANS_BYTES)
+        {
+            int count = segments[s] - offset > SPI_MAX_TRANS_BYTES ? SPI_MAX_TRANS_BYTES : segments[s] - offset;
+
+            add_piece(call, first ? COMMAND_BITS : 0, first ? addressBits : 0, count, octal[s] ? 8 : 4);
+            first = false;
+        }
+    }
+
+    end_call(call);
+}
+
+int main(void)
+{
+    static path_t old = { "palette + chunked write", .count = 2 };
+    static path_t present = { "present", .count = 1 };
+    static path_t octal = { "octal: palette + octal write", .count = 2 };
+
+    palette_call(&old.calls[0]);
+    chunked_call(&old.calls[1], FRAME_BYTES);
+
+    //palette, 3 bytes of first pixel index with its dummy nibble, pixels
+    const int presentSegments[] = { PALETTE_BYTES, 3, FRAME_BYTES };
+    const bool presentOctal[] = { false, false, false };
+
+    segments_call(&present.calls[0], 0, presentSegments, presentOctal, 3);
+
+    const int octalSegments[] = { FRAME_BYTES };
+    const bool octalOctal[] = { true };
+
+    palette_call(&octal.calls[0]);
+    segments_call(&octal.calls[1], ADDRESS_BITS, octalSegments, octalOctal, 1);
+
+    const path_t *paths[] = { &old, &present, &octal };
+    int errors = 0;
+
+    for (int p = 0; p < 3; ++p)
+    {
+        int pieces = 0;
+
+        for (int c = 0; c < paths[p]->count; ++c)
+            pieces += paths[p]->calls[c].count;
+
+        printf("%s: %d calls, %d pieces, %d data bytes, %d sclk cycles = %.1f us\n", paths[p]->name, paths[p]->count, pieces,
+               path_bytes(paths[p]), path_cycles(paths[p]), path_cycles(paths[p]) / SPI_FREQ_MHZ);
+
+        double idle = run_path(paths[p], &overheads[0]);
+
+        if (idle < path_cycles(paths[p]) / SPI_FREQ_MHZ - 0.001 || idle > path_cycles(paths[p]) / SPI_FREQ_MHZ + 0.001)
+        {
+            printf("FAIL: %s takes %.3f us without overheads, its cycles take %.3f us\n", paths[p]->name, idle, path_cycles(paths[p]) / SPI_FREQ_MHZ);
+            ++errors;
+        }
+    }
+
+    //the present command carries the first pixel index in its data phase instead of an address phase
+    if (path_bytes(&present) != path_bytes(&old) + 3 || path_bytes(&octal) != path_bytes(&old))
+    {
+        printf("FAIL: paths carry different data\n");
+        ++errors;
+    }
+
+    printf("\n%-8s  %8s  %8s  %8s  %10s  %8s\n", "overhead", "old us", "present", "saved us", "% vblank", "octal us");
+
+    for (unsigned i = 0; i < sizeof(overheads) / sizeof(overheads[0]); ++i)
+    {
+        double oldUs = run_path(&old, &overheads[i]);
+        double presentUs = run_path(&present, &overheads[i]);
+        double octalUs = run_path(&octal, &overheads[i]);
+
+        printf("%-8s  %8.1f  %8.1f  %8.1f  %9.1f%%  %8.1f\n", overheads[i].name, oldUs, presentUs, oldUs - presentUs,
+               100 * (oldUs - presentUs) / VBLANK_US, octalUs);
+
+        if (presentUs > oldUs)
+        {
+            printf("FAIL: present is slower than the chunked write with %s overheads\n", overheads[i].name);
+            ++errors;
+        }
+    }
+
+    printf(errors ? "FAIL\n" : "PASS\n");
+    return errors ? 1 : 0;
+}
@@ -14,7 +14,25 @@ typedef enum
     COMMAND_DISABLE_OUTPUT                  = 0b00000000,
     COMMAND_ENABLE_OUTPUT                   = 0b00000001,    
     COMMAND_AUDIO_BUFFER_READ_STATUS        = 0b01010000, //write only, 4 bits of flags + 12 bits of number of samples in buffer = 2 bytes
-    COMMAND_AUDIO_BUFFER_WRITE              = 0b11010001  //read+write, read 1 byte (1-256) of how many samples will be written, then read 32bits*number of samples, then write status 2 bytes
+    COMMAND_AUDIO_BUFFER_WRITE              = 0b11010001, //read+write, read 1 byte (1-256) of how many samples will be written, then read 32bits*number of samples, then write status 2 bytes
+    COMMAND_READ_STATUS_BUNDLE              = 0b01000001, //write 12 bytes: status register 0, 2 bytes of audio buffer status, 2 bytes of frame counter, 1 byte of flags, 2 bytes of read phase crc and 2 of write phase crc since the last bundle, 2 bytes of crc of the previous 10
+    COMMAND_WRITE_REGISTERS                 = 0b10000100, //read phase only, read 1 byte of first register idx, then continuously read register values in 1 byte blocks until master stops the transaction
+    COMMAND_READ_REGISTERS                  = 0b11000100, //read+write, read 1 byte of first register idx, then continuously write register values in 1 byte blocks until master stops the transaction
+    COMMAND_SPRITE_WRITE_IMAGE              = 0b10000101, //read phase only, read 1 byte of sprite idx, then 32*32 bytes of sprite pixels
+    COMMAND_READ_GEOMETRY                   = 0b01000101, //write 7 bytes: active layout mode, bits per pixel, 2 bytes of frame width, 2 bytes of frame height, then 1 byte of capabilities
+    COMMAND_WRITE_LINE_TABLE                = 0b10000110, //read phase only, read 1 byte of first screen line, then continuously read framebuffer row per line in 1 byte blocks until master stops the transaction
+    COMMAND_SET_SECONDARY_PALETTE           = 0b10000111, //read phase only, 256*3 bytes of the fade target palette starting from [0]
+    COMMAND_READ_RASTER                     = 0b01000110, //write 4 bytes: 2 bytes of current screen line, 2 bytes of frame rows scanned out in this frame
+    COMMAND_WRITE_COPPER_LIST               = 0b10001000, //read phase only, read 1 byte of first entry idx, then continuously read 8 byte entries in 1 byte blocks until master stops the transaction
+    COMMAND_BLIT                            = 0b10001001, //read phase only, continuously read 16 byte blit parameter blocks into the blitter queue, master must not exceed the free queue slots
+    COMMAND_WRITE_BLIT_STORE                = 0b10001010, //read phase only, read 2 bytes of first blit store address, then continuously read bytes until master stops the transaction
+    COMMAND_READ_BLIT_STATUS                = 0b01001001, //write 1 byte: blitter busy, 2 reserved bits, 5 bits of queued blocks
+    COMMAND_READ_BLIT_CRC                   = 0b01001010, //write 4 bytes of crc-32 computed by the last crc blit
+    COMMAND_ECHO                            = 0b11001011, //read+write, read 4 bytes, then write them back followed by their inverse
+    COMMAND_FRAMEBUFFER_PRESENT             = 0b10001011, //read phase only, 256*3 bytes of palette, then 3 bytes of first pixel idx, then continuously read pixel data in 1 byte blocks until master stops the transaction
+    COMMAND_FRAMEBUFFER_OCTAL_WRITE         = 0b10001100, //SPI_OCTAL builds only, read phase only, read 3 bytes of first pixel idx on 4 lines, then continuously read pixel data on 8 lines until master stops the transaction
+    COMMAND_FRAMEBUFFER_LZ_WRITE            = 0b10001101, //read phase only, read 3 bytes of first pixel idx, then continuously read lz tokens until master stops the transaction
+    COMMAND_FRAMEBUFFER_DELTA_WRITE         = 0b10001110  //read phase only, read 3 bytes of first pixel idx, then continuously read skip and literal tokens until master stops the transaction
 } FPGA_GPU_COMMAND;
 
 #define FPGA_GPU_MAGIC_NUMBER (0b1010010111000011)
@@ -36,6 +54,107 @@ bool IRAM_ATTR fpga_api_gpu_read_magic_number(fpga_qspi_t *qspi, bool *result)
     return true;
 }
 
+bool IRAM_ATTR fpga_api_gpu_echo(fpga_qspi_t *qspi, uint32_t pattern, bool *result)
+{
+    WORD_ALIGNED_ATTR uint8_t sendBuf[4] = { pattern >> 24, (pattern >> 16) & 0xFF, (pattern >> 8) & 0xFF, pattern & 0xFF };
+    WORD_ALIGNED_ATTR uint8_t buf[8] = { 0 };
+
+    if (!fpga_qspi_send_gpu(qspi, COMMAND_ECHO, 0, 0, sendBuf, 4, buf, 8))
+        return false;
+
+    *result = true;
+
+    for (int i = 0; i < 4; ++i)
+        if (buf[i] != sendBuf[i] || buf[i + 4] != (uint8_t)~sendBuf[i])
+            *result = false;
+
+    return true;
+}
+
+//reads the status bundle and compares its crcs with the gpu transactions since the previous one.
+//false in linkOk only for a mismatch, checks that cannot be compared pass
+static bool IRAM_ATTR fpga_api_gpu_link_check(fpga_qspi_t *qspi, uint8_t *buf, bool *linkOk)
+{
+    uint16_t sendCrc, receiveCrc;
+    bool valid;
+
+    *linkOk = false;
+
+    if (!fpga_qspi_receive_gpu_link_check(qspi, COMMAND_READ_STATUS_BUNDLE, buf, 12, &sendCrc, &receiveCrc, &valid))
+        return false;
+
+    //a corrupted bundle is dropped, the fpga may not have restarted its crcs
+    if (fpga_qspi_crc16(0xFFFF, buf, 10) != (buf[10] << 8 | buf[11]))
+    {
+        fpga_qspi_link_skip(qspi);
+        fpga_qspi_link_report(qspi, false);
+        return false;
+    }
+
+    *linkOk = !valid || (sendCrc == (buf[6] << 8 | buf[7]) && receiveCrc == (buf[8] << 8 | buf[9]));
+
+    if (valid)
+        fpga_qspi_link_report(qspi, *linkOk);
+
+    return true;
+}
+
+bool IRAM_ATTR fpga_api_gpu_read_status_bundle(fpga_qspi_t *qspi, fpga_api_gpu_status_bundle_t *result)
+{
+    WORD_ALIGNED_ATTR uint8_t buf[12] = { 0 };
+
+    bool linkOk;
+
+    //result keeps the previous values when the bundle is dropped
+    if (!fpga_api_gpu_link_check(qspi, buf, &linkOk))
+        return false;
+
+    *result = (fpga_api_gpu_status_bundle_t)
+    {
+        .status0 = buf[0],
+        .audioBufferStatus = buf[1] << 8 | buf[2],
+        .frameCounter = buf[3] << 8 | buf[4],
+        .flags = buf[5]
+    };
+    
+    return true;
+}
+
+bool IRAM_ATTR fpga_api_gpu_read_geometry(fpga_qspi_t *qspi, fpga_api_gpu_geometry_t *result)
+{
+    WORD_ALIGNED_ATTR uint8_t buf[8] = { 0 };
+
+    if (!fpga_qspi_send_gpu(qspi, COMMAND_READ_GEOMETRY, 0, 0, NULL, 0, buf, 7))
+        return false;
+
+    *result = (fpga_api_gpu_geometry_t)
+    {
+        .mode = buf[0],
+        .bitsPerPixel = buf[1],
+        .width = buf[2] << 8 | buf[3],
+        .height = buf[4] << 8 | buf[5],
+        .capabilities = buf[6]
+    };
+    
+    return true;
+}
+
+bool IRAM_ATTR fpga_api_gpu_read_raster(fpga_qspi_t *qspi, fpga_api_gpu_raster_t *result)
+{
+    WORD_ALIGNED_ATTR uint8_t buf[4] = { 0 };
+
+    if (!fpga_qspi_send_gpu(qspi, COMMAND_READ_RASTER, 0, 0, NULL, 0, buf, 4))
+        return false;
+
+    *result = (fpga_api_gpu_raster_t)
+    {
+        .line = buf[0] << 8 | buf[1],
+        .rowsDone = buf[2] << 8 | buf[3]
+    };
+    
+    return true;
+}
+
 bool IRAM_ATTR fpga_api_gpu_enable_output(fpga_qspi_t *qspi)
 {
     return fpga_qspi_send_gpu(qspi, COMMAND_ENABLE_OUTPUT, 0, 0, NULL, 0, NULL, 0);
@@ -56,6 +175,11 @@ bool IRAM_ATTR fpga_api_gpu_get_palette(fpga_qspi_t *qspi, uint8_t *palette)
     return fpga_qspi_send_gpu(qspi, COMMAND_FRAMEBUFFER_GET_PALETTE, 0, 0, NULL, 0, palette, 768);
 }
 
+bool IRAM_ATTR fpga_api_gpu_set_secondary_palette(fpga_qspi_t *qspi, uint8_t *palette)
+{
+    return fpga_qspi_send_gpu(qspi, COMMAND_SET_SECONDARY_PALETTE, 0, 0, palette, 768, NULL, 0);
+}
+
 bool IRAM_ATTR fpga_api_gpu_framebuffer_write(fpga_qspi_t *qspi, uint32_t startIdx, uint8_t *pixels, int pixelCount)
 {
     if (startIdx >= 76800)
@@ -64,24 +188,90 @@ bool IRAM_ATTR fpga_api_gpu_framebuffer_write(fpga_qspi_t *qspi, uint32_t startI
         return false;
     }
 
-    while (pixelCount > 0)
+    if (pixelCount <= 0)
+        return true;
+
+    fpga_qspi_segment_t segment = { pixels, pixelCount, qspi->octal };
+
+    //pixel index is followed by a dummy nibble
+    return fpga_qspi_send_gpu_segments(qspi, qspi->octal ? COMMAND_FRAMEBUFFER_OCTAL_WRITE : COMMAND_FRAMEBUFFER_CONTINUOUS_WRITE, startIdx << 4, 24, &segment, 1);
+}
+
+bool IRAM_ATTR fpga_api_gpu_framebuffer_write_lz(fpga_qspi_t *qspi, uint32_t startIdx, fpga_qspi_stream_fill_t fill, void *context)
+{
+    if (startIdx >= 76800)
     {
-        int pixelsToWrite = pixelCount > SPI_MAX_TRANS_BYTES ? SPI_MAX_TRANS_BYTES : pixelCount;
+        ESP_LOGE(TAG, "u mad bro");
+        return false;
+    }
 
-        if (!fpga_qspi_send_gpu(qspi, COMMAND_FRAMEBUFFER_CONTINUOUS_WRITE, startIdx << 4, 24, pixels, pixelsToWrite, NULL, 0))
-            return false;
+    //pixel index is followed by a dummy nibble
+    return fpga_qspi_send_gpu_stream(qspi, COMMAND_FRAMEBUFFER_LZ_WRITE, startIdx << 4, 24, fill, context);
+}
 
-        pixelCount -= pixelsToWrite;
-        pixels += pixelsToWrite;
-        startIdx += pixelsToWrite;
+bool IRAM_ATTR fpga_api_gpu_framebuffer_write_delta(fpga_qspi_t *qspi, uint32_t startIdx, fpga_qspi_stream_fill_t fill, void *context)
+{
+    if (startIdx >= 76800)
+    {
+        ESP_LOGE(TAG, "u mad bro");
+        return false;
     }
 
-    return true;
+    //pixel index is followed by a dummy nibble
+    return fpga_qspi_send_gpu_stream(qspi, COMMAND_FRAMEBUFFER_DELTA_WRITE, startIdx << 4, 24, fill, context);
+}
+
+bool IRAM_ATTR fpga_api_gpu_framebuffer_present(fpga_qspi_t *qspi, uint8_t *palette, uint32_t startIdx, uint8_t *pixels, int pixelCount)
+{
+    if (startIdx >= 76800 || pixelCount <= 0)
+    {
+        ESP_LOGE(TAG, "u mad bro");
+        return false;
+    }
+
+    //the pixel phase of the present command is 4 lines only, the octal write is twice as fast even with the extra transaction
+    if (qspi->octal)
+        return fpga_api_gpu_set_palette(qspi, palette) && fpga_api_gpu_framebuffer_write(qspi, startIdx, pixels, pixelCount);
+
+    //pixel index goes between the palette and the pixels, followed by a dummy nibble
+    uint32_t idx = startIdx << 4;
+    WORD_ALIGNED_ATTR uint8_t address[4] = { idx >> 16, (idx >> 8) & 0xFF, idx & 0xFF };
+
+    fpga_qspi_segment_t segments[3] = 
+    {
+        { palette, 768 },
+        { address, 3 },
+        { pixels, pixelCount }
+    };
+
+    return fpga_qspi_send_gpu_segments(qspi, COMMAND_FRAMEBUFFER_PRESENT, 0, 0, segments, 3);
 }
 
 bool IRAM_ATTR fpga_api_gpu_framebuffer_read(fpga_qspi_t *qspi, uint32_t startIdx, uint8_t *pixels, int pixelCount)
 {
-    return false;
+    if (startIdx >= 76800)
+    {
+        ESP_LOGE(TAG, "u mad bro");
+        return false;
+    }
+
+    while (pixelCount > 0)
+    {
+        int pixelsToRead = pixelCount > SPI_MAX_TRANS_BYTES ? SPI_MAX_TRANS_BYTES : pixelCount;
+
+        if (!fpga_qspi_send_gpu(qspi, COMMAND_FRAMEBUFFER_CONTINUOUS_READ, startIdx << 4, 24, NULL, 0, pixels, pixelsToRead))
+            return false;
+
+        pixelCount -= pixelsToRead;
+        pixels += pixelsToRead;
+        startIdx += pixelsToRead;
+    }
+
+    //the status bundle after it is the trailer of the read, its write phase crc covers every pixel
+    WORD_ALIGNED_ATTR uint8_t buf[12] = { 0 };
+    bool linkOk;
+
+    return fpga_api_gpu_link_check(qspi, buf, &linkOk) && linkOk;
 }
 
 bool IRAM_ATTR fpga_api_gpu_audio_buffer_read_status(fpga_qspi_t *qspi, uint16_t *status)
@@ -109,5 +299,101 @@ bool IRAM_ATTR fpga_api_gpu_audio_buffer_write(fpga_qspi_t *qspi, uint8_t *sampl
             return false;
 
     *status = buf[0] << 8 | buf[1];
+    return true;
+}
+
+bool IRAM_ATTR fpga_api_gpu_write_registers(fpga_qspi_t *qspi, uint8_t startRegister, uint8_t *values, int count)
+{
+    if (count <= 0 || startRegister + count > FPGA_API_GPU_REGISTER_COUNT)
+    {
+        ESP_LOGE(TAG, "register range out of bounds");
+        return false;
+    }
+
+    return fpga_qspi_send_gpu(qspi, COMMAND_WRITE_REGISTERS, startRegister, 8, values, count, NULL, 0);
+}
+
+bool IRAM_ATTR fpga_api_gpu_read_registers(fpga_qspi_t *qspi, uint8_t startRegister, uint8_t *values, int count)
+{
+    if (count <= 0 || startRegister + count > FPGA_API_GPU_REGISTER_COUNT)
+    {
+        ESP_LOGE(TAG, "register range out of bounds");
+        return false;
+    }
+
+    return fpga_qspi_send_gpu(qspi, COMMAND_READ_REGISTERS, startRegister, 8, NULL, 0, values, count);
+}
+
+bool IRAM_ATTR fpga_api_gpu_sprite_write_image(fpga_qspi_t *qspi, int sprite, uint8_t *pixels)
+{
+    if (sprite < 0 || sprite >= FPGA_API_GPU_SPRITE_COUNT)
+    {
+        ESP_LOGE(TAG, "sprite idx out of range");
+        return false;
+    }
+
+    return fpga_qspi_send_gpu(qspi, COMMAND_SPRITE_WRITE_IMAGE, sprite, 8, pixels, FPGA_API_GPU_SPRITE_IMAGE_SIZE_BYTES, NULL, 0);
+}
+
+bool IRAM_ATTR fpga_api_gpu_write_line_table(fpga_qspi_t *qspi, int startLine, uint8_t *rows, int count)
+{
+    if (startLine < 0 || count <= 0 || startLine + count > FPGA_API_GPU_LINE_TABLE_SIZE)
+    {
+        ESP_LOGE(TAG, "line table range out of bounds");
+        return false;
+    }
+
+    return fpga_qspi_send_gpu(qspi, COMMAND_WRITE_LINE_TABLE, startLine, 8, rows, count, NULL, 0);
+}
+
+bool IRAM_ATTR fpga_api_gpu_write_copper_list(fpga_qspi_t *qspi, int startEntry, uint8_t *entries, int count)
+{
+    if (startEntry < 0 || count <= 0 || startEntry + count > FPGA_API_GPU_COPPER_ENTRY_COUNT)
+    {
+        ESP_LOGE(TAG, "copper list range out of bounds");
+        return false;
+    }
+
+    return fpga_qspi_send_gpu(qspi, COMMAND_WRITE_COPPER_LIST, startEntry, 8, entries, count*FPGA_API_GPU_COPPER_ENTRY_SIZE_BYTES, NULL, 0);
+}
+
+bool IRAM_ATTR fpga_api_gpu_read_blit_status(fpga_qspi_t *qspi, uint8_t *status)
+{
+    return fpga_qspi_send_gpu(qspi, COMMAND_READ_BLIT_STATUS, 0, 0, NULL, 0, status, 1);
+}
+
+bool IRAM_ATTR fpga_api_gpu_blit(fpga_qspi_t *qspi, uint8_t *blocks, int count)
+{
+    if (count <= 0 || count > FPGA_API_GPU_BLIT_QUEUE_DEPTH)
+    {
+        ESP_LOGE(TAG, "blit count out of range");
+        return false;
+    }
+
+    return fpga_qspi_send_gpu(qspi, COMMAND_BLIT, 0, 0, blocks, count*FPGA_API_GPU_BLIT_PARAMS_SIZE_BYTES, NULL, 0);
+}
+
+bool IRAM_ATTR fpga_api_gpu_write_blit_store(fpga_qspi_t *qspi, int offset, uint8_t *data, int size)
+{
+    if (offset < 0 || size <= 0 || offset + size > FPGA_API_GPU_BLIT_STORE_SIZE)
+    {
+        ESP_LOGE(TAG, "blit store range out of bounds");
+        return false;
+    }
+
+    fpga_qspi_segment_t segment = { data, size };
+
+    return fpga_qspi_send_gpu_segments(qspi, COMMAND_WRITE_BLIT_STORE, offset, 16, &segment, 1);
+}
+
+bool IRAM_ATTR fpga_api_gpu_read_blit_crc(fpga_qspi_t *qspi, uint32_t *crc)
+{
+    WORD_ALIGNED_ATTR uint8_t buf[4] = { 0 };
+
+    if (!fpga_qspi_send_gpu(qspi, COMMAND_READ_BLIT_CRC, 0, 0, NULL, 0, buf, 4))
+        return false;
+
+    *crc = (uint32_t)buf[0] << 24 | buf[1] << 16 | buf[2] << 8 | buf[3];
+
     return true;
 }
\ No newline at end of file
@@ -11,19 +11,164 @@
 #define FPGA_API_GPU_AUDIO_BUFFER_STATUS_GET_CURRENT_FULL(status)           (!!((status) & 0b0001000000000000))
 #define FPGA_API_GPU_AUDIO_BUFFER_STATUS_GET_WNUM(status)                   ((status) & 0xFFF)
 
+#define FPGA_API_GPU_STATUS_BUNDLE_FLAGS_GET_HID_CHANGED(flags)             ((flags) & 0b00000001)
+
+#define FPGA_API_GPU_REGISTER_COUNT                 (64)
+
+#define FPGA_API_GPU_SPRITE_COUNT                   (4)
+#define FPGA_API_GPU_SPRITE_SIZE                    (32)
+#define FPGA_API_GPU_SPRITE_IMAGE_SIZE_BYTES        (FPGA_API_GPU_SPRITE_SIZE*FPGA_API_GPU_SPRITE_SIZE)
+
+//gpu register map, registers are latched by the framebuffer during vblank
+#define FPGA_API_GPU_REGISTER_SPRITE(sprite)        ((sprite)*8) //x (int16 LE), y (int16 LE), flags, transparent idx, 2 reserved
+#define FPGA_API_GPU_REGISTER_SPRITE_X              (0)
+#define FPGA_API_GPU_REGISTER_SPRITE_Y              (2)
+#define FPGA_API_GPU_REGISTER_SPRITE_FLAGS          (4)
+#define FPGA_API_GPU_REGISTER_SPRITE_TRANSPARENT    (5)
+
+#define FPGA_API_GPU_SPRITE_FLAGS_ENABLE            (0b00000001)
+#define FPGA_API_GPU_SPRITE_FLAGS_BEHIND            (0b00000010) //only drawn over framebuffer pixels with value 0
+
+#define FPGA_API_GPU_REGISTER_SCROLL_X              (0x20) //uint16 LE, 0..319
+#define FPGA_API_GPU_REGISTER_SCROLL_Y              (0x22) //uint16 LE, 0..239
+#define FPGA_API_GPU_REGISTER_SCROLL_FLAGS          (0x24)
+
+#define FPGA_API_GPU_SCROLL_FLAGS_LINE_TABLE        (0b00000001) //screen line y shows framebuffer row line_table[y] + scroll y
+
+#define FPGA_API_GPU_LINE_TABLE_SIZE                (240)
+
+#define FPGA_API_GPU_REGISTER_MODE                  (0x28) //layout, switched at vblank
+
+#define FPGA_API_GPU_MODE_320X240                   (0) //8bpp, x3 (x4 at 1080p), letterboxed
+#define FPGA_API_GPU_MODE_320X200                   (1) //8bpp, 4:3 aspect correct, fills screen height
+#define FPGA_API_GPU_MODE_640X240_4BPP              (2) //4bpp, left pixel in the high nibble, fills the screen
+#define FPGA_API_GPU_MODE_320X240_4BPP              (3) //4bpp, left pixel in the high nibble, x3 (x4 at 1080p)
+#define FPGA_API_GPU_MODE_320X240_2BPP              (4) //2bpp, leftmost pixel in the high bits, x3 (x4 at 1080p)
+#define FPGA_API_GPU_MODE_160X120                   (5) //8bpp, x6 (x8 at 1080p)
+
+#define FPGA_API_GPU_REGISTER_PALETTE_BANK          (0x29) //palette idx = bank*16 + pixel in 4bpp modes, bank*4 + pixel in 2bpp modes
+#define FPGA_API_GPU_REGISTER_PAGE                  (0x2A) //displayed page 0-3, page n starts at n*frame size bytes, pages past the framebuffer end show page 0
+
+#define FPGA_API_GPU_REGISTER_FADE_TARGET           (0x2B) //0 = palette, FPGA_API_GPU_FADE_LEVEL_MAX = secondary palette
+#define FPGA_API_GPU_REGISTER_FADE_SPEED            (0x2C) //fade levels per frame, 0 = jump to the target
+
+#define FPGA_API_GPU_FADE_LEVEL_MAX                 (128)
+
+#define FPGA_API_GPU_REGISTER_OUTPUT_FLAGS          (0x2D)
+
+#define FPGA_API_GPU_OUTPUT_FLAGS_DVI               (0b00000001) //no audio and infoframes, ignored by the dvi-only 1080p build
+
+#define FPGA_API_GPU_ROTATION_COUNT                 (2)
+
+#define FPGA_API_GPU_REGISTER_ROTATION(range)       (0x30 + (range)*4) //first idx, last idx, frames per step (0 = off), flags
+#define FPGA_API_GPU_REGISTER_ROTATION_FIRST        (0)
+#define FPGA_API_GPU_REGISTER_ROTATION_LAST         (1)
+#define FPGA_API_GPU_REGISTER_ROTATION_PERIOD       (2)
+#define FPGA_API_GPU_REGISTER_ROTATION_FLAGS        (3)
+
+#define FPGA_API_GPU_ROTATION_FLAGS_REVERSE         (0b00000001)
+
+#define FPGA_API_GPU_REGISTER_COPPER_FLAGS          (0x2E)
+
+#define FPGA_API_GPU_COPPER_FLAGS_ENABLE            (0b00000001)
+
+//copper list: entries sorted by frame row, executed during the hblank before the first screen line of their row,
+//register writes last until the registers are latched again at the next vblank, palette writes are permanent
+#define FPGA_API_GPU_COPPER_ENTRY_COUNT             (64)
+#define FPGA_API_GPU_COPPER_ENTRY_SIZE_BYTES        (8) //row (uint16 LE), op, register or palette idx, value (register value or r, g, b), reserved
+
+#define FPGA_API_GPU_COPPER_OP_REGISTER             (0)
+#define FPGA_API_GPU_COPPER_OP_PALETTE              (1)
+#define FPGA_API_GPU_COPPER_OP_END                  (0xFF)
+
+//blitter: parameter blocks are queued by the fpga and executed while the scanout does not need the framebuffer
+#define FPGA_API_GPU_BLIT_QUEUE_DEPTH               (16)
+#define FPGA_API_GPU_BLIT_PARAMS_SIZE_BYTES         (16) //op|flags, value, src (uint24 LE), src stride (uint16 LE), dst (uint24 LE), dst stride (uint16 LE), width (uint16 LE), height (uint16 LE)
+#define FPGA_API_GPU_BLIT_STORE_SIZE                (8192) //source of store copies, written with fpga_api_gpu_write_blit_store
+
+#define FPGA_API_GPU_BLIT_OP_FILL                   (0) //dst = value
+#define FPGA_API_GPU_BLIT_OP_COPY                   (1) //framebuffer src -> dst
+#define FPGA_API_GPU_BLIT_OP_STORE_COPY             (2) //blit store src -> dst
+#define FPGA_API_GPU_BLIT_OP_CRC                    (3) //crc-32 (zlib) of framebuffer src, dst is ignored, read with fpga_api_gpu_read_blit_crc
+
+#define FPGA_API_GPU_BLIT_FLAGS_TRANSPARENT         (0b01000000) //source bytes equal to value are skipped
+#define FPGA_API_GPU_BLIT_FLAGS_REVERSE             (0b10000000) //last byte first, for overlapping copies to higher addresses
+
+#define FPGA_API_GPU_BLIT_STATUS_GET_BUSY(status)   (((status) & 0b10000000) >> 7)
+#define FPGA_API_GPU_BLIT_STATUS_GET_QUEUED(status) ((status) & 0b00011111)
+
+#define FPGA_API_GPU_CAPABILITIES_OCTAL             (0b00000001) //built with SPI_OCTAL, framebuffer_write can use the octal data phase
+#define FPGA_API_GPU_CAPABILITIES_1080P             (0b00000010) //built with VIDEO_1080P, the raster runs 1125 lines of 14.8 us instead of 750 of 22.2 us
+#define FPGA_API_GPU_CAPABILITIES_CS1_IRQ           (0b00000100) //built with SPI_CS1_IRQ, the io chip select pin is an fpga output carrying vblank
+
+typedef struct
+{
+    uint8_t mode;
+    uint8_t bitsPerPixel;
+    uint16_t width;
+    uint16_t height;
+    uint8_t capabilities;
+} fpga_api_gpu_geometry_t;
+
+typedef struct
+{
+    uint8_t status0;
+    uint16_t audioBufferStatus;
+    uint16_t frameCounter;
+    uint8_t flags;
+} fpga_api_gpu_status_bundle_t;
+
+typedef struct
+{
+    uint16_t line;     //screen line including vblank lines, 0 is the first visible line
+    uint16_t rowsDone; //frame rows completely scanned out in this frame, 0 during vblank
+} fpga_api_gpu_raster_t;
+
 bool fpga_api_gpu_read_status0(fpga_qspi_t *qspi, uint8_t *result);
 bool fpga_api_gpu_read_magic_number(fpga_qspi_t *qspi, bool *result);
+//result is false if the pattern did not come back intact, for link calibration
+bool fpga_api_gpu_echo(fpga_qspi_t *qspi, uint32_t pattern, bool *result);
+//also feeds the fpga_qspi link integrity check with the crcs of everything since the previous bundle,
+//false without touching result if the bundle arrived corrupted
+bool fpga_api_gpu_read_status_bundle(fpga_qspi_t *qspi, fpga_api_gpu_status_bundle_t *result);
+bool fpga_api_gpu_read_geometry(fpga_qspi_t *qspi, fpga_api_gpu_geometry_t *result);
+bool fpga_api_gpu_read_raster(fpga_qspi_t *qspi, fpga_api_gpu_raster_t *result);
 
 bool fpga_api_gpu_enable_output(fpga_qspi_t *qspi);
 bool fpga_api_gpu_disable_output(fpga_qspi_t *qspi);
 
 bool fpga_api_gpu_set_palette(fpga_qspi_t *qspi, uint8_t *palette);
 bool fpga_api_gpu_get_palette(fpga_qspi_t *qspi, uint8_t *palette);
+bool fpga_api_gpu_set_secondary_palette(fpga_qspi_t *qspi, uint8_t *palette);
 
 bool fpga_api_gpu_framebuffer_write(fpga_qspi_t *qspi, uint32_t startIdx, uint8_t *pixels, int pixelCount);
+//followed by a status bundle read, false if its crcs show the pixels or anything since the last bundle arrived corrupted
 bool fpga_api_gpu_framebuffer_read(fpga_qspi_t *qspi, uint32_t startIdx, uint8_t *pixels, int pixelCount);
+//compressed write, fill produces the lz token stream piece by piece while the previous piece is sent.
+//takes at most half the sclk cycles of a plain write, the fpga writes no faster than a byte per clock
+bool fpga_api_gpu_framebuffer_write_lz(fpga_qspi_t *qspi, uint32_t startIdx, fpga_qspi_stream_fill_t fill, void *context);
+//skip and literal tokens against what the framebuffer already holds, skipped pixels cost a token however many there are
+bool fpga_api_gpu_framebuffer_write_delta(fpga_qspi_t *qspi, uint32_t startIdx, fpga_qspi_stream_fill_t fill, void *context);
+//palette and framebuffer write in a single transaction, one setup instead of one per SPI_MAX_TRANS_BYTES
+bool fpga_api_gpu_framebuffer_present(fpga_qspi_t *qspi, uint8_t *palette, uint32_t startIdx, uint8_t *pixels, int pixelCount);
 
 bool fpga_api_gpu_audio_buffer_read_status(fpga_qspi_t *qspi, uint16_t *status);
 bool fpga_api_gpu_audio_buffer_write(fpga_qspi_t *qspi, uint8_t *samples, int sampleCount, uint16_t *status);
 
+bool fpga_api_gpu_write_registers(fpga_qspi_t *qspi, uint8_t startRegister, uint8_t *values, int count);
+bool fpga_api_gpu_read_registers(fpga_qspi_t *qspi, uint8_t startRegister, uint8_t *values, int count);
+
+bool fpga_api_gpu_sprite_write_image(fpga_qspi_t *qspi, int sprite, uint8_t *pixels);
+
+bool fpga_api_gpu_write_line_table(fpga_qspi_t *qspi, int startLine, uint8_t *rows, int count);
+
+bool fpga_api_gpu_write_copper_list(fpga_qspi_t *qspi, int startEntry, uint8_t *entries, int count);
+
+bool fpga_api_gpu_read_blit_status(fpga_qspi_t *qspi, uint8_t *status);
+//count must not exceed the free queue slots, FPGA_API_GPU_BLIT_QUEUE_DEPTH - queued
+bool fpga_api_gpu_blit(fpga_qspi_t *qspi, uint8_t *blocks, int count);
+bool fpga_api_gpu_write_blit_store(fpga_qspi_t *qspi, int offset, uint8_t *data, int size);
+//valid once the blitter is no longer busy with the crc block
+bool fpga_api_gpu_read_blit_crc(fpga_qspi_t *qspi, uint32_t *crc);
+
 
@@ -1,14 +1,126 @@
 #include "fpga_api_gpu.h"
+#include "fpga_api_io.h"
 #include "esp_log.h"
+#include <string.h>
 
-//static const char TAG[] = "fpga_api_io";
+static const char TAG[] = "fpga_api_io";
 
 typedef enum 
 {
-    COMMAND_USB_HID_GET_STATUS = 0b01010000
+    COMMAND_USB_HID_GET_STATUS          = 0b01010000, //write only, 6*4 bytes of hid device slot 0 status, 2 bytes of trailer
+    COMMAND_USB_HID_GET_DEVICE_STATUS   = 0b11010000, //read+write, read 1 byte of device slot index, then write 6*4 bytes of its status, 2 bytes of trailer
+    COMMAND_USB_TRACE_READ              = 0b01100000, //write only, 4 bytes of total event count, then 64*4 bytes of the firmware trace ring, 2 bytes of trailer
+    COMMAND_EDID_READ                   = 0b01110000  //write only, 1 byte of ddc status, then 256 bytes of the monitor edid, 2 bytes of trailer
 } FPGA_IO_COMMAND;
 
+#define HID_STATUS_READ_SIZE_BYTES (FPGA_API_IO_HID_STATUS_SIZE_BYTES + FPGA_API_IO_TRAILER_SIZE_BYTES)
+
+//compares the trailer after size bytes of buf with the crc of the read phase (address bytes) and the data
+static bool IRAM_ATTR fpga_api_io_check_trailer(fpga_qspi_t *qspi, const uint8_t *address, int addressSize, const uint8_t *buf, int size)
+{
+    if (!qspi->link_check)
+        return true;
+
+    uint16_t crc = fpga_qspi_crc16(fpga_qspi_crc16(0xFFFF, address, addressSize), buf, size);
+    bool ok = crc == (buf[size] << 8 | buf[size + 1]);
+
+    fpga_qspi_link_report(qspi, ok);
+
+    return ok;
+}
+
+//read without a read phase, result gets size bytes once the trailer matched
+static bool IRAM_ATTR fpga_api_io_read(fpga_qspi_t *qspi, uint8_t command, uint8_t *buf, uint8_t *result, int size)
+{
+    if (!fpga_qspi_send_io(qspi, command, 0, 0, NULL, 0, buf, size + FPGA_API_IO_TRAILER_SIZE_BYTES))
+        return false;
+
+    if (!fpga_api_io_check_trailer(qspi, NULL, 0, buf, size))
+        return false;
+
+    memcpy(result, buf, size);
+
+    return true;
+}
+
 bool IRAM_ATTR fpga_api_io_hid_get_status(fpga_qspi_t *qspi, uint8_t *result)
 {
-    return fpga_qspi_send_io(qspi, COMMAND_USB_HID_GET_STATUS, 0, 0, NULL, 0, result, 6*4);
+    WORD_ALIGNED_ATTR uint8_t buf[HID_STATUS_READ_SIZE_BYTES];
+
+    return fpga_api_io_read(qspi, COMMAND_USB_HID_GET_STATUS, buf, result, FPGA_API_IO_HID_STATUS_SIZE_BYTES);
+}
+
+bool IRAM_ATTR fpga_api_io_hid_get_device_status(fpga_qspi_t *qspi, int slot, uint8_t *result)
+{
+    if (slot < 0 || slot >= FPGA_API_IO_HID_DEVICE_SLOTS)
+    {
+        ESP_LOGE(TAG, "hid device slot must be 0 <= slot < %d", FPGA_API_IO_HID_DEVICE_SLOTS);
+        return false;
+    }
+
+    WORD_ALIGNED_ATTR uint8_t buf[HID_STATUS_READ_SIZE_BYTES];
+    uint8_t address = slot;
+
+    if (!fpga_qspi_send_io(qspi, COMMAND_USB_HID_GET_DEVICE_STATUS, slot, 8, NULL, 0, buf, HID_STATUS_READ_SIZE_BYTES))
+        return false;
+
+    if (!fpga_api_io_check_trailer(qspi, &address, 1, buf, FPGA_API_IO_HID_STATUS_SIZE_BYTES))
+        return false;
+
+    memcpy(result, buf, FPGA_API_IO_HID_STATUS_SIZE_BYTES);
+
+    return true;
+}
+
+bool IRAM_ATTR fpga_api_io_hid_get_all_status(fpga_qspi_t *qspi, uint8_t *result)
+{
+    fpga_qspi_command_t commands[FPGA_API_IO_HID_DEVICE_SLOTS];
+    WORD_ALIGNED_ATTR uint8_t buf[FPGA_API_IO_HID_DEVICE_SLOTS][(HID_STATUS_READ_SIZE_BYTES + 3) & ~3]; //every slot word aligned
+
+    for (int slot = 0; slot < FPGA_API_IO_HID_DEVICE_SLOTS; ++slot)
+    {
+        commands[slot] = (fpga_qspi_command_t)
+        {
+            .io = true,
+            .command = COMMAND_USB_HID_GET_DEVICE_STATUS,
+            .address = slot,
+            .addressLengthBits = 8,
+            .receiveBuf = buf[slot],
+            .receiveCount = HID_STATUS_READ_SIZE_BYTES
+        };
+    }
+
+    if (!fpga_qspi_send_chain(qspi, commands, FPGA_API_IO_HID_DEVICE_SLOTS))
+        return false;
+
+    bool allOk = true;
+
+    for (int slot = 0; slot < FPGA_API_IO_HID_DEVICE_SLOTS; ++slot)
+    {
+        uint8_t address = slot;
+
+        allOk &= fpga_api_io_check_trailer(qspi, &address, 1, buf[slot], FPGA_API_IO_HID_STATUS_SIZE_BYTES);
+    }
+
+    if (!allOk)
+        return false;
+
+    for (int slot = 0; slot < FPGA_API_IO_HID_DEVICE_SLOTS; ++slot)
+        memcpy(result + slot * FPGA_API_IO_HID_STATUS_SIZE_BYTES, buf[slot], FPGA_API_IO_HID_STATUS_SIZE_BYTES);
+
+    return true;
+}
+
+bool IRAM_ATTR fpga_api_io_usb_trace_read(fpga_qspi_t *qspi, uint8_t *result)
+{
+    WORD_ALIGNED_ATTR uint8_t buf[FPGA_API_IO_USB_TRACE_SIZE_BYTES + FPGA_API_IO_TRAILER_SIZE_BYTES];
+
+    return fpga_api_io_read(qspi, COMMAND_USB_TRACE_READ, buf, result, FPGA_API_IO_USB_TRACE_SIZE_BYTES);
+}
+
+bool IRAM_ATTR fpga_api_io_edid_read(fpga_qspi_t *qspi, uint8_t *result)
+{
+    WORD_ALIGNED_ATTR uint8_t buf[FPGA_API_IO_EDID_READ_SIZE_BYTES + FPGA_API_IO_TRAILER_SIZE_BYTES];
+
+    return fpga_api_io_read(qspi, COMMAND_EDID_READ, buf, result, FPGA_API_IO_EDID_READ_SIZE_BYTES);
 }
\ No newline at end of file
@@ -2,4 +2,38 @@
 
 #include "fpga_qspi.h"
 
-bool fpga_api_io_hid_get_status(fpga_qspi_t *qspi, uint8_t *result);
\ No newline at end of file
+#define FPGA_API_IO_HID_DEVICE_SLOTS        (4)
+#define FPGA_API_IO_HID_STATUS_SIZE_BYTES   (6*4)
+
+#define FPGA_API_IO_USB_TRACE_ENTRIES       (64)
+#define FPGA_API_IO_USB_TRACE_SIZE_BYTES    (4 + FPGA_API_IO_USB_TRACE_ENTRIES*4)
+
+#define FPGA_API_IO_EDID_SIZE               (256) //base block and the first extension
+#define FPGA_API_IO_EDID_READ_SIZE_BYTES    (1 + FPGA_API_IO_EDID_SIZE)
+
+//crc-16 spi_io appends to every read over the slot index and the data, checked and stripped by the functions below
+#define FPGA_API_IO_TRAILER_SIZE_BYTES      (2)
+
+//first 4 bytes of hid status: 0xAB, keyboard slots mask, mouse slots mask, slot index
+#define FPGA_API_IO_HID_STATUS_GET_KEYBOARD_MASK(status)    ((status)[1])
+#define FPGA_API_IO_HID_STATUS_GET_MOUSE_MASK(status)       ((status)[2])
+
+//first byte of edid read: ddc status, edid follows and is only meaningful when valid
+#define FPGA_API_IO_EDID_STATUS_GET_HPD(status)             ((status) & 0b00000001)
+#define FPGA_API_IO_EDID_STATUS_GET_BUSY(status)            (((status) & 0b00000010) >> 1)
+#define FPGA_API_IO_EDID_STATUS_GET_VALID(status)           (((status) & 0b00000100) >> 2)
+#define FPGA_API_IO_EDID_STATUS_GET_NACK(status)            (((status) & 0b00001000) >> 3)
+
+//every read is false without touching result when its trailer does not match, which also feeds the fpga_qspi link check.
+//not to be called concurrently with fpga_qspi_link_report
+bool fpga_api_io_hid_get_status(fpga_qspi_t *qspi, uint8_t *result);
+bool fpga_api_io_hid_get_device_status(fpga_qspi_t *qspi, int slot, uint8_t *result);
+//status of every slot in one command list, FPGA_API_IO_HID_DEVICE_SLOTS*FPGA_API_IO_HID_STATUS_SIZE_BYTES
+bool fpga_api_io_hid_get_all_status(fpga_qspi_t *qspi, uint8_t *result);
+
+//usb softcore trace ring: 4 bytes of big endian total event count, then the ring, entry i is at event count ≡ i (mod FPGA_API_IO_USB_TRACE_ENTRIES)
+//each big endian entry: [31:24] event id, [23:16] low byte of softcore ms timer, [15:0] event argument
+bool fpga_api_io_usb_trace_read(fpga_qspi_t *qspi, uint8_t *result);
+
+//monitor edid as read by the fpga over ddc after hot plug: 1 byte of status, then FPGA_API_IO_EDID_SIZE bytes
+bool fpga_api_io_edid_read(fpga_qspi_t *qspi, uint8_t *result);
\ No newline at end of file
@@ -1,93 +1,166 @@
 #include "fpga_qspi.h"
 #include "esp_log.h"
 #include "esp_err.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "driver/gpio.h"
 
 static const char TAG[] = "fpga_qspi";
 
 #define SPI_DEVICE SPI2_HOST
 #define SPI_FREQ SPI_MASTER_FREQ_80M
-#define SPI_MAX_TRANS_BYTES 4092*4
+#define FPGA_QSPI_COMMAND_BITS 8
+#define FPGA_QSPI_COMMAND_CHAIN 0b00100000
 
-#define SPI_INPUT_DELAY_NS 18
+//transactions up to this size busy-wait in spi_device_polling_transmit, 
+//the queue, isr and task wakeup round trip costs far more than the transfer itself
+#define FPGA_QSPI_POLLING_MAX_BYTES 64
 
-#define FPGA_QSPI_COMMAND_BITS 8
-#define FPGA_QSPI_READ_DUMMY_CYCLES 2
+#define FPGA_QSPI_QUEUE_SIZE 4 //chunks of a long write in flight at once
+
+//clock steps for the link integrity fallback, SPI_FREQ first
+static const int fpga_qspi_freqs[FPGA_QSPI_FREQ_LEVELS] = { SPI_FREQ, SPI_MASTER_FREQ_40M, SPI_MASTER_FREQ_20M };
 
-bool fpga_qspi_init(fpga_qspi_t *qspi, int pinCsGpu, int pinCsIo, int pinSclk, int pinD0, int pinD1, int pinD2, int pinD3)
+//crc-16/ccitt-false one nibble at a time, same order the fpga clocks them in
+static DRAM_ATTR const uint16_t fpga_qspi_crc16_table[16] = 
 {
-    spi_device_handle_t spiGpu = NULL, spiIo = NULL;
+    0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7, 
+    0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF
+};
 
-    spi_bus_config_t busCfg = 
+static inline IRAM_ATTR uint16_t fpga_qspi_crc16_nibble(uint16_t crc, uint8_t nibble)
+{
+    return (crc << 4) ^ fpga_qspi_crc16_table[(crc >> 12) ^ nibble];
+}
+
+IRAM_ATTR uint16_t fpga_qspi_crc16(uint16_t crc, const uint8_t *data, int size)
+{
+    for (int i = 0; i < size; ++i)
     {
-        .sclk_io_num = pinSclk,
-        .data0_io_num = pinD0,
-        .data1_io_num = pinD1,
-        .data2_io_num = pinD2,
-        .data3_io_num = pinD3,
-        .max_transfer_sz = SPI_MAX_TRANS_BYTES,
-    };
-    
-    if (spi_bus_initialize(SPI_DEVICE, &busCfg, SPI_DMA_CH_AUTO) != ESP_OK)
-        goto cleanup;
-    
+        crc = fpga_qspi_crc16_nibble(crc, data[i] >> 4);
+        crc = fpga_qspi_crc16_nibble(crc, data[i] & 0x0F);
+    }
+
+    return crc;
+}
+
+static bool fpga_qspi_add_devices(fpga_qspi_t *qspi, int freq)
+{
     spi_device_interface_config_t gpuCfg = 
     {
-        .clock_speed_hz = SPI_FREQ,
+        .clock_speed_hz = freq,
         .mode = 0,
-        .spics_io_num = pinCsGpu,
-        .queue_size = 2,
+        .spics_io_num = qspi->pin_cs_gpu,
+        .queue_size = FPGA_QSPI_QUEUE_SIZE,
         .flags = SPI_DEVICE_HALFDUPLEX /*| SPI_DEVICE_NO_DUMMY*/,
-        .input_delay_ns = SPI_INPUT_DELAY_NS,
+        .input_delay_ns = qspi->input_delay_ns,
         .command_bits = FPGA_QSPI_COMMAND_BITS
     };
 
-    if (spi_bus_add_device(SPI_DEVICE, &gpuCfg, &spiGpu) != ESP_OK)
-        goto cleanup;
+    if (spi_bus_add_device(SPI_DEVICE, &gpuCfg, &qspi->spi_gpu) != ESP_OK)
+        return false;
+
+    int actualFreq;
+
+    spi_device_get_actual_freq(qspi->spi_gpu, &actualFreq);
+    ESP_LOGI(TAG, "fpga spi gpu actual freq: %d", actualFreq);
+
+    if (qspi->pin_cs_io < 0)
+        return true;
 
     spi_device_interface_config_t ioCfg = 
     {
-        .clock_speed_hz = SPI_FREQ,
+        .clock_speed_hz = freq,
         .mode = 0,
-        .spics_io_num = pinCsIo,
-        .queue_size = 2,
+        .spics_io_num = qspi->pin_cs_io,
+        .queue_size = FPGA_QSPI_QUEUE_SIZE,
         .flags = SPI_DEVICE_HALFDUPLEX /*| SPI_DEVICE_NO_DUMMY*/,
-        .input_delay_ns = SPI_INPUT_DELAY_NS,
+        .input_delay_ns = qspi->input_delay_ns,
         .command_bits = FPGA_QSPI_COMMAND_BITS
     };
 
-    if (spi_bus_add_device(SPI_DEVICE, &ioCfg, &spiIo) != ESP_OK)
-        goto cleanup;
+    if (spi_bus_add_device(SPI_DEVICE, &ioCfg, &qspi->spi_io) != ESP_OK)
+        return false;
 
-    qspi->spi_gpu = spiGpu;
-    qspi->spi_io = spiIo;
+    spi_device_get_actual_freq(qspi->spi_io, &actualFreq);
+    ESP_LOGI(TAG, "fpga spi io actual freq: %d", actualFreq);
 
-    int actualFreq;
+    return true;
+}
 
-    spi_device_get_actual_freq(spiGpu, &actualFreq);
-    ESP_LOGI(TAG, "fpga spi gpu actual freq: %d", actualFreq);
+static void fpga_qspi_remove_devices(fpga_qspi_t *qspi)
+{
+    if (qspi->spi_gpu != NULL)
+        spi_bus_remove_device(qspi->spi_gpu);
+    if (qspi->spi_io != NULL)
+        spi_bus_remove_device(qspi->spi_io);
 
-    spi_device_get_actual_freq(spiIo, &actualFreq);
-    ESP_LOGI(TAG, "fpga spi io actual freq: %d", actualFreq);
+    qspi->spi_gpu = NULL;
+    qspi->spi_io = NULL;
+}
+
+bool fpga_qspi_init(fpga_qspi_t *qspi, int pinCsGpu, int pinCsIo, int pinSclk, int pinD0, int pinD1, int pinD2, int pinD3, int pinD4, int pinD5, int pinD6, int pinD7)
+{
+    bool octal = pinD4 >= 0 && pinD5 >= 0 && pinD6 >= 0 && pinD7 >= 0;
+
+    *qspi = (fpga_qspi_t)
+    {
+        .pin_cs_gpu = pinCsGpu,
+        .pin_cs_io = pinCsIo,
+        .input_delay_ns = SPI_INPUT_DELAY_NS,
+        .read_dummy_cycles = FPGA_QSPI_READ_DUMMY_CYCLES,
+        .octal_wired = octal,
+        .octal = octal,
+        .io_on_gpu_cs = pinCsIo < 0,
+        .link_check = true,
+        .probe_windows = FPGA_QSPI_LINK_PROBE_WINDOWS
+    };
+
+    qspi->lock = xSemaphoreCreateMutex();
+
+    if (qspi->lock == NULL)
+        return false;
+
+    spi_bus_config_t busCfg = 
+    {
+        .sclk_io_num = pinSclk,
+        .data0_io_num = pinD0,
+        .data1_io_num = pinD1,
+        .data2_io_num = pinD2,
+        .data3_io_num = pinD3,
+        .data4_io_num = octal ? pinD4 : -1,
+        .data5_io_num = octal ? pinD5 : -1,
+        .data6_io_num = octal ? pinD6 : -1,
+        .data7_io_num = octal ? pinD7 : -1,
+        .max_transfer_sz = SPI_MAX_TRANS_BYTES,
+        .flags = octal ? SPICOMMON_BUSFLAG_OCTAL : 0
+    };
+    
+    if (spi_bus_initialize(SPI_DEVICE, &busCfg, SPI_DMA_CH_AUTO) != ESP_OK)
+        goto cleanup;
+    
+    if (!fpga_qspi_add_devices(qspi, fpga_qspi_freqs[0]))
+        goto cleanup;
 
     return true;
 
     //release spi if error
 cleanup:
-    if (spiGpu != NULL)
-        spi_bus_remove_device(spiGpu);
-    if (spiIo != NULL)
-        spi_bus_remove_device(spiIo);
+    fpga_qspi_remove_devices(qspi);
     
     spi_bus_free(SPI_DEVICE);
 
     return false;
 }
 
-static inline IRAM_ATTR bool fpga_qspi_send(spi_device_handle_t device, uint8_t command, uint64_t address, int addressLengthBits, uint8_t *sendBuf, int sendCount, uint8_t *receiveBuf, int receiveCount)
+static inline IRAM_ATTR bool fpga_qspi_send(spi_device_handle_t device, int dummyCycles, uint8_t command, uint64_t address, int addressLengthBits, uint8_t *sendBuf, int sendCount, uint8_t *receiveBuf, int receiveCount)
 {
     esp_err_t err = ~ESP_OK;
     spi_transaction_ext_t *lastTrans = NULL;
 
+    if (device == NULL) //a clock change failed to add it back
+        return false;
+
     if (spi_device_acquire_bus(device, portMAX_DELAY) != ESP_OK)
         return false;
 
@@ -129,12 +202,14 @@ static inline IRAM_ATTR bool fpga_qspi_send(spi_device_handle_t device, uint8_t
         },
         .address_bits = sendCount > 0 ? 0 : addressLengthBits,
         .command_bits = sendCount > 0 ? 0 : FPGA_QSPI_COMMAND_BITS,
-        .dummy_bits = FPGA_QSPI_READ_DUMMY_CYCLES //its cycles, not 'bits'
+        .dummy_bits = dummyCycles //its cycles, not 'bits'
     };
 
+    bool polling = sendCount + receiveCount <= FPGA_QSPI_POLLING_MAX_BYTES;
+
     if (sendCount > 0 || (sendCount == 0 && receiveCount == 0))
     {
-        err = spi_device_queue_trans(device, &transTx.base, 0);
+        err = polling ? spi_device_polling_transmit(device, &transTx.base) : spi_device_queue_trans(device, &transTx.base, 0);
 
         if (err != ESP_OK)
             goto cleanup;
@@ -144,7 +219,7 @@ static inline IRAM_ATTR bool fpga_qspi_send(spi_device_handle_t device, uint8_t
 
     if (receiveCount > 0)
     {
-        err = spi_device_queue_trans(device, &transRx.base, 0);
+        err = polling ? spi_device_polling_transmit(device, &transRx.base) : spi_device_queue_trans(device, &transRx.base, 0);
         
         if (err != ESP_OK)
             goto cleanup;
@@ -152,6 +227,9 @@ static inline IRAM_ATTR bool fpga_qspi_send(spi_device_handle_t device, uint8_t
         lastTrans = &transRx;
     }
 
+    if (polling)
+        goto cleanup;
+
     spi_transaction_t *completedTrans = NULL;
 
     while (completedTrans != &lastTrans->base)
@@ -168,12 +246,733 @@ cleanup:
     return err == ESP_OK;
 }
 
+//crc-16 of what the fpga sees in its read phase continued from crc: address nibbles, then data
+static inline IRAM_ATTR uint16_t fpga_qspi_read_phase_crc(uint16_t crc, uint64_t address, int addressLengthBits, const uint8_t *sendBuf, int sendCount)
+{
+    for (int i = addressLengthBits - 4; i >= 0; i -= 4)
+        crc = fpga_qspi_crc16_nibble(crc, (address >> i) & 0x0F);
+
+    return fpga_qspi_crc16(crc, sendBuf, sendCount);
+}
+
+//adds a finished gpu transaction to the crcs the next status bundle is compared with, lock must be held.
+//sendCrc already continues gpu_send_crc, a failed transaction leaves the fpga ones unknown until the bundle restarts them
+static inline IRAM_ATTR void fpga_qspi_link_update(fpga_qspi_t *qspi, bool ok, uint16_t sendCrc, const uint8_t *receiveBuf, int receiveCount)
+{
+    if (!ok || !qspi->link_check)
+    {
+        qspi->gpu_crc_valid = false;
+        return;
+    }
+
+    qspi->gpu_send_crc = sendCrc;
+    qspi->gpu_receive_crc = fpga_qspi_crc16(qspi->gpu_receive_crc, receiveBuf, receiveCount);
+}
+
+//takes the lock for a transaction, returns when it was asked for and sets when it was granted
+static inline IRAM_ATTR int64_t fpga_qspi_take(fpga_qspi_t *qspi, int64_t *startUs)
+{
+    int64_t requestedUs = esp_timer_get_time();
+
+    xSemaphoreTake(qspi->lock, portMAX_DELAY);
+
+    *startUs = esp_timer_get_time();
+
+    return requestedUs;
+}
+
+//counts a finished transaction and traces it, lock must be held
+static IRAM_ATTR void fpga_qspi_account(fpga_qspi_t *qspi, int64_t requestedUs, int64_t startUs, uint8_t command, uint8_t flags, int bytes, bool ok)
+{
+    int64_t endUs = esp_timer_get_time();
+    int64_t waitUs = startUs - requestedUs;
+
+    qspi->stats.transactions += 1;
+    qspi->stats.errors += ok ? 0 : 1;
+    qspi->stats.bytes += bytes;
+    qspi->stats.busUs += endUs - startUs;
+    qspi->stats.waitUs += waitUs;
+
+    if (qspi->trace == NULL)
+        return;
+
+    qspi->trace[qspi->trace_head++ % qspi->trace_size] = (fpga_qspi_trace_entry_t)
+    {
+        .command = command,
+        .flags = flags | (ok ? 0 : FPGA_QSPI_TRACE_FLAG_ERROR),
+        .waitUs = waitUs > UINT16_MAX ? UINT16_MAX : waitUs,
+        .bytes = bytes,
+        .startUs = startUs,
+        .endUs = endUs
+    };
+}
+
 IRAM_ATTR bool fpga_qspi_send_gpu(fpga_qspi_t *qspi, uint8_t command, uint64_t address, int addressLengthBits, uint8_t *sendBuf, int sendCount, uint8_t *receiveBuf, int receiveCount)
 {
-    return fpga_qspi_send(qspi->spi_gpu, command, address, addressLengthBits, sendBuf, sendCount, receiveBuf, receiveCount);
+    int64_t startUs, requestedUs = fpga_qspi_take(qspi, &startUs);
+
+    bool result = fpga_qspi_send(qspi->spi_gpu, qspi->read_dummy_cycles, command, address, addressLengthBits, sendBuf, sendCount, receiveBuf, receiveCount);
+
+    uint16_t crc = qspi->link_check ? fpga_qspi_read_phase_crc(qspi->gpu_send_crc, address, addressLengthBits, sendBuf, sendCount) : 0;
+
+    fpga_qspi_link_update(qspi, result, crc, receiveBuf, receiveCount);
+
+    fpga_qspi_account(qspi, requestedUs, startUs, command, 0, 1 + addressLengthBits / 8 + sendCount + receiveCount, result);
+
+    xSemaphoreGive(qspi->lock);
+
+    return result;
+}
+
+IRAM_ATTR bool fpga_qspi_send_gpu_segments(fpga_qspi_t *qspi, uint8_t command, uint64_t address, int addressLengthBits, const fpga_qspi_segment_t *segments, int segmentCount)
+{
+    spi_transaction_ext_t trans[FPGA_QSPI_QUEUE_SIZE];
+    spi_transaction_t *completedTrans = NULL;
+    esp_err_t err = ESP_OK;
+
+    int totalCount = 0;
+
+    for (int i = 0; i < segmentCount; ++i)
+        totalCount += segments[i].count;
+
+    int64_t startUs, requestedUs = fpga_qspi_take(qspi, &startUs);
+
+    spi_device_handle_t device = qspi->spi_gpu;
+
+    if (device == NULL || totalCount <= 0 || spi_device_acquire_bus(device, portMAX_DELAY) != ESP_OK)
+    {
+        xSemaphoreGive(qspi->lock);
+        return false;
+    }
+
+    int queued = 0, completed = 0, segment = 0, offset = 0, sent = 0;
+    uint16_t crc = qspi->gpu_send_crc;
+
+    //the driver starts the next queued piece from its isr and keeps cs low in between,
+    //the fpga only sees a pause of sclk
+    while (err == ESP_OK && sent < totalCount)
+    {
+        if (queued - completed < FPGA_QSPI_QUEUE_SIZE)
+        {
+            while (offset >= segments[segment].count)
+            {
+                ++segment;
+                offset = 0;
+            }
+
+            int count = segments[segment].count - offset > SPI_MAX_TRANS_BYTES ? SPI_MAX_TRANS_BYTES : segments[segment].count - offset;
+            bool first = queued == 0;
+            bool octal = segments[segment].octal;
+
+            if (first && octal) //command and address on their own, lines can only change between transactions
+                count = 0;
+
+            bool last = sent + count >= totalCount;
+
+            trans[queued % FPGA_QSPI_QUEUE_SIZE] = (spi_transaction_ext_t)
+            {
+                .base = 
+                {
+                    .flags = (octal && !first ? SPI_TRANS_MODE_OCT : SPI_TRANS_MODE_QIO) | 
+                             SPI_TRANS_MULTILINE_CMD | 
+                             SPI_TRANS_MULTILINE_ADDR | 
+                             SPI_TRANS_VARIABLE_CMD |
+                             SPI_TRANS_VARIABLE_ADDR |
+                             (last ? 0 : SPI_TRANS_CS_KEEP_ACTIVE),
+                    .cmd = command,
+                    .addr = address,
+                    .length = count * 8,
+                    .tx_buffer = segments[segment].data + offset
+                },
+                .command_bits = first ? FPGA_QSPI_COMMAND_BITS : 0,
+                .address_bits = first ? addressLengthBits : 0
+            };
+
+            err = spi_device_queue_trans(device, &trans[queued % FPGA_QSPI_QUEUE_SIZE].base, 0);
+
+            if (err == ESP_OK)
+            {
+                if (qspi->link_check)
+                    crc = first 
+                        ? fpga_qspi_read_phase_crc(crc, address, addressLengthBits, segments[segment].data + offset, count)
+                        : fpga_qspi_crc16(crc, segments[segment].data + offset, count);
+
+                ++queued;
+                offset += count;
+                sent += count;
+            }
+        }
+        else
+        {
+            err = spi_device_get_trans_result(device, &completedTrans, portMAX_DELAY);
+
+            if (err == ESP_OK)
+                ++completed;
+        }
+    }
+
+    //queued pieces must be finished before the bus is released, even after an error
+    while (completed < queued)
+    {
+        esp_err_t drainErr = spi_device_get_trans_result(device, &completedTrans, portMAX_DELAY);
+
+        if (drainErr != ESP_OK)
+        {
+            err = drainErr;
+            break;
+        }
+
+        ++completed;
+    }
+
+    spi_device_release_bus(device);
+
+    bool result = err == ESP_OK;
+
+    fpga_qspi_link_update(qspi, result, crc, NULL, 0);
+
+    fpga_qspi_account(qspi, requestedUs, startUs, command, 0, 1 + addressLengthBits / 8 + totalCount, result);
+
+    xSemaphoreGive(qspi->lock);
+
+    return result;
+}
+
+IRAM_ATTR bool fpga_qspi_send_gpu_stream(fpga_qspi_t *qspi, uint8_t command, uint64_t address, int addressLengthBits, fpga_qspi_stream_fill_t fill, void *context)
+{
+    spi_transaction_ext_t trans[2];
+    spi_transaction_t *completedTrans = NULL;
+    esp_err_t err = ESP_OK;
+
+    int64_t startUs, requestedUs = fpga_qspi_take(qspi, &startUs);
+
+    spi_device_handle_t device = qspi->spi_gpu;
+
+    if (device == NULL || spi_device_acquire_bus(device, portMAX_DELAY) != ESP_OK)
+    {
+        xSemaphoreGive(qspi->lock);
+        return false;
+    }
+
+    int queued = 0, completed = 0, sent = 0;
+    bool last = false;
+    uint16_t crc = qspi->gpu_send_crc;
+
+    //one piece on the wire while the next one is produced, cs stays low through the gaps
+    while (err == ESP_OK && !last)
+    {
+        if (queued - completed > 1)
+        {
+            err = spi_device_get_trans_result(device, &completedTrans, portMAX_DELAY);
+
+            if (err == ESP_OK)
+                ++completed;
+
+            continue;
+        }
+
+        uint8_t *data = NULL;
+        int count = fill(context, &data, &last);
+
+        if (count < 0 || count > SPI_MAX_TRANS_BYTES)
+        {
+            err = ESP_ERR_INVALID_SIZE;
+            break;
+        }
+
+        bool first = queued == 0;
+
+        trans[queued % 2] = (spi_transaction_ext_t)
+        {
+            .base = 
+            {
+                .flags = SPI_TRANS_MODE_QIO | 
+                         SPI_TRANS_MULTILINE_CMD | 
+                         SPI_TRANS_MULTILINE_ADDR | 
+                         SPI_TRANS_VARIABLE_CMD |
+                         SPI_TRANS_VARIABLE_ADDR |
+                         (last ? 0 : SPI_TRANS_CS_KEEP_ACTIVE),
+                .cmd = command,
+                .addr = address,
+                .length = count * 8,
+                .tx_buffer = data
+            },
+            .command_bits = first ? FPGA_QSPI_COMMAND_BITS : 0,
+            .address_bits = first ? addressLengthBits : 0
+        };
+
+        err = spi_device_queue_trans(device, &trans[queued % 2].base, portMAX_DELAY);
+
+        if (err == ESP_OK)
+        {
+            if (qspi->link_check)
+                crc = first 
+                    ? fpga_qspi_read_phase_crc(crc, address, addressLengthBits, data, count)
+                    : fpga_qspi_crc16(crc, data, count);
+
+            ++queued;
+            sent += count;
+        }
+    }
+
+    //cs is only released by a piece without CS_KEEP_ACTIVE, an aborted stream ends with an empty one
+    if (err != ESP_OK && queued > 0 && !last)
+    {
+        while (completed < queued && spi_device_get_trans_result(device, &completedTrans, portMAX_DELAY) == ESP_OK)
+            ++completed;
+
+        trans[0] = (spi_transaction_ext_t)
+        {
+            .base = 
+            {
+                .flags = SPI_TRANS_MODE_QIO | SPI_TRANS_VARIABLE_CMD | SPI_TRANS_VARIABLE_ADDR
+            }
+        };
+
+        if (spi_device_queue_trans(device, &trans[0].base, portMAX_DELAY) == ESP_OK)
+            ++queued;
+    }
+
+    while (completed < queued)
+    {
+        esp_err_t drainErr = spi_device_get_trans_result(device, &completedTrans, portMAX_DELAY);
+
+        if (drainErr != ESP_OK)
+        {
+            err = drainErr;
+            break;
+        }
+
+        ++completed;
+    }
+
+    spi_device_release_bus(device);
+
+    bool result = err == ESP_OK;
+
+    fpga_qspi_link_update(qspi, result, crc, NULL, 0);
+
+    fpga_qspi_account(qspi, requestedUs, startUs, command, 0, 1 + addressLengthBits / 8 + sent, result);
+
+    xSemaphoreGive(qspi->lock);
+
+    return result;
 }
 
 IRAM_ATTR bool fpga_qspi_send_io(fpga_qspi_t *qspi, uint8_t command, uint64_t address, int addressLengthBits, uint8_t *sendBuf, int sendCount, uint8_t *receiveBuf, int receiveCount)
 {
-    return fpga_qspi_send(qspi->spi_io, command, address, addressLengthBits, sendBuf, sendCount, receiveBuf, receiveCount);
+    if (qspi->io_on_gpu_cs)
+    {
+        fpga_qspi_command_t chained = 
+        {
+            .io = true,
+            .command = command,
+            .address = address,
+            .addressLengthBits = addressLengthBits,
+            .sendBuf = sendBuf,
+            .sendCount = sendCount,
+            .receiveBuf = receiveBuf,
+            .receiveCount = receiveCount
+        };
+
+        return fpga_qspi_send_chain(qspi, &chained, 1);
+    }
+
+    int64_t startUs, requestedUs = fpga_qspi_take(qspi, &startUs);
+
+    bool result = fpga_qspi_send(qspi->spi_io, qspi->read_dummy_cycles, command, address, addressLengthBits, sendBuf, sendCount, receiveBuf, receiveCount);
+
+    fpga_qspi_account(qspi, requestedUs, startUs, command, FPGA_QSPI_TRACE_FLAG_IO, 1 + addressLengthBits / 8 + sendCount + receiveCount, result);
+
+    xSemaphoreGive(qspi->lock);
+
+    return result;
+}
+
+//queues all transactions with at most FPGA_QSPI_QUEUE_SIZE in flight, bus must be acquired
+static IRAM_ATTR esp_err_t fpga_qspi_transmit_all(spi_device_handle_t device, spi_transaction_ext_t *trans, int count)
+{
+    spi_transaction_t *completedTrans = NULL;
+    esp_err_t err = ESP_OK;
+
+    int queued = 0, completed = 0;
+
+    while (err == ESP_OK && queued < count)
+    {
+        if (queued - completed < FPGA_QSPI_QUEUE_SIZE)
+        {
+            err = spi_device_queue_trans(device, &trans[queued].base, 0);
+
+            if (err == ESP_OK)
+                ++queued;
+        }
+        else
+        {
+            err = spi_device_get_trans_result(device, &completedTrans, portMAX_DELAY);
+
+            if (err == ESP_OK)
+                ++completed;
+        }
+    }
+
+    while (completed < queued)
+    {
+        esp_err_t drainErr = spi_device_get_trans_result(device, &completedTrans, portMAX_DELAY);
+
+        if (drainErr != ESP_OK)
+            return drainErr;
+
+        ++completed;
+    }
+
+    return err;
+}
+
+IRAM_ATTR bool fpga_qspi_send_chain(fpga_qspi_t *qspi, const fpga_qspi_command_t *commands, int count)
+{
+    if (count <= 0 || count > FPGA_QSPI_CHAIN_MAX_COMMANDS)
+        return false;
+
+    int64_t startUs, requestedUs = fpga_qspi_take(qspi, &startUs);
+
+    spi_device_handle_t device = qspi->spi_gpu;
+    spi_transaction_ext_t *trans = qspi->chain_trans;
+
+    int transCount = 0, bytes = 1;
+    bool valid = true;
+    uint16_t crc = qspi->gpu_send_crc;
+
+    //every command is a prefix (length, command and address), then its data and its write phase
+    for (int i = 0; i < count && valid; ++i)
+    {
+        const fpga_qspi_command_t *c = &commands[i];
+
+        int addressBytes = c->addressLengthBits / 8;
+        int cycles = 2 * (1 + addressBytes + c->sendCount) + (c->receiveCount > 0 ? qspi->read_dummy_cycles + 2 * c->receiveCount : 0);
+
+        if ((c->addressLengthBits % 8) != 0 || addressBytes > 8 || cycles > FPGA_QSPI_CHAIN_MAX_CYCLES)
+        {
+            valid = false;
+            break;
+        }
+
+        uint8_t *prefix = qspi->chain_prefix[i];
+
+        bytes += 3 + addressBytes + c->sendCount + c->receiveCount;
+
+        prefix[0] = (c->io ? 0x80 : 0) | (cycles >> 8);
+        prefix[1] = cycles & 0xFF;
+        prefix[2] = c->command;
+
+        for (int j = 0; j < addressBytes; ++j)
+            prefix[3 + j] = (c->address >> (8 * (addressBytes - 1 - j))) & 0xFF;
+
+        trans[transCount++] = (spi_transaction_ext_t)
+        {
+            .base = 
+            {
+                .flags = SPI_TRANS_MODE_QIO | 
+                         SPI_TRANS_MULTILINE_CMD | 
+                         SPI_TRANS_VARIABLE_CMD |
+                         SPI_TRANS_VARIABLE_ADDR |
+                         SPI_TRANS_CS_KEEP_ACTIVE,
+                .cmd = FPGA_QSPI_COMMAND_CHAIN,
+                .length = (3 + addressBytes) * 8,
+                .tx_buffer = prefix
+            },
+            .command_bits = i == 0 ? FPGA_QSPI_COMMAND_BITS : 0
+        };
+
+        if (c->sendCount > 0)
+        {
+            trans[transCount++] = (spi_transaction_ext_t)
+            {
+                .base = 
+                {
+                    .flags = SPI_TRANS_MODE_QIO | 
+                             SPI_TRANS_VARIABLE_CMD |
+                             SPI_TRANS_VARIABLE_ADDR |
+                             SPI_TRANS_CS_KEEP_ACTIVE,
+                    .length = c->sendCount * 8,
+                    .tx_buffer = c->sendBuf
+                }
+            };
+        }
+
+        if (c->receiveCount > 0)
+        {
+            trans[transCount++] = (spi_transaction_ext_t)
+            {
+                .base = 
+                {
+                    .flags = SPI_TRANS_MODE_QIO | 
+                             SPI_TRANS_VARIABLE_CMD |
+                             SPI_TRANS_VARIABLE_ADDR |
+                             SPI_TRANS_VARIABLE_DUMMY |
+                             SPI_TRANS_CS_KEEP_ACTIVE,
+                    .rxlength = c->receiveCount * 8,
+                    .rx_buffer = c->receiveBuf
+                },
+                .dummy_bits = qspi->read_dummy_cycles //its cycles, not 'bits'
+            };
+        }
+
+        //spi_gpu sees every gpu command as a transaction of its own, spi_io commands are not part of its crcs
+        if (!c->io && qspi->link_check)
+            crc = fpga_qspi_read_phase_crc(crc, c->address, c->addressLengthBits, c->sendBuf, c->sendCount);
+    }
+
+    if (!valid || device == NULL || spi_device_acquire_bus(device, portMAX_DELAY) != ESP_OK)
+    {
+        xSemaphoreGive(qspi->lock);
+        return false;
+    }
+
+    trans[transCount - 1].base.flags &= ~SPI_TRANS_CS_KEEP_ACTIVE;
+
+    bool result = fpga_qspi_transmit_all(device, trans, transCount) == ESP_OK;
+
+    spi_device_release_bus(device);
+
+    fpga_qspi_link_update(qspi, result, crc, NULL, 0);
+
+    for (int i = 0; i < count && result && qspi->link_check; ++i)
+        if (!commands[i].io)
+            qspi->gpu_receive_crc = fpga_qspi_crc16(qspi->gpu_receive_crc, commands[i].receiveBuf, commands[i].receiveCount);
+
+    fpga_qspi_account(qspi, requestedUs, startUs, commands[0].command, FPGA_QSPI_TRACE_FLAG_CHAIN | (commands[0].io ? FPGA_QSPI_TRACE_FLAG_IO : 0), bytes, result);
+
+    xSemaphoreGive(qspi->lock);
+
+    return result;
+}
+
+void fpga_qspi_set_io_on_gpu_cs(fpga_qspi_t *qspi, bool enable)
+{
+    xSemaphoreTake(qspi->lock, portMAX_DELAY);
+
+    qspi->io_on_gpu_cs = enable || qspi->pin_cs_io < 0;
+
+    xSemaphoreGive(qspi->lock);
+}
+
+void fpga_qspi_set_octal(fpga_qspi_t *qspi, bool enable)
+{
+    xSemaphoreTake(qspi->lock, portMAX_DELAY);
+
+    qspi->octal = enable && qspi->octal_wired;
+
+    xSemaphoreGive(qspi->lock);
+}
+
+void fpga_qspi_release_io_cs(fpga_qspi_t *qspi)
+{
+    xSemaphoreTake(qspi->lock, portMAX_DELAY);
+
+    if (qspi->pin_cs_io >= 0)
+    {
+        if (qspi->spi_io != NULL)
+            spi_bus_remove_device(qspi->spi_io);
+
+        gpio_reset_pin(qspi->pin_cs_io); //no output, weak pull-up
+
+        qspi->spi_io = NULL;
+        qspi->pin_cs_io = -1; //not added back on clock changes
+        qspi->io_on_gpu_cs = true;
+    }
+
+    xSemaphoreGive(qspi->lock);
+}
+
+IRAM_ATTR bool fpga_qspi_receive_gpu_link_check(fpga_qspi_t *qspi, uint8_t command, uint8_t *receiveBuf, int receiveCount, uint16_t *sendCrc, uint16_t *receiveCrc, bool *valid)
+{
+    int64_t startUs, requestedUs = fpga_qspi_take(qspi, &startUs);
+
+    *sendCrc = qspi->gpu_send_crc;
+    *receiveCrc = qspi->gpu_receive_crc;
+    *valid = qspi->gpu_crc_valid;
+
+    bool result = fpga_qspi_send(qspi->spi_gpu, qspi->read_dummy_cycles, command, 0, 0, NULL, 0, receiveBuf, receiveCount);
+
+    //the fpga restarts its crcs with this transaction
+    qspi->gpu_send_crc = 0xFFFF;
+    qspi->gpu_receive_crc = 0xFFFF;
+    qspi->gpu_crc_valid = result && qspi->link_check;
+
+    fpga_qspi_account(qspi, requestedUs, startUs, command, 0, 1 + receiveCount, result);
+
+    xSemaphoreGive(qspi->lock);
+
+    return result;
+}
+
+void fpga_qspi_set_link_check(fpga_qspi_t *qspi, bool enable)
+{
+    xSemaphoreTake(qspi->lock, portMAX_DELAY);
+
+    qspi->link_check = enable;
+    qspi->gpu_crc_valid = false;
+
+    xSemaphoreGive(qspi->lock);
+}
+
+void fpga_qspi_link_skip(fpga_qspi_t *qspi)
+{
+    xSemaphoreTake(qspi->lock, portMAX_DELAY);
+
+    qspi->gpu_crc_valid = false;
+
+    xSemaphoreGive(qspi->lock);
+}
+
+static void fpga_qspi_set_freq_level(fpga_qspi_t *qspi, int level)
+{
+    ESP_LOGW(TAG, "fpga spi clock %d -> %d Hz", fpga_qspi_freqs[qspi->freq_level], fpga_qspi_freqs[level]);
+
+    xSemaphoreTake(qspi->lock, portMAX_DELAY);
+
+    fpga_qspi_remove_devices(qspi);
+
+    //the devices at the old clock worked, they go back if the new ones cannot be added. handles left NULL
+    //would fail every transaction from then on, and without transactions the link never reports again
+    if (fpga_qspi_add_devices(qspi, fpga_qspi_freqs[level]))
+        qspi->freq_level = level;
+    else
+    {
+        ESP_LOGE(TAG, "fpga spi devices could not be added at %d Hz, staying at %d Hz", fpga_qspi_freqs[level], fpga_qspi_freqs[qspi->freq_level]);
+
+        fpga_qspi_remove_devices(qspi);
+
+        if (!fpga_qspi_add_devices(qspi, fpga_qspi_freqs[qspi->freq_level]))
+            ESP_LOGE(TAG, "fpga spi devices could not be added back");
+    }
+
+    qspi->gpu_crc_valid = false; //the fpga may have seen part of the transactions since the last bundle at the old clock
+
+    xSemaphoreGive(qspi->lock);
+}
+
+void fpga_qspi_link_report(fpga_qspi_t *qspi, bool ok)
+{
+    ++qspi->link_checks;
+    ++qspi->window_checks;
+
+    if (!ok)
+    {
+        ++qspi->link_errors;
+        ++qspi->window_errors;
+    }
+
+    if (qspi->window_errors > FPGA_QSPI_LINK_WINDOW_MAX_ERRORS)
+    {
+        //a failed probe waits twice as long before the next one
+        if (qspi->probing && qspi->probe_windows < FPGA_QSPI_LINK_PROBE_WINDOWS_MAX)
+            qspi->probe_windows *= 2;
+
+        if (qspi->freq_level + 1 < FPGA_QSPI_FREQ_LEVELS)
+            fpga_qspi_set_freq_level(qspi, qspi->freq_level + 1);
+
+        qspi->probing = false;
+        qspi->clean_windows = 0;
+        qspi->window_checks = 0;
+        qspi->window_errors = 0;
+    }
+    else if (qspi->window_checks >= FPGA_QSPI_LINK_WINDOW_CHECKS)
+    {
+        if (qspi->probing) //survived a whole window at the faster clock
+        {
+            qspi->probing = false;
+            qspi->probe_windows = FPGA_QSPI_LINK_PROBE_WINDOWS;
+        }
+
+        if (qspi->freq_level > qspi->fastest_freq_level && ++qspi->clean_windows >= qspi->probe_windows)
+        {
+            fpga_qspi_set_freq_level(qspi, qspi->freq_level - 1);
+
+            qspi->probing = true;
+            qspi->clean_windows = 0;
+        }
+
+        qspi->window_checks = 0;
+        qspi->window_errors = 0;
+    }
+}
+
+int fpga_qspi_get_freq_hz(fpga_qspi_t *qspi)
+{
+    return fpga_qspi_freqs[qspi->freq_level];
+}
+
+void fpga_qspi_get_stats(fpga_qspi_t *qspi, fpga_qspi_stats_t *stats)
+{
+    xSemaphoreTake(qspi->lock, portMAX_DELAY);
+
+    *stats = qspi->stats;
+
+    xSemaphoreGive(qspi->lock);
+}
+
+void fpga_qspi_set_trace(fpga_qspi_t *qspi, fpga_qspi_trace_entry_t *ring, int size)
+{
+    xSemaphoreTake(qspi->lock, portMAX_DELAY);
+
+    qspi->trace = size > 0 ? ring : NULL;
+    qspi->trace_size = size;
+    qspi->trace_head = 0;
+
+    xSemaphoreGive(qspi->lock);
+}
+
+int fpga_qspi_get_trace(fpga_qspi_t *qspi, fpga_qspi_trace_entry_t *entries, int maxCount)
+{
+    xSemaphoreTake(qspi->lock, portMAX_DELAY);
+
+    int count = 0;
+
+    if (qspi->trace != NULL)
+    {
+        uint32_t available = qspi->trace_head < qspi->trace_size ? qspi->trace_head : qspi->trace_size;
+
+        count = available < maxCount ? available : maxCount;
+
+        for (int i = 0; i < count; ++i)
+            entries[i] = qspi->trace[(qspi->trace_head - count + i) % qspi->trace_size];
+    }
+
+    xSemaphoreGive(qspi->lock);
+
+    return count;
+}
+
+int fpga_qspi_get_level_freq_hz(int freqLevel)
+{
+    return fpga_qspi_freqs[freqLevel];
+}
+
+bool fpga_qspi_configure(fpga_qspi_t *qspi, int freqLevel, int inputDelayNs, int readDummyCycles)
+{
+    if (freqLevel < 0 || freqLevel >= FPGA_QSPI_FREQ_LEVELS)
+        return false;
+
+    xSemaphoreTake(qspi->lock, portMAX_DELAY);
+
+    fpga_qspi_remove_devices(qspi);
+
+    qspi->freq_level = freqLevel;
+    qspi->fastest_freq_level = freqLevel;
+    qspi->input_delay_ns = inputDelayNs;
+    qspi->read_dummy_cycles = readDummyCycles;
+
+    qspi->gpu_crc_valid = false;
+    qspi->probing = false;
+    qspi->clean_windows = 0;
+    qspi->window_checks = 0;
+    qspi->window_errors = 0;
+    qspi->probe_windows = FPGA_QSPI_LINK_PROBE_WINDOWS;
+
+    bool result = fpga_qspi_add_devices(qspi, fpga_qspi_freqs[freqLevel]);
+
+    xSemaphoreGive(qspi->lock);
+
+    return result;
 }
\ No newline at end of file
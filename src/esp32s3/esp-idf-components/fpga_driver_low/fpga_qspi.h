@@ -2,16 +2,159 @@
 
 #include <stdint.h>
 #include "driver/spi_master.h"
+#include "esp_attr.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
 
 #define SPI_MAX_TRANS_BYTES 4092*4
 
+//defaults until the link is calibrated, tuned for the reference wiring
+#define SPI_INPUT_DELAY_NS 18
+#define FPGA_QSPI_READ_DUMMY_CYCLES 2
+
+#define FPGA_QSPI_FREQ_LEVELS               (3) //80, 40 and 20 MHz
+
+//link integrity: the fpga reports crc-16s of every gpu read and write phase since the previous status bundle in the next one,
+//the master compares them with what it sent and received meanwhile. the clock steps down when too many of them mismatch within a window and probes back up after enough clean windows
+#define FPGA_QSPI_LINK_WINDOW_CHECKS        (1024)
+#define FPGA_QSPI_LINK_WINDOW_MAX_ERRORS    (4)
+#define FPGA_QSPI_LINK_PROBE_WINDOWS        (64)   //doubled after every failed probe
+#define FPGA_QSPI_LINK_PROBE_WINDOWS_MAX    (4096)
+
+//command lists: one cs0 transaction carrying several gpu and io commands, each prefixed with its length in sclk cycles
+#define FPGA_QSPI_CHAIN_MAX_COMMANDS        (4)
+#define FPGA_QSPI_CHAIN_MAX_CYCLES          (0x7FFF)
+#define FPGA_QSPI_CHAIN_PREFIX_SIZE_BYTES   (12) //2 bytes of length, command, up to 64 bits of address, padded to words
+
+#define FPGA_QSPI_TRACE_FLAG_IO             (0x01) //spi_io chip select
+#define FPGA_QSPI_TRACE_FLAG_CHAIN          (0x02) //command list, command is the first one in it
+#define FPGA_QSPI_TRACE_FLAG_ERROR          (0x04)
+
+typedef struct
+{
+    uint8_t command;
+    uint8_t flags;          //FPGA_QSPI_TRACE_FLAG_*
+    uint16_t waitUs;        //for the bus before start, saturated
+    uint32_t bytes;         //address, data and received bytes
+    int64_t startUs, endUs; //esp_timer_get_time, the bus is held in between
+} fpga_qspi_trace_entry_t;
+
+typedef struct
+{
+    uint32_t transactions;
+    uint32_t errors;
+    uint64_t bytes;
+    uint64_t busUs;         //held by a transaction, including the time spent producing streamed pieces
+    uint64_t waitUs;        //tasks waiting for the bus
+} fpga_qspi_stats_t;
+
 typedef struct 
 {
     spi_device_handle_t spi_gpu;
     spi_device_handle_t spi_io;
+
+    SemaphoreHandle_t lock; //devices are re-added on clock changes
+    int pin_cs_gpu, pin_cs_io;
+    int freq_level;         //0 is the fastest clock
+    int fastest_freq_level; //link fallback probes back up to this one
+    int input_delay_ns;
+    int read_dummy_cycles;
+    bool octal_wired;       //d4-d7 are wired
+    bool octal;             //bulk framebuffer writes use 8 lines in their data phase
+    bool io_on_gpu_cs;      //io commands go in command lists on the gpu chip select, the io one is unused or not wired
+
+    bool link_check;        //crc-16s of gpu transactions are only computed when enabled
+    bool gpu_crc_valid;     //false after a failed transaction or a clock change until the next status bundle
+    uint16_t gpu_send_crc;  //read phases of the gpu transactions since the last status bundle
+    uint16_t gpu_receive_crc; //and their write phases
+
+    uint32_t link_checks, link_errors; //totals, a corrupted status bundle counts as an error too
+    uint32_t window_checks, window_errors, clean_windows, probe_windows;
+    bool probing;
+
+    //transport statistics and optional trace ring, guarded by lock
+    fpga_qspi_stats_t stats;
+    fpga_qspi_trace_entry_t *trace;
+    int trace_size;
+    uint32_t trace_head; //free running
+
+    //command list in flight, guarded by lock
+    spi_transaction_ext_t chain_trans[FPGA_QSPI_CHAIN_MAX_COMMANDS*3];
+    WORD_ALIGNED_ATTR uint8_t chain_prefix[FPGA_QSPI_CHAIN_MAX_COMMANDS][FPGA_QSPI_CHAIN_PREFIX_SIZE_BYTES];
 } fpga_qspi_t;
 
-bool fpga_qspi_init(fpga_qspi_t *qspi, int pinCsGpu, int pinCsIo, int pinSclk, int pinD0, int pinD1, int pinD2, int pinD3);
+typedef struct
+{
+    uint8_t *data;
+    int count;
+    bool octal; //sent on 8 lines, command and address always go on 4
+} fpga_qspi_segment_t;
+
+typedef struct
+{
+    bool io;    //spi_io command, spi_gpu otherwise
+    uint8_t command;
+    uint64_t address;
+    int addressLengthBits; //whole bytes only
+    uint8_t *sendBuf;
+    int sendCount;
+    uint8_t *receiveBuf;
+    int receiveCount;
+} fpga_qspi_command_t;
+
+//pinD4-pinD7 are -1 for a quad only link, pinCsIo is -1 when the pin is not wired or used for the vblank irq
+bool fpga_qspi_init(fpga_qspi_t *qspi, int pinCsGpu, int pinCsIo, int pinSclk, int pinD0, int pinD1, int pinD2, int pinD3, int pinD4, int pinD5, int pinD6, int pinD7);
 
 bool fpga_qspi_send_gpu(fpga_qspi_t *qspi, uint8_t command, uint64_t address, int addressLengthBits, uint8_t *sendBuf, int sendCount, uint8_t *receiveBuf, int receiveCount);
-bool fpga_qspi_send_io(fpga_qspi_t *qspi, uint8_t command, uint64_t address, int addressLengthBits, uint8_t *sendBuf, int sendCount, uint8_t *receiveBuf, int receiveCount);
\ No newline at end of file
+//write only, one cs low period: command and address, then the segments back to back.
+//segments are split into SPI_MAX_TRANS_BYTES pieces that are queued with cs kept active between them
+bool fpga_qspi_send_gpu_segments(fpga_qspi_t *qspi, uint8_t command, uint64_t address, int addressLengthBits, const fpga_qspi_segment_t *segments, int segmentCount);
+
+//produces the next piece of a streamed write, up to SPI_MAX_TRANS_BYTES, and sets last on the final one.
+//called while the previous piece is on the wire, the buffer of the one before it is no longer in use
+typedef int (*fpga_qspi_stream_fill_t)(void *context, uint8_t **data, bool *last);
+
+//write only, one cs low period: command and address, then pieces from fill until it reports the last one
+bool fpga_qspi_send_gpu_stream(fpga_qspi_t *qspi, uint8_t command, uint64_t address, int addressLengthBits, fpga_qspi_stream_fill_t fill, void *context);
+bool fpga_qspi_send_io(fpga_qspi_t *qspi, uint8_t command, uint64_t address, int addressLengthBits, uint8_t *sendBuf, int sendCount, uint8_t *receiveBuf, int receiveCount);
+
+//commands are executed in order within one cs low period, every one of them as if it had a cs low period of its own
+bool fpga_qspi_send_chain(fpga_qspi_t *qspi, const fpga_qspi_command_t *commands, int count);
+
+//send_io goes through single command lists on the gpu chip select, always on when there is no io chip select
+void fpga_qspi_set_io_on_gpu_cs(fpga_qspi_t *qspi, bool enable);
+
+//octal data phases for bulk framebuffer writes, only when d4-d7 are wired. on after init if they are
+void fpga_qspi_set_octal(fpga_qspi_t *qspi, bool enable);
+
+//stops driving the io chip select pin, for an fpga that drives it itself. io commands go through command lists from then on
+void fpga_qspi_release_io_cs(fpga_qspi_t *qspi);
+
+//receive only gpu transaction after which the fpga restarts its link crcs, returns the ones of everything sent and received
+//since the previous one, captured atomically with it. false in valid if they cannot be compared or link checks are disabled
+bool fpga_qspi_receive_gpu_link_check(fpga_qspi_t *qspi, uint8_t command, uint8_t *receiveBuf, int receiveCount, uint16_t *sendCrc, uint16_t *receiveCrc, bool *valid);
+
+uint16_t fpga_qspi_crc16(uint16_t crc, const uint8_t *data, int size);
+
+void fpga_qspi_set_link_check(fpga_qspi_t *qspi, bool enable);
+
+//the next link check is not compared, the fpga may not have seen the last one
+void fpga_qspi_link_skip(fpga_qspi_t *qspi);
+
+//counts one link check, steps the clock down or probes it back up when needed. not to be called concurrently with itself
+void fpga_qspi_link_report(fpga_qspi_t *qspi, bool ok);
+
+int fpga_qspi_get_freq_hz(fpga_qspi_t *qspi);
+
+void fpga_qspi_get_stats(fpga_qspi_t *qspi, fpga_qspi_stats_t *stats);
+
+//every transaction goes to the ring once set, the oldest is overwritten. NULL stops tracing, the ring can be freed after
+void fpga_qspi_set_trace(fpga_qspi_t *qspi, fpga_qspi_trace_entry_t *ring, int size);
+
+//copies out up to maxCount of the newest entries, oldest first
+int fpga_qspi_get_trace(fpga_qspi_t *qspi, fpga_qspi_trace_entry_t *entries, int maxCount);
+
+int fpga_qspi_get_level_freq_hz(int freqLevel);
+
+//re-adds the devices with new link timing, freqLevel also becomes the fastest the link fallback may return to
+bool fpga_qspi_configure(fpga_qspi_t *qspi, int freqLevel, int inputDelayNs, int readDummyCycles);
\ No newline at end of file
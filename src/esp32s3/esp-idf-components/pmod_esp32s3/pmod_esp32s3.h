@@ -17,6 +17,13 @@
 #define PMOD_FPGA_SPI_D2 16
 #define PMOD_FPGA_SPI_D3 18
 
+//octal link data lines, not wired on the reference pmod. a board that routes them sets the gpios here,
+//away from 33-37 on modules with octal flash or psram, and builds the fpga with SPI_OCTAL
+#define PMOD_FPGA_SPI_D4 -1
+#define PMOD_FPGA_SPI_D5 -1
+#define PMOD_FPGA_SPI_D6 -1
+#define PMOD_FPGA_SPI_D7 -1
+
 #define PMOD_BUTTON 0
 
 #ifndef PMOD_OCTAL_SPI_IN_USE
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_cpu.h"
+#include "esp_private/esp_clk.h"
+
+#include "fpga_driver.h"
+
+#define LZ_BENCH_PIECE_BYTES    4096 //FPGA_DRIVER_UPLOAD_PIECE_SIZE_BYTES
+#define LZ_BENCH_RUNS           5
+
+static DMA_ATTR uint8_t lz_bench_piece[LZ_BENCH_PIECE_BYTES];
+static fpga_driver_lz_encoder_t lz_bench_encoder;
+
+static uint32_t lz_bench_noise(uint32_t x)
+{
+    x = (x ^ (x >> 16)) * 0x45d9f3b;
+    return x ^ (x >> 16);
+}
+
+//frames the encoder has an easy, a typical and a hard time with: the user_task gradient, textured blocks with flat
+//areas in between, and noise where every byte tries all three candidates and ends up a literal
+static void lz_bench_render(uint8_t *framebuffer, int kind)
+{
+    for (int i = 0; i < FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES; ++i)
+    {
+        int x = i % FPGA_DRIVER_FRAME_WIDTH, y = i / FPGA_DRIVER_FRAME_WIDTH;
+
+        if (kind == 0)
+            framebuffer[i] = x;
+        else if (kind == 1)
+            framebuffer[i] = ((x / 32) ^ (y / 32)) & 1 ? (lz_bench_noise(x / 2 + y * 997) & 0x0F) + 0x40 : ((y / 8) & 0x0F) * 16;
+        else
+            framebuffer[i] = lz_bench_noise(i);
+    }
+}
+
+//cpu cycles of the lz encoder on the esp, as the driver runs it on a compressed upload: from the driver's internal
+//framebuffer into 4 KB pieces. needs no fpga, only fpga_driver_get_framebuffer
+void lz_bench_task(void *arg)
+{
+    static const char *kinds[] = { "gradient", "blocks", "noise" };
+
+    uint8_t *palette, *framebuffer;
+
+    fpga_driver_get_framebuffer(&palette, &framebuffer);
+
+    int cpu_mhz = esp_clk_cpu_freq() / 1000000;
+
+    for (;;)
+    {
+        for (int kind = 0; kind < 3; ++kind)
+        {
+            lz_bench_render(framebuffer, kind);
+
+            uint32_t best = UINT32_MAX;
+
+            for (int run = 0; run < LZ_BENCH_RUNS; ++run)
+            {
+                uint32_t start = esp_cpu_get_cycle_count();
+
+                fpga_driver_lz_init(&lz_bench_encoder, framebuffer, FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES, FPGA_DRIVER_FRAME_WIDTH);
+
+                while (!fpga_driver_lz_done(&lz_bench_encoder))
+                    fpga_driver_lz_encode(&lz_bench_encoder, lz_bench_piece, LZ_BENCH_PIECE_BYTES);
+
+                uint32_t cycles = esp_cpu_get_cycle_count() - start;
+
+                best = cycles < best ? cycles : best;
+            }
+
+            printf("lz bench: %-8s %.1f cpu cycles per byte at %d MHz, lz cycles %d%% of raw\n", kinds[kind],
+                (double)best / FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES, cpu_mhz, lz_bench_encoder.out.nibbles * 100 / (FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES * 2));
+        }
+
+        printf("lz bench: a raw byte is %d cpu cycles on a 40 MHz link and %d at 20 MHz\n", 2 * cpu_mhz / 40, 2 * cpu_mhz / 20);
+
+        vTaskDelay(pdMS_TO_TICKS(5000));
+    }
+}
@@ -14,6 +14,12 @@
 #include "fpga_driver.h"
 #include "pmod_esp32s3.h"
 
+//#define TESTAPP_SCROLL_DEMO //run the hardware scroll bandwidth demo instead of user_task
+//#define TESTAPP_LZ_BENCH //print the cpu cycles per byte of the lz encoder instead of running user_task, no fpga needed
+
+void scroll_demo_task(void *arg);
+void lz_bench_task(void *arg);
+
 #define PIXEL_IDX(x, y) ((x) + (y)*FPGA_DRIVER_FRAME_WIDTH)
 #define PIXEL_INBOUNDS(x, y) ((x) >= 0 && (x) < FPGA_DRIVER_FRAME_WIDTH && (y) >= 0 && (y) < FPGA_DRIVER_FRAME_HEIGHT)
 
@@ -76,6 +82,9 @@ void hid_event_callback(fpga_driver_hid_event_t hidEvent)
         case FPGA_DRIVER_HID_EVENT_KEY_UP:
             printf("key_up: %d modifiers %d\n", hidEvent.keyEvent.keyCode, hidEvent.keyEvent.modifiers);
             break;
+        case FPGA_DRIVER_HID_EVENT_KEY_REPEAT:
+            printf("key_repeat: %d char '%c'\n", hidEvent.keyEvent.keyCode, hidEvent.keyEvent.character ? hidEvent.keyEvent.character : ' ');
+            break;
         case FPGA_DRIVER_HID_EVENT_MOUSE_MOVE:
             printf("mouse_move: x:%ld y:%ld w:%ld buttons %d\n", 
                 hidEvent.mouseMoveEvent.moveX, 
@@ -111,7 +120,7 @@ void user_task(void *arg)
             palette[3*j + 2] = j;
         }
 
-        fpga_driver_present_frame(&palette, &framebuffer, FPGA_DRIVER_VSYNC_WAIT_IF_PREVIOUS_NOT_PRESENTED);
+        fpga_driver_present_frame(&palette, &framebuffer, NULL, FPGA_DRIVER_VSYNC_WAIT_IF_PREVIOUS_NOT_PRESENTED);
     }
 
     int64_t time = 0;
@@ -163,8 +172,8 @@ void user_task(void *arg)
 
         ++temp1;
 EXT_RAM_ATTR
-        //fpga_driver_present_frame(&palette, &framebuffer, FPGA_DRIVER_VSYNC_DONT_WAIT_OVERWRITE_PREVIOUS);
-        fpga_driver_present_frame(&palette, &framebuffer, FPGA_DRIVER_VSYNC_WAIT_IF_PREVIOUS_NOT_PRESENTED);
+        //fpga_driver_present_frame(&palette, &framebuffer, NULL, FPGA_DRIVER_VSYNC_DONT_WAIT_OVERWRITE_PREVIOUS);
+        fpga_driver_present_frame(&palette, &framebuffer, NULL, FPGA_DRIVER_VSYNC_WAIT_IF_PREVIOUS_NOT_PRESENTED);
         fpga_driver_hid_get_status(&hid_status);
     }
 }
@@ -190,5 +199,23 @@ void app_main(void)
     if (!fpga_driver_init(&driver_config))
         printf("failed to init driver\n");
 
+    fpga_driver_display_info_t display;
+
+    if (fpga_driver_display_get_info(&display) && display.valid)
+    {
+        printf("display '%s': preferred %dx%d@%d, 720p60 %d, 1080p60 %d, hdmi %d, audio %d\n", 
+            display.name, display.preferredWidth, display.preferredHeight, display.preferredRefreshHz,
+            display.supports720p60, display.supports1080p60, display.hdmi, display.audio);
+
+        if (!display.hdmi) //dvi-only sink, drop audio and infoframes
+            fpga_driver_set_dvi_output(true);
+    }
+
+#ifdef TESTAPP_SCROLL_DEMO
+    xTaskCreatePinnedToCore(scroll_demo_task, "scroll_demo_task", 4096, NULL, tskIDLE_PRIORITY+1, NULL, 1);
+#elif defined(TESTAPP_LZ_BENCH)
+    xTaskCreatePinnedToCore(lz_bench_task, "lz_bench_task", 4096, NULL, tskIDLE_PRIORITY+1, NULL, 1);
+#else
     xTaskCreatePinnedToCore(user_task, "user_task", 4096, NULL, tskIDLE_PRIORITY+1, NULL, 1);
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,120 @@
+#include <stdio.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "fpga_driver.h"
+
+#define SCROLL_DEMO_PHASE_LINES     120 //lines scrolled with each method before switching to the other one
+
+static DMA_ATTR uint8_t scroll_demo_row[FPGA_DRIVER_FRAME_WIDTH];
+
+static void scroll_demo_fill_row(uint8_t *row, uint32_t line)
+{
+    //diagonal stripes so that the scrolling is visible
+    for (int x = 0; x < FPGA_DRIVER_FRAME_WIDTH; ++x)
+        row[x] = ((x + line) & 0x1F) < 4 ? 255 : (line & 0xFF);
+}
+
+static void scroll_demo_fill_frame(uint8_t *framebuffer, uint32_t topLine)
+{
+    for (int y = 0; y < FPGA_DRIVER_FRAME_HEIGHT; ++y)
+        scroll_demo_fill_row(framebuffer + y*FPGA_DRIVER_FRAME_WIDTH, topLine + y);
+}
+
+//returns once the beam has left the top line of a frame that started after the call, with the rest of it to go
+static void scroll_demo_wait_frame(void)
+{
+    fpga_driver_wait_line(FPGA_DRIVER_FRAME_HEIGHT - 1);
+    fpga_driver_wait_line(0);
+}
+
+static uint64_t scroll_demo_bus_bytes(void)
+{
+    fpga_driver_stats_t stats;
+
+    fpga_driver_get_stats(&stats);
+
+    return stats.bytes;
+}
+
+//vertical console-like scroll by one framebuffer line per frame, alternating between re-presenting the whole frame
+//and uploading only the exposed line and setting the scroll register. bytes per scrolled line are taken from the
+//driver's bus counters, less the status and hid polling measured while idle, so they follow whatever the driver
+//actually sends: delta and lz uploads, command lists, the raster reads the hardware scroll waits with
+void scroll_demo_task(void *arg)
+{
+    uint8_t *palette, *framebuffer;
+
+    fpga_driver_get_framebuffer(&palette, &framebuffer);
+
+    for (int j = 0; j < 256; ++j)
+    {
+        palette[3*j] = j;
+        palette[3*j + 1] = j;
+        palette[3*j + 2] = j;
+    }
+
+    //idle bus traffic, subtracted from both methods
+    uint64_t bytes = scroll_demo_bus_bytes();
+    int64_t time = esp_timer_get_time();
+
+    vTaskDelay(pdMS_TO_TICKS(1000));
+
+    double idle_bytes_per_us = (double)(scroll_demo_bus_bytes() - bytes) / (esp_timer_get_time() - time);
+
+    uint32_t line = 0; //content line shown at the top of the screen
+    uint64_t bytes_per_line[2] = { 0 };
+
+    for (;;)
+    {
+        for (int hardware = 0; hardware < 2; ++hardware)
+        {
+            //both methods start from a whole frame at scroll 0, uploaded at the vblank after it is queued and not counted
+            scroll_demo_fill_frame(framebuffer, line);
+            fpga_driver_present_frame(&palette, &framebuffer, NULL, FPGA_DRIVER_VSYNC_WAIT_IF_PREVIOUS_NOT_PRESENTED);
+            fpga_driver_scroll_set(0, 0);
+
+            scroll_demo_wait_frame();
+            scroll_demo_wait_frame();
+
+            int scroll_y = 0;
+
+            bytes = scroll_demo_bus_bytes();
+            time = esp_timer_get_time();
+
+            for (int i = 0; i < SCROLL_DEMO_PHASE_LINES; ++i)
+            {
+                if (!hardware)
+                {
+                    scroll_demo_fill_frame(framebuffer, ++line);
+                    fpga_driver_present_frame(&palette, &framebuffer, NULL, FPGA_DRIVER_VSYNC_WAIT_IF_PREVIOUS_NOT_PRESENTED);
+                    continue;
+                }
+
+                //framebuffer row scroll_y is the top screen line until the scroll register changes at the next vblank,
+                //and the bottom one after it. the row write and the scroll register go out a driver tick or two after
+                //the wait, once the beam has left the row and long before that vblank
+                scroll_demo_wait_frame();
+
+                scroll_demo_fill_row(scroll_demo_row, ++line + FPGA_DRIVER_FRAME_HEIGHT - 1);
+
+                if (!fpga_driver_framebuffer_write_rows(scroll_demo_row, scroll_y, 1))
+                    printf("scroll demo: row write failed\n");
+
+                scroll_y = (scroll_y + 1) % FPGA_DRIVER_FRAME_HEIGHT;
+                fpga_driver_scroll_set(0, scroll_y);
+            }
+
+            int64_t elapsed_us = esp_timer_get_time() - time;
+            int64_t sent = (int64_t)(scroll_demo_bus_bytes() - bytes) - (int64_t)(idle_bytes_per_us * elapsed_us);
+
+            bytes_per_line[hardware] = sent > 0 ? sent / SCROLL_DEMO_PHASE_LINES : 0;
+
+            printf("scroll demo: %s, %lld lines/s\n", hardware ? "hardware scroll" : "full frame upload", (long long)(SCROLL_DEMO_PHASE_LINES * 1000000LL / elapsed_us));
+        }
+
+        printf("scroll demo: bus bytes per scrolled line: full frame upload %llu, hardware scroll %llu, idle polling excluded\n",
+            bytes_per_line[0], bytes_per_line[1]);
+    }
+}
@@ -29,57 +29,6 @@ Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
 
 #define MAX_HANDLES 10
 
-//keys missing from quake keys.h ?
-#define K_CAPSLOCK 0
-#define K_PRTSCR 0
-#define K_SCRLCK 0
-#define K_NUMLOCK 0
-
-#define KEYP_DIVIDE 0
-#define KEYP_MULTIPLY 0
-#define KEYP_MINUS 0
-#define KEYP_PLUS 0
-#define KEYP_ENTER 0
-#define KEYP_1 0
-#define KEYP_2 0
-#define KEYP_3 0
-#define KEYP_4 0
-#define KEYP_5 0
-#define KEYP_6 0
-#define KEYP_7 0
-#define KEYP_8 0
-#define KEYP_9 0
-#define KEYP_0 0
-#define KEYP_PERIOD 0
-#define KEYP_EQUALS 0
-
-//borrowed from chocolate doom code
-static const int scancode_to_quake_table[] = 
-{                                            
-    0,   0,   0,   0,   'a',                                  /* 0-9 */     
-    'b', 'c', 'd', 'e', 'f',                                                
-    'g', 'h', 'i', 'j', 'k',                                  /* 10-19 */   
-    'l', 'm', 'n', 'o', 'p',                                                
-    'q', 'r', 's', 't', 'u',                                  /* 20-29 */   
-    'v', 'w', 'x', 'y', 'z',                                                
-    '1', '2', '3', '4', '5',                                  /* 30-39 */   
-    '6', '7', '8', '9', '0',                                                
-    K_ENTER, K_ESCAPE, K_BACKSPACE, K_TAB, K_SPACE,           /* 40-49 */   
-    '-', '=', '[', ']', '\\',                                  
-    0,   ';', '\'', '`', ',',                                 /* 50-59 */   
-    '.', '/', K_CAPSLOCK, K_F1, K_F2,                                 
-    K_F3, K_F4, K_F5, K_F6, K_F7,                             /* 60-69 */   
-    K_F8, K_F9, K_F10, K_F11, K_F12,                              
-    K_PRTSCR, K_SCRLCK, K_PAUSE, K_INS, K_HOME,               /* 70-79 */   
-    K_PGUP, K_DEL, K_END, K_PGDN, K_RIGHTARROW,                   
-    K_LEFTARROW, K_DOWNARROW, K_UPARROW,                      /* 80-89 */   
-    K_NUMLOCK, KEYP_DIVIDE,                                               
-    KEYP_MULTIPLY, KEYP_MINUS, KEYP_PLUS, KEYP_ENTER, KEYP_1,               
-    KEYP_2, KEYP_3, KEYP_4, KEYP_5, KEYP_6,                   /* 90-99 */  
-    KEYP_7, KEYP_8, KEYP_9, KEYP_0, KEYP_PERIOD,                            
-    0, 0, 0, KEYP_EQUALS                                      /* 100-103 */ 
-};
-
 typedef struct 
 {
     bool isOpen;
@@ -103,6 +52,7 @@ static void hid_callback(fpga_driver_hid_event_t hidEvent)
     {
         case FPGA_DRIVER_HID_EVENT_KEY_DOWN:
         case FPGA_DRIVER_HID_EVENT_KEY_UP:
+        case FPGA_DRIVER_HID_EVENT_KEY_REPEAT:
         case FPGA_DRIVER_HID_EVENT_MOUSE_BUTTON_DOWN:
         case FPGA_DRIVER_HID_EVENT_MOUSE_BUTTON_UP:
             if (xRingbufferSend(hid_ringbuf, &hidEvent, sizeof(fpga_driver_hid_event_t), 0) != pdPASS)
@@ -114,6 +64,7 @@ static void hid_callback(fpga_driver_hid_event_t hidEvent)
     }
 }
 
+//printable keys come lowercased from the us layout, only the rest needs mapping
 static int translate_hid_key(uint8_t keyCode)
 {
     switch (keyCode)
@@ -127,9 +78,23 @@ static int translate_hid_key(uint8_t keyCode)
         case FPGA_DRIVER_HID_KEY_CODE_LEFT_ALT:
         case FPGA_DRIVER_HID_KEY_CODE_RIGHT_ALT:
             return K_ALT;
+        case FPGA_DRIVER_HID_KEY_CODE_BACKSPACE:    return K_BACKSPACE;
+        case FPGA_DRIVER_HID_KEY_CODE_PAUSE:        return K_PAUSE;
+        case FPGA_DRIVER_HID_KEY_CODE_INSERT:       return K_INS;
+        case FPGA_DRIVER_HID_KEY_CODE_HOME:         return K_HOME;
+        case FPGA_DRIVER_HID_KEY_CODE_PAGE_UP:      return K_PGUP;
+        case FPGA_DRIVER_HID_KEY_CODE_DELETE:       return K_DEL;
+        case FPGA_DRIVER_HID_KEY_CODE_END:          return K_END;
+        case FPGA_DRIVER_HID_KEY_CODE_PAGE_DOWN:    return K_PGDN;
+        case FPGA_DRIVER_HID_KEY_CODE_RIGHT:        return K_RIGHTARROW;
+        case FPGA_DRIVER_HID_KEY_CODE_LEFT:         return K_LEFTARROW;
+        case FPGA_DRIVER_HID_KEY_CODE_DOWN:         return K_DOWNARROW;
+        case FPGA_DRIVER_HID_KEY_CODE_UP:           return K_UPARROW;
         default:
-            if (keyCode < (sizeof(scancode_to_quake_table)/sizeof(scancode_to_quake_table[0])))
-                return scancode_to_quake_table[keyCode];
+            if (keyCode >= FPGA_DRIVER_HID_KEY_CODE_F1 && keyCode <= FPGA_DRIVER_HID_KEY_CODE_F12)
+                return K_F1 + (keyCode - FPGA_DRIVER_HID_KEY_CODE_F1);
+            else if (keyCode < FPGA_DRIVER_HID_KEY_CODE_CAPS_LOCK) //enter, escape, tab and space are ascii in quake too
+                return (unsigned char)fpga_driver_hid_layout_us.normal[keyCode]; //bindings stay on the us keys whatever layout is set
             else
                 return 0;
     }
@@ -535,8 +500,9 @@ void Sys_SendKeyEvents(void)
         {
             case FPGA_DRIVER_HID_EVENT_KEY_DOWN:
             case FPGA_DRIVER_HID_EVENT_KEY_UP:
+            case FPGA_DRIVER_HID_EVENT_KEY_REPEAT: //quake counts repeats itself, bound game keys ignore them
                 Key_Event(translate_hid_key(hid_event->keyEvent.keyCode), 
-                          hid_event->type == FPGA_DRIVER_HID_EVENT_KEY_DOWN);
+                          hid_event->type != FPGA_DRIVER_HID_EVENT_KEY_UP);
                 break;
             case FPGA_DRIVER_HID_EVENT_MOUSE_BUTTON_DOWN:
             case FPGA_DRIVER_HID_EVENT_MOUSE_BUTTON_UP:  
@@ -85,7 +85,7 @@ void VID_Update (vrect_t *rects)
 
     const void *oldBuffer = fpga_framebuffer;
 
-    fpga_driver_present_frame(&fpga_palette, &fpga_framebuffer, FPGA_DRIVER_VSYNC_WAIT_IF_PREVIOUS_NOT_PRESENTED);
+    fpga_driver_present_frame(&fpga_palette, &fpga_framebuffer, NULL, FPGA_DRIVER_VSYNC_WAIT_IF_PREVIOUS_NOT_PRESENTED);
 
     memcpy(fpga_framebuffer, oldBuffer, FPGA_DRIVER_FRAMEBUFFER_SIZE_BYTES); //well.. i dont want to understand how to hook up proper buffer switching here
     vid.buffer = vid.conbuffer = fpga_framebuffer;
@@ -0,0 +1,128 @@
+// reference for tb_blitter: runs the blit queue of tb_blitter.sv byte by byte over the same framebuffer and
+// blit store contents and prints the result of its two crc blits and the crc of the whole framebuffer
+// afterwards as hex, one per line: cc blits.c && ./a.out > blits.hex
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define FRAMEBUFFER_SIZE (320*240)
+#define BLIT_STORE_SIZE 8192
+
+#define OP_FILL 0
+#define OP_COPY 1
+#define OP_STORE_COPY 2
+#define OP_CRC 3
+
+#define FLAG_TRANSPARENT 0x40
+#define FLAG_REVERSE 0x80
+
+#define R(row, column) (20480 + (row)*320 + (column)) //blits stay below the 160x120 frame shown meanwhile
+
+typedef struct
+{
+    uint8_t op, value;
+    uint32_t src;
+    uint16_t srcStride;
+    uint32_t dst;
+    uint16_t dstStride, width, height;
+} blit_t;
+
+// same queue as tb_blitter.sv, in the order it is run
+static const blit_t blits[] = {
+    //batch 0
+    { OP_FILL, 0x5a, 0, 0, R(0, 5), 320, 37, 9 },
+    { OP_FILL, 0x11, 0, 0, R(2, 100), 320, 61, 1 },
+    { OP_COPY, 0, 0, 0, 0, 0, 0, 5 },
+    { OP_COPY, 0, R(10, 20), 320, R(9, 17), 320, 50, 12 },
+    { OP_COPY | FLAG_REVERSE, 0, R(30, 10), 320, R(32, 15), 320, 40, 10 },
+    { OP_STORE_COPY | FLAG_TRANSPARENT, 0x1f, 100, 48, R(50, 30), 320, 48, 20 },
+    { OP_STORE_COPY, 0, 1000, 33, R(75, 200), 320, 33, 7 },
+    { OP_FILL, 0x99, 0, 0, FRAMEBUFFER_SIZE - 100, 0, 200, 1 },
+    { OP_CRC, 0, R(0, 0), 320, 0, 0, 256, 130 },
+    //batch 1
+    { OP_FILL, 0x77, 0, 0, R(170, 0), 320, 64, 4 },
+    { OP_COPY, 0, R(0, 0), 320, R(160, 0), 320, 41, 5 },
+    //batch 2 and 3
+    { OP_FILL, 0x33, 0, 0, R(110, 0), 320, 320, 20 },
+    { OP_FILL, 0x44, 0, 0, R(130, 0), 320, 320, 20 },
+    //batch 4
+    { OP_CRC, 0, 0, 0, 0, 0, 0, 0 },
+    { OP_COPY, 0, R(0, 0), 320, R(100, 3), 320, 70, 30 },
+    { OP_COPY | FLAG_REVERSE | FLAG_TRANSPARENT, 0x5a, R(100, 0), 320, R(101, 1), 320, 80, 40 },
+    { OP_STORE_COPY | FLAG_TRANSPARENT, 0x00, 4000, 64, R(140, 250), 320, 64, 30 },
+    { OP_CRC, 0, 19200, 320, 0, 0, 320, 180 },
+};
+
+static uint8_t framebuffer[FRAMEBUFFER_SIZE];
+static uint8_t store[BLIT_STORE_SIZE];
+
+static uint32_t crc32_update(uint32_t crc, uint8_t data)
+{
+    crc ^= data;
+
+    for (int i = 0; i < 8; ++i)
+        crc = crc & 1 ? (crc >> 1) ^ 0xedb88320 : crc >> 1;
+
+    return crc;
+}
+
+// returns the crc for crc blits
+static uint32_t run(const blit_t *b)
+{
+    int op = b->op & 3;
+    int reverse = b->op & FLAG_REVERSE;
+    int transparent = b->op & FLAG_TRANSPARENT;
+    uint32_t crc = 0xffffffff;
+
+    if (b->width == 0 || b->height == 0)
+        return 0;
+
+    uint32_t src_row = reverse ? b->src + (b->height - 1)*b->srcStride : b->src;
+    uint32_t dst_row = reverse ? b->dst + (b->height - 1)*b->dstStride : b->dst;
+
+    for (int y = 0; y < b->height; ++y)
+    {
+        for (int x = 0; x < b->width; ++x)
+        {
+            int column = reverse ? b->width - 1 - x : x;
+            uint32_t src = (src_row + column) & 0xffffff;
+            uint32_t dst = (dst_row + column) & 0xffffff;
+            uint8_t data = op == OP_FILL ? b->value : (op == OP_COPY || op == OP_CRC ? framebuffer[src] : store[src % BLIT_STORE_SIZE]);
+
+            if (op == OP_CRC)
+                crc = crc32_update(crc, data);
+            else if (dst < FRAMEBUFFER_SIZE && !(transparent && data == b->value))
+                framebuffer[dst] = data;
+        }
+
+        src_row = reverse ? src_row - b->srcStride : src_row + b->srcStride;
+        dst_row = reverse ? dst_row - b->dstStride : dst_row + b->dstStride;
+    }
+
+    return ~crc;
+}
+
+int main(void)
+{
+    uint32_t crc = 0xffffffff;
+
+    for (int i = 0; i < FRAMEBUFFER_SIZE; ++i)
+        framebuffer[i] = i*7 + (i >> 8)*13;
+
+    for (int i = 0; i < BLIT_STORE_SIZE; ++i)
+        store[i] = i*29 + 3;
+
+    for (unsigned i = 0; i < sizeof(blits) / sizeof(blits[0]); ++i)
+    {
+        uint32_t result = run(&blits[i]);
+
+        if ((blits[i].op & 3) == OP_CRC && blits[i].width != 0 && blits[i].height != 0)
+            printf("%08x\n", result);
+    }
+
+    for (int i = 0; i < FRAMEBUFFER_SIZE; ++i)
+        crc = crc32_update(crc, framebuffer[i]);
+
+    printf("%08x\n", ~crc);
+    return 0;
+}
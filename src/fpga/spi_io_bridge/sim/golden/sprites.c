@@ -0,0 +1,69 @@
+// reference for tb_sprites: renders the top left 64x48 frame pixels of the sprite scene
+// and prints them as rgb hex, one pixel per line: cc sprites.c && ./a.out > sprites.hex
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define FRAME_WIDTH 320
+#define CROP_WIDTH 64
+#define CROP_HEIGHT 48
+#define SPRITE_SIZE 32
+
+// same scene as tb_sprites.sv
+static const int sprite_x[4] = {-10, 12, -4, 20};
+static const int sprite_y[4] = {-6, 4, 14, 16};
+static const int sprite_behind[4] = {0, 0, 1, 0};
+static const uint8_t sprite_transparent[4] = {0xe0, 0xe1, 0xe2, 0x00};
+
+static uint8_t framebuffer_value(int x, int y)
+{
+    return x < 24 ? 0 : 0x40 | ((x ^ y) & 0x3f);
+}
+
+static uint8_t sprite_pixel(int s, int x, int y)
+{
+    if ((x + 2*y + s) % 5 == 0)
+        return sprite_transparent[s];
+
+    if (s == 1 && x == y)
+        return 0; //opaque, index 0 is not special
+
+    return 0x80 + s*0x10 + ((x + y) & 0xf);
+}
+
+static uint32_t palette(uint8_t i)
+{
+    return (uint32_t)i << 16 | (uint8_t)(i*7) << 8 | (uint8_t)~i;
+}
+
+int main(void)
+{
+    for (int y = 0; y < CROP_HEIGHT; ++y)
+        for (int x = 0; x < CROP_WIDTH; ++x)
+        {
+            uint8_t background = framebuffer_value(x, y);
+            uint8_t idx = background;
+
+            //lower sprite index is drawn on top
+            for (int s = 0; s < 4; ++s)
+            {
+                int dx = x - sprite_x[s], dy = y - sprite_y[s];
+                uint8_t p;
+
+                if (dx < 0 || dx >= SPRITE_SIZE || dy < 0 || dy >= SPRITE_SIZE)
+                    continue;
+
+                p = sprite_pixel(s, dx, dy);
+
+                if (p == sprite_transparent[s] || (sprite_behind[s] && background != 0))
+                    continue;
+
+                idx = p;
+                break;
+            }
+
+            printf("%06x\n", palette(idx));
+        }
+
+    return 0;
+}
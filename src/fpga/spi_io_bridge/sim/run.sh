@@ -0,0 +1,42 @@
+#!/bin/sh
+# icarus verilog testbenches, run.sh [testbench...], all of them by default
+
+cd "$(dirname "$0")"
+
+SIM=$(pwd)
+SRC=../src
+
+TESTBENCHES=${*:-"tb_rv32i tb_sprites tb_left_edge tb_palette_animation tb_raster tb_blitter"}
+
+mkdir -p build
+
+failed=0
+
+for tb in $TESTBENCHES
+do
+    rundir=.
+
+    case $tb in
+    tb_rv32i)
+        sources="$SRC/usb_host/rv32i.v"
+        rundir=$SRC/usb_host # m_lm_mc loads ucmem/mem.hex
+        ;;
+    tb_sprites|tb_left_edge|tb_palette_animation|tb_raster|tb_blitter)
+        sources="$SRC/framebuffer.sv tb_video.sv"
+        ;;
+    *)
+        echo "unknown testbench $tb"
+        exit 1
+        ;;
+    esac
+
+    echo "== $tb"
+
+    iverilog -g2012 -D__ICARUS__ -s $tb -o build/$tb.vvp $sources $tb.sv || exit 1
+
+    (cd $rundir && vvp -n "$SIM/build/$tb.vvp") | tee build/$tb.log
+
+    grep -q "^PASS" build/$tb.log || failed=1
+done
+
+exit $failed
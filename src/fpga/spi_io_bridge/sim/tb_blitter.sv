@@ -0,0 +1,276 @@
+//blit queue in five batches while 160x120 is shown: fills, a copy forward and a reverse one over overlapping
+//rectangles, store copies with and without transparency, a reverse transparent copy, a fill running past the end
+//of the framebuffer and crc blits. both crc results and a crc of the framebuffer read back afterwards are compared
+//with golden/blits.hex, which golden/blits.c computes from the same queue.
+//batches are started at both clock parities inside an hblank window and shortly before vblank end, so the
+//accesses straddle the window edges. every blitter access has to be inside a window or be the write after a read
+//in it, each edge has to be hit, and every screen pixel of the frame above the blit rectangles must stay unchanged
+
+`timescale 1ns / 1ps
+
+module tb_blitter;
+
+    localparam int SCREEN_WIDTH = 1280, SCREEN_HEIGHT = 720;
+    localparam int TOTAL_WIDTH = 1650, TOTAL_HEIGHT = 750;
+    localparam int HBLANK_WINDOW = 256;
+
+    localparam int BORDER_LEFT = 160; //160x120 at 720p: x6 scaling, letterboxed
+    localparam int SCALE = 6;
+    localparam int FRAME_WIDTH = 160;
+
+    localparam int FRAMEBUFFER_SIZE = 320*240;
+    localparam int STORE_USED = 6144;
+    localparam int BLIT_QUEUE_DEPTH = 16, BLIT_PARAMS_SIZE = 16;
+
+    localparam logic [7:0] OP_FILL = 0, OP_COPY = 1, OP_STORE_COPY = 2, OP_CRC = 3;
+    localparam logic [7:0] FLAG_TRANSPARENT = 8'h40, FLAG_REVERSE = 8'h80;
+
+    logic clk;
+    logic [11:0] cx, cy, px, py;
+    logic [23:0] rgb;
+
+    tb_video video (.clk(clk), .cx(cx), .cy(cy), .px(px), .py(py), .rgb(rgb));
+
+    logic [31:0] golden [3];
+
+    bit capture = 0;
+    int errors = 0, pixels_checked = 0;
+
+    function automatic logic [7:0] framebuffer_value(int addr);
+        return 8'(addr*7 + (addr >> 8)*13);
+    endfunction
+
+    function automatic logic [7:0] store_value(int addr);
+        return 8'(addr*29 + 3);
+    endfunction
+
+    function automatic logic [23:0] palette(logic [7:0] idx);
+        return {idx, idx ^ 8'h55, ~idx};
+    endfunction
+
+    function automatic logic [31:0] crc32_update(logic [31:0] crc, logic [7:0] data);
+        crc = crc ^ 32'(data);
+
+        for (int i = 0; i < 8; i++)
+            crc = crc[0] ? (crc >> 1) ^ 32'hEDB88320 : crc >> 1;
+
+        return crc;
+    endfunction
+
+    function automatic logic [4:0] gray_to_binary(logic [4:0] gray);
+        logic [4:0] binary;
+
+        binary[4] = gray[4];
+
+        for (int i = 3; i >= 0; i--)
+            binary[i] = binary[i+1] ^ gray[i];
+
+        return binary;
+    endfunction
+
+    //blits go below the frame shown meanwhile, every screen pixel of it is checked
+    always @(negedge clk)
+    begin
+        if (capture && px >= BORDER_LEFT && px < BORDER_LEFT + FRAME_WIDTH*SCALE && py < SCREEN_HEIGHT)
+        begin
+            automatic int addr = (py / SCALE)*FRAME_WIDTH + (px - BORDER_LEFT) / SCALE;
+            automatic logic [23:0] expected = palette(framebuffer_value(addr));
+
+            if (rgb !== expected)
+            begin
+                if (errors < 16)
+                    $display("FAIL: screen %0d,%0d: %06x, expected %06x", px, py, rgb, expected);
+
+                ++errors;
+            end
+
+            ++pixels_checked;
+        end
+    end
+
+    //framebuffer accesses of the blitter and the window edges they were seen at
+    int hblank_first = 0, hblank_last = 0, hblank_trailing = 0;
+    int vblank_first = 0, vblank_last = 0, vblank_trailing = 0;
+    bit previous_window = 0;
+
+    always @(posedge clk)
+    begin
+        if (video.dut.blit_read || video.dut.blit_wren)
+        begin
+            if (!video.dut.blit_window && !(video.dut.blit_wren && previous_window))
+            begin
+                if (errors < 16)
+                    $display("FAIL: blitter %s at %0d,%0d outside the windows", video.dut.blit_wren ? "write" : "read", cx, cy);
+
+                ++errors;
+            end
+
+            if (cy < SCREEN_HEIGHT && cx == SCREEN_WIDTH)
+                ++hblank_first;
+
+            if (cy < SCREEN_HEIGHT && cx == SCREEN_WIDTH + HBLANK_WINDOW - 1)
+                ++hblank_last;
+
+            if (cy < SCREEN_HEIGHT && cx == SCREEN_WIDTH + HBLANK_WINDOW)
+                ++hblank_trailing;
+
+            if (cy == SCREEN_HEIGHT && cx == 0)
+                ++vblank_first;
+
+            if (cy == TOTAL_HEIGHT - 2 && cx == TOTAL_WIDTH - 1)
+                ++vblank_last;
+
+            if (cy == TOTAL_HEIGHT - 1 && cx == 0)
+                ++vblank_trailing;
+        end
+
+        previous_window = video.dut.blit_window;
+    end
+
+    //queue entry n, parameters as in framebuffer.sv
+
+    int queued = 0;
+
+    task automatic queue_blit(input logic [7:0] op, input logic [7:0] value, input int src, input int src_stride,
+                              input int dst, input int dst_stride, input int width, input int height);
+        automatic logic [0:BLIT_PARAMS_SIZE-1][7:0] params = {op, value,
+            8'(src), 8'(src >> 8), 8'(src >> 16), 8'(src_stride), 8'(src_stride >> 8),
+            8'(dst), 8'(dst >> 8), 8'(dst >> 16), 8'(dst_stride), 8'(dst_stride >> 8),
+            8'(width), 8'(width >> 8), 8'(height), 8'(height >> 8)};
+
+        for (int i = 0; i < BLIT_PARAMS_SIZE; ++i)
+            video.write_blit_queue((queued % BLIT_QUEUE_DEPTH)*BLIT_PARAMS_SIZE + i, params[i]);
+
+        ++queued;
+    endtask
+
+    function automatic int R(int row, int column);
+        return 20480 + row*320 + column;
+    endfunction
+
+    //same queue as golden/blits.c
+    task automatic queue_batch(input int batch);
+        case (batch)
+            0:
+            begin
+                queue_blit(OP_FILL, 8'h5a, 0, 0, R(0, 5), 320, 37, 9);
+                queue_blit(OP_FILL, 8'h11, 0, 0, R(2, 100), 320, 61, 1);
+                queue_blit(OP_COPY, 0, 0, 0, 0, 0, 0, 5); //empty
+                queue_blit(OP_COPY, 0, R(10, 20), 320, R(9, 17), 320, 50, 12);
+                queue_blit(OP_COPY | FLAG_REVERSE, 0, R(30, 10), 320, R(32, 15), 320, 40, 10);
+                queue_blit(OP_STORE_COPY | FLAG_TRANSPARENT, 8'h1f, 100, 48, R(50, 30), 320, 48, 20);
+                queue_blit(OP_STORE_COPY, 0, 1000, 33, R(75, 200), 320, 33, 7);
+                queue_blit(OP_FILL, 8'h99, 0, 0, FRAMEBUFFER_SIZE - 100, 0, 200, 1); //half past the end
+                queue_blit(OP_CRC, 0, R(0, 0), 320, 0, 0, 256, 130);
+            end
+            1:
+            begin
+                queue_blit(OP_FILL, 8'h77, 0, 0, R(170, 0), 320, 64, 4);
+                queue_blit(OP_COPY, 0, R(0, 0), 320, R(160, 0), 320, 41, 5);
+            end
+            2: queue_blit(OP_FILL, 8'h33, 0, 0, R(110, 0), 320, 320, 20);
+            3: queue_blit(OP_FILL, 8'h44, 0, 0, R(130, 0), 320, 320, 20);
+            4:
+            begin
+                queue_blit(OP_CRC, 0, 0, 0, 0, 0, 0, 0); //empty
+                queue_blit(OP_COPY, 0, R(0, 0), 320, R(100, 3), 320, 70, 30);
+                queue_blit(OP_COPY | FLAG_REVERSE | FLAG_TRANSPARENT, 8'h5a, R(100, 0), 320, R(101, 1), 320, 80, 40);
+                queue_blit(OP_STORE_COPY | FLAG_TRANSPARENT, 8'h00, 4000, 64, R(140, 250), 320, 64, 30);
+                queue_blit(OP_CRC, 0, 19200, 320, 0, 0, 320, 180);
+            end
+            default: ;
+        endcase
+    endtask
+
+    //queues a batch, hands it to the blitter at the clock after screen position (x, y) and waits until it is done
+    task automatic run_batch(input int batch, input int x, input int y);
+        queue_batch(batch);
+
+        video.wait_raster(x, y);
+
+        @(negedge clk);
+        video.blit_head_gray = 5'(queued ^ (queued >> 1));
+
+        do
+            @(posedge clk);
+        while (gray_to_binary(video.blit_tail_gray) != 5'(queued));
+    endtask
+
+    task automatic check_crc(input string what, input logic [31:0] crc, input logic [31:0] expected);
+        if (crc !== expected)
+        begin
+            $display("FAIL: %s crc %08x, expected %08x", what, crc, expected);
+            ++errors;
+        end
+    endtask
+
+    task automatic check_edge(input string what, input int count);
+        if (count == 0)
+        begin
+            $display("FAIL: no blitter access at the %s", what);
+            ++errors;
+        end
+    endtask
+
+    initial
+    begin
+        automatic logic [31:0] crc = '1;
+
+        $readmemh("golden/blits.hex", golden);
+
+        #1; //after the register defaults of tb_video
+
+        video.registers[8'h28] = 5; //MODE_160X120
+
+        for (int i = 0; i < 256; ++i)
+            video.write_palette(i, palette(8'(i)));
+
+        for (int i = 0; i < FRAMEBUFFER_SIZE; ++i)
+            video.write_framebuffer(i, framebuffer_value(i));
+
+        for (int i = 0; i < STORE_USED; ++i)
+            video.write_blit_store(i, store_value(i));
+
+        video.wait_raster(0, 0);
+
+        capture = 1;
+
+        //the first blits start inside an hblank window at both parities, the long crc runs through the vblank
+        run_batch(0, SCREEN_WIDTH + 20, SCREEN_HEIGHT - 30);
+        check_crc("batch 0", video.blit_crc, golden[0]);
+
+        run_batch(1, SCREEN_WIDTH + 21, SCREEN_HEIGHT - 30);
+
+        //fills started at both parities shortly before vblank end, running into the next frame
+        run_batch(2, 100, TOTAL_HEIGHT - 5);
+        run_batch(3, 101, TOTAL_HEIGHT - 5);
+
+        run_batch(4, 0, SCREEN_HEIGHT + 5);
+        check_crc("batch 4", video.blit_crc, golden[1]);
+
+        capture = 0;
+
+        for (int i = 0; i < FRAMEBUFFER_SIZE; ++i)
+        begin
+            automatic logic [7:0] value;
+
+            video.read_framebuffer(i, value);
+            crc = crc32_update(crc, value);
+        end
+
+        check_crc("framebuffer", ~crc, golden[2]);
+
+        check_edge("hblank window start", hblank_first);
+        check_edge("hblank window end", hblank_last);
+        check_edge("clock after the hblank window", hblank_trailing);
+        check_edge("vblank window start", vblank_first);
+        check_edge("vblank window end", vblank_last);
+        check_edge("clock after the vblank window", vblank_trailing);
+
+        $display("%0d screen pixels checked, window edge accesses: hblank %0d/%0d/%0d, vblank %0d/%0d/%0d, %0d errors",
+                 pixels_checked, hblank_first, hblank_last, hblank_trailing, vblank_first, vblank_last, vblank_trailing, errors);
+        $display("%s", errors ? "FAIL" : "PASS");
+        $finish;
+    end
+
+endmodule
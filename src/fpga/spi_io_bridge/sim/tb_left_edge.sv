@@ -0,0 +1,78 @@
+//640x240 4bpp fills the 720p screen without a border, so the first pixels of every line are fetched
+//at the end of the previous one. checks every screen pixel of the first four frame rows,
+//including the last vblank line fetching the first pixels of line 0
+
+`timescale 1ns / 1ps
+
+module tb_left_edge;
+
+    localparam int ROWS = 4;
+    localparam int SCALE_Y = 3; //640x240 at 720p: x2 horizontally, x3 vertically
+
+    logic clk;
+    logic [11:0] cx, cy, px, py;
+    logic [23:0] rgb;
+
+    tb_video video (.clk(clk), .cx(cx), .cy(cy), .px(px), .py(py), .rgb(rgb));
+
+    bit capture = 0;
+    int errors = 0, checked = 0;
+
+    //frame pixel x of a row has palette index (x + row) & 15, so every column is distinct from its neighbours
+    function automatic logic [23:0] expected_rgb(int x, int row);
+        automatic logic [7:0] idx = 8'((x + row) & 15);
+
+        return {8'(idx*16 + 1), idx, 8'(255 - idx)};
+    endfunction
+
+    always @(negedge clk)
+    begin
+        if (capture && px < 1280 && py < ROWS*SCALE_Y)
+        begin
+            automatic logic [23:0] expected = expected_rgb(px / 2, py / SCALE_Y);
+
+            if (rgb !== expected)
+            begin
+                if (errors < 16)
+                    $display("FAIL: screen %0d,%0d: %06x, expected %06x", px, py, rgb, expected);
+
+                ++errors;
+            end
+
+            ++checked;
+        end
+    end
+
+    initial
+    begin
+        #1; //after the register defaults of tb_video
+
+        video.registers[8'h28] = 2; //MODE_640X240_4BPP
+
+        for (int i = 0; i < 16; ++i)
+            video.write_palette(i, {8'(i*16 + 1), 8'(i), 8'(255 - i)});
+
+        for (int row = 0; row < ROWS; ++row)
+            for (int b = 0; b < 320; ++b)
+                video.write_framebuffer(row*320 + b, {4'(2*b + row), 4'(2*b + 1 + row)}); //left pixel in the high nibble
+
+        if (cy < 720)
+        begin
+            $display("FAIL: frame loaded after the first vblank");
+            $finish;
+        end
+
+        video.wait_raster(0, 0);
+
+        capture = 1;
+
+        video.wait_raster(0, ROWS*SCALE_Y + 1);
+
+        capture = 0;
+
+        $display("%0d of %0d screen pixels mismatching", errors, checked);
+        $display("%s", errors ? "FAIL" : "PASS");
+        $finish;
+    end
+
+endmodule
@@ -0,0 +1,199 @@
+//palette fade and rotation over a dozen frames: fade levels stepped by speed towards a changing target,
+//a speed 0 jump, a target above FADE_LEVEL_MAX, one forward and one reverse rotation range, a direction change
+//and a disable. frame row 0 holds indices 0..15 and every frame its screen pixels are compared with a model
+//of the registers. each column has its own index, so a latency compensation that misses the fade stage shows up too
+
+`timescale 1ns / 1ps
+
+module tb_palette_animation;
+
+    localparam int BORDER_LEFT = 160; //320x240 at 720p: x3 scaling, letterboxed
+    localparam int SCALE = 3;
+    localparam int FRAMES = 12;
+
+    localparam int REGISTER_FADE_TARGET = 'h2B;
+    localparam int REGISTER_FADE_SPEED = 'h2C;
+    localparam int REGISTER_ROTATION_BASE = 'h30;
+
+    logic clk;
+    logic [11:0] cx, cy, px, py;
+    logic [23:0] rgb;
+
+    tb_video video (.clk(clk), .cx(cx), .cy(cy), .px(px), .py(py), .rgb(rgb));
+
+    //model: registers as written, as copied at vblank, and the animation state stepped at vblank start
+
+    logic [7:0] written [64], active [64];
+    int level = 0;
+    int timer [2] = '{0, 0}, offset [2] = '{0, 0};
+
+    int frame = 0, errors = 0;
+
+    function automatic logic [23:0] primary(int i);
+        return {8'(i*16), 8'd40, 8'd200};
+    endfunction
+
+    function automatic logic [23:0] secondary(int i);
+        return {8'(255 - i*8), 8'd240, 8'd10};
+    endfunction
+
+    //from + (to - from) * level / 128, rounded towards minus infinity
+    function automatic int fade_channel(int from, int to, int level);
+        automatic int delta = (to - from)*level;
+
+        return from + (delta >= 0 ? delta/128 : -((-delta + 127)/128));
+    endfunction
+
+    function automatic logic [23:0] expected_rgb(int idx);
+        automatic logic [23:0] p, s;
+
+        for (int r = 0; r < 2; ++r)
+        begin
+            automatic int first = active[REGISTER_ROTATION_BASE + r*4];
+            automatic int last = active[REGISTER_ROTATION_BASE + r*4 + 1];
+            automatic int period = active[REGISTER_ROTATION_BASE + r*4 + 2];
+
+            if (period != 0 && last > first && idx >= first && idx <= last)
+            begin
+                idx = first + (idx - first + offset[r]) % (last - first + 1);
+                break;
+            end
+        end
+
+        p = primary(idx);
+        s = secondary(idx);
+
+        return {8'(fade_channel(p[23:16], s[23:16], level)),
+                8'(fade_channel(p[15:8], s[15:8], level)),
+                8'(fade_channel(p[7:0], s[7:0], level))};
+    endfunction
+
+    task automatic write_register(input int idx, input logic [7:0] value);
+        written[idx] = value;
+        video.registers[idx] = value;
+    endtask
+
+    task automatic step_model;
+        automatic int target = active[REGISTER_FADE_TARGET] > 128 ? 128 : active[REGISTER_FADE_TARGET];
+        automatic int speed = active[REGISTER_FADE_SPEED];
+        automatic int distance = level < target ? target - level : level - target;
+
+        if (speed == 0 || distance <= speed)
+            level = target;
+        else
+            level = level < target ? level + speed : level - speed;
+
+        for (int r = 0; r < 2; ++r)
+        begin
+            automatic int first = active[REGISTER_ROTATION_BASE + r*4];
+            automatic int last = active[REGISTER_ROTATION_BASE + r*4 + 1];
+            automatic int period = active[REGISTER_ROTATION_BASE + r*4 + 2];
+            automatic bit reverse = active[REGISTER_ROTATION_BASE + r*4 + 3][0];
+
+            if (period == 0 || last <= first)
+            begin
+                timer[r] = 0;
+                offset[r] = 0;
+            end
+            else if (timer[r] + 1 < period)
+                ++timer[r];
+            else
+            begin
+                timer[r] = 0;
+                offset[r] = reverse ? (offset[r] + last - first) % (last - first + 1) : (offset[r] + 1) % (last - first + 1);
+            end
+        end
+
+        //vblank copy, a disabled range is cleared on the next clock
+        active = written;
+
+        for (int r = 0; r < 2; ++r)
+            if (active[REGISTER_ROTATION_BASE + r*4 + 2] == 0 ||
+                active[REGISTER_ROTATION_BASE + r*4 + 1] <= active[REGISTER_ROTATION_BASE + r*4])
+            begin
+                timer[r] = 0;
+                offset[r] = 0;
+            end
+    endtask
+
+    //frame pixel x of row 0 is sampled in the middle of its 3x3 screen pixels
+    always @(negedge clk)
+    begin
+        if (frame > 0 && py == 1 && px >= BORDER_LEFT && px < BORDER_LEFT + 16*SCALE && (px - BORDER_LEFT) % SCALE == 1)
+        begin
+            automatic int x = (px - BORDER_LEFT) / SCALE;
+            automatic logic [23:0] expected = expected_rgb(x);
+
+            if (rgb !== expected)
+            begin
+                $display("FAIL: frame %0d index %0d: %06x, expected %06x (level %0d, offsets %0d %0d)",
+                         frame, x, rgb, expected, level, offset[0], offset[1]);
+                ++errors;
+            end
+        end
+    end
+
+    initial
+    begin
+        #1; //after the register defaults of tb_video
+
+        for (int i = 0; i < 64; ++i)
+            written[i] = 0;
+
+        write_register('h28, 0); //MODE_320X240
+
+        //range 0 forward every second frame, range 1 reverse every frame
+        write_register(REGISTER_ROTATION_BASE + 0, 4);
+        write_register(REGISTER_ROTATION_BASE + 1, 9);
+        write_register(REGISTER_ROTATION_BASE + 2, 2);
+        write_register(REGISTER_ROTATION_BASE + 3, 0);
+        write_register(REGISTER_ROTATION_BASE + 4, 12);
+        write_register(REGISTER_ROTATION_BASE + 5, 14);
+        write_register(REGISTER_ROTATION_BASE + 6, 1);
+        write_register(REGISTER_ROTATION_BASE + 7, 1);
+
+        for (int i = 0; i < 16; ++i)
+        begin
+            video.write_palette(i, primary(i));
+            video.write_palette_secondary(i, secondary(i));
+            video.write_framebuffer(i, 8'(i));
+        end
+
+        if (cy < 720)
+        begin
+            $display("FAIL: frame loaded after the first vblank");
+            $finish;
+        end
+
+        //the raster starts at vblank start, where the copy is already taken into account by the model
+        active = written;
+
+        for (frame = 1; frame <= FRAMES; ++frame)
+        begin
+            video.wait_raster(0, 0);
+            video.wait_raster(0, 3);
+
+            case (frame)
+                1: begin write_register(REGISTER_FADE_TARGET, 128); write_register(REGISTER_FADE_SPEED, 48); end
+                5: begin write_register(REGISTER_FADE_TARGET, 20); write_register(REGISTER_FADE_SPEED, 0); end
+                6:
+                begin
+                    write_register(REGISTER_FADE_TARGET, 0);
+                    write_register(REGISTER_FADE_SPEED, 8);
+                    write_register(REGISTER_ROTATION_BASE + 3, 1); //range 0 reverses
+                end
+                8: write_register(REGISTER_FADE_TARGET, 200); //clamped to FADE_LEVEL_MAX
+                9: write_register(REGISTER_ROTATION_BASE + 6, 0); //range 1 disabled
+                default: ;
+            endcase
+
+            video.wait_raster(0, 720);
+            step_model();
+        end
+
+        $display("%0d frames, %0d mismatching samples", FRAMES, errors);
+        $display("%s", errors ? "FAIL" : "PASS");
+        $finish;
+    end
+
+endmodule
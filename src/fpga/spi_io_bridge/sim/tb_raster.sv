@@ -0,0 +1,205 @@
+//rows_done and the raster position readback after every screen line, one frame in each layout,
+//then two frames of a copper list whose palette and register writes must land on their programmed row.
+//rows done are derived from the last screen line showing each frame row, not from upcoming_row
+
+`timescale 1ns / 1ps
+
+module tb_raster;
+
+    localparam int SCREEN_WIDTH = 1280, SCREEN_HEIGHT = 720;
+    localparam int MODES = 6;
+    localparam int BORDER_LEFT = 160; //320x240 at 720p: x3 scaling, letterboxed
+
+    localparam int REGISTER_SCROLL_X = 'h20;
+    localparam int REGISTER_MODE = 'h28;
+    localparam int REGISTER_COPPER_FLAGS = 'h2E;
+
+    localparam logic [23:0] P0 = 24'h102030, P1 = 24'h405060, P2 = 24'h708090, Q = 24'ha0b0c0;
+
+    logic clk;
+    logic [11:0] cx, cy, px, py;
+    logic [23:0] rgb;
+
+    tb_video video (.clk(clk), .cx(cx), .cy(cy), .px(px), .py(py), .rgb(rgb));
+
+    int mode = 0;
+    int copper_frame = -1; //0 and 1 while the copper list runs
+    int errors = 0, lines_checked = 0, pixels_checked = 0;
+
+    //frame row shown by a screen line at 720p, screen to frame mapping frame = screen * NUM / DEN,
+    //every layout fills the screen height so there is no top border
+    function automatic int frame_height(int mode);
+        case (mode)
+            1: return 200;
+            5: return 120;
+            default: return 240;
+        endcase
+    endfunction
+
+    function automatic int frame_row(int mode, int line);
+        case (mode)
+            1: return line*5/18;
+            5: return line/6;
+            default: return line/3;
+        endcase
+    endfunction
+
+    int last_line [240];
+    int expected_rows_done [SCREEN_HEIGHT];
+
+    task automatic prepare_mode(input int m);
+        for (int r = 0; r < 240; ++r)
+            last_line[r] = -1;
+
+        for (int line = 0; line < SCREEN_HEIGHT; ++line)
+            last_line[frame_row(m, line)] = line;
+
+        for (int r = 0; r < frame_height(m); ++r)
+            if (last_line[r] < 0)
+            begin
+                $display("FAIL: mode %0d never shows frame row %0d", m, r);
+                ++errors;
+            end
+
+        //after a line, rows done are the leading rows that no later line shows
+        for (int line = 0; line < SCREEN_HEIGHT; ++line)
+        begin
+            automatic int done = 0;
+
+            while (done < frame_height(m) && last_line[done] <= line)
+                ++done;
+
+            expected_rows_done[line] = done;
+        end
+    endtask
+
+    function automatic logic [15:0] gray_to_binary(logic [15:0] gray);
+        logic [15:0] binary;
+
+        binary[15] = gray[15];
+
+        for (int i = 14; i >= 0; i--)
+            binary[i] = binary[i+1] ^ gray[i];
+
+        return binary;
+    endfunction
+
+    //rows_done is updated at cx == screen_width and raster_gray a clock later
+    always @(posedge clk)
+    begin
+        if (cx == SCREEN_WIDTH + 2)
+        begin
+            automatic int expected = cy < SCREEN_HEIGHT ? expected_rows_done[cy] : 0;
+            automatic int rows_done = gray_to_binary(video.raster_gray[15:0]);
+            automatic int line = gray_to_binary(video.raster_gray[31:16]);
+
+            if (video.dut.rows_done !== 9'(expected) || rows_done != expected || line != cy)
+            begin
+                if (errors < 16)
+                    $display("FAIL: mode %0d line %0d: rows_done %0d, raster %0d/%0d, expected %0d",
+                             mode, cy, video.dut.rows_done, line, rows_done, expected);
+
+                ++errors;
+            end
+
+            ++lines_checked;
+        end
+    end
+
+    //copper frames: column 0 holds index 5 whose palette entry the list rewrites, column 1 index 6 which
+    //shows once scroll x is 1. palette writes are permanent, so the second frame starts with the last one
+    function automatic logic [23:0] copper_rgb(int row);
+        if (row >= 30)
+            return Q;
+        else if (row >= 20)
+            return P2;
+        else if (row >= 10)
+            return P1;
+        else
+            return copper_frame == 0 ? P0 : P2;
+    endfunction
+
+    always @(negedge clk)
+    begin
+        if (copper_frame >= 0 && px == BORDER_LEFT + 1 && py < 40*3)
+        begin
+            if (rgb !== copper_rgb(py / 3))
+            begin
+                if (errors < 16)
+                    $display("FAIL: copper frame %0d line %0d (row %0d): %06x, expected %06x",
+                             copper_frame, py, py / 3, rgb, copper_rgb(py / 3));
+
+                ++errors;
+            end
+
+            ++pixels_checked;
+        end
+    end
+
+    task automatic write_copper_entry(input int n, input int row, input logic [7:0] op, input logic [7:0] idx, input logic [23:0] value);
+        video.write_copper(n*8 + 0, 8'(row));
+        video.write_copper(n*8 + 1, 8'(row >> 8));
+        video.write_copper(n*8 + 2, op);
+        video.write_copper(n*8 + 3, idx);
+        video.write_copper(n*8 + 4, value[23:16]);
+        video.write_copper(n*8 + 5, value[15:8]);
+        video.write_copper(n*8 + 6, value[7:0]);
+        video.write_copper(n*8 + 7, 0);
+    endtask
+
+    initial
+    begin
+        #1; //after the register defaults of tb_video
+
+        video.registers[REGISTER_MODE] = 0;
+        prepare_mode(0);
+
+        //frame 0 is already running in mode 0, every frame switches to the next mode
+        for (int m = 0; m < MODES; ++m)
+        begin
+            video.wait_raster(0, 0);
+            mode = m;
+            prepare_mode(m);
+
+            video.registers[REGISTER_MODE] = 8'(m + 1 < MODES ? m + 1 : 0);
+
+            if (m == MODES - 1)
+            begin
+                video.write_palette(5, P0);
+                video.write_palette(6, Q);
+
+                for (int row = 0; row < 240; ++row)
+                begin
+                    video.write_framebuffer(row*320, 5);
+                    video.write_framebuffer(row*320 + 1, 6);
+                end
+
+                write_copper_entry(0, 10, 8'd1, 5, P1);
+                write_copper_entry(1, 20, 8'd1, 5, P2);
+                write_copper_entry(2, 30, 8'd0, REGISTER_SCROLL_X, 24'h010000);
+                write_copper_entry(3, 0, 8'hFF, 0, 0);
+
+                video.registers[REGISTER_COPPER_FLAGS] = 1;
+            end
+
+            video.wait_raster(0, SCREEN_HEIGHT);
+        end
+
+        for (int f = 0; f < 2; ++f)
+        begin
+            video.wait_raster(0, 0);
+            mode = 0;
+            prepare_mode(0);
+            copper_frame = f;
+
+            video.wait_raster(0, SCREEN_HEIGHT);
+        end
+
+        copper_frame = -1;
+
+        $display("%0d lines and %0d copper pixels checked, %0d errors", lines_checked, pixels_checked, errors);
+        $display("%s", errors ? "FAIL" : "PASS");
+        $finish;
+    end
+
+endmodule
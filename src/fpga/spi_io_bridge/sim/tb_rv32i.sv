@@ -0,0 +1,384 @@
+//runs ucmem/mem.hex on RV32I and RV32I_P3 side by side and compares retired pcs, register writes
+//and peripheral writes of both cores, then prints the CPI of each.
+//every core gets its own copy of the peripherals below. they answer by access count instead of time,
+//so both cores see the same values. run from src/usb_host so $readmemh finds ucmem/mem.hex (see run.sh)
+
+`timescale 1ns / 1ps
+
+module tb_rv32i;
+
+    localparam int RETIRE_COUNT = 200000; //enumeration plus three keyboard reports
+    localparam int MAX_CYCLES = RETIRE_COUNT*8;
+
+    logic clk = 0;
+    logic rstn = 0;
+
+    always #10 clk = ~clk;
+
+    logic [31:0] ad_a, di_a, do_a, ad_b, di_b, do_b;
+    logic [1:0] md_a, md_b;
+
+    RV32I cpu_a (
+        .CLK(clk),
+        .RST_X(rstn),
+        .w_stall(1'b0),
+        .w_mic_addr(ad_a),
+        .w_data(di_a),
+        .w_mic_wdata(do_a),
+        .w_mic_mmuwe(),
+        .w_mic_ctrl(),
+        .w_mic_req(md_a)
+    );
+
+    RV32I_P3 #(.MUL(0)) cpu_b (
+        .CLK(clk),
+        .RST_X(rstn),
+        .w_stall(1'b0),
+        .w_mic_addr(ad_b),
+        .w_data(di_b),
+        .w_mic_wdata(do_b),
+        .w_mic_mmuwe(),
+        .w_mic_ctrl(),
+        .w_mic_req(md_b)
+    );
+
+    tb_rv32i_periph #(.ECHO(1)) periph_a (.clk(clk), .ad(ad_a), .di(di_a), .data_out(do_a), .md(md_a));
+    tb_rv32i_periph periph_b (.clk(clk), .ad(ad_b), .di(di_b), .data_out(do_b), .md(md_b));
+
+    //traces: retired pc, register writes as {rd, value}, peripheral writes as {address, value}.
+    //RV32I raises ACCESS_WRITE for local memory stores too, RV32I_P3 only outside of it
+
+    logic [31:0] pc_a [RETIRE_COUNT], pc_b [RETIRE_COUNT];
+    logic [63:0] reg_a [RETIRE_COUNT], reg_b [RETIRE_COUNT];
+    logic [63:0] io_a [RETIRE_COUNT], io_b [RETIRE_COUNT];
+
+    int pc_count_a = 0, pc_count_b = 0;
+    int reg_count_a = 0, reg_count_b = 0;
+    int io_count_a = 0, io_count_b = 0;
+    int cycles_a = 0, cycles_b = 0;
+
+    always @(posedge clk)
+    begin
+        if (rstn && pc_count_a < RETIRE_COUNT)
+        begin
+            cycles_a = cycles_a + 1;
+
+            if (cpu_a.r_state == `MC_MA)
+            begin
+                pc_a[pc_count_a] = cpu_a.r_pc;
+                pc_count_a = pc_count_a + 1;
+            end
+
+            if (cpu_a.w_reg_w && cpu_a.r_rd != 0)
+            begin
+                reg_a[reg_count_a] = {27'b0, cpu_a.r_rd, cpu_a.w_reg_d};
+                reg_count_a = reg_count_a + 1;
+            end
+
+            if (md_a == `ACCESS_WRITE && ad_a[31:28] != `UC_TADDR)
+            begin
+                io_a[io_count_a] = {ad_a, do_a};
+                io_count_a = io_count_a + 1;
+            end
+        end
+
+        if (rstn && pc_count_b < RETIRE_COUNT)
+        begin
+            cycles_b = cycles_b + 1;
+
+            if (cpu_b.w_x_go)
+            begin
+                pc_b[pc_count_b] = cpu_b.r_pc;
+                pc_count_b = pc_count_b + 1;
+            end
+
+            if (cpu_b.w_reg_w && cpu_b.r_w_rd != 0)
+            begin
+                reg_b[reg_count_b] = {27'b0, cpu_b.r_w_rd, cpu_b.w_reg_d};
+                reg_count_b = reg_count_b + 1;
+            end
+
+            if (md_b == `ACCESS_WRITE && ad_b[31:28] != `UC_TADDR)
+            begin
+                io_b[io_count_b] = {ad_b, do_b};
+                io_count_b = io_count_b + 1;
+            end
+        end
+    end
+
+    int errors = 0;
+    int count;
+
+    initial
+    begin
+        repeat (8) @(posedge clk);
+        rstn = 1;
+
+        for (int i = 0; i < MAX_CYCLES && (pc_count_a < RETIRE_COUNT || pc_count_b < RETIRE_COUNT); ++i)
+            @(posedge clk);
+
+        @(negedge clk);
+
+        if (pc_count_a < RETIRE_COUNT || pc_count_b < RETIRE_COUNT)
+        begin
+            $display("FAIL: timeout, RV32I retired %0d, RV32I_P3 retired %0d", pc_count_a, pc_count_b);
+            $finish;
+        end
+
+        //the register and peripheral write streams end wherever the last retired instruction left them,
+        //compare the common prefix
+
+        for (int i = 0; i < RETIRE_COUNT; ++i)
+            if (pc_a[i] !== pc_b[i])
+            begin
+                $display("FAIL: retired instruction %0d, RV32I pc %08x, RV32I_P3 pc %08x", i, pc_a[i], pc_b[i]);
+                ++errors;
+                break;
+            end
+
+        count = (reg_count_a < reg_count_b) ? reg_count_a : reg_count_b;
+
+        for (int i = 0; i < count; ++i)
+            if (reg_a[i] !== reg_b[i])
+            begin
+                $display("FAIL: register write %0d, RV32I x%0d = %08x, RV32I_P3 x%0d = %08x",
+                         i, reg_a[i][36:32], reg_a[i][31:0], reg_b[i][36:32], reg_b[i][31:0]);
+                ++errors;
+                break;
+            end
+
+        count = (io_count_a < io_count_b) ? io_count_a : io_count_b;
+
+        for (int i = 0; i < count; ++i)
+            if (io_a[i] !== io_b[i])
+            begin
+                $display("FAIL: peripheral write %0d, RV32I [%08x] = %08x, RV32I_P3 [%08x] = %08x",
+                         i, io_a[i][63:32], io_a[i][31:0], io_b[i][63:32], io_b[i][31:0]);
+                ++errors;
+                break;
+            end
+
+        //slot 0 keys1 after the third report: no modifiers, keys 05 06
+
+        if (periph_a.hid[17] !== 32'h00000506 || periph_b.hid[17] !== 32'h00000506)
+        begin
+            $display("FAIL: slot 0 keys1 RV32I %08x, RV32I_P3 %08x, expected 00000506", periph_a.hid[17], periph_b.hid[17]);
+            ++errors;
+        end
+
+        $display("%0d instructions, %0d/%0d register writes, %0d/%0d peripheral writes",
+                 RETIRE_COUNT, reg_count_a, reg_count_b, io_count_a, io_count_b);
+        $display("RV32I    %0d cycles, CPI %0.3f", cycles_a, real'(cycles_a) / RETIRE_COUNT);
+        $display("RV32I_P3 %0d cycles, CPI %0.3f", cycles_b, real'(cycles_b) / RETIRE_COUNT);
+        $display("%s", errors ? "FAIL" : "PASS");
+        $finish;
+    end
+
+endmodule
+
+//uart/timer, usb11 SIE with a boot keyboard on the root port, hid pages and the trace ring.
+//read data is combinational on the address like the muxes in usb_host.v, side effects happen on the
+//read request cycle and both cores consume the value after it, like the registered rx fifo output
+module tb_rv32i_periph
+#(
+    parameter bit ECHO = 0 //print the uart output
+)
+(
+    input logic clk,
+    input logic [31:0] ad,
+    output logic [31:0] di,
+    input logic [31:0] data_out,
+    input logic [1:0] md
+);
+
+    localparam logic [7:0] PID_SETUP = 8'h2d, PID_IN = 8'h69, PID_OUT = 8'he1;
+    localparam logic [7:0] PID_DATA0 = 8'hc3, PID_DATA1 = 8'h4b, PID_ACK = 8'hd2, PID_NAK = 8'h5a, PID_STALL = 8'h1e;
+
+    localparam logic [31:0] SIE_IDLE = 32'h10000000, RX_TIMEOUT = 32'h20000000;
+
+    localparam bit [0:17][7:0] DEV_DESC = {8'd18, 8'd1, 8'h10, 8'd1, 8'd0, 8'd0, 8'd0, 8'd8, 8'h34, 8'h12, 8'h78, 8'h56,
+                                           8'd1, 8'd0, 8'd0, 8'd0, 8'd0, 8'd1};
+    localparam bit [0:33][7:0] CFG_DESC = {8'd9, 8'd2, 8'd34, 8'd0, 8'd1, 8'd1, 8'd0, 8'ha0, 8'd50,
+                                           8'd9, 8'd4, 8'd0, 8'd0, 8'd1, 8'd3, 8'd1, 8'd1, 8'd0,
+                                           8'd9, 8'h21, 8'h11, 8'd1, 8'd0, 8'd1, 8'h22, 8'd63, 8'd0,
+                                           8'd7, 8'd5, 8'h81, 8'd3, 8'd8, 8'd0, 8'd10};
+    localparam bit [0:2][0:7][7:0] REPORTS = {{8'h02, 8'h00, 8'h04, 8'h00, 8'h00, 8'h00, 8'h00, 8'h00},  //shift + a
+                                              {8'h02, 8'h00, 8'h04, 8'h05, 8'h00, 8'h00, 8'h00, 8'h00},
+                                              {8'h00, 8'h00, 8'h05, 8'h06, 8'h07, 8'h08, 8'h09, 8'h0a}}; //6 keys
+
+    wire rd = (md == `ACCESS_READ);
+    wire wr = (md == `ACCESS_WRITE);
+    wire [3:0] reg_idx = ad[5:2];
+
+    wire uart_sel = (ad[31:8] == 24'h200000);
+    wire sie_sel = (ad[31:8] == 24'h210000);
+    wire hid_sel = (ad[31:9] == 23'h110000);
+
+    //the ms timer advances every 16 reads of it, wait_ms returns at once with the sim bit set
+
+    int timer_reads = 0;
+
+    //sie registers and the device
+
+    logic [31:0] ctrl = 0, token = 0, rxsts = SIE_IDLE;
+    logic [7:0] tx_fifo [64], rx_fifo [64];
+    logic [7:0] rx_data = 0;
+    int tx_count = 0, rx_count = 0, rx_pos = 0;
+
+    int dev_addr = 0, pending_addr = -1;
+    bit configured = 0;
+    int ctl_src = 0, ctl_len = 0, ctl_pos = 0; //ctl_src 1 device, 2 configuration descriptor
+    bit toggle0 = 0, toggle1 = 0;
+    int in_polls = 0, report_idx = 0;
+
+    logic [31:0] hid [128];
+
+    initial
+        for (int i = 0; i < 128; ++i)
+            hid[i] = 0;
+
+    always_comb
+    begin
+        di = 32'b0;
+
+        if (uart_sel)
+            case (reg_idx)
+                4'd1: di = 32'h00000005; //tx ready, sim
+                4'd2: di = timer_reads >> 4;
+                default: di = 32'b0;
+            endcase
+        else if (sie_sel)
+            case (reg_idx)
+                4'd0: di = ctrl;
+                4'd1: di = 32'h00000009; //detect, D+ high: full speed device
+                4'd6: di = token & 32'h7fffffff;
+                4'd7: di = rxsts;
+                4'd8: di = {24'b0, rx_data};
+                default: di = 32'b0;
+            endcase
+        else if (hid_sel)
+            di = hid[ad[8:2]];
+    end
+
+    task automatic sie_transaction(input logic [31:0] t);
+        logic [7:0] pid;
+        int addr, ep, value, length;
+
+        pid = t[23:16];
+        addr = t[15:9];
+        ep = t[8:5];
+
+        rx_count = 0;
+        rx_pos = 0;
+        rxsts = SIE_IDLE;
+
+        if (addr != dev_addr)
+            rxsts |= RX_TIMEOUT;
+        else if (pid == PID_SETUP)
+        begin
+            value = tx_fifo[2] | tx_fifo[3] << 8;
+            length = tx_fifo[6] | tx_fifo[7] << 8;
+            toggle0 = 1;
+            ctl_src = 0;
+            ctl_pos = 0;
+            ctl_len = 0;
+
+            if (tx_fifo[0] == 8'h00 && tx_fifo[1] == 8'h05)
+                pending_addr = value;
+            else if (tx_fifo[0] == 8'h00 && tx_fifo[1] == 8'h09)
+                configured = 1;
+            else if (tx_fifo[0] == 8'h80 && tx_fifo[1] == 8'h06 && value[15:8] == 1)
+            begin
+                ctl_src = 1;
+                ctl_len = 18;
+            end
+            else if (tx_fifo[0] == 8'h80 && tx_fifo[1] == 8'h06 && value[15:8] == 2)
+            begin
+                ctl_src = 2;
+                ctl_len = 34;
+            end
+
+            if (ctl_len > length)
+                ctl_len = length;
+
+            //class requests and report descriptors are stalled, the firmware goes on without them
+            if ((tx_fifo[0] == 8'h00 && (tx_fifo[1] == 8'h05 || tx_fifo[1] == 8'h09)) || ctl_src != 0)
+                rxsts |= PID_ACK << 16;
+            else
+                rxsts |= PID_STALL << 16;
+        end
+        else if (pid == PID_OUT)
+            rxsts |= ((ep == 0) ? PID_ACK : PID_STALL) << 16;
+        else if (pid == PID_IN && ep == 0)
+        begin
+            while (rx_count < 8 && ctl_pos < ctl_len)
+            begin
+                rx_fifo[rx_count] = (ctl_src == 1) ? DEV_DESC[ctl_pos] : CFG_DESC[ctl_pos];
+                ++rx_count;
+                ++ctl_pos;
+            end
+
+            rxsts |= ((toggle0 ? PID_DATA1 : PID_DATA0) << 16) | rx_count;
+            toggle0 = !toggle0;
+
+            //zero length status stage of SET_ADDRESS
+            if (ctl_src == 0 && pending_addr >= 0)
+            begin
+                dev_addr = pending_addr;
+                pending_addr = -1;
+            end
+        end
+        else if (pid == PID_IN && ep == 1 && configured && report_idx < 3 && (++in_polls % 16) == 0)
+        begin
+            for (int i = 0; i < 8; ++i)
+                rx_fifo[i] = REPORTS[report_idx][i];
+
+            rx_count = 8;
+            ++report_idx;
+            rxsts |= ((toggle1 ? PID_DATA1 : PID_DATA0) << 16) | rx_count;
+            toggle1 = !toggle1;
+        end
+        else
+            rxsts |= PID_NAK << 16;
+
+        tx_count = 0;
+    endtask
+
+    always @(posedge clk)
+    begin
+        if (rd && uart_sel && reg_idx == 4'd2)
+            ++timer_reads;
+
+        if (rd && sie_sel && reg_idx == 4'd8 && rx_pos < rx_count)
+        begin
+            rx_data = rx_fifo[rx_pos];
+            ++rx_pos;
+        end
+
+        if (ECHO && wr && uart_sel && reg_idx == 4'd0)
+            $write("%c", data_out[7:0]);
+
+        if (wr && sie_sel)
+            case (reg_idx)
+                4'd0: ctrl = data_out;
+                4'd6:
+                begin
+                    token = data_out;
+
+                    if (data_out[31])
+                        sie_transaction(data_out);
+                end
+                4'd8:
+                    if (tx_count < 64)
+                    begin
+                        tx_fifo[tx_count] = data_out[7:0];
+                        ++tx_count;
+                    end
+                default: ;
+            endcase
+
+        if (wr && hid_sel)
+            hid[ad[8:2]] = data_out;
+    end
+
+endmodule
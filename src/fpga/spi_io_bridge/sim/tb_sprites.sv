@@ -0,0 +1,116 @@
+//four overlapping sprites in the top left corner of a 320x240 frame: priority by sprite index,
+//transparent index per sprite, the behind flag, clipping at negative x and y.
+//every screen pixel of the top left 64x48 frame pixels is compared with golden/sprites.hex
+
+`timescale 1ns / 1ps
+
+module tb_sprites;
+
+    localparam int BORDER_LEFT = 160; //320x240 at 720p: x3 scaling, letterboxed
+    localparam int SCALE = 3;
+    localparam int CROP_WIDTH = 64, CROP_HEIGHT = 48;
+
+    //same scene as golden/sprites.c
+    localparam bit [0:3][15:0] SPRITE_X = {-16'sd10, 16'sd12, -16'sd4, 16'sd20};
+    localparam bit [0:3][15:0] SPRITE_Y = {-16'sd6, 16'sd4, 16'sd14, 16'sd16};
+    localparam bit [0:3][7:0] SPRITE_FLAGS = {8'h01, 8'h01, 8'h03, 8'h01}; //enable, sprite 2 behind
+    localparam bit [0:3][7:0] SPRITE_TRANSPARENT = {8'he0, 8'he1, 8'he2, 8'h00};
+
+    logic clk;
+    logic [11:0] cx, cy, px, py;
+    logic [23:0] rgb;
+
+    tb_video video (.clk(clk), .cx(cx), .cy(cy), .px(px), .py(py), .rgb(rgb));
+
+    logic [23:0] golden [CROP_WIDTH*CROP_HEIGHT];
+    logic [23:0] captured [CROP_WIDTH*CROP_HEIGHT];
+
+    bit capture = 0;
+    int errors = 0;
+
+    function automatic logic [7:0] framebuffer_value(int x, int y);
+        return x < 24 ? 8'h00 : 8'(8'h40 | ((x ^ y) & 8'h3f));
+    endfunction
+
+    function automatic logic [7:0] sprite_pixel(int s, int x, int y);
+        if ((x + 2*y + s) % 5 == 0)
+            return SPRITE_TRANSPARENT[s];
+
+        if (s == 1 && x == y)
+            return 8'h00; //opaque, index 0 is not special
+
+        return 8'(8'h80 + s*8'h10 + ((x + y) & 8'hf));
+    endfunction
+
+    always @(negedge clk)
+    begin
+        if (capture && px >= BORDER_LEFT && px < BORDER_LEFT + CROP_WIDTH*SCALE && py < CROP_HEIGHT*SCALE)
+        begin
+            automatic int x = (px - BORDER_LEFT) / SCALE;
+            automatic int y = py / SCALE;
+
+            if ((px - BORDER_LEFT) % SCALE == 1 && py % SCALE == 1)
+                captured[y*CROP_WIDTH + x] = rgb;
+
+            if (rgb !== golden[y*CROP_WIDTH + x])
+            begin
+                if (errors < 16)
+                    $display("FAIL: screen %0d,%0d frame %0d,%0d: %06x, expected %06x", px, py, x, y, rgb, golden[y*CROP_WIDTH + x]);
+
+                ++errors;
+            end
+        end
+    end
+
+    initial
+    begin
+        $readmemh("golden/sprites.hex", golden);
+
+        #1; //after the register defaults of tb_video
+
+        video.registers[8'h28] = 0; //MODE_320X240
+
+        for (int s = 0; s < 4; ++s)
+        begin
+            video.registers[s*8 + 0] = SPRITE_X[s][7:0];
+            video.registers[s*8 + 1] = SPRITE_X[s][15:8];
+            video.registers[s*8 + 2] = SPRITE_Y[s][7:0];
+            video.registers[s*8 + 3] = SPRITE_Y[s][15:8];
+            video.registers[s*8 + 4] = SPRITE_FLAGS[s];
+            video.registers[s*8 + 5] = SPRITE_TRANSPARENT[s];
+        end
+
+        for (int i = 0; i < 256; ++i)
+            video.write_palette(i, {8'(i), 8'(i*7), ~8'(i)});
+
+        for (int y = 0; y < CROP_HEIGHT; ++y)
+            for (int x = 0; x < CROP_WIDTH; ++x)
+                video.write_framebuffer(y*320 + x, framebuffer_value(x, y));
+
+        for (int s = 0; s < 4; ++s)
+            for (int i = 0; i < 32*32; ++i)
+                video.write_sprite(s, i, sprite_pixel(s, i % 32, i / 32));
+
+        //loading ends inside the first vblank, where the registers are copied
+        if (cy < 720)
+        begin
+            $display("FAIL: scene loaded after the first vblank");
+            $finish;
+        end
+
+        video.wait_raster(0, 0);
+
+        capture = 1;
+
+        video.wait_raster(0, CROP_HEIGHT*SCALE + 1);
+
+        capture = 0;
+
+        $writememh("build/tb_sprites.hex", captured);
+
+        $display("%0d mismatching screen pixels", errors);
+        $display("%s", errors ? "FAIL" : "PASS");
+        $finish;
+    end
+
+endmodule
@@ -0,0 +1,256 @@
+//framebuffer with 720p raster timing and write tasks for its memories, shared by the framebuffer testbenches.
+//the raster starts at vblank start so the registers set at time 0 are copied before the first frame.
+//rgb is the screen pixel at (px, py): screen_rgb_out lags cx by one clock
+
+`timescale 1ns / 1ps
+
+module tb_video
+(
+    output logic clk,
+    output logic [11:0] cx, cy,
+    output logic [11:0] px, py,
+    output logic [23:0] rgb
+);
+
+    localparam int SCREEN_WIDTH = 1280, SCREEN_HEIGHT = 720;
+    localparam int TOTAL_WIDTH = 1650, TOTAL_HEIGHT = 750;
+
+    localparam int REGISTER_COUNT = 64;
+    localparam int SPRITE_COUNT = 4;
+
+    logic clk_wr = 0;
+
+    initial clk = 0;
+
+    always #7 clk = ~clk;   //pixel clock
+    always #5 clk_wr = ~clk_wr; //spi side memory ports
+
+    initial
+    begin
+        cx = 0;
+        cy = SCREEN_HEIGHT;
+    end
+
+    always @(posedge clk)
+    begin
+        cx <= cx == TOTAL_WIDTH-1 ? 12'd0 : 12'(cx + 1);
+        cy <= cx == TOTAL_WIDTH-1 ? (cy == TOTAL_HEIGHT-1 ? 12'd0 : 12'(cy + 1)) : cy;
+
+        px <= cx;
+        py <= cy;
+    end
+
+    logic [7:0] registers [REGISTER_COUNT];
+    logic registers_busy = 0;
+
+    logic [7:0] rgb_in = 0, rgb_out;
+    logic [16:0] rgb_addr = 0;
+    logic wren_rgb = 0;
+
+    logic [23:0] palette_in = 0, palette_out;
+    logic [7:0] palette_addr = 0;
+    logic wren_palette = 0;
+
+    logic [7:0] sprite_in = 0;
+    logic [$clog2(SPRITE_COUNT)+9:0] sprite_addr = 0;
+    logic wren_sprite = 0;
+
+    logic [7:0] line_table_in = 0, line_table_addr = 0;
+    logic wren_line_table = 0;
+
+    logic [23:0] palette_secondary_in = 0;
+    logic [7:0] palette_secondary_addr = 0;
+    logic wren_palette_secondary = 0;
+
+    logic [7:0] copper_in = 0;
+    logic [8:0] copper_addr = 0;
+    logic wren_copper = 0;
+
+    logic [7:0] blit_queue_in = 0, blit_queue_addr = 0;
+    logic wren_blit_queue = 0;
+    logic [4:0] blit_head_gray = 0, blit_tail_gray;
+    logic blit_busy;
+    logic [31:0] blit_crc;
+
+    logic [7:0] blit_store_in = 0;
+    logic [12:0] blit_store_addr = 0;
+    logic wren_blit_store = 0;
+
+    logic hblank, vblank, dvi_output;
+    logic [15:0] frame_counter_gray;
+    logic [47:0] geometry;
+    logic [31:0] raster_gray;
+
+    initial
+        for (int i = 0; i < REGISTER_COUNT; ++i)
+            registers[i] = 0;
+
+    framebuffer #(.REGISTER_COUNT(REGISTER_COUNT), .SPRITE_COUNT(SPRITE_COUNT), .VIDEO_1080P(0)) dut
+    (
+        .rgb_in(rgb_in),
+        .rgb_out(rgb_out),
+        .palette_in(palette_in),
+        .palette_out(palette_out),
+
+        .rgb_addr(rgb_addr),
+        .palette_addr(palette_addr),
+
+        .clk_rgb(clk_wr), .clk_palette(clk_wr),
+        .wren_rgb(wren_rgb), .wren_palette(wren_palette),
+
+        .hblank(hblank), .vblank(vblank),
+        .frame_counter_gray(frame_counter_gray),
+        .geometry(geometry),
+        .raster_gray(raster_gray),
+        .dvi_output(dvi_output),
+
+        .registers(registers), .registers_busy(registers_busy),
+
+        .sprite_in(sprite_in),
+        .sprite_addr(sprite_addr),
+        .clk_sprite(clk_wr), .wren_sprite(wren_sprite),
+
+        .line_table_in(line_table_in),
+        .line_table_addr(line_table_addr),
+        .clk_line_table(clk_wr), .wren_line_table(wren_line_table),
+
+        .palette_secondary_in(palette_secondary_in),
+        .palette_secondary_addr(palette_secondary_addr),
+        .clk_palette_secondary(clk_wr), .wren_palette_secondary(wren_palette_secondary),
+
+        .copper_in(copper_in),
+        .copper_addr(copper_addr),
+        .clk_copper(clk_wr), .wren_copper(wren_copper),
+
+        .blit_queue_in(blit_queue_in),
+        .blit_queue_addr(blit_queue_addr),
+        .clk_blit_queue(clk_wr), .wren_blit_queue(wren_blit_queue),
+        .blit_head_gray(blit_head_gray), .blit_tail_gray(blit_tail_gray),
+        .blit_busy(blit_busy), .blit_crc(blit_crc),
+
+        .blit_store_in(blit_store_in),
+        .blit_store_addr(blit_store_addr),
+        .clk_blit_store(clk_wr), .wren_blit_store(wren_blit_store),
+
+        .clk_pixel(clk),
+        .screen_rgb_out(rgb),
+        .cx(cx),
+        .cy(cy),
+        .screen_width(12'(SCREEN_WIDTH)),
+        .screen_height(12'(SCREEN_HEIGHT)),
+        .total_width(12'(TOTAL_WIDTH)),
+        .total_height(12'(TOTAL_HEIGHT))
+    );
+
+    //the fpga powers up with every flip-flop cleared and the framebuffer has no reset of its own,
+    //clear the state that is only ever updated from itself. variables keep the forced value after release
+    initial
+    begin
+        force dut.blit_tail = 0;
+        force dut.fade_level = 0;
+        force dut.frame_counter = 0;
+        force dut.gen_rotation[0].timer = 0;
+        force dut.gen_rotation[0].offset = 0;
+        force dut.gen_rotation[1].timer = 0;
+        force dut.gen_rotation[1].offset = 0;
+
+        repeat (4) @(posedge clk);
+
+        release dut.blit_tail;
+        release dut.fade_level;
+        release dut.frame_counter;
+        release dut.gen_rotation[0].timer;
+        release dut.gen_rotation[0].offset;
+        release dut.gen_rotation[1].timer;
+        release dut.gen_rotation[1].offset;
+    end
+
+    //spi side writes, one per clk_wr
+
+    task automatic write_framebuffer(input int addr, input logic [7:0] value);
+        @(negedge clk_wr);
+        rgb_addr = 17'(addr);
+        rgb_in = value;
+        wren_rgb = 1;
+        @(negedge clk_wr);
+        wren_rgb = 0;
+    endtask
+
+    task automatic read_framebuffer(input int addr, output logic [7:0] value);
+        @(negedge clk_wr);
+        rgb_addr = 17'(addr);
+        @(negedge clk_wr);
+        value = rgb_out;
+    endtask
+
+    task automatic write_palette(input int idx, input logic [23:0] value);
+        @(negedge clk_wr);
+        palette_addr = 8'(idx);
+        palette_in = value;
+        wren_palette = 1;
+        @(negedge clk_wr);
+        wren_palette = 0;
+    endtask
+
+    task automatic write_palette_secondary(input int idx, input logic [23:0] value);
+        @(negedge clk_wr);
+        palette_secondary_addr = 8'(idx);
+        palette_secondary_in = value;
+        wren_palette_secondary = 1;
+        @(negedge clk_wr);
+        wren_palette_secondary = 0;
+    endtask
+
+    task automatic write_sprite(input int sprite, input int idx, input logic [7:0] value);
+        @(negedge clk_wr);
+        sprite_addr = {2'(sprite), 10'(idx)};
+        sprite_in = value;
+        wren_sprite = 1;
+        @(negedge clk_wr);
+        wren_sprite = 0;
+    endtask
+
+    task automatic write_line_table(input int idx, input logic [7:0] value);
+        @(negedge clk_wr);
+        line_table_addr = 8'(idx);
+        line_table_in = value;
+        wren_line_table = 1;
+        @(negedge clk_wr);
+        wren_line_table = 0;
+    endtask
+
+    task automatic write_copper(input int addr, input logic [7:0] value);
+        @(negedge clk_wr);
+        copper_addr = 9'(addr);
+        copper_in = value;
+        wren_copper = 1;
+        @(negedge clk_wr);
+        wren_copper = 0;
+    endtask
+
+    task automatic write_blit_queue(input int addr, input logic [7:0] value);
+        @(negedge clk_wr);
+        blit_queue_addr = 8'(addr);
+        blit_queue_in = value;
+        wren_blit_queue = 1;
+        @(negedge clk_wr);
+        wren_blit_queue = 0;
+    endtask
+
+    task automatic write_blit_store(input int addr, input logic [7:0] value);
+        @(negedge clk_wr);
+        blit_store_addr = 13'(addr);
+        blit_store_in = value;
+        wren_blit_store = 1;
+        @(negedge clk_wr);
+        wren_blit_store = 0;
+    endtask
+
+    //waits for the raster to reach screen position (x, y)
+    task automatic wait_raster(input int x, input int y);
+        do
+            @(posedge clk);
+        while (cx != x || cy != y);
+    endtask
+
+endmodule
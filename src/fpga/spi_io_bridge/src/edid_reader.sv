@@ -0,0 +1,264 @@
+module edid_reader
+#(
+    parameter int CLOCK_HZ = 50_000_000,
+    parameter int I2C_HZ = 100_000,
+    parameter int RETRIES = 3
+)
+(
+    input logic clk,
+    input logic reset,
+
+    input logic hpd,
+
+    inout logic ddc_sda,
+    output logic ddc_scl,
+
+    //read side, contents only change while busy
+    input logic [7:0] addr,
+    output logic [7:0] data,
+
+    output logic [7:0] status //bit0 hot plug detect, bit1 busy, bit2 edid valid, bit3 sink did not acknowledge
+);
+
+    localparam int QUARTER_CYCLES = CLOCK_HZ / I2C_HZ / 4;
+    localparam int SETTLE_CYCLES = CLOCK_HZ / 10; //sinks may need up to 100ms after hot plug before ddc answers
+
+    localparam bit [7:0] EDID_WRITE_ADDRESS = 8'hA0;
+    localparam bit [7:0] EDID_READ_ADDRESS = 8'hA1;
+
+    localparam int EDID_SIZE = 256; //base block and the first extension
+
+    logic [7:0] edid [EDID_SIZE];
+
+    assign data = edid[addr];
+
+    //open drain, both pins are configured with OPEN_DRAIN=ON
+    logic scl_low, sda_low;
+
+    assign ddc_scl = ~scl_low;
+    assign ddc_sda = sda_low ? 1'b0 : 1'bZ;
+
+    logic [1:0] hpd_sync_ff, sda_sync_ff;
+
+    wire hpd_sync = hpd_sync_ff[0];
+    wire sda_sync = sda_sync_ff[0];
+
+    always_ff @(posedge clk)
+    begin
+        hpd_sync_ff <= {hpd, hpd_sync_ff[1]};
+        sda_sync_ff <= {ddc_sda, sda_sync_ff[1]};
+    end
+
+    //bit timing, every bit is split in 4 quarters: set sda, scl high, sample, scl low
+    logic [$clog2(QUARTER_CYCLES)-1:0] quarter_timer;
+
+    wire tick = quarter_timer == QUARTER_CYCLES - 1;
+
+    always_ff @(posedge clk)
+        quarter_timer <= tick ? '0 : quarter_timer + 1'b1;
+
+    typedef enum
+    {
+        IDLE,   //no sink
+        SETTLE, //waiting after hot plug or a failed attempt
+        START,  //start or repeated start condition
+        BYTE,   //8 data bits and the acknowledge bit
+        STOP,
+        DONE    //waiting for the sink to be unplugged
+    } edid_state;
+
+    //transaction steps: start, A0, 00, repeated start, A1, EDID_SIZE bytes, stop
+    localparam int STEP_START = 0;
+    localparam int STEP_DEVICE_WRITE = 1;
+    localparam int STEP_OFFSET = 2;
+    localparam int STEP_RESTART = 3;
+    localparam int STEP_DEVICE_READ = 4;
+    localparam int STEP_READ = 5;
+    localparam int STEP_STOP = 6;
+
+    edid_state state;
+
+    logic [2:0] step;
+    logic [1:0] quarter;
+    logic [3:0] bit_idx;
+    logic [7:0] shift;
+    logic [8:0] byte_count;
+    logic [$clog2(SETTLE_CYCLES)-1:0] settle_timer;
+    logic [$clog2(RETRIES+1)-1:0] retries;
+    logic failed, valid, nack;
+
+    wire reading = step == STEP_READ;
+
+    assign status = {4'b0, nack, valid, state != IDLE && state != DONE, hpd_sync};
+
+    always_ff @(posedge clk)
+    begin
+        if (reset || !hpd_sync)
+        begin
+            state <= IDLE;
+
+            scl_low <= 0;
+            sda_low <= 0;
+
+            valid <= 0;
+            nack <= 0;
+            retries <= 0;
+        end
+        else
+        begin
+            unique case (state)
+                IDLE :
+                begin
+                    settle_timer <= 0;
+                    state <= SETTLE;
+                end
+                SETTLE :
+                begin
+                    if (settle_timer == SETTLE_CYCLES - 1)
+                    begin
+                        step <= STEP_START;
+                        quarter <= 0;
+                        byte_count <= 0;
+                        failed <= 0;
+
+                        state <= START;
+                    end
+                    else
+                        settle_timer <= settle_timer + 1'b1;
+                end
+                START :
+                begin
+                    if (tick)
+                    begin
+                        quarter <= quarter + 1'b1;
+
+                        unique case (quarter)
+                            2'd0 : {scl_low, sda_low} <= 2'b10;
+                            2'd1 : scl_low <= 0;
+                            2'd2 : sda_low <= 1; //sda falls while scl is high
+                            2'd3 :
+                            begin
+                                scl_low <= 1;
+
+                                step <= step + 1'b1;
+                                bit_idx <= 0;
+                                shift <= step == STEP_START ? EDID_WRITE_ADDRESS : EDID_READ_ADDRESS;
+
+                                state <= BYTE;
+                            end
+                        endcase
+                    end
+                end
+                BYTE :
+                begin
+                    if (tick)
+                    begin
+                        quarter <= quarter + 1'b1;
+
+                        unique case (quarter)
+                            2'd0 :
+                            begin
+                                scl_low <= 1;
+
+                                if (bit_idx < 8)
+                                    sda_low <= !reading && !shift[7];
+                                else
+                                    sda_low <= reading && byte_count != EDID_SIZE - 1; //master acknowledges all but the last byte
+                            end
+                            2'd1 : scl_low <= 0;
+                            2'd2 :
+                            begin
+                                if (bit_idx < 8 && reading)
+                                    shift <= {shift[6:0], sda_sync};
+                                else if (bit_idx == 8 && !reading)
+                                    failed <= sda_sync;
+                            end
+                            2'd3 :
+                            begin
+                                scl_low <= 1;
+
+                                if (bit_idx < 8)
+                                begin
+                                    if (!reading)
+                                        shift <= {shift[6:0], 1'b0};
+
+                                    bit_idx <= bit_idx + 1'b1;
+                                end
+                                else
+                                begin
+                                    bit_idx <= 0;
+
+                                    if (reading)
+                                    begin
+                                        edid[byte_count[7:0]] <= shift;
+                                        byte_count <= byte_count + 1'b1;
+
+                                        if (byte_count == EDID_SIZE - 1)
+                                        begin
+                                            step <= STEP_STOP;
+                                            state <= STOP;
+                                        end
+                                    end
+                                    else if (failed)
+                                    begin
+                                        step <= STEP_STOP;
+                                        state <= STOP;
+                                    end
+                                    else
+                                    begin
+                                        unique case (step)
+                                            STEP_DEVICE_WRITE :
+                                            begin
+                                                shift <= 8'h00; //edid offset
+                                                step <= STEP_OFFSET;
+                                            end
+                                            STEP_OFFSET :
+                                            begin
+                                                step <= STEP_RESTART;
+                                                state <= START;
+                                            end
+                                            default : //STEP_DEVICE_READ
+                                                step <= STEP_READ;
+                                        endcase
+                                    end
+                                end
+                            end
+                        endcase
+                    end
+                end
+                STOP :
+                begin
+                    if (tick)
+                    begin
+                        quarter <= quarter + 1'b1;
+
+                        unique case (quarter)
+                            2'd0 : {scl_low, sda_low} <= 2'b11;
+                            2'd1 : scl_low <= 0;
+                            2'd2 : sda_low <= 0; //sda rises while scl is high
+                            2'd3 :
+                            begin
+                                if (failed && retries < RETRIES)
+                                begin
+                                    retries <= retries + 1'b1;
+                                    settle_timer <= 0;
+
+                                    state <= SETTLE;
+                                end
+                                else
+                                begin
+                                    valid <= !failed;
+                                    nack <= failed;
+
+                                    state <= DONE;
+                                end
+                            end
+                        endcase
+                    end
+                end
+                DONE : ;
+            endcase
+        end
+    end
+
+endmodule
@@ -1,4 +1,9 @@
 module framebuffer
+#(
+    parameter int REGISTER_COUNT = 64,
+    parameter int SPRITE_COUNT = 4,
+    parameter bit VIDEO_1080P = 0 //layout scaling for 1920x1080 instead of 1280x720
+)
 (
     //spi side
     input logic [7:0] rgb_in,
@@ -13,23 +18,56 @@ module framebuffer
     input logic wren_rgb, wren_palette,
     
     output logic hblank, vblank,
+    output logic [15:0] frame_counter_gray,
+    output logic [47:0] geometry, //mode, bits per pixel, frame width, frame height of the active layout
+    output logic [31:0] raster_gray, //screen line and frame rows scanned out so far, both gray coded
+    output logic dvi_output,
+
+    input logic [7:0] registers [REGISTER_COUNT],
+    input logic registers_busy,
+
+    input logic [7:0] sprite_in,
+    input logic [$clog2(SPRITE_COUNT)+9:0] sprite_addr,
+    input logic clk_sprite, wren_sprite,
+
+    input logic [7:0] line_table_in,
+    input logic [7:0] line_table_addr,
+    input logic clk_line_table, wren_line_table,
+
+    input logic [23:0] palette_secondary_in,
+    input logic [7:0] palette_secondary_addr,
+    input logic clk_palette_secondary, wren_palette_secondary,
+
+    input logic [7:0] copper_in,
+    input logic [8:0] copper_addr,
+    input logic clk_copper, wren_copper,
+
+    input logic [7:0] blit_queue_in,
+    input logic [7:0] blit_queue_addr,
+    input logic clk_blit_queue, wren_blit_queue,
+    input logic [4:0] blit_head_gray,  //queue entries written by the spi side
+    output logic [4:0] blit_tail_gray, //queue entries finished by the blitter
+    output logic blit_busy,
+    output logic [31:0] blit_crc,      //result of the last crc blit
+
+    input logic [7:0] blit_store_in,
+    input logic [12:0] blit_store_addr,
+    input logic clk_blit_store, wren_blit_store,
 
     //hdmi side
     input logic clk_pixel,
     output logic [23:0] screen_rgb_out,
-    input logic [11:0] cx, cy, screen_width, screen_height
+    input logic [11:0] cx, cy, screen_width, screen_height,
+    input logic [11:0] total_width, //screen columns including hblank
+    input logic [11:0] total_height //screen lines including vblank
 );
 
-    localparam int FRAME_WIDTH = 320;
-    localparam int FRAME_HEIGHT = 240;
-    localparam int SCALE_X = 3;
-    localparam int SCALE_Y = 3;
-
-    wire [11:0] frame_border_top_bottom = 12'((screen_height - FRAME_HEIGHT*SCALE_Y)/2);
-    wire [11:0] frame_border_left_right = 12'((screen_width - FRAME_WIDTH*SCALE_X)/2);
+    localparam int FRAMEBUFFER_SIZE = 320*240; //bytes, every layout fits
+    localparam int MAX_FRAME_HEIGHT = 240;
 
-    bit [7:0] framebuffer [FRAME_WIDTH*FRAME_HEIGHT];
+    bit [7:0] framebuffer [FRAMEBUFFER_SIZE];
     bit [23:0] palette [256];
+    bit [23:0] palette_secondary [256]; //fade target, write only from the spi side
 
     always_ff @(posedge clk_rgb)
     begin
@@ -47,54 +85,822 @@ module framebuffer
             palette_out <= palette[palette_addr];
     end
 
+    always_ff @(posedge clk_palette_secondary)
+    begin
+        if (wren_palette_secondary)
+            palette_secondary[palette_secondary_addr] <= palette_secondary_in;
+    end
+
+    //gpu registers
+    //
+
+    //sprite n occupies REGISTER_SPRITE_BASE + n*REGISTER_SPRITE_STRIDE:
+    //  +0 x low, +1 x high, +2 y low, +3 y high (signed, frame pixels), +4 flags, +5 transparent index
+    localparam int REGISTER_SPRITE_BASE = 'h00;
+    localparam int REGISTER_SPRITE_STRIDE = 8;
+
+    localparam int SPRITE_FLAG_ENABLE = 0;
+    localparam int SPRITE_FLAG_BEHIND = 1; //only drawn over framebuffer pixel value 0
+
+    //scroll x (0..frame width-1) and y (0..frame height-1) are 16 bit little endian, framebuffer wraps around
+    localparam int REGISTER_SCROLL_X = 'h20;
+    localparam int REGISTER_SCROLL_Y = 'h22;
+    localparam int REGISTER_SCROLL_FLAGS = 'h24;
+
+    localparam int SCROLL_FLAG_LINE_TABLE = 0; //screen line y shows framebuffer row line_table[y] + scroll y
+
+    localparam int REGISTER_MODE = 'h28;
+    localparam int REGISTER_PALETTE_BANK = 'h29; //high palette index bits in 4bpp (16 colors per bank) and 2bpp (4 colors per bank) layouts
+    localparam int REGISTER_PAGE = 'h2A;         //displayed page, page n starts at byte n*frame size, pages past the end of the framebuffer show page 0
+
+    //output color = palette + (palette_secondary - palette) * fade level / FADE_LEVEL_MAX
+    //fade level moves towards the target by speed levels every frame, speed 0 jumps to the target at the next frame
+    localparam int REGISTER_FADE_TARGET = 'h2B;
+    localparam int REGISTER_FADE_SPEED = 'h2C;
+
+    localparam int FADE_LEVEL_MAX = 128;
+
+    localparam int REGISTER_OUTPUT_FLAGS = 'h2D;
+
+    localparam int OUTPUT_FLAG_DVI = 0; //plain dvi without audio and infoframes for sinks that reject hdmi data islands
+
+    //rotation range n occupies REGISTER_ROTATION_BASE + n*REGISTER_ROTATION_STRIDE:
+    //  +0 first index, +1 last index (inclusive), +2 frames per step (0 disables), +3 flags
+    //palette entries first..last are shifted by one every step, wrapping around inside the range
+    localparam int REGISTER_ROTATION_BASE = 'h30;
+    localparam int REGISTER_ROTATION_STRIDE = 4;
+    localparam int ROTATION_COUNT = 2;
+
+    localparam int ROTATION_FLAG_REVERSE = 0;
+
+    localparam int REGISTER_COPPER_FLAGS = 'h2E;
+
+    localparam int COPPER_FLAG_ENABLE = 0;
+
+    //spi side writes at any time, copy is taken during vblank when no register write transaction is running
+    //so that multi-register updates are applied to the same frame,
+    //the last vblank line is left to the copper list so that its first row entries are not overwritten
+    logic [7:0] active_registers [REGISTER_COUNT];
+    logic [1:0] registers_busy_sync_ff;
+
+    logic copper_register_wren;
+    logic [7:0] copper_register_idx, copper_register_value;
+
+    always_ff @(posedge clk_pixel)
+    begin
+        registers_busy_sync_ff <= {registers_busy, registers_busy_sync_ff[1]};
+
+        if (cy >= screen_height && cy + 1 < total_height && !registers_busy_sync_ff[0])
+            active_registers <= registers;
+        else if (copper_register_wren && copper_register_idx < REGISTER_COUNT)
+            active_registers[copper_register_idx] <= copper_register_value;
+    end
+
+    assign dvi_output = active_registers[REGISTER_OUTPUT_FLAGS][OUTPUT_FLAG_DVI];
+
+    //layouts
+    //
+
+    localparam int MODE_320X240 = 0;      //8bpp, integer scaling x3 (x4 at 1080p), letterboxed
+    localparam int MODE_320X200 = 1;      //8bpp, 4:3 aspect correct scaling, fills screen height
+    localparam int MODE_640X240_4BPP = 2; //4bpp, two pixels per byte with the left one in the high nibble, fills the screen
+    localparam int MODE_320X240_4BPP = 3; //4bpp, same scaling as 320x240, two pages
+    localparam int MODE_320X240_2BPP = 4; //2bpp, four pixels per byte with the leftmost one in the high bits, four pages
+    localparam int MODE_160X120 = 5;      //8bpp, line and pixel doubled 320x240, four pages
+
+    //screen to frame pixel mapping: frame = screen * NUM / DEN
+    localparam int M0_X_NUM = 1,                 M0_X_DEN = VIDEO_1080P ? 4 : 3;
+    localparam int M0_Y_NUM = 1,                 M0_Y_DEN = VIDEO_1080P ? 4 : 3;
+    localparam int M1_X_NUM = VIDEO_1080P ? 2 : 1, M1_X_DEN = VIDEO_1080P ? 9 : 3;
+    localparam int M1_Y_NUM = 5,                 M1_Y_DEN = VIDEO_1080P ? 27 : 18;
+    localparam int M2_X_NUM = 1,                 M2_X_DEN = VIDEO_1080P ? 3 : 2;
+    localparam int M2_Y_NUM = VIDEO_1080P ? 2 : 1, M2_Y_DEN = VIDEO_1080P ? 9 : 3;
+    localparam int M5_X_NUM = 1,                 M5_X_DEN = VIDEO_1080P ? 8 : 6;
+    localparam int M5_Y_NUM = 1,                 M5_Y_DEN = VIDEO_1080P ? 8 : 6;
+
+    //switched only during vblank together with the rest of the registers
+    wire [2:0] mode = active_registers[REGISTER_MODE] <= MODE_160X120 ? 3'(active_registers[REGISTER_MODE]) : 3'(MODE_320X240);
+
+    logic [9:0] frame_width;
+    logic [7:0] frame_height;
+    logic [1:0] width_shift; //frame width is 160 << width_shift
+    logic [1:0] pixel_shift; //log2 of pixels per byte: 8bpp, 4bpp or 2bpp
+    logic [11:0] display_width, display_height;
+
+    always_comb
+    begin
+        unique case (mode)
+            MODE_320X200 :
+            begin
+                {frame_width, frame_height, width_shift, pixel_shift} = {10'd320, 8'd200, 2'd1, 2'd0};
+                display_width = 12'(320*M1_X_DEN/M1_X_NUM);
+                display_height = 12'(200*M1_Y_DEN/M1_Y_NUM);
+            end
+            MODE_640X240_4BPP :
+            begin
+                {frame_width, frame_height, width_shift, pixel_shift} = {10'd640, 8'd240, 2'd2, 2'd1};
+                display_width = 12'(640*M2_X_DEN/M2_X_NUM);
+                display_height = 12'(240*M2_Y_DEN/M2_Y_NUM);
+            end
+            MODE_160X120 :
+            begin
+                {frame_width, frame_height, width_shift, pixel_shift} = {10'd160, 8'd120, 2'd0, 2'd0};
+                display_width = 12'(160*M5_X_DEN/M5_X_NUM);
+                display_height = 12'(120*M5_Y_DEN/M5_Y_NUM);
+            end
+            default : //320x240 in 8bpp, 4bpp and 2bpp
+            begin
+                {frame_width, frame_height, width_shift} = {10'd320, 8'd240, 2'd1};
+                pixel_shift = mode == MODE_320X240_2BPP ? 2'd2 : (mode == MODE_320X240_4BPP ? 2'd1 : 2'd0);
+                display_width = 12'(320*M0_X_DEN/M0_X_NUM);
+                display_height = 12'(240*M0_Y_DEN/M0_Y_NUM);
+            end
+        endcase
+    end
+
+    //page flipping in the framebuffer memory left free by the smaller layouts
+    wire [1:0] page = active_registers[REGISTER_PAGE][1:0];
+    wire [7:0] palette_bank = active_registers[REGISTER_PALETTE_BANK];
+
+    logic [16:0] page_base;
+
+    always_ff @(posedge clk_pixel)
+    begin
+        automatic logic [17:0] frame_size = (18'(frame_width) * 18'(frame_height)) >> pixel_shift;
+
+        page_base <= (page + 1)*frame_size <= FRAMEBUFFER_SIZE ? 17'(page*frame_size) : 17'b0;
+
+        geometry <= {8'(mode), 8'd8 >> pixel_shift, 16'(frame_width), 16'(frame_height)};
+    end
+
+    wire [11:0] frame_border_top_bottom = 12'((screen_height - display_height)/2);
+    wire [11:0] frame_border_left_right = 12'((screen_width - display_width)/2);
+
+    //framebuffer mapping
+    //
+
+    function automatic logic [7:0] frame_row(logic [2:0] mode, int y);
+        unique case (mode)
+            MODE_160X120 : return 8'(y*M5_Y_NUM/M5_Y_DEN);
+            MODE_320X200 : return 8'(y*M1_Y_NUM/M1_Y_DEN);
+            MODE_640X240_4BPP : return 8'(y*M2_Y_NUM/M2_Y_DEN);
+            default : return 8'(y*M0_Y_NUM/M0_Y_DEN);
+        endcase
+    endfunction
+
     logic [16:0] framebuffer_idx;
+    logic [1:0] framebuffer_subpixel;
+
+    //pixels are fetched 4 clocks ahead of cx to compensate latency, the last 4 clocks of a line
+    //fetch the first pixels of the next one, which layouts without a left border show at cx 0
+    logic [11:0] fetch_cx, fetch_cy;
+    logic signed [12:0] cx_offset, cy_offset;
+    logic [9:0] next_framebuffer_x;
+    logic [7:0] next_framebuffer_y;
+    logic next_in_frame;
+
+    always_comb
+    begin
+        automatic logic [12:0] ahead = 13'(cx + 4);
+
+        if (ahead >= total_width)
+        begin
+            fetch_cx = 12'(ahead - total_width);
+            fetch_cy = cy + 1 >= total_height ? 12'b0 : 12'(cy + 1);
+        end
+        else
+        begin
+            fetch_cx = 12'(ahead);
+            fetch_cy = cy;
+        end
+
+        cx_offset = 13'(fetch_cx - frame_border_left_right);
+        cy_offset = 13'(fetch_cy - frame_border_top_bottom);
+
+        next_framebuffer_x = 10'b0;
+        next_framebuffer_y = 8'b0;
+
+        if (cy_offset >= 0 && cy_offset < display_height && cx_offset < display_width) //y is in framebuffer zone, x is in or before framebuffer zone
+        begin
+            automatic int x = cx_offset < 0 ? 0 : int'(cx_offset);
+
+            unique case (mode)
+                MODE_160X120 : next_framebuffer_x = 10'(x*M5_X_NUM/M5_X_DEN);
+                MODE_320X200 : next_framebuffer_x = 10'(x*M1_X_NUM/M1_X_DEN);
+                MODE_640X240_4BPP : next_framebuffer_x = 10'(x*M2_X_NUM/M2_X_DEN);
+                default : next_framebuffer_x = 10'(x*M0_X_NUM/M0_X_DEN);
+            endcase
+
+            next_framebuffer_y = frame_row(mode, int'(cy_offset));
+        end //else prepare {0;0}
+
+        next_in_frame = fetch_cx < screen_width && fetch_cy < screen_height && 
+                        cx_offset >= 0 && cx_offset < display_width && 
+                        cy_offset >= 0 && cy_offset < display_height;
+    end
+
+    //raster position
+    //
+
+    //frame row shown by the next screen line, every layout shows a row on at least one line
+    logic [7:0] upcoming_row;
+    logic upcoming_in_frame;
+
+    always_comb
+    begin
+        automatic logic [11:0] next_cy = cy + 1 >= total_height ? 12'b0 : 12'(cy + 1);
+        automatic logic signed [12:0] next_cy_offset = 13'(next_cy - frame_border_top_bottom);
+
+        upcoming_in_frame = next_cy_offset >= 0 && next_cy_offset < display_height;
+        upcoming_row = upcoming_in_frame ? frame_row(mode, int'(next_cy_offset)) : 8'b0;
+    end
+
+    //the pixel side memory ports are free for the copper list and the blitter in these windows
+    localparam int HBLANK_WINDOW = 256; //pixel clocks after hblank start, ends before the next line is fetched at both resolutions
+
+    wire hblank_window = cx >= screen_width && cx < screen_width + HBLANK_WINDOW;
+    wire vblank_window = cy >= screen_height && cy + 1 < total_height; //last vblank line fetches the first pixels
+
+    //frame rows completely scanned out, updated at the end of every visible line and cleared at vblank start:
+    //row n of the framebuffer can be rewritten for the next frame once rows_done > n
+    logic [8:0] rows_done;
 
-    //320*240 mapping with integer scaling and letterboxing
     always_ff @(posedge clk_pixel)
     begin
-        automatic logic [8:0] next_framebuffer_x = 9'b0;
-        automatic logic [7:0] next_framebuffer_y = 8'b0;
+        if (cx == 0 && cy == screen_height)
+            rows_done <= 0;
+        else if (cx == screen_width && cy < screen_height)
+        begin
+            if (upcoming_in_frame)
+                rows_done <= 9'(upcoming_row);
+            else if (cy_offset >= 0 && cy_offset < display_height) //last line of the frame
+                rows_done <= 9'(frame_height);
+        end
+
+        raster_gray <= {16'(cy) ^ 16'(cy >> 1), 16'(rows_done) ^ 16'(rows_done >> 1)};
+    end
 
-        automatic logic signed [12:0] cx_offset = 13'(cx - frame_border_left_right + 3); //compensate latency :/
-        automatic logic signed [12:0] cy_offset = 13'(cy - frame_border_top_bottom);
+    //scroll and line-start table
+    //
 
-        if (cx >= screen_width || cy >= screen_height)
+    wire [9:0] scroll_x = 10'({active_registers[REGISTER_SCROLL_X+1], active_registers[REGISTER_SCROLL_X]});
+    wire [7:0] scroll_y = 8'({active_registers[REGISTER_SCROLL_Y+1], active_registers[REGISTER_SCROLL_Y]});
+    wire line_table_enabled = active_registers[REGISTER_SCROLL_FLAGS][SCROLL_FLAG_LINE_TABLE];
+
+    bit [7:0] line_table [MAX_FRAME_HEIGHT];
+
+    always_ff @(posedge clk_line_table)
+    begin
+        if (wren_line_table && line_table_addr < MAX_FRAME_HEIGHT)
+            line_table[line_table_addr] <= line_table_in;
+    end
+
+    //row only depends on y and is looked up two pixels late, so from hblank on it is the row
+    //of the next line: the first pixels of a line are fetched at the end of the previous one
+    wire [7:0] line_row = cx >= screen_width ? upcoming_row : next_framebuffer_y;
+
+    logic [7:0] line_table_row;
+    logic [17:0] line_start_pixel;
+
+    always_ff @(posedge clk_pixel)
+    begin
+        automatic logic [8:0] row = 9'(line_table_enabled ? line_table_row : line_row) + scroll_y;
+        automatic logic [8:0] wrapped_row = row >= frame_height ? 9'(row - frame_height) : row;
+
+        line_table_row <= line_table[line_row];
+        line_start_pixel <= 18'(wrapped_row * 160) << width_shift;
+    end
+
+    //layout mapping with scaling and letterboxing, in 4bpp and 2bpp several pixels share a byte
+    always_ff @(posedge clk_pixel)
+    begin
+        automatic logic [10:0] column = 11'(next_framebuffer_x + scroll_x);
+        automatic logic [17:0] pixel_idx = 18'(line_start_pixel + (column >= frame_width ? column - frame_width : column));
+
+        if (fetch_cx >= screen_width || fetch_cy >= screen_height)
         begin
             framebuffer_idx <= 0; //h-blank / v-blank
+            framebuffer_subpixel <= 0;
+        end
+        else
+        begin
+            framebuffer_idx <= 17'(page_base + (pixel_idx >> pixel_shift));
+            framebuffer_subpixel <= pixel_idx[1:0] & ~(2'b11 << pixel_shift);
+        end
 
+        if (cx >= screen_width || cy >= screen_height)
+        begin
             hblank <= cx >= screen_width;
             vblank <= cy >= screen_height;
         end
         else 
         begin
-            if (cy_offset >= 0 && cy_offset < FRAME_HEIGHT*SCALE_Y && cx_offset < FRAME_WIDTH*SCALE_X) //y is in framebuffer zone, x is in or before framebuffer zone
+            hblank <= cx_offset < 0 || cx_offset >= display_width;
+            vblank <= cy_offset < 0 || cy_offset >= display_height;
+        end
+    end
+
+    //sprites
+    //
+
+    localparam int SPRITE_SIZE = 32;
+
+    logic [7:0] next_palette;
+    logic [1:0] next_subpixel;
+
+    //value of the framebuffer pixel and its palette index after bank selection, aligned with next_palette
+    logic [7:0] framebuffer_value, framebuffer_pixel;
+
+    always_comb
+    begin
+        unique case (pixel_shift)
+            2'd1 :
+            begin
+                framebuffer_value = next_subpixel[0] ? {4'b0, next_palette[3:0]} : {4'b0, next_palette[7:4]};
+                framebuffer_pixel = {palette_bank[3:0], framebuffer_value[3:0]};
+            end
+            2'd2 :
+            begin
+                framebuffer_value = {6'b0, 2'(next_palette >> (3'd6 - {next_subpixel, 1'b0}))};
+                framebuffer_pixel = {palette_bank[5:0], framebuffer_value[1:0]};
+            end
+            default :
+            begin
+                framebuffer_value = next_palette;
+                framebuffer_pixel = next_palette;
+            end
+        endcase
+    end
+
+    //{visible, palette index} of the topmost opaque sprite pixel, lower sprite index is drawn on top
+    wire [8:0] sprite_layer [SPRITE_COUNT+1];
+
+    assign sprite_layer[SPRITE_COUNT] = 9'b0;
+
+    generate
+        for (genvar i = 0; i < SPRITE_COUNT; i++)
+        begin : gen_sprite
+            localparam int BASE = REGISTER_SPRITE_BASE + i*REGISTER_SPRITE_STRIDE;
+
+            wire signed [15:0] x = {active_registers[BASE+1], active_registers[BASE]};
+            wire signed [15:0] y = {active_registers[BASE+3], active_registers[BASE+2]};
+            wire [7:0] flags = active_registers[BASE+4];
+            wire [7:0] transparent_idx = active_registers[BASE+5];
+
+            wire signed [16:0] dx = $signed({7'b0, next_framebuffer_x}) - x;
+            wire signed [16:0] dy = $signed({9'b0, next_framebuffer_y}) - y;
+
+            bit [7:0] image [SPRITE_SIZE*SPRITE_SIZE];
+
+            always_ff @(posedge clk_sprite)
+            begin
+                if (wren_sprite && sprite_addr[$high(sprite_addr):10] == i)
+                    image[sprite_addr[9:0]] <= sprite_in;
+            end
+
+            logic [9:0] image_idx;
+            logic hit, hit_delayed;
+            logic [7:0] pixel;
+
+            //same latency as framebuffer_idx -> next_palette
+            always_ff @(posedge clk_pixel)
+            begin
+                image_idx <= {dy[4:0], dx[4:0]};
+                hit <= flags[SPRITE_FLAG_ENABLE] && next_in_frame && dx >= 0 && dx < SPRITE_SIZE && dy >= 0 && dy < SPRITE_SIZE;
+
+                pixel <= image[image_idx];
+                hit_delayed <= hit;
+            end
+
+            assign sprite_layer[i] = hit_delayed && pixel != transparent_idx && (!flags[SPRITE_FLAG_BEHIND] || framebuffer_value == 0) 
+                ? {1'b1, pixel} 
+                : sprite_layer[i+1];
+        end
+    endgenerate
+
+    //frame counter for the host, incremented at vblank start, gray coded for clock domain crossing
+    logic [15:0] frame_counter;
+
+    always_ff @(posedge clk_pixel)
+    begin
+        if (cx == 0 && cy == screen_height)
+            frame_counter <= 16'(frame_counter + 1);
+
+        frame_counter_gray <= frame_counter ^ (frame_counter >> 1);
+    end
+
+    //palette animation, stepped at vblank start like the frame counter
+    //
+
+    logic [7:0] fade_level;
+
+    always_ff @(posedge clk_pixel)
+    begin
+        if (cx == 0 && cy == screen_height)
+        begin
+            automatic logic [7:0] target = active_registers[REGISTER_FADE_TARGET] > FADE_LEVEL_MAX ? 8'(FADE_LEVEL_MAX) : active_registers[REGISTER_FADE_TARGET];
+            automatic logic [7:0] speed = active_registers[REGISTER_FADE_SPEED];
+            automatic logic [7:0] distance = fade_level < target ? 8'(target - fade_level) : 8'(fade_level - target);
+
+            if (speed == 0 || distance <= speed)
+                fade_level <= target;
+            else
+                fade_level <= fade_level < target ? 8'(fade_level + speed) : 8'(fade_level - speed);
+        end
+    end
+
+    function automatic logic [7:0] fade(logic [7:0] from, logic [7:0] to, logic [7:0] level);
+        automatic logic signed [17:0] delta = ($signed({1'b0, to}) - $signed({1'b0, from})) * $signed({1'b0, level});
+
+        return 8'($signed({1'b0, from}) + (delta >>> $clog2(FADE_LEVEL_MAX)));
+    endfunction
+
+    //palette index after the rotation ranges, ranges are expected not to overlap
+    wire [7:0] palette_index [ROTATION_COUNT+1];
+
+    assign palette_index[0] = sprite_layer[0][8] ? sprite_layer[0][7:0] : framebuffer_pixel;
+
+    generate
+        for (genvar i = 0; i < ROTATION_COUNT; i++)
+        begin : gen_rotation
+            localparam int BASE = REGISTER_ROTATION_BASE + i*REGISTER_ROTATION_STRIDE;
+
+            wire [7:0] first = active_registers[BASE];
+            wire [7:0] last = active_registers[BASE+1];
+            wire [7:0] period = active_registers[BASE+2];
+            wire [7:0] flags = active_registers[BASE+3];
+
+            wire enabled = period != 0 && last > first;
+            wire [7:0] length_minus_1 = 8'(last - first);
+
+            logic [7:0] timer, offset;
+
+            always_ff @(posedge clk_pixel)
             begin
-                next_framebuffer_x = 9'(cx_offset < 0 ? 0 : 9'(cx_offset / SCALE_X));
-                next_framebuffer_y = 8'(cy_offset / SCALE_Y);
-            end //else prepare {0;0}
-            
-            framebuffer_idx <= 17'(next_framebuffer_x + next_framebuffer_y*FRAME_WIDTH);
-
-            hblank <= cx_offset < 0 || cx_offset >= FRAME_WIDTH*SCALE_X;
-            vblank <= cy_offset < 0 || cy_offset >= FRAME_HEIGHT*SCALE_Y;
+                if (!enabled || offset > length_minus_1)
+                begin
+                    timer <= 0;
+                    offset <= 0;
+                end
+                else if (cx == 0 && cy == screen_height)
+                begin
+                    if (timer + 1 < period)
+                        timer <= 8'(timer + 1);
+                    else
+                    begin
+                        timer <= 0;
+
+                        if (flags[ROTATION_FLAG_REVERSE])
+                            offset <= offset == 0 ? length_minus_1 : 8'(offset - 1);
+                        else
+                            offset <= offset == length_minus_1 ? 8'b0 : 8'(offset + 1);
+                    end
+                end
+            end
+
+            wire [7:0] idx = palette_index[i];
+            wire [8:0] shifted = 9'(8'(idx - first)) + offset;
+
+            assign palette_index[i+1] = enabled && idx >= first && idx <= last
+                ? 8'(first + (shifted > length_minus_1 ? shifted - length_minus_1 - 1 : shifted))
+                : idx;
         end
+    endgenerate
+
+    //copper list
+    //
+
+    //entry n occupies 8 bytes at n*COPPER_ENTRY_SIZE:
+    //  +0 frame row low, +1 frame row high, +2 op, +3 register or palette index, +4..+6 value (register value or r, g, b), +7 reserved
+    //entries are sorted by row and run in the hblank before the first screen line of their row,
+    //register writes last until the next vblank copy, palette writes are permanent
+    localparam int COPPER_ENTRIES = 64;
+    localparam int COPPER_ENTRY_SIZE = 8;
+
+    localparam bit [7:0] COPPER_OP_REGISTER = 8'd0;
+    localparam bit [7:0] COPPER_OP_PALETTE = 8'd1;
+    localparam bit [7:0] COPPER_OP_END = 8'hFF;
+
+    bit [7:0] copper_list [COPPER_ENTRIES*COPPER_ENTRY_SIZE];
+
+    always_ff @(posedge clk_copper)
+    begin
+        if (wren_copper)
+            copper_list[copper_addr] <= copper_in;
+    end
+
+    typedef enum
+    {
+        COPPER_IDLE,  //disabled or the list is finished for this frame
+        COPPER_FETCH, //reading the 8 entry bytes, one per clock
+        COPPER_WAIT   //waiting for the hblank before the entry row
+    } copper_state;
+
+    copper_state copper;
+
+    logic [8:0] copper_read_addr;
+    logic [7:0] copper_byte;
+    logic [3:0] copper_fetch_idx;
+    logic [7:0] copper_entry [COPPER_ENTRY_SIZE];
+
+    logic copper_palette_wren;
+    logic [7:0] copper_palette_idx;
+    logic [23:0] copper_palette_rgb;
+
+    wire copper_enabled = active_registers[REGISTER_COPPER_FLAGS][COPPER_FLAG_ENABLE];
+
+    always_ff @(posedge clk_pixel)
+    begin
+        copper_byte <= copper_list[copper_read_addr];
+
+        copper_register_wren <= 0;
+        copper_palette_wren <= 0;
+
+        if (cx == 0 && cy + 1 == total_height) //restart on the last vblank line, after the register copy
+        begin
+            copper <= copper_enabled ? COPPER_FETCH : COPPER_IDLE;
+            copper_read_addr <= 0;
+            copper_fetch_idx <= 0;
+        end
+        else if (!copper_enabled)
+            copper <= COPPER_IDLE;
+        else
+            unique case (copper)
+                COPPER_IDLE : ;
+                COPPER_FETCH :
+                begin
+                    //one clock of read latency, byte k arrives while fetch_idx is k+1
+                    if (copper_fetch_idx != 0)
+                        copper_entry[copper_fetch_idx - 1] <= copper_byte;
+
+                    if (copper_fetch_idx == COPPER_ENTRY_SIZE)
+                        copper <= COPPER_WAIT;
+                    else
+                    begin
+                        copper_fetch_idx <= copper_fetch_idx + 1'b1;
+
+                        if (copper_fetch_idx != COPPER_ENTRY_SIZE - 1)
+                            copper_read_addr <= copper_read_addr + 1'b1;
+                    end
+                end
+                COPPER_WAIT :
+                begin
+                    if (copper_entry[2] == COPPER_OP_END)
+                        copper <= COPPER_IDLE;
+                    else if (hblank_window && upcoming_in_frame && {copper_entry[1], copper_entry[0]} <= 16'(upcoming_row))
+                    begin
+                        copper_register_wren <= copper_entry[2] == COPPER_OP_REGISTER;
+                        copper_register_idx <= copper_entry[3];
+                        copper_register_value <= copper_entry[4];
+
+                        copper_palette_wren <= copper_entry[2] == COPPER_OP_PALETTE;
+                        copper_palette_idx <= copper_entry[3];
+                        copper_palette_rgb <= {copper_entry[4], copper_entry[5], copper_entry[6]};
+
+                        copper_read_addr <= copper_read_addr + 1'b1;
+                        copper_fetch_idx <= 0;
+
+                        copper <= copper_read_addr == 9'(COPPER_ENTRIES*COPPER_ENTRY_SIZE - 1) ? COPPER_IDLE : COPPER_FETCH;
+                    end
+                end
+            endcase
+    end
+
+    //blitter
+    //
+
+    //queue entry n occupies 16 bytes at n*BLIT_PARAMS_SIZE, all values little endian:
+    //  +0 op and flags, +1 fill value or transparent index, +2..+4 source address, +5..+6 source stride,
+    //  +7..+9 destination address, +10..+11 destination stride, +12..+13 width in bytes, +14..+15 height in rows
+    //source is the framebuffer for copies and the blit store for store copies, addresses are in bytes
+    //crc reads the source rectangle from the framebuffer without writing, destination is ignored
+    //bytes are moved one per two pixel clocks, only while the pixel side framebuffer port is free
+    localparam int BLIT_QUEUE_DEPTH = 16;
+    localparam int BLIT_PARAMS_SIZE = 16;
+    localparam int BLIT_STORE_SIZE = 8192;
+
+    localparam bit [1:0] BLIT_OP_FILL = 2'd0;
+    localparam bit [1:0] BLIT_OP_COPY = 2'd1;
+    localparam bit [1:0] BLIT_OP_STORE_COPY = 2'd2;
+    localparam bit [1:0] BLIT_OP_CRC = 2'd3;
+
+    localparam int BLIT_FLAG_TRANSPARENT = 6; //source bytes equal to the value byte are skipped
+    localparam int BLIT_FLAG_REVERSE = 7;     //last byte first, for overlapping copies towards higher addresses
+
+    bit [7:0] blit_queue [BLIT_QUEUE_DEPTH*BLIT_PARAMS_SIZE];
+    bit [7:0] blit_store [BLIT_STORE_SIZE];
+
+    always_ff @(posedge clk_blit_queue)
+    begin
+        if (wren_blit_queue)
+            blit_queue[blit_queue_addr] <= blit_queue_in;
+    end
+
+    always_ff @(posedge clk_blit_store)
+    begin
+        if (wren_blit_store)
+            blit_store[blit_store_addr] <= blit_store_in;
+    end
+
+    function automatic logic [4:0] gray_to_binary(logic [4:0] gray);
+        logic [4:0] binary;
+
+        binary[4] = gray[4];
+
+        for (int i = 3; i >= 0; i--)
+            binary[i] = binary[i+1] ^ gray[i];
+
+        return binary;
+    endfunction
+
+    //crc-32 as in zlib: reflected 0x04C11DB7, initial and final value inverted
+    function automatic logic [31:0] crc32_update(logic [31:0] crc, logic [7:0] data);
+        crc = crc ^ 32'(data);
+
+        for (int i = 0; i < 8; i++)
+            crc = crc[0] ? (crc >> 1) ^ 32'hEDB88320 : crc >> 1;
+
+        return crc;
+    endfunction
+
+    logic [4:0] blit_head_gray_sync_ff [1:0];
+
+    wire [4:0] blit_head = gray_to_binary(blit_head_gray_sync_ff[0]);
+
+    typedef enum
+    {
+        BLIT_IDLE,
+        BLIT_FETCH, //reading the 16 parameter bytes, one per clock
+        BLIT_SETUP,
+        BLIT_READ,  //source byte read is issued
+        BLIT_WRITE  //source byte is available, destination write
+    } blit_state;
+
+    blit_state blit;
+
+    logic [4:0] blit_tail;
+    logic [7:0] blit_fetch_addr;
+    logic [4:0] blit_fetch_idx;
+    logic [7:0] blit_queue_byte, blit_store_byte;
+    logic [7:0] blit_params [BLIT_PARAMS_SIZE];
+
+    logic [23:0] blit_src_row, blit_dst_row;
+    logic [15:0] blit_x, blit_rows_left;
+    logic [31:0] blit_crc_state;
+
+    wire [1:0] blit_op = blit_params[0][1:0];
+    wire blit_transparent = blit_params[0][BLIT_FLAG_TRANSPARENT];
+    wire blit_reverse = blit_params[0][BLIT_FLAG_REVERSE];
+    wire [7:0] blit_value = blit_params[1];
+    wire [23:0] blit_src = {blit_params[4], blit_params[3], blit_params[2]};
+    wire [15:0] blit_src_stride = {blit_params[6], blit_params[5]};
+    wire [23:0] blit_dst = {blit_params[9], blit_params[8], blit_params[7]};
+    wire [15:0] blit_dst_stride = {blit_params[11], blit_params[10]};
+    wire [15:0] blit_width = {blit_params[13], blit_params[12]};
+    wire [15:0] blit_height = {blit_params[15], blit_params[14]};
+
+    wire [15:0] blit_column = blit_reverse ? 16'(blit_width - 1 - blit_x) : blit_x;
+    wire [23:0] blit_src_addr = 24'(blit_src_row + blit_column);
+    wire [23:0] blit_dst_addr = 24'(blit_dst_row + blit_column);
+
+    wire blit_window = hblank_window || vblank_window;
+
+    wire [7:0] blit_data = blit_op == BLIT_OP_FILL ? blit_value : (blit_op == BLIT_OP_COPY ? next_palette : blit_store_byte);
+
+    wire blit_read = blit == BLIT_READ && blit_window && (blit_op == BLIT_OP_COPY || blit_op == BLIT_OP_CRC);
+    wire blit_wren = blit == BLIT_WRITE && blit_op != BLIT_OP_CRC && blit_dst_addr < FRAMEBUFFER_SIZE && !(blit_transparent && blit_data == blit_value);
+
+    wire [31:0] blit_crc_next = crc32_update(blit_crc_state, next_palette);
+    wire [16:0] blit_addr = blit == BLIT_WRITE ? 17'(blit_dst_addr) : 17'(blit_src_addr);
+
+    always_ff @(posedge clk_pixel)
+    begin
+        blit_head_gray_sync_ff <= '{blit_head_gray, blit_head_gray_sync_ff[1]};
+
+        blit_queue_byte <= blit_queue[blit_fetch_addr];
+        blit_store_byte <= blit_store[blit_src_addr[12:0]];
+
+        unique case (blit)
+            BLIT_IDLE :
+            begin
+                if (blit_head != blit_tail)
+                begin
+                    blit_fetch_addr <= {blit_tail[3:0], 4'b0};
+                    blit_fetch_idx <= 0;
+
+                    blit <= BLIT_FETCH;
+                end
+            end
+            BLIT_FETCH :
+            begin
+                //one clock of read latency, byte k arrives while fetch_idx is k+1
+                if (blit_fetch_idx != 0)
+                    blit_params[blit_fetch_idx - 1] <= blit_queue_byte;
+
+                if (blit_fetch_idx == BLIT_PARAMS_SIZE)
+                    blit <= BLIT_SETUP;
+                else
+                begin
+                    blit_fetch_idx <= blit_fetch_idx + 1'b1;
+                    blit_fetch_addr <= blit_fetch_addr + 1'b1;
+                end
+            end
+            BLIT_SETUP :
+            begin
+                blit_src_row <= blit_reverse ? 24'(blit_src + (blit_height - 1)*blit_src_stride) : blit_src;
+                blit_dst_row <= blit_reverse ? 24'(blit_dst + (blit_height - 1)*blit_dst_stride) : blit_dst;
+                blit_x <= 0;
+                blit_rows_left <= blit_height;
+                blit_crc_state <= '1;
+
+                if (blit_width == 0 || blit_height == 0)
+                begin
+                    if (blit_op == BLIT_OP_CRC)
+                        blit_crc <= 0;
+
+                    blit_tail <= blit_tail + 1'b1;
+                    blit <= BLIT_IDLE;
+                end
+                else
+                    blit <= BLIT_READ;
+            end
+            BLIT_READ :
+            begin
+                if (blit_window)
+                    blit <= BLIT_WRITE;
+            end
+            BLIT_WRITE :
+            begin
+                blit <= BLIT_READ;
+
+                if (blit_op == BLIT_OP_CRC)
+                    blit_crc_state <= blit_crc_next;
+
+                if (blit_x + 1 < blit_width)
+                    blit_x <= blit_x + 1'b1;
+                else
+                begin
+                    blit_x <= 0;
+                    blit_rows_left <= blit_rows_left - 1'b1;
+
+                    blit_src_row <= blit_reverse ? 24'(blit_src_row - blit_src_stride) : 24'(blit_src_row + blit_src_stride);
+                    blit_dst_row <= blit_reverse ? 24'(blit_dst_row - blit_dst_stride) : 24'(blit_dst_row + blit_dst_stride);
+
+                    if (blit_rows_left == 1)
+                    begin
+                        if (blit_op == BLIT_OP_CRC)
+                            blit_crc <= ~blit_crc_next;
+
+                        blit_tail <= blit_tail + 1'b1;
+                        blit <= BLIT_IDLE;
+                    end
+                end
+            end
+        endcase
+
+        blit_tail_gray <= blit_tail ^ (blit_tail >> 1);
+        blit_busy <= blit != BLIT_IDLE || blit_head != blit_tail;
+    end
+
+    //pixel side framebuffer port, borrowed by the blitter outside of the fetch window
+    always_ff @(posedge clk_pixel)
+    begin
+        if (blit_wren)
+            framebuffer[blit_addr] <= blit_data;
+        else
+            next_palette <= framebuffer[blit_read ? blit_addr : framebuffer_idx];
+    end
+
+    //pixel side palette port, borrowed by the copper list during hblank
+    logic [23:0] primary_rgb, secondary_rgb;
+
+    always_ff @(posedge clk_pixel)
+    begin
+        if (copper_palette_wren)
+            palette[copper_palette_idx] <= copper_palette_rgb;
+        else
+            primary_rgb <= palette[palette_index[ROTATION_COUNT]];
     end
 
     logic [23:0] next_rgb;
-    logic [7:0] next_palette;
 
     always_ff @(posedge clk_pixel)
     begin
         if (cx < frame_border_left_right || 
-            cx >= (FRAME_WIDTH*SCALE_X+frame_border_left_right) || 
+            cx >= (display_width+frame_border_left_right) || 
             cy < frame_border_top_bottom || 
-            cy >= (FRAME_HEIGHT*SCALE_Y+frame_border_top_bottom))
+            cy >= (display_height+frame_border_top_bottom))
             screen_rgb_out <= {8'(cx), 8'(cy), 8'(cx+cy)};
         else
             screen_rgb_out <= next_rgb;
 
-        next_palette <= framebuffer[framebuffer_idx];
-        next_rgb <= palette[next_palette];
+        next_subpixel <= framebuffer_subpixel;
+
+        secondary_rgb <= palette_secondary[palette_index[ROTATION_COUNT]];
+
+        next_rgb <= {fade(primary_rgb[23:16], secondary_rgb[23:16], fade_level),
+                     fade(primary_rgb[15:8], secondary_rgb[15:8], fade_level),
+                     fade(primary_rgb[7:0], secondary_rgb[7:0], fade_level)};
     end
 
 endmodule
\ No newline at end of file
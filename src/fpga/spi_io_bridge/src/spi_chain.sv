@@ -0,0 +1,115 @@
+module spi_chain
+#(
+    parameter bit [7:0] COMMAND_CHAIN = 8'b00100000
+)
+(
+    input logic reset,
+
+    input logic cs, //gpu chip select pin
+    input logic sclk,
+    input logic [3:0] data_in,
+
+    //active low like the pins, high while no element of the chain targets them
+    output logic cs_gpu,
+    output logic cs_io_select
+);
+
+    //command list: COMMAND_CHAIN, then any number of elements until cs goes high.
+    //every element is 2 bytes of header - bit 15 set for spi_io, bits 14-0 the number of sclk cycles of the element -
+    //followed by a whole transaction of its own (command, address, data, dummy cycles and write phase) sent in that many cycles.
+    //the target is selected on the falling edge after the header and released on the rising edge that samples the next header,
+    //so the last falling edge of an element still happens with the target selected, as it would with a real cs
+
+    typedef enum
+    {
+        COMMAND,
+        HEADER,
+        ELEMENT,
+        PASS    //not a chain, cs goes to spi_gpu as is
+    } chain_state;
+
+    chain_state state;
+
+    logic [1:0] nibble;
+    logic [15:0] header;
+    logic [14:0] remaining;
+    logic [7:0] command_bits;
+
+    wire [7:0] command_next = {command_bits[3:0], data_in};
+    wire [15:0] header_next = {header[11:0], data_in};
+
+    logic chain_active, element_active, element_io;
+    logic element_active_falling;
+
+    always_ff @(posedge sclk, posedge (cs | reset))
+    begin
+        if (cs | reset)
+        begin
+            state <= COMMAND;
+            nibble <= 0;
+            chain_active <= 0;
+            element_active <= 0;
+        end
+        else
+        begin
+            unique case (state)
+                COMMAND :
+                begin
+                    command_bits <= command_next;
+                    nibble <= nibble + 1'b1;
+
+                    if (nibble == 1)
+                    begin
+                        nibble <= 0;
+                        state <= command_next == COMMAND_CHAIN ? HEADER : PASS;
+                        chain_active <= command_next == COMMAND_CHAIN;
+                    end
+                end
+                HEADER :
+                begin
+                    header <= header_next;
+                    nibble <= nibble + 1'b1;
+                    element_active <= 0;
+
+                    if (nibble == 3)
+                    begin
+                        nibble <= 0;
+                        element_io <= header_next[15];
+                        remaining <= header_next[14:0];
+
+                        if (header_next[14:0] != 0)
+                        begin
+                            element_active <= 1;
+                            state <= ELEMENT;
+                        end
+                    end
+                end
+                ELEMENT :
+                begin
+                    //the rising edge after the last cycle is the first one of the next header
+                    if (remaining == 1)
+                        state <= HEADER;
+
+                    remaining <= remaining - 1'b1;
+                end
+                PASS : ;
+            endcase
+        end
+    end
+
+    //selection starts on the falling edge, same as a pin would go low between clocks
+    always_ff @(negedge sclk, posedge (cs | reset))
+    begin
+        if (cs | reset)
+            element_active_falling <= 0;
+        else
+            element_active_falling <= element_active;
+    end
+
+    //released as soon as the rising edge leaves the element
+    wire element_selected = element_active & element_active_falling;
+
+    assign cs_gpu = cs | (chain_active & !(element_selected & !element_io));
+    assign cs_io_select = !(element_selected & element_io);
+
+endmodule
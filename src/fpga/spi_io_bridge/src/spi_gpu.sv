@@ -1,4 +1,11 @@
 module spi_gpu 
+#(
+    parameter int REGISTER_COUNT = 64,
+    parameter int SPRITE_COUNT = 4,
+    parameter bit OCTAL = 0, //d4-d7 are wired, COMMAND_FRAMEBUFFER_OCTAL_WRITE takes a byte per clock
+    parameter bit VIDEO_1080P = 0, //reported in the capabilities, the raster runs 1125 lines of 1080p60 instead of 750 of 720p60
+    parameter bit CS1_IRQ = 0 //reported in the capabilities, the cs1 pin is an output carrying vblank
+)
 (
     input logic reset,
 
@@ -9,6 +16,7 @@ module spi_gpu
     inout logic miso_d1,
     inout logic d2,
     inout logic d3,
+    input logic [3:0] d7_d4, //input only, tie to 0 without OCTAL
 
     output logic [7:0] framebuffer_rgb_in,
     input logic [7:0] framebuffer_rgb_out,
@@ -22,6 +30,42 @@ module spi_gpu
     output logic framebuffer_wren_rgb, framebuffer_wren_palette,
 
     input logic framebuffer_hblank, framebuffer_vblank,
+    input logic [15:0] framebuffer_frame_counter_gray,
+    input logic [47:0] framebuffer_geometry,
+    input logic [31:0] framebuffer_raster_gray,
+
+    output logic [7:0] registers [REGISTER_COUNT],
+    output logic registers_busy,
+
+    output logic [7:0] framebuffer_sprite_in,
+    output logic [$clog2(SPRITE_COUNT)+9:0] framebuffer_sprite_addr,
+    output logic framebuffer_clk_sprite, framebuffer_wren_sprite,
+
+    output logic [7:0] framebuffer_line_table_in,
+    output logic [7:0] framebuffer_line_table_addr,
+    output logic framebuffer_clk_line_table, framebuffer_wren_line_table,
+
+    output logic [23:0] framebuffer_palette_secondary_in,
+    output logic [7:0] framebuffer_palette_secondary_addr,
+    output logic framebuffer_clk_palette_secondary, framebuffer_wren_palette_secondary,
+
+    output logic [7:0] framebuffer_copper_in,
+    output logic [8:0] framebuffer_copper_addr,
+    output logic framebuffer_clk_copper, framebuffer_wren_copper,
+
+    output logic [7:0] framebuffer_blit_queue_in,
+    output logic [7:0] framebuffer_blit_queue_addr,
+    output logic framebuffer_clk_blit_queue, framebuffer_wren_blit_queue,
+    output logic [4:0] framebuffer_blit_head_gray,
+    input logic [4:0] framebuffer_blit_tail_gray,
+    input logic framebuffer_blit_busy,
+    input logic [31:0] framebuffer_blit_crc,
+
+    output logic [7:0] framebuffer_blit_store_in,
+    output logic [12:0] framebuffer_blit_store_addr,
+    output logic framebuffer_clk_blit_store, framebuffer_wren_blit_store,
+
+    input logic hid_changed,
 
     output logic audio_fifo_wr_clk, audio_fifo_wren,
     output logic [31:0] audio_fifo_in,
@@ -33,17 +77,47 @@ module spi_gpu
 );
     //clock domain crossing
 
-    logic [1:0] framebuffer_hblank_sync_ff, framebuffer_vblank_sync_ff;
+    logic [1:0] framebuffer_hblank_sync_ff, framebuffer_vblank_sync_ff, hid_changed_sync_ff, framebuffer_blit_busy_sync_ff;
+    logic [15:0] framebuffer_frame_counter_gray_sync_ff [1:0];
+    logic [47:0] framebuffer_geometry_sync_ff [1:0];
+    logic [31:0] framebuffer_raster_gray_sync_ff [1:0];
+    logic [4:0] framebuffer_blit_tail_gray_sync_ff [1:0];
+    logic [31:0] framebuffer_blit_crc_sync_ff [1:0];
     
     wire framebuffer_hblank_sync = framebuffer_hblank_sync_ff[0];
     wire framebuffer_vblank_sync = framebuffer_vblank_sync_ff[0];
+    wire hid_changed_sync = hid_changed_sync_ff[0];
+    wire framebuffer_blit_busy_sync = framebuffer_blit_busy_sync_ff[0];
+    wire [15:0] framebuffer_frame_counter_sync = gray_to_binary(framebuffer_frame_counter_gray_sync_ff[0]);
+    wire [47:0] framebuffer_geometry_sync = framebuffer_geometry_sync_ff[0]; //quasi-static, changes only on a mode switch at vblank
+    wire [31:0] framebuffer_raster_sync = {gray_to_binary(framebuffer_raster_gray_sync_ff[0][31:16]), gray_to_binary(framebuffer_raster_gray_sync_ff[0][15:0])};
+    wire [4:0] framebuffer_blit_tail_sync = 5'(gray_to_binary({11'b0, framebuffer_blit_tail_gray_sync_ff[0]}));
+    wire [31:0] framebuffer_blit_crc_sync = framebuffer_blit_crc_sync_ff[0]; //quasi-static, changes only when a crc blit finishes
     
     always_ff @(posedge sclk)
     begin
         framebuffer_hblank_sync_ff <= {framebuffer_hblank, framebuffer_hblank_sync_ff[1]};
         framebuffer_vblank_sync_ff <= {framebuffer_vblank, framebuffer_vblank_sync_ff[1]};
+        hid_changed_sync_ff <= {hid_changed, hid_changed_sync_ff[1]};
+        framebuffer_blit_busy_sync_ff <= {framebuffer_blit_busy, framebuffer_blit_busy_sync_ff[1]};
+        framebuffer_blit_tail_gray_sync_ff <= '{framebuffer_blit_tail_gray, framebuffer_blit_tail_gray_sync_ff[1]};
+        framebuffer_blit_crc_sync_ff <= '{framebuffer_blit_crc, framebuffer_blit_crc_sync_ff[1]};
+        framebuffer_frame_counter_gray_sync_ff <= '{framebuffer_frame_counter_gray, framebuffer_frame_counter_gray_sync_ff[1]};
+        framebuffer_geometry_sync_ff <= '{framebuffer_geometry, framebuffer_geometry_sync_ff[1]};
+        framebuffer_raster_gray_sync_ff <= '{framebuffer_raster_gray, framebuffer_raster_gray_sync_ff[1]};
     end
 
+    function automatic logic [15:0] gray_to_binary(logic [15:0] gray);
+        logic [15:0] binary;
+
+        binary[15] = gray[15];
+
+        for (int i = 14; i >= 0; i--)
+            binary[i] = binary[i+1] ^ gray[i];
+
+        return binary;
+    endfunction
+
     //spi stuff
     //
 
@@ -69,6 +143,8 @@ module spi_gpu
     assign {d3, d2, miso_d1, mosi_d0} = current_state == WRITE ? data_out : 4'bZZZZ;
     assign data_in = {d3, d2, miso_d1, mosi_d0};
 
+    wire [3:0] data_in_high = OCTAL ? d7_d4 : 4'b0;
+
     //internal registers
     //
 
@@ -78,6 +154,10 @@ module spi_gpu
 
     assign status_register0 = {5'b10110, framebuffer_hblank_sync, framebuffer_vblank_sync, output_enabled};
 
+    logic [7:0] status_bundle_flags;
+
+    assign status_bundle_flags = {7'b0, hid_changed_sync};
+
     int counter;
     logic [3:0] tmp1, tmp2, tmp3;
     logic [7:0] tmp4, tmp5, tmp6;
@@ -99,12 +179,35 @@ module spi_gpu
         COMMAND_READ_MAGIC_NUMBER               = 8'b01100000, //write 2 bytes of magic number to check that fpga is present and initialized
         COMMAND_DISABLE_OUTPUT                  = 8'b00000000,
         COMMAND_ENABLE_OUTPUT                   = 8'b00000001,
+        COMMAND_CHAIN                           = 8'b00100000, //no phases, spi_chain takes the rest of the transaction as a command list for both slaves
         COMMAND_AUDIO_BUFFER_READ_STATUS        = 8'b01010000, //write only, 4 bits of flags + 12 bits of number of samples in buffer = 2 bytes
-        COMMAND_AUDIO_BUFFER_WRITE              = 8'b11010001  //read+write, read 1 byte (1-256) of how many samples will be written, then read 32bits*number of samples, then write status 2 bytes
+        COMMAND_AUDIO_BUFFER_WRITE              = 8'b11010001, //read+write, read 1 byte (1-256) of how many samples will be written, then read 32bits*number of samples, then write status 2 bytes
+        COMMAND_READ_STATUS_BUNDLE              = 8'b01000001, //write 12 bytes: status register 0, 2 bytes of audio buffer status, 2 bytes of frame counter, 1 byte of flags, 2 bytes of read phase crc and 2 of write phase crc since the last bundle, 2 bytes of crc of the previous 10
+        COMMAND_WRITE_REGISTERS                 = 8'b10000100, //read phase only, read 1 byte of first register idx, then continuously read register values in 1 byte blocks until master stops the transaction
+        COMMAND_READ_REGISTERS                  = 8'b11000100, //read+write, read 1 byte of first register idx, then continuously write register values in 1 byte blocks until master stops the transaction
+        COMMAND_SPRITE_WRITE_IMAGE              = 8'b10000101, //read phase only, read 1 byte of sprite idx, then 32*32 bytes of sprite pixels
+        COMMAND_READ_GEOMETRY                   = 8'b01000101, //write 7 bytes: active layout mode, bits per pixel, 2 bytes of frame width, 2 bytes of frame height, then 1 byte of capabilities
+        COMMAND_WRITE_LINE_TABLE                = 8'b10000110, //read phase only, read 1 byte of first screen line, then continuously read framebuffer row per line in 1 byte blocks until master stops the transaction
+        COMMAND_SET_SECONDARY_PALETTE           = 8'b10000111, //read phase only, 256*3 bytes of the fade target palette starting from [0]
+        COMMAND_READ_RASTER                     = 8'b01000110, //write 4 bytes: 2 bytes of current screen line, 2 bytes of frame rows scanned out in this frame
+        COMMAND_WRITE_COPPER_LIST               = 8'b10001000, //read phase only, read 1 byte of first entry idx, then continuously read 8 byte entries in 1 byte blocks until master stops the transaction
+        COMMAND_BLIT                            = 8'b10001001, //read phase only, continuously read 16 byte blit parameter blocks into the blitter queue, master must not exceed the free queue slots
+        COMMAND_WRITE_BLIT_STORE                = 8'b10001010, //read phase only, read 2 bytes of first blit store address, then continuously read bytes until master stops the transaction
+        COMMAND_READ_BLIT_STATUS                = 8'b01001001, //write 1 byte: blitter busy, 2 reserved bits, 5 bits of queued blocks
+        COMMAND_READ_BLIT_CRC                   = 8'b01001010, //write 4 bytes of the crc32 computed by the last crc blit
+        COMMAND_ECHO                            = 8'b11001011, //read+write, read 4 bytes, then write them back followed by their inverse, for link calibration
+        COMMAND_FRAMEBUFFER_PRESENT             = 8'b10001011, //read phase only, 256*3 bytes of palette, then 3 bytes of first pixel idx, then continuously read pixel data in 1 byte blocks until master stops the transaction
+        COMMAND_FRAMEBUFFER_OCTAL_WRITE         = 8'b10001100, //OCTAL builds only, read phase only, read 3 bytes of first pixel idx on 4 lines, then continuously read pixel data on 8 lines, 1 byte per clock, until master stops the transaction
+        COMMAND_FRAMEBUFFER_LZ_WRITE            = 8'b10001101, //read phase only, read 3 bytes of first pixel idx, then continuously read lz tokens until master stops the transaction
+        COMMAND_FRAMEBUFFER_DELTA_WRITE         = 8'b10001110  //read phase only, read 3 bytes of first pixel idx, then continuously read skip and literal tokens until master stops the transaction
     } command_code;
 
     localparam int MAGIC_NUMBER = 16'b1010010111000011;
 
+    //last byte of COMMAND_READ_GEOMETRY, bit 0: COMMAND_FRAMEBUFFER_OCTAL_WRITE is decoded, bit 1: 1080p60 output,
+    //bit 2: cs1 drives vblank
+    wire [7:0] capabilities = {5'b0, CS1_IRQ, VIDEO_1080P, OCTAL};
+
     logic [7:0] command_bits;
 
     command_code command_enum;
@@ -117,15 +220,188 @@ module spi_gpu
     logic framebuffer_clk_rgb_pulse_1, framebuffer_clk_rgb_pulse_2;
     logic framebuffer_clk_palette_pulse_1, framebuffer_clk_palette_pulse_2;
 
-    assign framebuffer_clk_rgb = framebuffer_clk_rgb_pulse_1 | framebuffer_clk_rgb_pulse_2;
+    //a byte per clock leaves no room for pulses, the octal data phase and lz copies clock the memory with the falling sclk edge instead.
+    //enable is set and cleared while sclk is high
+    logic framebuffer_clk_rgb_sclk_en;
+
+    assign framebuffer_clk_rgb = framebuffer_clk_rgb_pulse_1 | framebuffer_clk_rgb_pulse_2 | (framebuffer_clk_rgb_sclk_en & ~sclk);
     assign framebuffer_clk_palette = framebuffer_clk_palette_pulse_1 | framebuffer_clk_palette_pulse_2;
 
+    //COMMAND_FRAMEBUFFER_PRESENT is a palette write followed by a continuous write in the same transaction
+    localparam int PALETTE_NIBBLES = 256*6;
+
+    wire present_palette = command_enum == COMMAND_FRAMEBUFFER_PRESENT && counter < PALETTE_NIBBLES;
+
+    int pixel_counter;
+
+    assign pixel_counter = command_enum == COMMAND_FRAMEBUFFER_PRESENT ? counter - PALETTE_NIBBLES : counter;
+
     logic[16:0] framebuffer_rgb_addr_re, framebuffer_rgb_addr_wr;
+
+    //COMMAND_FRAMEBUFFER_LZ_WRITE token stream, every token starts with a header byte:
+    //0LLLLLLL - L+1 literal bytes follow, a byte is written on the clock its low nibble arrives
+    //1LLLLLLL - copy L+LZ_MIN_MATCH bytes from 3 nibbles of distance-1 back in the output, one byte per clock right after the distance.
+    //           the master keeps clocking filler nibbles while the copy runs, a distance of 1 repeats the last byte.
+    //the output never takes more than a clock per byte, so the token stream is at most 2x shorter than raw pixels,
+    //the history is kept here rather than read back from the framebuffer because its port is busy writing.
+    //COMMAND_FRAMEBUFFER_DELTA_WRITE has the same literals, 1SSSSSSS and 3 more nibbles leave S+1 pixels as they are instead of a copy.
+    //S is 19 bits, the master keeps a skip within the framebuffer size
+    localparam int LZ_WINDOW = 512; //320 pixel line back-reference and then some
+    localparam int LZ_MIN_MATCH = 6;
+
+    typedef enum
+    {
+        LZ_HEADER_HIGH,
+        LZ_HEADER_LOW,
+        LZ_DISTANCE,
+        LZ_LITERAL_HIGH,
+        LZ_LITERAL_LOW,
+        LZ_COPY
+    } lz_state;
+
+    lz_state lz_current;
+    logic [7:0] lz_remaining;
+    logic [11:0] lz_distance;
+    logic [1:0] lz_distance_nibble;
+    logic [3:0] lz_high;
+    logic [$clog2(LZ_WINDOW)-1:0] lz_window_pos;
+    logic [7:0] lz_window [LZ_WINDOW];
+
+    wire [7:0] lz_header = {lz_high, data_in};
+    wire [7:0] lz_byte = lz_current == LZ_LITERAL_LOW 
+        ? {lz_high, data_in} 
+        : lz_window[$clog2(LZ_WINDOW)'(lz_window_pos - lz_distance - 1)];
+    wire lz_delta = command_enum == COMMAND_FRAMEBUFFER_DELTA_WRITE;
+    wire lz_byte_valid = current_state == READ && (command_enum == COMMAND_FRAMEBUFFER_LZ_WRITE || lz_delta) && counter >= 6 
+        && (lz_current == LZ_LITERAL_LOW || lz_current == LZ_COPY);
+
+    //skip ends on the last distance nibble, the address already points past the last byte written
+    wire [19:0] lz_skip_end = framebuffer_rgb_addr_wr + {lz_remaining[6:0], lz_distance[7:0], data_in} + 1'b1;
+
+    //distributed memory with asynchronous read, a byte written on this edge is visible to the copy on the next one
+    always_ff @(posedge sclk)
+    begin
+        if (lz_byte_valid)
+            lz_window[lz_window_pos] <= lz_byte;
+    end
     logic[7:0] framebuffer_palette_addr_re, framebuffer_palette_addr_wr;
 
     assign framebuffer_rgb_addr = framebuffer_wren_rgb ? framebuffer_rgb_addr_wr : framebuffer_rgb_addr_re;
     assign framebuffer_palette_addr = framebuffer_wren_palette ? framebuffer_palette_addr_wr : framebuffer_palette_addr_re;
 
+    //gpu registers, sprite images, line table, secondary palette and copper list
+    //
+
+    localparam int SPRITE_PIXELS = 32*32;
+    localparam int COPPER_LIST_SIZE = 64*8; //64 entries of 8 bytes
+    localparam int BLIT_QUEUE_DEPTH = 16;  //16 byte parameter blocks
+    localparam int BLIT_STORE_SIZE = 8192;
+
+    //blit queue write pointer, advanced after the last byte of a block is written, the framebuffer side owns the read pointer
+    logic [4:0] blit_head;
+
+    assign framebuffer_blit_head_gray = blit_head ^ (blit_head >> 1);
+
+    wire [7:0] blit_status = {framebuffer_blit_busy_sync, 2'b0, 5'(blit_head - framebuffer_blit_tail_sync)};
+
+    logic [7:0] registers_wr_data;
+    logic [7:0] registers_wr_addr;
+    logic registers_wren;
+
+    //framebuffer copies the registers during vblank only while this is low
+    assign registers_busy = ~cs & (command_enum == COMMAND_WRITE_REGISTERS);
+
+    initial
+    begin
+        for (int i = 0; i < REGISTER_COUNT; i++)
+            registers[i] = 0; //all sprites disabled
+
+        blit_head = 0;
+    end
+
+    //registers, sprite images, line table, secondary palette and copper list are written on the falling edge after the byte was sampled, 
+    //master brings SCLK low after the last bit so the last byte is written too
+    always_ff @(negedge sclk)
+    begin
+        if (registers_wren && registers_wr_addr < REGISTER_COUNT)
+            registers[registers_wr_addr] <= registers_wr_data;
+
+        if (framebuffer_wren_blit_queue && framebuffer_blit_queue_addr[3:0] == 4'hF)
+            blit_head <= blit_head + 1'b1;
+    end
+
+    assign framebuffer_clk_sprite = ~sclk;
+    assign framebuffer_clk_line_table = ~sclk;
+    assign framebuffer_clk_palette_secondary = ~sclk;
+    assign framebuffer_clk_copper = ~sclk;
+    assign framebuffer_clk_blit_queue = ~sclk;
+    assign framebuffer_clk_blit_store = ~sclk;
+
+    function automatic logic [7:0] register_read(logic [7:0] idx);
+        return idx < REGISTER_COUNT ? registers[idx] : 8'b0;
+    endfunction
+
+    //link integrity
+    //
+
+    //crc-16/ccitt-false (0x1021, initial 0xFFFF), nibbles msb first exactly as they are clocked in
+    function automatic logic [15:0] crc16_update(logic [15:0] crc, logic [3:0] data);
+        for (int i = 3; i >= 0; i--)
+            crc = (crc[15] ^ data[i]) ? 16'(crc << 1) ^ 16'h1021 : 16'(crc << 1);
+
+        return crc;
+    endfunction
+
+    //crcs of every nibble of the read phases (address and data, not the command) and of the write phases of all
+    //transactions since the last status bundle, which reports and restarts them. the master accumulates the same
+    //over what it sent and received, so any corrupted nibble in between shows up in the next bundle
+    logic [15:0] rx_crc, tx_crc;
+
+    always_ff @(posedge sclk)
+    begin
+        if (!cs)
+        begin
+            if (current_state == READ)
+            begin
+                if (command_enum == COMMAND_FRAMEBUFFER_OCTAL_WRITE && counter >= 6)
+                    rx_crc <= crc16_update(crc16_update(rx_crc, data_in_high), data_in);
+                else
+                    rx_crc <= crc16_update(rx_crc, data_in);
+            end
+            else if (current_state == WRITE)
+            begin
+                //the bundle was loaded on the falling edge before
+                if (command_enum == COMMAND_READ_STATUS_BUNDLE)
+                begin
+                    if (counter == 0)
+                    begin
+                        rx_crc <= 16'hFFFF;
+                        tx_crc <= 16'hFFFF;
+                    end
+                end
+                else
+                    tx_crc <= crc16_update(tx_crc, data_out);
+            end
+        end
+    end
+
+    wire [79:0] status_bundle = {status_register0, 
+                                 {2'b0, audio_fifo_almost_full, audio_fifo_full, 1'b0, audio_fifo_wnum},
+                                 framebuffer_frame_counter_sync,
+                                 status_bundle_flags,
+                                 rx_crc,
+                                 tx_crc};
+
+    //trailer of the status bundle, a corrupted bundle is dropped by the master instead of acted upon
+    function automatic logic [15:0] crc16_bundle(logic [79:0] data);
+        logic [15:0] crc = 16'hFFFF;
+
+        for (int i = 19; i >= 0; i--)
+            crc = crc16_update(crc, data[i*4 +: 4]);
+
+        return crc;
+    endfunction
+
     //CPOL = 0, CPHA = 0:
     //out clock triggers first - on negedge cs and negedge sclk,
     //in clock triggers second = on posedge sclk
@@ -144,15 +420,27 @@ module spi_gpu
 
             framebuffer_clk_rgb_pulse_1 <= 0;
             framebuffer_clk_palette_pulse_1 <= 0;
+            framebuffer_clk_rgb_sclk_en <= 0;
 
             audio_fifo_wren <= 0;
             audio_fifo_wr_clk <= 0;
             audio_fifo_in <= 0;
 
+            registers_wren <= 0;
+            framebuffer_wren_sprite <= 0;
+            framebuffer_wren_line_table <= 0;
+            framebuffer_wren_palette_secondary <= 0;
+            framebuffer_wren_copper <= 0;
+            framebuffer_wren_blit_queue <= 0;
+            framebuffer_wren_blit_store <= 0;
+
             tmp7 <= 0;
             tmp2 <= 0;
             tmp4 <= 0;
             tmp10 <= 0;
+
+            lz_current <= LZ_HEADER_HIGH;
+            lz_window_pos <= 0;
         end
         else if (!cs)
         begin
@@ -176,27 +464,44 @@ module spi_gpu
                 READ : 
                 begin
                     unique0 case (command_enum)
-                        COMMAND_FRAMEBUFFER_SET_PALETTE : 
+                        COMMAND_ECHO :
                         begin
-                            read_done <= counter >= 1535;
-
-                            if ((counter % 6) == 5) //set d_in when 24 bits are ready (6 spi cycles)
-                            begin
-                                framebuffer_palette_in <= {tmp7[19:0], data_in};
-                                framebuffer_palette_addr_wr <= 8'(framebuffer_palette_addr_wr + 1); //overflow to 0 at first write
-                            end
-                            else
-                                tmp7 <= {tmp7[19:0], data_in};
+                            read_done <= counter >= 7;
+                            tmp10 <= {tmp10[27:0], data_in};
+                        end
+                        COMMAND_FRAMEBUFFER_CONTINUOUS_READ :
+                        begin
+                            read_done <= counter >= 5;
 
-                            if ((counter >= 6) && (counter % 6) == 0)
-                                framebuffer_clk_palette_pulse_1 <= 1;
+                            if (counter <= 4)
+                                framebuffer_rgb_addr_wr <= {framebuffer_rgb_addr_wr[12:0], data_in};
                         end
+                        COMMAND_FRAMEBUFFER_SET_PALETTE,
+                        COMMAND_FRAMEBUFFER_PRESENT,
                         COMMAND_FRAMEBUFFER_CONTINUOUS_WRITE : 
                         begin
-                            if (counter < 6)
+                            if (command_enum == COMMAND_FRAMEBUFFER_SET_PALETTE || present_palette)
+                            begin
+                                read_done <= command_enum == COMMAND_FRAMEBUFFER_SET_PALETTE && counter >= 1535;
+
+                                if ((counter % 6) == 5) //set d_in when 24 bits are ready (6 spi cycles)
+                                begin
+                                    framebuffer_palette_in <= {tmp7[19:0], data_in};
+                                    framebuffer_palette_addr_wr <= 8'(framebuffer_palette_addr_wr + 1); //overflow to 0 at first write
+                                end
+                                else
+                                    tmp7 <= {tmp7[19:0], data_in};
+
+                                if ((counter >= 6) && (counter % 6) == 0)
+                                    framebuffer_clk_palette_pulse_1 <= 1;
+                            end
+                            else if (pixel_counter < 6)
                             begin
-                                if (counter <= 4)
+                                if (pixel_counter <= 4)
                                     framebuffer_rgb_addr_wr <= {framebuffer_rgb_addr_wr[12:0], data_in};
+
+                                if (pixel_counter == 0 && command_enum == COMMAND_FRAMEBUFFER_PRESENT)
+                                    framebuffer_clk_palette_pulse_1 <= 1; //last palette entry, set palette does it at DONE instead
                             end
                             else
                             begin
@@ -204,12 +509,88 @@ module spi_gpu
                                 //also when stopping the transaction master is expected to bring SCLK low, so last write should be triggered correctly
                                 framebuffer_rgb_in <= {framebuffer_rgb_in[3:0], data_in};
 
-                                if ((counter > 6) && (counter % 2) == 0) //addr increment at counter 8, 10 etc
+                                if ((pixel_counter > 6) && (pixel_counter % 2) == 0) //addr increment at counter 8, 10 etc
+                                    framebuffer_rgb_addr_wr <= framebuffer_rgb_addr_wr < 76800 //wraparound
+                                        ? framebuffer_rgb_addr_wr + 1 
+                                        : 0;
+                            end
+                        end
+                        COMMAND_FRAMEBUFFER_OCTAL_WRITE :
+                        begin
+                            if (counter <= 4)
+                                framebuffer_rgb_addr_wr <= {framebuffer_rgb_addr_wr[12:0], data_in};
+                            else if (counter >= 6)
+                            begin
+                                //byte and address are stable by the falling edge that writes them
+                                framebuffer_rgb_in <= {data_in_high, data_in};
+                                framebuffer_clk_rgb_sclk_en <= 1;
+
+                                if (counter > 6)
                                     framebuffer_rgb_addr_wr <= framebuffer_rgb_addr_wr < 76800 //wraparound
                                         ? framebuffer_rgb_addr_wr + 1 
                                         : 0;
                             end
                         end
+                        COMMAND_FRAMEBUFFER_LZ_WRITE,
+                        COMMAND_FRAMEBUFFER_DELTA_WRITE :
+                        begin
+                            if (counter <= 4)
+                                framebuffer_rgb_addr_wr <= {framebuffer_rgb_addr_wr[12:0], data_in};
+                            else if (counter >= 6)
+                            begin
+                                //same falling edge write as the octal data phase, the address moves past the byte written on the previous clock
+                                framebuffer_rgb_in <= lz_byte;
+                                framebuffer_clk_rgb_sclk_en <= lz_byte_valid;
+
+                                if (framebuffer_clk_rgb_sclk_en)
+                                    framebuffer_rgb_addr_wr <= framebuffer_rgb_addr_wr < 76800 //wraparound
+                                        ? framebuffer_rgb_addr_wr + 1 
+                                        : 0;
+
+                                if (lz_byte_valid)
+                                    lz_window_pos <= lz_window_pos + 1'b1;
+
+                                unique case (lz_current)
+                                    LZ_HEADER_HIGH :
+                                    begin
+                                        lz_high <= data_in;
+                                        lz_current <= LZ_HEADER_LOW;
+                                    end
+                                    LZ_HEADER_LOW :
+                                    begin
+                                        lz_remaining <= lz_header[7] && !lz_delta ? 8'(lz_header[6:0] + LZ_MIN_MATCH - 1) : {1'b0, lz_header[6:0]};
+                                        lz_distance_nibble <= 0;
+                                        lz_current <= lz_header[7] ? LZ_DISTANCE : LZ_LITERAL_HIGH;
+                                    end
+                                    LZ_DISTANCE :
+                                    begin
+                                        lz_distance <= {lz_distance[7:0], data_in};
+                                        lz_distance_nibble <= lz_distance_nibble + 1'b1;
+
+                                        if (lz_distance_nibble == 2)
+                                            lz_current <= lz_delta ? LZ_HEADER_HIGH : LZ_COPY;
+
+                                        if (lz_distance_nibble == 2 && lz_delta)
+                                            framebuffer_rgb_addr_wr <= 17'(lz_skip_end >= 76800 ? lz_skip_end - 76800 : lz_skip_end);
+                                    end
+                                    LZ_LITERAL_HIGH :
+                                    begin
+                                        lz_high <= data_in;
+                                        lz_current <= LZ_LITERAL_LOW;
+                                    end
+                                    LZ_LITERAL_LOW,
+                                    LZ_COPY :
+                                    begin
+                                        lz_remaining <= lz_remaining - 1'b1;
+
+                                        if (lz_remaining == 0)
+                                            lz_current <= LZ_HEADER_HIGH;
+                                        else if (lz_current == LZ_LITERAL_LOW)
+                                            lz_current <= LZ_LITERAL_HIGH;
+                                    end
+                                endcase
+                            end
+                        end
                         COMMAND_AUDIO_BUFFER_WRITE : 
                         begin
                             read_done <= counter > 1 && counter >= ((tmp4 == 0 ? 256 : tmp4)*8 + 1);
@@ -239,12 +620,131 @@ module spi_gpu
                                     audio_fifo_wr_clk <= 0;
                             end
                         end
+                        COMMAND_WRITE_REGISTERS :
+                        begin
+                            if (counter <= 1)
+                                tmp5 <= {tmp5[3:0], data_in};
+                            else if (counter[0] == 0)
+                            begin
+                                tmp2 <= data_in;
+                                registers_wren <= 0;
+                            end
+                            else
+                            begin
+                                registers_wr_data <= {tmp2, data_in};
+                                registers_wr_addr <= 8'(tmp5 + (counter-3)/2);
+                                registers_wren <= 1;
+                            end
+                        end
+                        COMMAND_READ_REGISTERS :
+                        begin
+                            read_done <= counter >= 1;
+                            tmp5 <= {tmp5[3:0], data_in};
+                        end
+                        COMMAND_SPRITE_WRITE_IMAGE :
+                        begin
+                            read_done <= counter >= (SPRITE_PIXELS*2 + 1);
+
+                            if (counter <= 1)
+                                tmp6 <= {tmp6[3:0], data_in};
+                            else if (counter[0] == 0)
+                            begin
+                                tmp2 <= data_in;
+                                framebuffer_wren_sprite <= 0;
+                            end
+                            else
+                            begin
+                                framebuffer_sprite_in <= {tmp2, data_in};
+                                framebuffer_sprite_addr <= {tmp6[$clog2(SPRITE_COUNT)-1:0], 10'((counter-3)/2)};
+                                framebuffer_wren_sprite <= tmp6 < SPRITE_COUNT;
+                            end
+                        end
+                        COMMAND_WRITE_LINE_TABLE :
+                        begin
+                            if (counter <= 1)
+                                tmp5 <= {tmp5[3:0], data_in};
+                            else if (counter[0] == 0)
+                            begin
+                                tmp2 <= data_in;
+                                framebuffer_wren_line_table <= 0;
+                            end
+                            else
+                            begin
+                                framebuffer_line_table_in <= {tmp2, data_in};
+                                framebuffer_line_table_addr <= 8'(tmp5 + (counter-3)/2);
+                                framebuffer_wren_line_table <= 1;
+                            end
+                        end
+                        COMMAND_SET_SECONDARY_PALETTE :
+                        begin
+                            read_done <= counter >= 1535;
+
+                            if ((counter % 6) == 5)
+                            begin
+                                framebuffer_palette_secondary_in <= {tmp7[19:0], data_in};
+                                framebuffer_palette_secondary_addr <= 8'(counter / 6);
+                                framebuffer_wren_palette_secondary <= 1;
+                            end
+                            else
+                            begin
+                                tmp7 <= {tmp7[19:0], data_in};
+                                framebuffer_wren_palette_secondary <= 0;
+                            end
+                        end
+                        COMMAND_WRITE_COPPER_LIST :
+                        begin
+                            if (counter <= 1)
+                                tmp5 <= {tmp5[3:0], data_in};
+                            else if (counter[0] == 0)
+                            begin
+                                tmp2 <= data_in;
+                                framebuffer_wren_copper <= 0;
+                            end
+                            else
+                            begin
+                                framebuffer_copper_in <= {tmp2, data_in};
+                                framebuffer_copper_addr <= 9'({tmp5, 3'b0} + (counter-3)/2);
+                                framebuffer_wren_copper <= ({tmp5, 3'b0} + (counter-3)/2) < COPPER_LIST_SIZE;
+                            end
+                        end
+                        COMMAND_BLIT :
+                        begin
+                            if (counter[0] == 0)
+                            begin
+                                tmp2 <= data_in;
+                                framebuffer_wren_blit_queue <= 0;
+                            end
+                            else
+                            begin
+                                //head has already moved past the previous blocks of this transaction
+                                framebuffer_blit_queue_in <= {tmp2, data_in};
+                                framebuffer_blit_queue_addr <= {blit_head[3:0], 4'(counter/2)};
+                                framebuffer_wren_blit_queue <= 1;
+                            end
+                        end
+                        COMMAND_WRITE_BLIT_STORE :
+                        begin
+                            if (counter <= 3)
+                                tmp7 <= {tmp7[19:0], data_in};
+                            else if (counter[0] == 0)
+                            begin
+                                tmp2 <= data_in;
+                                framebuffer_wren_blit_store <= 0;
+                            end
+                            else
+                            begin
+                                framebuffer_blit_store_in <= {tmp2, data_in};
+                                framebuffer_blit_store_addr <= 13'(tmp7[15:0] + (counter-5)/2);
+                                framebuffer_wren_blit_store <= (tmp7[15:0] + (counter-5)/2) < BLIT_STORE_SIZE;
+                            end
+                        end
                     endcase
                 end
                 WRITE_DUMMY :      
                 begin
                     unique0 case (command_enum)
-                        COMMAND_AUDIO_BUFFER_READ_STATUS : audio_fifo_wr_clk <= ~counter[0];
+                        COMMAND_AUDIO_BUFFER_READ_STATUS,
+                        COMMAND_READ_STATUS_BUNDLE : audio_fifo_wr_clk <= ~counter[0];
                         COMMAND_AUDIO_BUFFER_WRITE : 
                         begin
                             audio_fifo_wr_clk <= 1;
@@ -269,11 +769,17 @@ module spi_gpu
                 WRITE : 
                 begin //set write_done flags
                     unique0 case (command_enum)
-                        COMMAND_READ_STATUS0 : write_done <= counter >= 1;
+                        COMMAND_READ_STATUS0,
+                        COMMAND_READ_BLIT_STATUS : write_done <= counter >= 1;
                         COMMAND_FRAMEBUFFER_GET_PALETTE : write_done <= counter >= 1535;
                         COMMAND_AUDIO_BUFFER_READ_STATUS, 
                         COMMAND_AUDIO_BUFFER_WRITE, 
                         COMMAND_READ_MAGIC_NUMBER : write_done <= counter >= 3;
+                        COMMAND_READ_STATUS_BUNDLE : write_done <= counter >= 23;
+                        COMMAND_READ_GEOMETRY : write_done <= counter >= 13;
+                        COMMAND_ECHO : write_done <= counter >= 15;
+                        COMMAND_READ_RASTER,
+                        COMMAND_READ_BLIT_CRC : write_done <= counter >= 7;
                     endcase
                 end
                 DONE : ;
@@ -323,19 +829,37 @@ module spi_gpu
                 begin
                     unique0 case (command_enum)
                         COMMAND_FRAMEBUFFER_SET_PALETTE : framebuffer_wren_palette <= 1;
+                        COMMAND_FRAMEBUFFER_PRESENT,
                         COMMAND_FRAMEBUFFER_CONTINUOUS_WRITE : 
                         begin 
                             if (counter == 0)
+                            begin
                                 framebuffer_wren_rgb <= 1;
+                                framebuffer_wren_palette <= command_enum == COMMAND_FRAMEBUFFER_PRESENT;
+                            end
                             
-                            framebuffer_clk_rgb_pulse_2 <= (counter > 6) && ((counter % 2) == 1);
+                            framebuffer_clk_rgb_pulse_2 <= !present_palette && (pixel_counter > 6) && ((pixel_counter % 2) == 1);
+                        end
+                        COMMAND_FRAMEBUFFER_OCTAL_WRITE,
+                        COMMAND_FRAMEBUFFER_LZ_WRITE,
+                        COMMAND_FRAMEBUFFER_DELTA_WRITE :
+                        begin
+                            if (counter == 0)
+                                framebuffer_wren_rgb <= 1;
                         end
                     endcase
                 end
+                WRITE_DUMMY :
+                begin
+                    //address was set on entering dummy cycles, first byte is read here
+                    if (command_enum == COMMAND_FRAMEBUFFER_CONTINUOUS_READ && counter == 0)
+                        framebuffer_clk_rgb_pulse_2 <= 1;
+                end
                 WRITE :             
                 begin
                     unique0 case (command_enum)
-                        COMMAND_READ_STATUS0 : data_out <= tmp1;
+                        COMMAND_READ_STATUS0,
+                        COMMAND_READ_BLIT_STATUS : data_out <= tmp1;
                         COMMAND_FRAMEBUFFER_GET_PALETTE : 
                         begin
                             //first palette read happens during IDLE&COMMAND cycles
@@ -355,6 +879,34 @@ module spi_gpu
                         COMMAND_AUDIO_BUFFER_READ_STATUS, 
                         COMMAND_AUDIO_BUFFER_WRITE, 
                         COMMAND_READ_MAGIC_NUMBER : {data_out, tmp8[15:4]} <= tmp8[15:0];
+                        COMMAND_READ_STATUS_BUNDLE : {data_out, tmp12, tmp11, tmp9, tmp8[23:20]} <= {tmp12, tmp11, tmp9, tmp8[23:20], 4'b0};
+                        COMMAND_READ_GEOMETRY,
+                        COMMAND_ECHO : {data_out, tmp12, tmp11[31:4]} <= {tmp12, tmp11};
+                        COMMAND_READ_RASTER,
+                        COMMAND_READ_BLIT_CRC : {data_out, tmp12[31:4]} <= tmp12;
+                        COMMAND_FRAMEBUFFER_CONTINUOUS_READ :
+                        begin
+                            //the address moves while the high nibble goes out, the next byte is read while the low one does
+                            if (counter[0])
+                            begin
+                                {data_out, tmp1} <= framebuffer_rgb_out;
+
+                                framebuffer_rgb_addr_re <= framebuffer_rgb_addr_re < 76800 - 1 ? framebuffer_rgb_addr_re + 1 : 0;
+                            end
+                            else
+                            begin
+                                data_out <= tmp1;
+
+                                framebuffer_clk_rgb_pulse_2 <= 1;
+                            end
+                        end
+                        COMMAND_READ_REGISTERS : 
+                        begin
+                            if (counter[0])
+                                {data_out, tmp1} <= register_read(8'(tmp5 + counter/2 + 1));
+                            else
+                                data_out <= tmp1;
+                        end
                     endcase
                 end
                 DONE : ;
@@ -371,14 +923,32 @@ module spi_gpu
                 //prepare stuff for sample edge / next output cycle
                 unique0 case (next_state)
                     READ : ;
+                    WRITE_DUMMY :
+                    begin
+                        if (command_enum == COMMAND_FRAMEBUFFER_CONTINUOUS_READ)
+                            framebuffer_rgb_addr_re <= framebuffer_rgb_addr_wr < 76800 ? framebuffer_rgb_addr_wr : 0;
+                    end
                     WRITE :             
                     begin
                         unique0 case (command_enum)
                             COMMAND_READ_STATUS0 : {data_out, tmp1} <= status_register0;
+                            COMMAND_READ_BLIT_STATUS : {data_out, tmp1} <= blit_status;
                             COMMAND_FRAMEBUFFER_GET_PALETTE : {data_out, tmp8[23:4]} <= framebuffer_palette_out;
                             COMMAND_AUDIO_BUFFER_READ_STATUS : {data_out, tmp8[15:4]} <= {2'b0, audio_fifo_almost_full, audio_fifo_full, 1'b0, audio_fifo_wnum};
                             COMMAND_AUDIO_BUFFER_WRITE : {data_out, tmp8[15:4]} <= tmp7[15:0];
                             COMMAND_READ_MAGIC_NUMBER : {data_out, tmp8[15:4]} <= MAGIC_NUMBER[15:0];
+                            COMMAND_READ_STATUS_BUNDLE : {data_out, tmp12, tmp11, tmp9, tmp8[23:20]} <= {status_bundle, crc16_bundle(status_bundle)};
+                            COMMAND_READ_REGISTERS : {data_out, tmp1} <= register_read(tmp5);
+                            COMMAND_READ_GEOMETRY : {data_out, tmp12, tmp11[31:4]} <= {framebuffer_geometry_sync, capabilities, 8'b0};
+                            COMMAND_ECHO : {data_out, tmp12, tmp11[31:4]} <= {tmp10, ~tmp10}; //every line toggles at least once
+                            COMMAND_READ_RASTER : {data_out, tmp12[31:4]} <= framebuffer_raster_sync;
+                            COMMAND_READ_BLIT_CRC : {data_out, tmp12[31:4]} <= framebuffer_blit_crc_sync;
+                            COMMAND_FRAMEBUFFER_CONTINUOUS_READ :
+                            begin
+                                {data_out, tmp1} <= framebuffer_rgb_out;
+
+                                framebuffer_rgb_addr_re <= framebuffer_rgb_addr_re < 76800 - 1 ? framebuffer_rgb_addr_re + 1 : 0;
+                            end
                         endcase
                     end
                     DONE :
@@ -397,6 +967,10 @@ module spi_gpu
     function automatic bit command_defined(command_code command);
         command_code i = i.first();
 
+        //without d4-d7 the octal data phase would write garbage, the command is ignored like an unknown one
+        if (!OCTAL && command == COMMAND_FRAMEBUFFER_OCTAL_WRITE)
+            return 0;
+
         if (command == i)
             return 1;
 
@@ -1,4 +1,8 @@
 module spi_io
+#(
+    parameter int HID_SLOTS = 4,
+    parameter int TRACE_ENTRIES = 64
+)
 (
     input logic reset,
 
@@ -12,15 +16,23 @@ module spi_io
 
     output logic hid_read,
 
-    input logic hid_keyboard_connected, hid_mouse_connected,
+    input logic [HID_SLOTS-1:0] hid_keyboard_connected, hid_mouse_connected,
 
-    input logic [7:0] hid_keyboard_modifiers,
-    input logic [7:0] hid_keyboard_keycodes [0:5],
+    input logic [7:0] hid_keyboard_modifiers [0:HID_SLOTS-1],
+    input logic [7:0] hid_keyboard_keycodes [0:HID_SLOTS-1][0:5],
 
-    input logic [7:0] hid_mouse_buttons,
-    input logic signed [31:0] hid_mouse_x,
-    input logic signed [31:0] hid_mouse_y,
-    input logic signed [31:0] hid_mouse_wheel,
+    input logic [7:0] hid_mouse_buttons [0:HID_SLOTS-1],
+    input logic signed [31:0] hid_mouse_x [0:HID_SLOTS-1],
+    input logic signed [31:0] hid_mouse_y [0:HID_SLOTS-1],
+    input logic signed [31:0] hid_mouse_wheel [0:HID_SLOTS-1],
+
+    input logic [31:0] trace_count,
+    output logic [$clog2(TRACE_ENTRIES)-1:0] trace_addr,
+    input logic [31:0] trace_data,
+
+    output logic [7:0] edid_addr,
+    input logic [7:0] edid_data,
+    input logic [7:0] edid_status,
 
     output logic test_led_ready, test_led_done,
     output logic [7:0] test_led
@@ -67,7 +79,10 @@ module spi_io
 
     typedef enum bit[7:0] 
     {
-        COMMAND_USB_HID_GET_STATUS = 8'b01010000
+        COMMAND_USB_HID_GET_STATUS          = 8'b01010000, //write only, 6*4 bytes of hid device slot 0 status, 2 bytes of trailer
+        COMMAND_USB_HID_GET_DEVICE_STATUS   = 8'b11010000, //read+write, read 1 byte of device slot index, then write 6*4 bytes of its status, 2 bytes of trailer
+        COMMAND_USB_TRACE_READ              = 8'b01100000, //write only, 4 bytes of total event count, then TRACE_ENTRIES*4 bytes of the firmware trace ring, 2 bytes of trailer
+        COMMAND_EDID_READ                   = 8'b01110000  //write only, 1 byte of ddc status, then 256 bytes of the monitor edid, 2 bytes of trailer
     } command_code;
 
     logic [7:0] command_bits;
@@ -81,6 +96,58 @@ module spi_io
 
     assign hid_read = ~cs;
 
+    //slot index is latched to tmp4 during read phase, stays 0 for COMMAND_USB_HID_GET_STATUS
+    wire [$clog2(HID_SLOTS)-1:0] hid_slot = tmp4[$clog2(HID_SLOTS)-1:0];
+
+    //first status word: 'AB', keyboard slots mask, mouse slots mask, slot index
+    wire [31:0] hid_slot_header = {8'hAB, 8'(hid_keyboard_connected), 8'(hid_mouse_connected), tmp4};
+
+    //trace
+    //
+
+    //ring word k is shifted out starting at counter 8*(k+1) - 1, right after the count word
+    assign trace_addr = counter[$clog2(TRACE_ENTRIES)+2:3];
+
+    //edid
+    //
+
+    //edid is quasi-static, only the status byte is synchronized
+    logic [7:0] edid_status_sync_ff [1:0];
+
+    wire [7:0] edid_status_sync = edid_status_sync_ff[0];
+
+    always_ff @(posedge sclk)
+        edid_status_sync_ff <= '{edid_status, edid_status_sync_ff[1]};
+
+    //edid byte k is shifted out starting at counter 2*k + 1, right after the status byte
+    assign edid_addr = counter[8:1];
+
+    //link integrity
+    //
+
+    //crc-16/ccitt-false (0x1021, initial 0xFFFF), nibbles msb first exactly as they are clocked in
+    function automatic logic [15:0] crc16_update(logic [15:0] crc, logic [3:0] data);
+        for (int i = 3; i >= 0; i--)
+            crc = (crc[15] ^ data[i]) ? 16'(crc << 1) ^ 16'h1021 : 16'(crc << 1);
+
+        return crc;
+    endfunction
+
+    //nibbles of the write phase before the trailer
+    function automatic int data_nibbles(command_code command);
+        unique0 case (command)
+            COMMAND_USB_HID_GET_STATUS,
+            COMMAND_USB_HID_GET_DEVICE_STATUS : return 6*8;
+            COMMAND_USB_TRACE_READ : return (TRACE_ENTRIES+1)*8;
+            COMMAND_EDID_READ : return (256+1)*2;
+        endcase
+
+        return 0;
+    endfunction
+
+    //every write phase ends with a trailer: crc-16 of the read phase nibbles and the data nibbles sent before it
+    logic [15:0] io_crc;
+
     //CPOL = 0, CPHA = 0:
     //out clock triggers first - on negedge cs and negedge sclk,
     //in clock triggers second = on posedge sclk
@@ -93,6 +160,10 @@ module spi_io
         begin
             read_done <= 0;
             write_done <= 0;
+
+            tmp4 <= 0;
+
+            io_crc <= 16'hFFFF;
         end
         else if (!cs)
         begin
@@ -101,12 +172,27 @@ module spi_io
                 COMMAND : command_bits <= {command_bits[3:0], data_in};
                 READ : 
                 begin
+                    unique0 case (command_enum)
+                        COMMAND_USB_HID_GET_DEVICE_STATUS : 
+                        begin
+                            read_done <= counter >= 1;
+                            tmp4 <= {tmp4[3:0], data_in};
+                        end
+                    endcase
+
+                    io_crc <= crc16_update(io_crc, data_in);
                 end
                 WRITE : 
                 begin
                     unique0 case (command_enum)
-                        COMMAND_USB_HID_GET_STATUS : write_done <= counter >= (6*8 - 1);
+                        COMMAND_USB_HID_GET_STATUS,
+                        COMMAND_USB_HID_GET_DEVICE_STATUS,
+                        COMMAND_USB_TRACE_READ,
+                        COMMAND_EDID_READ : write_done <= counter >= (data_nibbles(command_enum) + 4 - 1);
                     endcase
+
+                    if (counter < data_nibbles(command_enum))
+                        io_crc <= crc16_update(io_crc, data_out);
                 end
                 DONE : ;
             endcase
@@ -142,18 +228,37 @@ module spi_io
                 WRITE :             
                 begin
                     unique0 case (command_enum)
-                        COMMAND_USB_HID_GET_STATUS :
+                        COMMAND_USB_HID_GET_STATUS,
+                        COMMAND_USB_HID_GET_DEVICE_STATUS :
                         begin
                             unique case (counter)
-                                (8 - 1)   : {data_out, tmp10[31:4]} <= {hid_mouse_buttons, hid_keyboard_modifiers, hid_keyboard_keycodes[0], hid_keyboard_keycodes[1]};
-                                (8*2 - 1) : {data_out, tmp10[31:4]} <= {hid_keyboard_keycodes[2], hid_keyboard_keycodes[3], hid_keyboard_keycodes[4], hid_keyboard_keycodes[5]};
-                                (8*3 - 1) : {data_out, tmp10[31:4]} <= hid_mouse_x;
-                                (8*4 - 1) : {data_out, tmp10[31:4]} <= hid_mouse_y;
-                                (8*5 - 1) : {data_out, tmp10[31:4]} <= hid_mouse_wheel;
+                                (8 - 1)   : {data_out, tmp10[31:4]} <= {hid_mouse_buttons[hid_slot], hid_keyboard_modifiers[hid_slot], hid_keyboard_keycodes[hid_slot][0], hid_keyboard_keycodes[hid_slot][1]};
+                                (8*2 - 1) : {data_out, tmp10[31:4]} <= {hid_keyboard_keycodes[hid_slot][2], hid_keyboard_keycodes[hid_slot][3], hid_keyboard_keycodes[hid_slot][4], hid_keyboard_keycodes[hid_slot][5]};
+                                (8*3 - 1) : {data_out, tmp10[31:4]} <= hid_mouse_x[hid_slot];
+                                (8*4 - 1) : {data_out, tmp10[31:4]} <= hid_mouse_y[hid_slot];
+                                (8*5 - 1) : {data_out, tmp10[31:4]} <= hid_mouse_wheel[hid_slot];
                                 default : {data_out, tmp10[31:4]} <= tmp10;
                             endcase
                         end
+                        COMMAND_USB_TRACE_READ : 
+                        begin
+                            if (counter[2:0] == 3'd7)
+                                {data_out, tmp10[31:4]} <= trace_data;
+                            else
+                                {data_out, tmp10[31:4]} <= tmp10;
+                        end
+                        COMMAND_EDID_READ :
+                        begin
+                            if (counter[0])
+                                {data_out, tmp1} <= edid_data;
+                            else
+                                data_out <= tmp1;
+                        end
                     endcase
+
+                    //trailer replaces the data once its last nibble was sampled, io_crc no longer changes
+                    if (counter >= data_nibbles(command_enum) - 1 && counter <= data_nibbles(command_enum) + 2)
+                        data_out <= io_crc[4*(data_nibbles(command_enum) + 2 - counter) +: 4];
                 end
                 DONE : ;
             endcase
@@ -172,7 +277,10 @@ module spi_io
                     WRITE :             
                     begin
                         unique0 case (command_enum)
-                            COMMAND_USB_HID_GET_STATUS : {data_out, tmp10[31:4]} <= 32'hABCDEF12; //status tmp
+                            COMMAND_USB_HID_GET_STATUS,
+                            COMMAND_USB_HID_GET_DEVICE_STATUS : {data_out, tmp10[31:4]} <= hid_slot_header;
+                            COMMAND_USB_TRACE_READ : {data_out, tmp10[31:4]} <= trace_count;
+                            COMMAND_EDID_READ : {data_out, tmp1} <= edid_status_sync;
                         endcase
                     end
                     DONE :
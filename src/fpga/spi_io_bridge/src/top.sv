@@ -1,4 +1,7 @@
 `define GW_IDE
+//`define VIDEO_1080P //1920x1080 DVI output without audio, swap the hdmi clocks in timing.sdc too
+//`define SPI_OCTAL //d4-d7 of the gpu link on extra pmod pins, uncomment their IO_LOC in pins.cst too
+//`define SPI_CS1_IRQ //io commands only through chains on cs0, the cs1 pin outputs vblank instead
 
 module top 
 (
@@ -20,12 +23,22 @@ module top
     input logic usb_cpu_uart_rx,
 
     input logic spi_cs0,
+`ifdef SPI_CS1_IRQ
+    output logic spi_cs1,
+`else
     input logic spi_cs1,
+`endif
     input logic spi_sclk,
     inout logic spi_mosi_d0,
     inout logic spi_miso_d1,
     inout logic spi_d2,
     inout logic spi_d3,
+`ifdef SPI_OCTAL
+    input logic spi_d4,
+    input logic spi_d5,
+    input logic spi_d6,
+    input logic spi_d7,
+`endif
 
     output logic led_ready,
     output logic led_done, 
@@ -36,8 +49,6 @@ module top
     output logic [7:0] test_led
 );
 
-    assign hdmi_tx_ddc_sda = 1;
-    assign hdmi_tx_ddc_scl = 1;
     assign hdmi_tx_cec = 1;
 
     // clocks
@@ -55,12 +66,21 @@ module top
 
     assign reset = 0;
 
+`ifdef VIDEO_1080P
+    gowin_pll_hdmi_1080 pll_hdmi (
+        .lock(pll_hdmi_lock), 
+        .clkout0(clk_pixel),
+        .clkout1(clk_pixel_x5),
+        .clkin(clk_50m)
+    );
+`else
     gowin_pll_hdmi_720 pll_hdmi (
         .lock(pll_hdmi_lock), 
         .clkout0(clk_pixel),
         .clkout1(clk_pixel_x5),
         .clkin(clk_50m)
     );
+`endif
 
     gowin_pll_usb pll_usb (
         .lock(pll_usb_lock), 
@@ -76,10 +96,17 @@ module top
 
     logic [15:0] audio_sample_word [1:0];
 
+    logic dvi_fallback;
+
     hdmi 
     #(
+`ifdef VIDEO_1080P
+        .VIDEO_ID_CODE(16), //4: 720p60hz, 16: 1080p60hz
+        .DVI_OUTPUT(1),
+`else
         .VIDEO_ID_CODE(4), //4: 720p60hz, 16: 1080p60hz
         .DVI_OUTPUT(0), //true HDMI with audio
+`endif
         .VIDEO_REFRESH_RATE(60.0), 
         .AUDIO_RATE(48000)
     )
@@ -89,6 +116,7 @@ module top
         .clk_pixel(clk_pixel),
         .clk_audio(clk_audio),
         .reset(~pll_hdmi_lock),
+        .dvi_fallback(dvi_fallback),
         .rgb(rgb),
         .audio_sample_word(audio_sample_word),
         .tmds(hdmi_tx_tmds),
@@ -101,8 +129,27 @@ module top
         .screen_height(screen_height)
     );
 
+    // ddc
+
+    logic [7:0] edid_addr, edid_data, edid_status;
+
+    edid_reader #(.CLOCK_HZ(50_000_000)) edid_reader
+    (
+        .clk(clk_50m),
+        .reset(reset),
+        .hpd(hdmi_tx_hpd),
+        .ddc_sda(hdmi_tx_ddc_sda),
+        .ddc_scl(hdmi_tx_ddc_scl),
+        .addr(edid_addr),
+        .data(edid_data),
+        .status(edid_status)
+    );
+
     // framebuffer
 
+    localparam int GPU_REGISTER_COUNT = 64;
+    localparam int SPRITE_COUNT = 4;
+
     logic [7:0] framebuffer_rgb_in;
     logic [7:0] framebuffer_rgb_out;
     logic [23:0] framebuffer_palette_in;
@@ -115,8 +162,47 @@ module top
     logic framebuffer_wren_rgb, framebuffer_wren_palette;
 
     logic framebuffer_hblank, framebuffer_vblank;
-
-    framebuffer framebuffer
+    logic [15:0] framebuffer_frame_counter_gray;
+    logic [47:0] framebuffer_geometry;
+    logic [31:0] framebuffer_raster_gray;
+
+    logic [7:0] gpu_registers [GPU_REGISTER_COUNT];
+    logic gpu_registers_busy;
+
+    logic [7:0] framebuffer_sprite_in;
+    logic [$clog2(SPRITE_COUNT)+9:0] framebuffer_sprite_addr;
+    logic framebuffer_clk_sprite, framebuffer_wren_sprite;
+
+    logic [7:0] framebuffer_line_table_in;
+    logic [7:0] framebuffer_line_table_addr;
+    logic framebuffer_clk_line_table, framebuffer_wren_line_table;
+
+    logic [23:0] framebuffer_palette_secondary_in;
+    logic [7:0] framebuffer_palette_secondary_addr;
+    logic framebuffer_clk_palette_secondary, framebuffer_wren_palette_secondary;
+
+    logic [7:0] framebuffer_copper_in;
+    logic [8:0] framebuffer_copper_addr;
+    logic framebuffer_clk_copper, framebuffer_wren_copper;
+
+    logic [7:0] framebuffer_blit_queue_in;
+    logic [7:0] framebuffer_blit_queue_addr;
+    logic framebuffer_clk_blit_queue, framebuffer_wren_blit_queue;
+    logic [4:0] framebuffer_blit_head_gray, framebuffer_blit_tail_gray;
+    logic framebuffer_blit_busy;
+    logic [31:0] framebuffer_blit_crc;
+
+    logic [7:0] framebuffer_blit_store_in;
+    logic [12:0] framebuffer_blit_store_addr;
+    logic framebuffer_clk_blit_store, framebuffer_wren_blit_store;
+
+`ifdef VIDEO_1080P
+    localparam bit VIDEO_1080P = 1;
+`else
+    localparam bit VIDEO_1080P = 0;
+`endif
+
+    framebuffer #(.REGISTER_COUNT(GPU_REGISTER_COUNT), .SPRITE_COUNT(SPRITE_COUNT), .VIDEO_1080P(VIDEO_1080P)) framebuffer
     (
         .rgb_in(framebuffer_rgb_in),
         .rgb_out(framebuffer_rgb_out),
@@ -130,13 +216,47 @@ module top
         .wren_rgb(framebuffer_wren_rgb), .wren_palette(framebuffer_wren_palette),
 
         .hblank(framebuffer_hblank), .vblank(framebuffer_vblank),
+        .frame_counter_gray(framebuffer_frame_counter_gray),
+        .geometry(framebuffer_geometry),
+        .raster_gray(framebuffer_raster_gray),
+        .dvi_output(dvi_fallback),
+
+        .registers(gpu_registers), .registers_busy(gpu_registers_busy),
+
+        .sprite_in(framebuffer_sprite_in),
+        .sprite_addr(framebuffer_sprite_addr),
+        .clk_sprite(framebuffer_clk_sprite), .wren_sprite(framebuffer_wren_sprite),
+
+        .line_table_in(framebuffer_line_table_in),
+        .line_table_addr(framebuffer_line_table_addr),
+        .clk_line_table(framebuffer_clk_line_table), .wren_line_table(framebuffer_wren_line_table),
+
+        .palette_secondary_in(framebuffer_palette_secondary_in),
+        .palette_secondary_addr(framebuffer_palette_secondary_addr),
+        .clk_palette_secondary(framebuffer_clk_palette_secondary), .wren_palette_secondary(framebuffer_wren_palette_secondary),
+
+        .copper_in(framebuffer_copper_in),
+        .copper_addr(framebuffer_copper_addr),
+        .clk_copper(framebuffer_clk_copper), .wren_copper(framebuffer_wren_copper),
+
+        .blit_queue_in(framebuffer_blit_queue_in),
+        .blit_queue_addr(framebuffer_blit_queue_addr),
+        .clk_blit_queue(framebuffer_clk_blit_queue), .wren_blit_queue(framebuffer_wren_blit_queue),
+        .blit_head_gray(framebuffer_blit_head_gray), .blit_tail_gray(framebuffer_blit_tail_gray),
+        .blit_busy(framebuffer_blit_busy), .blit_crc(framebuffer_blit_crc),
+
+        .blit_store_in(framebuffer_blit_store_in),
+        .blit_store_addr(framebuffer_blit_store_addr),
+        .clk_blit_store(framebuffer_clk_blit_store), .wren_blit_store(framebuffer_wren_blit_store),
 
         .clk_pixel(clk_pixel),
         .screen_rgb_out(rgb),
         .cx(cx),
         .cy(cy),
         .screen_width(screen_width),
-        .screen_height(screen_height)
+        .screen_height(screen_height),
+        .total_width(frame_width),
+        .total_height(frame_height)
     );	
 
     // audio
@@ -164,8 +284,11 @@ module top
 
     logic [11:0] audio_div_counter;
 
+`ifdef VIDEO_1080P
+    localparam int PIXEL_TO_AUDIO_DIV = 3125; //1080p: 150mhz to 48khz
+`else
     localparam int PIXEL_TO_AUDIO_DIV = 1562; //720p: 75mhz to ~48khz
-    //localparam int PIXEL_TO_AUDIO_DIV = 3125; //1080p: 150mhz to 48khz
+`endif
     
     always_ff @(posedge clk_pixel, negedge pll_hdmi_lock)
     begin
@@ -189,14 +312,20 @@ module top
 
     // usb
 
-    logic hid_read;
-    logic hid_keyboard_connected, hid_mouse_connected;
-    logic [7:0] hid_keyboard_modifiers;
-    logic [7:0] hid_keyboard_keycodes [0:5];
-    logic [7:0] hid_mouse_buttons;
-    logic signed [31:0] hid_mouse_x, hid_mouse_y, hid_mouse_wheel;
+    localparam int HID_SLOTS = 4;
+    localparam int USB_TRACE_ENTRIES = 64;
 
-    usb_host usb_host 
+    logic hid_read, hid_changed;
+    logic [HID_SLOTS-1:0] hid_keyboard_connected, hid_mouse_connected;
+    logic [7:0] hid_keyboard_modifiers [0:HID_SLOTS-1];
+    logic [7:0] hid_keyboard_keycodes [0:HID_SLOTS-1][0:5];
+    logic [7:0] hid_mouse_buttons [0:HID_SLOTS-1];
+    logic signed [31:0] hid_mouse_x [0:HID_SLOTS-1], hid_mouse_y [0:HID_SLOTS-1], hid_mouse_wheel [0:HID_SLOTS-1];
+
+    logic [31:0] usb_trace_count, usb_trace_data;
+    logic [$clog2(USB_TRACE_ENTRIES)-1:0] usb_trace_addr;
+
+    usb_host #(.HID_SLOTS(HID_SLOTS), .TRACE_ENTRIES(USB_TRACE_ENTRIES)) usb_host 
     (
         .clk_48m(clk_usb_48m),
         .clk_cpu_bram_96m(clk_usb_cpu_bram_96m),
@@ -209,24 +338,59 @@ module top
         .cpu_uart_rx(usb_cpu_uart_rx),
 
         .hid_read(hid_read),
+        .hid_changed(hid_changed),
         .hid_keyboard_connected(hid_keyboard_connected), .hid_mouse_connected(hid_mouse_connected),
         .hid_keyboard_modifiers(hid_keyboard_modifiers),
         .hid_keyboard_keycodes(hid_keyboard_keycodes),
         .hid_mouse_buttons(hid_mouse_buttons),
-        .hid_mouse_x(hid_mouse_x), .hid_mouse_y(hid_mouse_y), .hid_mouse_wheel(hid_mouse_wheel)
+        .hid_mouse_x(hid_mouse_x), .hid_mouse_y(hid_mouse_y), .hid_mouse_wheel(hid_mouse_wheel),
+
+        .trace_count(usb_trace_count), .trace_addr(usb_trace_addr), .trace_data(usb_trace_data)
     );
 
     // spi
 
-    spi_gpu spi0
-    (   
+    //command lists on cs0 switch between both slaves without touching the pins
+    logic spi_chain_cs_gpu, spi_chain_cs_io_select;
+
+    spi_chain spi_chain0
+    (
         .reset(reset),
         .cs(spi_cs0),
         .sclk(spi_sclk),
+        .data_in({spi_d3, spi_d2, spi_miso_d1, spi_mosi_d0}),
+        .cs_gpu(spi_chain_cs_gpu),
+        .cs_io_select(spi_chain_cs_io_select)
+    );
+
+`ifdef SPI_CS1_IRQ
+    localparam bit SPI_GPU_CS1_IRQ = 1;
+    assign spi_cs1 = framebuffer_vblank;
+
+    wire spi_cs_io = spi_chain_cs_io_select;
+`else
+    localparam bit SPI_GPU_CS1_IRQ = 0;
+    wire spi_cs_io = spi_cs1 & spi_chain_cs_io_select;
+`endif
+
+`ifdef SPI_OCTAL
+    localparam bit SPI_GPU_OCTAL = 1;
+    wire [3:0] spi_d7_d4 = {spi_d7, spi_d6, spi_d5, spi_d4};
+`else
+    localparam bit SPI_GPU_OCTAL = 0;
+    wire [3:0] spi_d7_d4 = 4'b0;
+`endif
+
+    spi_gpu #(.REGISTER_COUNT(GPU_REGISTER_COUNT), .SPRITE_COUNT(SPRITE_COUNT), .OCTAL(SPI_GPU_OCTAL), .VIDEO_1080P(VIDEO_1080P), .CS1_IRQ(SPI_GPU_CS1_IRQ)) spi0
+    (   
+        .reset(reset),
+        .cs(spi_chain_cs_gpu),
+        .sclk(spi_sclk),
         .mosi_d0(spi_mosi_d0),
         .miso_d1(spi_miso_d1),
         .d2(spi_d2),
         .d3(spi_d3),
+        .d7_d4(spi_d7_d4),
 
         .framebuffer_rgb_in(framebuffer_rgb_in),
         .framebuffer_rgb_out(framebuffer_rgb_out),
@@ -240,6 +404,39 @@ module top
         .framebuffer_wren_rgb(framebuffer_wren_rgb), .framebuffer_wren_palette(framebuffer_wren_palette),
 
         .framebuffer_hblank(framebuffer_hblank), .framebuffer_vblank(framebuffer_vblank),
+        .framebuffer_frame_counter_gray(framebuffer_frame_counter_gray),
+        .framebuffer_geometry(framebuffer_geometry),
+        .framebuffer_raster_gray(framebuffer_raster_gray),
+
+        .registers(gpu_registers), .registers_busy(gpu_registers_busy),
+
+        .framebuffer_sprite_in(framebuffer_sprite_in),
+        .framebuffer_sprite_addr(framebuffer_sprite_addr),
+        .framebuffer_clk_sprite(framebuffer_clk_sprite), .framebuffer_wren_sprite(framebuffer_wren_sprite),
+
+        .framebuffer_line_table_in(framebuffer_line_table_in),
+        .framebuffer_line_table_addr(framebuffer_line_table_addr),
+        .framebuffer_clk_line_table(framebuffer_clk_line_table), .framebuffer_wren_line_table(framebuffer_wren_line_table),
+
+        .framebuffer_palette_secondary_in(framebuffer_palette_secondary_in),
+        .framebuffer_palette_secondary_addr(framebuffer_palette_secondary_addr),
+        .framebuffer_clk_palette_secondary(framebuffer_clk_palette_secondary), .framebuffer_wren_palette_secondary(framebuffer_wren_palette_secondary),
+
+        .framebuffer_copper_in(framebuffer_copper_in),
+        .framebuffer_copper_addr(framebuffer_copper_addr),
+        .framebuffer_clk_copper(framebuffer_clk_copper), .framebuffer_wren_copper(framebuffer_wren_copper),
+
+        .framebuffer_blit_queue_in(framebuffer_blit_queue_in),
+        .framebuffer_blit_queue_addr(framebuffer_blit_queue_addr),
+        .framebuffer_clk_blit_queue(framebuffer_clk_blit_queue), .framebuffer_wren_blit_queue(framebuffer_wren_blit_queue),
+        .framebuffer_blit_head_gray(framebuffer_blit_head_gray), .framebuffer_blit_tail_gray(framebuffer_blit_tail_gray),
+        .framebuffer_blit_busy(framebuffer_blit_busy), .framebuffer_blit_crc(framebuffer_blit_crc),
+
+        .framebuffer_blit_store_in(framebuffer_blit_store_in),
+        .framebuffer_blit_store_addr(framebuffer_blit_store_addr),
+        .framebuffer_clk_blit_store(framebuffer_clk_blit_store), .framebuffer_wren_blit_store(framebuffer_wren_blit_store),
+
+        .hid_changed(hid_changed),
 
         .audio_fifo_wr_clk(audio_fifo_wr_clk), .audio_fifo_wren(audio_fifo_wren),
         .audio_fifo_in(audio_fifo_in),
@@ -253,10 +450,10 @@ module top
         //.test_led(test_led)
     );
 
-    spi_io spi1
+    spi_io #(.HID_SLOTS(HID_SLOTS), .TRACE_ENTRIES(USB_TRACE_ENTRIES)) spi1
     (   
         .reset(reset),
-        .cs(spi_cs1),
+        .cs(spi_cs_io),
         .sclk(spi_sclk),
         .mosi_d0(spi_mosi_d0),
         .miso_d1(spi_miso_d1),
@@ -270,6 +467,10 @@ module top
         .hid_mouse_buttons(hid_mouse_buttons),
         .hid_mouse_x(hid_mouse_x), .hid_mouse_y(hid_mouse_y), .hid_mouse_wheel(hid_mouse_wheel),
 
+        .trace_count(usb_trace_count), .trace_addr(usb_trace_addr), .trace_data(usb_trace_data),
+
+        .edid_addr(edid_addr), .edid_data(edid_data), .edid_status(edid_status),
+
         .test_led_ready(led_ready),
         .test_led_done(led_done),
 
@@ -376,6 +376,295 @@ module RV32I (
 
 endmodule
 
+// 3-stage pipelined variant of the RV32I controller above, same ports
+//    F : local memory instruction port is addressed with the next PC
+//    X : decode, register read with bypass from W, ALU, branch resolve,
+//        local memory data port is addressed here
+//    W : load data / multiplier result, register write-back,
+//        non-local memory is accessed here on the registered address
+//
+// Taken branches cost nothing as the next PC goes straight to the BRAM
+// address, an instruction using the result of a load or a multiply
+// right before it stalls for one cycle (two for non-local loads, which
+// get an extra cycle for the peripheral to answer, like in MA above).
+// MUL = 1 adds MUL/MULH/MULHSU/MULHU from the M extension, no divider.
+//
+module RV32I_P3
+#(
+    parameter MUL = 0
+)
+(
+    input  wire         CLK,          // clock
+`ifdef GW_IDE
+    input  wire         clk_2x,       // 2x clock with +45 deg phase for emulating read-before-write memory
+`endif
+    input  wire         RST_X,        // nReset
+    input  wire         w_stall,      // stall execution (wait for main memory)
+    output wire [31:0]  w_mic_addr,   // CPU address,
+    input  wire [31:0]  w_data,       //     data in,
+    output wire [31:0]  w_mic_wdata,  //     data out,
+    output wire         w_mic_mmuwe,  //     wr
+    output wire  [2:0]  w_mic_ctrl,   // info size: 'funct3' field, to select b/h/w
+    output wire  [1:0]  w_mic_req     // info TLB: type of access: 1 = WR, 0 = RD, 3 = NONE
+  );
+
+    /******************************************** F   *********************************************/
+    reg  [31:0] r_pc      = 0; // PC of the instruction in X
+    reg         r_x_valid = 0; // instruction port holds the instruction at r_pc
+
+    wire        w_x_stall;
+    wire        w_x_tkn;
+    wire [31:0] w_x_jmp_pc;
+
+    wire [31:0] w_fetch_pc = (!r_x_valid) ? r_pc : (w_x_tkn) ? w_x_jmp_pc : r_pc+4;
+
+    // a stalled X re-reads its own instruction
+    wire [31:0] w_mic_insn_addr = (w_x_stall) ? r_pc : w_fetch_pc;
+
+    always @(posedge CLK) begin
+        if (!RST_X) begin
+            r_pc      <= {`UC_TADDR, 28'h0000000};
+            r_x_valid <= 0;
+        end
+        else if (!w_x_stall) begin
+            r_pc      <= w_fetch_pc;
+            r_x_valid <= 1;
+        end
+    end
+
+    /******************************************** X   *********************************************/
+    wire [31:0] w_ir;
+    wire  [6:0] w_op      = w_ir[ 6: 0];
+    wire  [4:0] w_rd      = w_ir[11: 7];
+    wire  [4:0] w_rs1     = w_ir[19:15];
+    wire  [4:0] w_rs2     = w_ir[24:20];
+    wire  [2:0] w_funct3  = w_ir[14:12];
+    wire  [6:0] w_funct7  = w_ir[31:25];
+    wire [31:0] w_imm;
+    wire [31:0] w_rrs1_reg, w_rrs2_reg;
+
+    m_imm_gen imm_gen0(w_ir, w_imm);
+
+    wire w_x_load   = (w_op==`OPCODE_LOAD____);
+    wire w_x_store  = (w_op==`OPCODE_STORE___);
+    wire w_x_mul    = (MUL != 0) && (w_op==`OPCODE_OP______) && (w_funct7==7'h01);
+
+    wire w_x_reg_we = (w_op==`OPCODE_LOAD____) ? 1 :
+                      (w_op==`OPCODE_LUI_____) ? 1 :
+                      (w_op==`OPCODE_AUIPC___) ? 1 :
+                      (w_op==`OPCODE_JAL_____) ? 1 :
+                      (w_op==`OPCODE_JALR____) ? 1 :
+                      (w_op==`OPCODE_OP______) ? 1 :
+                      (w_op==`OPCODE_OP_IMM__) ? 1 : 0;
+
+    wire w_x_use_rs1 = !(w_op==`OPCODE_LUI_____ || w_op==`OPCODE_AUIPC___ || w_op==`OPCODE_JAL_____);
+    wire w_x_use_rs2 =  (w_op==`OPCODE_OP______ || w_op==`OPCODE_STORE___ || w_op==`OPCODE_BRANCH__);
+
+    // W stage, see below
+    reg         r_w_valid = 0;
+    reg         r_w_we    = 0;
+    reg   [4:0] r_w_rd    = 0;
+    reg  [31:0] r_w_rslt  = 0;
+    reg         r_w_late  = 0; // result is only known at the end of W (load, multiply)
+    reg         r_w_load  = 0;
+    reg         r_w_store = 0;
+    reg         r_w_mul   = 0;
+    reg         r_w_ext   = 0; // non-local memory access
+    reg         r_w_wait  = 0; // second cycle of a non-local load
+    reg  [31:0] r_w_addr  = 0;
+    reg  [31:0] r_w_wdata = 0;
+    reg   [2:0] r_w_funct3 = 0;
+    reg  [31:0] r_w_in1   = 0;
+    reg  [31:0] r_w_in2   = 0;
+
+    wire w_w_fwd = r_w_valid && r_w_we && !r_w_late && (r_w_rd != 0);
+
+    wire [31:0] w_rrs1 = (w_w_fwd && r_w_rd==w_rs1) ? r_w_rslt : w_rrs1_reg;
+    wire [31:0] w_rrs2 = (w_w_fwd && r_w_rd==w_rs2) ? r_w_rslt : w_rrs2_reg;
+
+    // interlocks
+    wire w_w_ext_rd = r_w_valid && r_w_load && r_w_ext && !r_w_wait;
+    wire w_x_hazard = r_x_valid && r_w_valid && r_w_we && r_w_late && (r_w_rd != 0) &&
+                      ((w_x_use_rs1 && r_w_rd==w_rs1) || (w_x_use_rs2 && r_w_rd==w_rs2));
+
+    assign w_x_stall = w_stall || w_w_ext_rd || w_x_hazard;
+
+    wire w_x_go = r_x_valid && !w_x_stall;
+
+    // ALU
+    wire [31:0] w_alu_i_rslt;
+    wire        w_alu_b_rslt;
+
+    wire  [6:0] w_alu_fn7 = (w_op==`OPCODE_OP_IMM__) ?
+                            ((w_funct3==`FUNCT3_ADD___) ? 0 : w_funct7 & 7'h20) : w_funct7;
+
+    wire [31:0] w_in2 = (w_op==`OPCODE_OP_IMM__) ? w_imm : w_rrs2;
+
+    m_alu_i ALU_I (w_rrs1, w_in2, w_funct3, w_alu_fn7, w_alu_i_rslt);
+    m_alu_b ALU_B (w_rrs1, w_in2, w_funct3, w_alu_b_rslt);
+
+    reg  [31:0] r_x_rslt;
+
+    always @(*) begin
+        case(w_op)
+            `OPCODE_LUI_____ : r_x_rslt = w_imm;
+            `OPCODE_AUIPC___ : r_x_rslt = r_pc + w_imm;
+            `OPCODE_JAL_____ : r_x_rslt = r_pc + 4;
+            `OPCODE_JALR____ : r_x_rslt = r_pc + 4;
+            `OPCODE_OP______ : r_x_rslt = w_alu_i_rslt;
+            `OPCODE_OP_IMM__ : r_x_rslt = w_alu_i_rslt;
+            default          : r_x_rslt = 0;
+        endcase
+    end
+
+    assign w_x_jmp_pc = (w_op==`OPCODE_JALR____) ? w_rrs1+w_imm : r_pc+w_imm;
+    assign w_x_tkn    = (w_op==`OPCODE_JAL_____ || w_op==`OPCODE_JALR____) ? 1 :
+                        (w_op==`OPCODE_BRANCH__) ? w_alu_b_rslt : 0;
+
+`ifdef __ICARUS__
+    always @(posedge CLK) begin
+        if (w_x_go) begin
+            case(w_op)
+                `OPCODE_LUI_____, `OPCODE_AUIPC___, `OPCODE_JAL_____, `OPCODE_JALR____,
+                `OPCODE_OP______, `OPCODE_OP_IMM__, `OPCODE_BRANCH__, `OPCODE_LOAD____,
+                `OPCODE_STORE___, `OPCODE_MISC_MEM : ;
+                default : begin
+                    $write("UNKNOWN OPCODE DETECT in Micro Controller!!\n");
+                    $write("PC:%08x OPCODE=%7b, ir=%8x\n", r_pc, w_op, w_ir);
+                    $write("Simulation Stopped...\n");
+                    $finish();
+                end
+            endcase
+        end
+    end
+`endif
+
+    // data address, local memory is accessed from X, everything else from W
+    wire [31:0] w_x_addr  = w_rrs1 + w_imm;
+    wire        w_x_local = (w_x_addr[31:28]==`UC_TADDR);
+
+    wire [31:0] w_wdata_t = (w_funct3[1:0]==0) ? {4{w_rrs2[ 7:0]}} :
+                            (w_funct3[1:0]==1) ? {2{w_rrs2[15:0]}} :
+                            w_rrs2;
+
+    wire  [3:0] w_we_sb = (4'b0001 << w_x_addr[1:0]);
+    wire  [3:0] w_we_sh = (4'b0011 << {w_x_addr[1], 1'b0});
+    wire  [3:0] w_we_sw = 4'b1111;
+    wire  [3:0] w_mic_lcmwe = (!(w_x_go && w_x_store && w_x_local)) ? 0 :
+                              (w_funct3[1:0]==2)                     ? w_we_sw :
+                              (w_funct3[1:0]==1)                     ? w_we_sh : w_we_sb;
+
+    /******************************************** W   *********************************************/
+    always @(posedge CLK) begin
+        if (!RST_X) begin
+            r_w_valid <= 0;
+            r_w_wait  <= 0;
+        end
+        else if (w_stall) begin
+        end
+        else if (w_w_ext_rd) begin
+            r_w_wait <= 1;
+        end
+        else begin
+            r_w_wait   <= 0;
+            r_w_valid  <= w_x_go;
+            r_w_we     <= w_x_reg_we;
+            r_w_rd     <= w_rd;
+            r_w_rslt   <= r_x_rslt;
+            r_w_late   <= w_x_load || w_x_mul;
+            r_w_load   <= w_x_load;
+            r_w_store  <= w_x_store;
+            r_w_mul    <= w_x_mul;
+            r_w_ext    <= !w_x_local;
+            r_w_addr   <= w_x_addr;
+            r_w_wdata  <= w_rrs2;
+            r_w_funct3 <= w_funct3;
+            r_w_in1    <= w_rrs1;
+            r_w_in2    <= w_rrs2;
+        end
+    end
+
+    // multiplier, operands are sign extended to 33 bits so one signed
+    // product covers MUL, MULH, MULHSU and MULHU
+    wire [31:0] w_mul_rslt;
+
+    generate
+        if (MUL != 0) begin : gen_mul
+            wire signed [32:0] w_mul_a = {(r_w_funct3[1:0]==2'b01 || r_w_funct3[1:0]==2'b10) & r_w_in1[31], r_w_in1};
+            wire signed [32:0] w_mul_b = {(r_w_funct3[1:0]==2'b01) & r_w_in2[31], r_w_in2};
+            wire signed [65:0] w_mul_p = w_mul_a * w_mul_b;
+
+            assign w_mul_rslt = (r_w_funct3[2])          ? 0 : // DIV/REM not implemented
+                                (r_w_funct3[1:0]==2'b00) ? w_mul_p[31:0] : w_mul_p[63:32];
+
+`ifdef __ICARUS__
+            always @(posedge CLK) begin
+                if (r_w_valid && r_w_mul && r_w_funct3[2]) begin
+                    $write("ILLEGAL INSTRUCTION! DIV/REM in Micro Controller\n");
+                    $finish();
+                end
+            end
+`endif
+        end
+        else begin : gen_no_mul
+            assign w_mul_rslt = 0;
+        end
+    endgenerate
+
+    // local load data
+    wire [31:0] w_odata2;
+    wire [31:0] w_odata2_t2  = w_odata2 >> {r_w_addr[1:0], 3'b0};
+
+    wire [31:0] w_odata2_lb  = {{24{w_odata2_t2[7]}}, w_odata2_t2[7:0]};
+    wire [31:0] w_odata2_lbu = {24'h0, w_odata2_t2[7:0]};
+    wire [31:0] w_odata2_lh  = {{16{w_odata2_t2[15]}}, w_odata2_t2[15:0]};
+    wire [31:0] w_odata2_lhu = {16'h0, w_odata2_t2[15:0]};
+
+    wire [31:0] w_lcm_data = (r_w_funct3[2:0]==3'b000) ? w_odata2_lb :
+                             (r_w_funct3[2:0]==3'b100) ? w_odata2_lbu:
+                             (r_w_funct3[2:0]==3'b001) ? w_odata2_lh :
+                             (r_w_funct3[2:0]==3'b101) ? w_odata2_lhu: w_odata2_t2;
+
+    // non-local loads return the whole word, like in RV32I above
+    wire [31:0] w_reg_d  = (r_w_load) ? ((r_w_ext) ? w_data : w_lcm_data) :
+                           (r_w_mul)  ? w_mul_rslt : r_w_rslt;
+    wire        w_reg_w  = r_w_valid && r_w_we && !w_w_ext_rd && !w_stall;
+
+    m_regfile regs(CLK, w_rs1, w_rs2, w_rrs1_reg, w_rrs2_reg, w_reg_w, r_w_rd, w_reg_d);
+
+    assign w_mic_addr  = r_w_addr;
+    assign w_mic_wdata = r_w_wdata;
+    assign w_mic_ctrl  = r_w_funct3;
+    assign w_mic_mmuwe = r_w_valid && r_w_store && r_w_ext;
+    assign w_mic_req   = (w_mic_mmuwe) ? `ACCESS_WRITE :
+                         (w_w_ext_rd)  ? `ACCESS_READ  : 3;
+
+    // BRAM local memory
+    m_lm_mc lm_mc
+    (
+        CLK, 
+`ifdef GW_IDE
+        clk_2x,
+`endif
+        w_mic_insn_addr[`D_UC_LM_BITS-1:2], w_ir,
+        w_mic_lcmwe, w_x_addr[`D_UC_LM_BITS-1:2], w_odata2, w_wdata_t
+    );
+
+`ifdef __ICARUS__
+    // retired instructions vs cycles, for CPI in simulation
+    reg [31:0] r_sim_cycles  = 0;
+    reg [31:0] r_sim_retired = 0;
+
+    always @(posedge CLK) begin
+        if (RST_X) begin
+            r_sim_cycles  <= r_sim_cycles + 1;
+            r_sim_retired <= r_sim_retired + (w_x_go ? 1 : 0);
+        end
+    end
+`endif
+
+endmodule
+
 // Dual ported BRAM for controller local memory, preloaded with code
 //
 
@@ -0,0 +1,14 @@
+# gnu as version of _entry.s: stack at the top of the 16KB, clear bss, run main
+	.section .text.entry,"ax",@progbits
+	.globl	_start
+_start:
+	li	sp, 0x10004000
+
+	la	t0, edata		# clear bss area
+	la	t1, end
+1:	sw	zero, 0(t0)
+	addi	t0, t0, 4
+	bltu	t0, t1, 1b
+
+	call	main
+2:	j	2b
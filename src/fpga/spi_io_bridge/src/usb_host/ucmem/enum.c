@@ -2,6 +2,7 @@
 //
 
 #include "sys.h"
+#include "log.h"
 #include "usb.h"
 
 DEV_DESC dev_desc;
@@ -14,8 +15,8 @@ void prn_all(TASK *task)
 {
     prn_dev_desc((uint8_t*) &dev_desc);
     prn_cf_full((uint8_t*) buffer);
-    printf("# of NAKs: %x\n", task->nak);
-    printf("# of TOs:  %x\n", task->tout); 
+    LOG_D(("# of NAKs: %x\n", task->nak));
+    LOG_D(("# of TOs:  %x\n", task->tout));
 }
 
 void set_driver(TASK *task, uint8_t *data);
@@ -54,7 +55,7 @@ void enum_dev(TASK *task, uint8_t *data)
     case get_dev_desc:
         if (task->req->resp != REQ_OK) break;
         task->addr = nxt_addr++;
-        printf("SET ADDR ok\n");
+        LOG_D(("SET ADDR ok\n"));
 
         setup_req(task, (SU_IN|SU_STD|SU_DEV), GET_DESC, DEV_ID<<8, 0, sizeof(DEV_DESC));
         task->setup.pData = (uint8_t *) &dev_desc;
@@ -63,7 +64,7 @@ void enum_dev(TASK *task, uint8_t *data)
     
     case get_cfg_desc:
         if (task->req->resp != REQ_OK) break;
-        printf("GET TASK DESC ok\n");
+        LOG_D(("GET TASK DESC ok\n"));
         
         setup_req(task, (SU_IN|SU_STD|SU_DEV), GET_DESC, CNF_ID<<8, 0, sizeof(CNF_DESC));
         task->setup.pData = buffer;
@@ -72,7 +73,7 @@ void enum_dev(TASK *task, uint8_t *data)
 
     case set_config:
         if (task->req->resp != REQ_OK) break;
-        printf("GET CONF DESC ok, size = %d\n", ((struct config_desc*)buffer)->wTotalLength);
+        LOG_D(("GET CONF DESC ok, size = %d\n", ((struct config_desc*)buffer)->wTotalLength));
         
         setup_req(task, (SU_OUT|SU_STD|SU_DEV), SET_CONF, 1, 0, 0);
         task->when = now_ms() + 10; // [needed ?]
@@ -81,10 +82,10 @@ void enum_dev(TASK *task, uint8_t *data)
 
     case get_full_config:
         if (task->req->resp != REQ_OK) break;
-        printf("SET CONFIG ok\n");
+        LOG_D(("SET CONFIG ok\n"));
 
         if (desc_conf->wTotalLength > sizeof(buffer)) {
-            printf("configuration too large\n");
+            LOG_E(("configuration too large\n"));
             task->state = dev_stall;
             return;
         }
@@ -95,7 +96,7 @@ void enum_dev(TASK *task, uint8_t *data)
 
     case dev_enumerated:
         if (task->req->resp != REQ_OK) break;
-        printf("GET CONF FULL ok\n");
+        LOG_D(("GET CONF FULL ok\n"));
         prn_all(task);
         set_driver(task, buffer);
         task->state = dev_init;
@@ -106,7 +107,8 @@ void enum_dev(TASK *task, uint8_t *data)
         task->when = now_ms() + 255;
         return;
     }
-    printf("Enumeration %x step failed (%x)\n", task->state, task->req->resp);
+    LOG_E(("Enumeration %x step failed (%x)\n", task->state, task->req->resp));
+    TRACE(TRACE_ENUM_FAIL, (task->state << 8) | (task->req->resp & 0xFF));
     task->state = dev_stall;
     return;
 }
@@ -3,13 +3,13 @@
 //
 
 #include "sys.h"
+#include "log.h"
 #include "usb.h"
 #include "regs.h"
 
 #define KBD          0x01
 #define MSE          0x02
 
-#define PRINT_REPORTS
 
 enum hid_state {
     hid_init, hid_mouse1, hid_mouse2, hid_keybd1, hid_keybd2, hid_idle
@@ -17,6 +17,7 @@ enum hid_state {
 
 struct hid_data {
     uint8_t flags;
+    uint8_t slot;
     uint8_t ms_ep;
     uint8_t ms_toggle;
     uint8_t ms_pkt[4];
@@ -27,16 +28,25 @@ struct hid_data {
 
 #define local ((struct hid_data *)task->data)
 
-uint32_t *hid_output = (uint32_t *)0x22000000;
+volatile uint32_t *hid_output = (volatile uint32_t *)0x22000000;
 
-static uint32_t reg_status = 0;
-static uint32_t reg_keys1 = 0;
-static uint32_t reg_keys2 = 0;
-static int32_t reg_mouse_x = 0;
-static int32_t reg_mouse_y = 0;
-static int32_t reg_mouse_wheel = 0;
+// One register set per HID device, so devices behind a hub
+// don't overwrite each other's state
+//
+struct hid_slot {
+    TASK    *owner;
+    uint32_t status;
+    uint32_t keys1;
+    uint32_t keys2;
+    int32_t  mouse_x;
+    int32_t  mouse_y;
+    int32_t  mouse_wheel;
+};
+
+static struct hid_slot slots[HID_SLOTS];
 
-static void update_hid_regs(void);
+static uint8_t alloc_hid_slot(TASK *task);
+static void update_hid_regs(uint8_t slot);
 
 // Driver for HID keyboard and mouse
 //
@@ -45,6 +55,7 @@ void drv_hid(TASK *task, uint8_t *config)
     REQ  *req;
     IFC_DESC *iface;
     EPT_DESC *ept;
+    struct hid_slot *slot;
     
     switch (task->state) {
     
@@ -52,9 +63,15 @@ void drv_hid(TASK *task, uint8_t *config)
     // a boot keyboard (3,1,1) and/or a boot mouse (3,1,2).
     //
     case hid_init:
-        printf("HID connected\n");
+        LOG_I(("HID connected\n"));
         
         task->data = malloc(sizeof(struct hid_data));
+        local->slot = alloc_hid_slot(task);
+        if (local->slot == HID_SLOT_NONE) {
+            LOG_E(("No free HID slot\n"));
+            task->state = hid_idle;
+            return;
+        }
         while (1) {
             if ((iface = find_desc(config, IFC_ID)) == NULL)
                 break;
@@ -68,17 +85,17 @@ void drv_hid(TASK *task, uint8_t *config)
                                 local->flags |= KBD;
                                 ept = find_desc(config, EPT_ID);
                                 local->kbd_ep  = ept->bEndpointAddress & 0x0f;
-                                printf("std keyboard detected (%d)\n", local->kbd_ep);
+                                LOG_I(("std keyboard detected (%d)\n", local->kbd_ep));
                                 break;
 
                     case MSE:   task->state   = hid_mouse1;
                                 local->flags |= MSE;
                                 ept = find_desc(config, EPT_ID);
                                 local->ms_ep  = ept->bEndpointAddress & 0x0f;
-                                printf("std mouse detected (%d)\n", local->ms_ep);
+                                LOG_I(("std mouse detected (%d)\n", local->ms_ep));
                                 break;
 
-                    default:    printf("HID boot device not recognised\n");
+                    default:    LOG_I(("HID boot device not recognised\n"));
                                 continue;
                     }
                 }
@@ -90,13 +107,17 @@ void drv_hid(TASK *task, uint8_t *config)
                 local->flags |= KBD;
                 ept = find_desc(config, EPT_ID);
                 local->kbd_ep  = ept->bEndpointAddress & 0x0f;
-                printf("device detected (%d)\n", local->kbd_ep);
+                LOG_I(("device detected (%d)\n", local->kbd_ep));
             }
         }
         if (local->flags == 0) {
-            printf("No boot HID device found\n");
+            LOG_I(("No boot HID device found\n"));
             task->state = hid_idle;
         }
+        slots[local->slot].status = ((local->flags & KBD) ? HID_SLOT_STATUS_KEYBOARD : 0) |
+                                    ((local->flags & MSE) ? HID_SLOT_STATUS_MOUSE : 0);
+        update_hid_regs(local->slot);
+        TRACE(TRACE_HID_CONNECT, (local->slot << 8) | local->flags);
         return;
     
     // Read the keyboard and/or mouse data, alternating between the two
@@ -110,7 +131,8 @@ void drv_hid(TASK *task, uint8_t *config)
         
     case hid_mouse2:
         if (task->req->resp == PID_STALL) {
-            printf("stalled\n");
+            LOG_E(("stalled\n"));
+            TRACE(TRACE_HID_STALL, local->slot);
             task->state = hid_idle;
             return;
         }
@@ -119,18 +141,16 @@ void drv_hid(TASK *task, uint8_t *config)
         if (task->req->resp == REQ_OK) {
             local->ms_toggle = task->req->toggle;
 
-            reg_keys1 = (reg_keys1 & 0x00FFFFFF) | (local->ms_pkt[0] << 24);
-            reg_mouse_x += (int8_t)local->ms_pkt[1];
-            reg_mouse_y += (int8_t)local->ms_pkt[2];
-            reg_mouse_wheel += (int8_t)local->ms_pkt[3];
+            slot = &slots[local->slot];
 
-            update_hid_regs();
+            slot->keys1 = (slot->keys1 & 0x00FFFFFF) | (local->ms_pkt[0] << 24);
+            slot->mouse_x += (int8_t)local->ms_pkt[1];
+            slot->mouse_y += (int8_t)local->ms_pkt[2];
+            slot->mouse_wheel += (int8_t)local->ms_pkt[3];
 
-#ifdef PRINT_REPORTS
-            printf("MOUSE: ");
-            for(int i=0; i<4; i++) printf("%x ", local->ms_pkt[i]);
-            printf("\n");
-#endif
+            update_hid_regs(local->slot);
+
+            TRACE(TRACE_HID_MOUSE, (local->slot << 8) | local->ms_pkt[0]);
         }
         return;
     
@@ -142,7 +162,8 @@ void drv_hid(TASK *task, uint8_t *config)
         
     case hid_keybd2:
         if (task->req->resp == PID_STALL) {
-            printf("stalled\n");
+            LOG_E(("stalled\n"));
+            TRACE(TRACE_HID_STALL, local->slot);
             task->state = hid_idle;
             return;
         }
@@ -151,23 +172,21 @@ void drv_hid(TASK *task, uint8_t *config)
         if (task->req->resp == REQ_OK) {
             local->kbd_toggle = task->req->toggle;
 
-            reg_keys1 = (reg_keys1 & 0xFF000000) | 
+            slot = &slots[local->slot];
+
+            slot->keys1 = (slot->keys1 & 0xFF000000) | 
                 (local->kbd_pkt[0] << 16) |
                 (local->kbd_pkt[2] << 8) |
                 local->kbd_pkt[3];
 
-            reg_keys2 = (local->kbd_pkt[4] << 24) |
+            slot->keys2 = (local->kbd_pkt[4] << 24) |
                 (local->kbd_pkt[5] << 16) |
                 (local->kbd_pkt[6] << 8) |
                 local->kbd_pkt[7];
 
-            update_hid_regs();
+            update_hid_regs(local->slot);
 
-#ifdef PRINT_REPORTS
-            printf("KEYBD: ");
-            for(int i=0; i<8; i++) printf("%x ", local->kbd_pkt[i]);
-            printf("\n");
-#endif
+            TRACE(TRACE_HID_KEYBD, (local->kbd_pkt[0] << 8) | local->kbd_pkt[2]);
         }
         return;
 
@@ -176,20 +195,48 @@ void drv_hid(TASK *task, uint8_t *config)
         return;
 
     }
-    printf("HID driver step failed (%x, %x)\n", task->state, task->req->resp);
+    LOG_E(("HID driver step failed (%x, %x)\n", task->state, task->req->resp));
+    TRACE(TRACE_HID_FAIL, (task->state << 8) | (task->req->resp & 0xFF));
     task->state = dev_stall;
     return;
 }
 
-static void update_hid_regs(void)
+// Release the slot of a disconnected device, clearing its output state
+//
+void free_hid_slot(TASK *task)
 {
-    hid_output[REG_HID_OUTPUT_STATUS] = HID_STATUS_BUSY | reg_status;
+    if (task->data == NULL || local->slot == HID_SLOT_NONE)
+        return;
 
-    hid_output[REG_HID_OUTPUT_REG_KEYS_1] = reg_keys1;
-    hid_output[REG_HID_OUTPUT_REG_KEYS_2] = reg_keys2;
-    hid_output[REG_HID_OUTPUT_MOUSE_X] = reg_mouse_x;
-    hid_output[REG_HID_OUTPUT_MOUSE_Y] = reg_mouse_y;
-    hid_output[REG_HID_OUTPUT_MOUSE_WHEEL] = reg_mouse_wheel;
+    memset(&slots[local->slot], 0, sizeof(struct hid_slot));
+    update_hid_regs(local->slot);
+    local->slot = HID_SLOT_NONE;
+}
 
-    hid_output[REG_HID_OUTPUT_STATUS] = reg_status;
-}
\ No newline at end of file
+static uint8_t alloc_hid_slot(TASK *task)
+{
+    for (int i = 0; i < HID_SLOTS; i++) {
+        if (slots[i].owner == NULL) {
+            memset(&slots[i], 0, sizeof(struct hid_slot));
+            slots[i].owner = task;
+            return i;
+        }
+    }
+    return HID_SLOT_NONE;
+}
+
+static void update_hid_regs(uint8_t slot)
+{
+    volatile uint32_t *regs = &hid_output[REG_HID_OUTPUT_SLOT(slot)];
+
+    hid_output[REG_HID_OUTPUT_STATUS] = HID_STATUS_BUSY;
+
+    regs[REG_HID_OUTPUT_SLOT_STATUS] = slots[slot].status;
+    regs[REG_HID_OUTPUT_REG_KEYS_1] = slots[slot].keys1;
+    regs[REG_HID_OUTPUT_REG_KEYS_2] = slots[slot].keys2;
+    regs[REG_HID_OUTPUT_MOUSE_X] = slots[slot].mouse_x;
+    regs[REG_HID_OUTPUT_MOUSE_Y] = slots[slot].mouse_y;
+    regs[REG_HID_OUTPUT_MOUSE_WHEEL] = slots[slot].mouse_wheel;
+
+    hid_output[REG_HID_OUTPUT_STATUS] = 0;
+}
@@ -4,9 +4,14 @@
 //
 
 #include "sys.h"
+#include "log.h"
 #include "usb.h"
 
+#ifdef __GNUC__
+#pragma pack(push, 1)
+#else
 #pragma pack on
+#endif
 struct hub_desc {
   uint8_t  bLength;
   uint8_t  bDescriptorType;
@@ -19,7 +24,11 @@ struct hub_desc {
   uint8_t  PortPwrCtrlMask;
 };
 typedef struct hub_desc HUBDESC;
+#ifdef __GNUC__
+#pragma pack(pop)
+#else
 #pragma pack off
+#endif
 
 #define HUB_ID       0x29
 #define POWER        0x08
@@ -61,7 +70,8 @@ void drv_hub(TASK *task, uint8_t *data)
     // re-using the config buffer for hub descriptor.
     //
     case hub_init:
-        printf("hub connected\n");
+        LOG_I(("hub connected\n"));
+        TRACE(TRACE_HUB_CONNECT, task->addr);
         setup_req(task, (SU_IN|SU_CLS|SU_DEV), GET_DESC, HUB_ID<<8, 0, sizeof(HUBDESC));
         task->setup.pData = data;
         task->state = build_ports;
@@ -69,7 +79,7 @@ void drv_hub(TASK *task, uint8_t *data)
         
     case build_ports:
         if (task->req->resp != REQ_OK) break;
-        printf("GET HUB DESC ok\n");
+        LOG_D(("GET HUB DESC ok\n"));
 
         hub_desc = (struct hub_desc *)task->setup.pData;
         task->data   = malloc(sizeof(struct hub_data));
@@ -108,7 +118,8 @@ void drv_hub(TASK *task, uint8_t *data)
         // check that port is still connected to the device
         //
         if ( (((status & ENABLED) == 0) && (port->prt_flags & PRT_ENABLED)) || (port->prt_flags & PRT_STALL) ) {
-            printf("port %x powered down\n", idx);
+            LOG_I(("port %x powered down\n", idx));
+            TRACE(TRACE_HUB_PORT, idx << 8);
             clr_task(port);
             port->prt_flags = HUB_PORT;
             setup_req(task, (SU_OUT|SU_CLS|SU_OTHER), CLR_FEAT, POWER, idx, 0);
@@ -139,7 +150,8 @@ void drv_hub(TASK *task, uint8_t *data)
         }
         else if (status & ENABLED) {
             if ((port->prt_flags & PRT_ENABLED) == 0) {
-                printf("port %x connected, status = %x\n", idx, status);
+                LOG_I(("port %x connected, status = %x\n", idx, status));
+                TRACE(TRACE_HUB_PORT, (idx << 8) | (status & 0xFF));
                 port->prt_flags |= (PRT_RESET|PRT_ENABLED);
                 port->prt_speed  = (status & IS_LS_DEV) ? SPEED_MM : SPEED_FS;
                 port->driver     = &enum_dev;
@@ -172,7 +184,8 @@ void drv_hub(TASK *task, uint8_t *data)
         return;
 
     }
-    printf("Hub driver step failed (%x, %x)\n", task->state, task->req->resp);
+    LOG_E(("Hub driver step failed (%x, %x)\n", task->state, task->req->resp));
+    TRACE(TRACE_HUB_FAIL, (task->state << 8) | (task->req->resp & 0xFF));
     //task->state = dev_stall;
     return;
 }
@@ -181,7 +194,7 @@ void drv_hub(TASK *task, uint8_t *data)
 //
 void free_hub_tasks(TASK *task)
 {
-    printf("hub disconnects, free tasks\n");
+    LOG_I(("hub disconnects, free tasks\n"));
     for(int i=1; i <= cnfg->nports; i++) {
         clr_task(cnfg->port[i]);
     }
@@ -2,6 +2,7 @@
 // support routines for the main code
 // - output to serial port
 // - timer
+// - binary trace ring
 // - cut-down printf routine
 // - memset
 // - malloc & free
@@ -12,7 +13,17 @@ typedef uint32_t       time_t;
 
 #define NULL    ((void*)0)
 
-uint32_t *uart = (uint32_t *)0x20000000;
+#ifdef __GNUC__
+#include <stdarg.h>
+#else
+// kencc passes all arguments on the stack, in order
+typedef char *va_list;
+#define va_start(list, last)    (list = (char*)(&(last) + 1))
+#define va_arg(list, type)      (((type*)(list += sizeof(type)))[-1])
+#define va_end(list)
+#endif
+
+volatile uint32_t *uart = (volatile uint32_t *)0x20000000;
 
 void putc(char c)
 {
@@ -43,6 +54,16 @@ time_t now_ms(void)
 	return uart[2];
 }
 
+// Trace ring: every write to 0x23000000 lands in the next ring slot,
+// the host reads the whole ring over spi. Costs one store, unlike printf.
+//
+volatile uint32_t *trace_ring = (volatile uint32_t *)0x23000000;
+
+void trace(uint8_t id, uint32_t arg)
+{
+	*trace_ring = (id << 24) | ((uart[2] & 0xFF) << 16) | (arg & 0xFFFF);
+}
+
 
 // We run on RV32I, so no hw '/' and '%' available
 //
@@ -91,33 +112,33 @@ void printn(uint32_t n, uint32_t b)
 	}
 }
 
-void printf(char *fmt, unsigned int x1)
+void printf(char *fmt, ...)
 {
 	int c;
-	unsigned int *adx;
+	va_list ap;
 	char *s;
 
-	adx = &x1;
+	va_start(ap, fmt);
 loop:
 	while((c = *fmt++) != '%') {
-		if(c == '\0')
+		if(c == '\0') {
+			va_end(ap);
 			return;
+		}
 		putc(c);
 	}
 	c = *fmt++;
 	if(c == 'd' || c == 'u' || c == 'o' || c == 'x') {
-		printn((long)*adx, c=='o'? 8: (c=='x'? 16:10));
+		printn(va_arg(ap, unsigned int), c=='o'? 8: (c=='x'? 16:10));
 	}
 	else if(c == 'c') {
-		putc(*adx);
+		putc(va_arg(ap, int));
 	}
 	else if(c == 's') {
-		s = *(char **)adx;
-		adx++;
+		s = va_arg(ap, char *);
 		while(c = *s++)
 			putc(c);
 	}
-	adx++;
 	goto loop;
 }
 
@@ -173,7 +194,7 @@ void* malloc(uint32_t nbytes)
             return (void*)(p+1);
         }
         if(p == freep) {
-            printf("panic: NULL malloc\n", 0);
+            printf("panic: NULL malloc\n");
             return NULL;
         }
     }
@@ -0,0 +1,58 @@
+// Compile time logging and binary tracing.
+//
+// Pick one log level, messages above it are compiled out:
+//   LOG_LEVEL_ERROR - failures only
+//   LOG_LEVEL_INFO  - plus connect/disconnect and device detection
+//   LOG_LEVEL_DEBUG - plus enumeration steps and descriptor dumps
+// printf over the UART stalls the event loop, so keep per-report
+// diagnostics in the trace ring instead.
+//
+#define LOG_LEVEL_INFO
+#define TRACE_ENABLE
+
+#ifdef LOG_LEVEL_DEBUG
+#define LOG_LEVEL_INFO
+#endif
+#ifdef LOG_LEVEL_INFO
+#define LOG_LEVEL_ERROR
+#endif
+
+// usage: LOG_I(("fmt %x\n", value));
+#ifdef LOG_LEVEL_ERROR
+#define LOG_E(args)     printf args
+#else
+#define LOG_E(args)
+#endif
+
+#ifdef LOG_LEVEL_INFO
+#define LOG_I(args)     printf args
+#else
+#define LOG_I(args)
+#endif
+
+#ifdef LOG_LEVEL_DEBUG
+#define LOG_D(args)     printf args
+#else
+#define LOG_D(args)
+#define NOPRINT
+#endif
+
+// Trace ring entry: event << 24 | (ms & 0xff) << 16 | arg
+//
+#ifdef TRACE_ENABLE
+#define TRACE(id, arg)  trace((id), (arg))
+#else
+#define TRACE(id, arg)
+#endif
+
+#define TRACE_DEV_CONNECT       0x01    // arg = speed
+#define TRACE_DEV_DISCONNECT    0x02    // arg = address
+#define TRACE_ENUM_FAIL         0x03    // arg = state << 8 | resp
+#define TRACE_HID_CONNECT       0x10    // arg = slot << 8 | flags
+#define TRACE_HID_STALL         0x11    // arg = slot
+#define TRACE_HID_FAIL          0x12    // arg = state << 8 | resp
+#define TRACE_HID_MOUSE         0x13    // arg = slot << 8 | buttons
+#define TRACE_HID_KEYBD         0x14    // arg = modifiers << 8 | first key
+#define TRACE_HUB_CONNECT       0x20    // arg = address
+#define TRACE_HUB_PORT          0x21    // arg = port << 8 | status
+#define TRACE_HUB_FAIL          0x22    // arg = state << 8 | resp
@@ -1,19 +1,31 @@
 #!/bin/sh
+# builds mem.hex with kencc from setup.sh, or with a gnu rv32i toolchain when CC is set:
+#   CC=riscv64-unknown-elf-gcc ./make.sh
 
+mkdir -p build
 cd build
 
+SOURCES="../task.c ../req.c ../enum.c ../hub.c ../hid.c ../prnt.c ../lib.c"
+
+if [ -z "$CC" ]; then
+
 ./riscv-kencc/host/bin/ia ../_entry.s
-./riscv-kencc/host/bin/ic ../task.c
-./riscv-kencc/host/bin/ic ../req.c
-./riscv-kencc/host/bin/ic ../enum.c
-./riscv-kencc/host/bin/ic ../hub.c
-./riscv-kencc/host/bin/ic ../hid.c
-./riscv-kencc/host/bin/ic ../prnt.c
-./riscv-kencc/host/bin/ic ../lib.c
+for src in $SOURCES; do
+    ./riscv-kencc/host/bin/ic $src
+done
 ./riscv-kencc/host/bin/il -H1 -l -T0x10000000 -c -t -a *.i >test.txt
 ./riscv-kencc/host/bin/il -H1 -l -T0x10000000 -c -t    *.i
 rm *.i
 
+else
+
+# rv32i has no mul/div, libgcc brings __mulsi3. struct copies and clears must not turn into memcpy/memset calls
+$CC -march=rv32i -mabi=ilp32 -Os -ffreestanding -fno-builtin -fno-tree-loop-distribute-patterns -nostdlib \
+    -Wl,-T,../link.ld -Wl,--no-relax -o i.elf ../_entry_gnu.s $SOURCES -lgcc || exit 1
+${OBJCOPY:-${CC%gcc}objcopy} -O binary i.elf i.out || exit 1
+
+fi
+
 #cp mem.hex old.hex
 hexdump -e '1/4 "%08x\n"' -v i.out >mem.tmp
 cat mem.tmp ../zero.hex | head -n 4096 >../mem.hex
@@ -21,4 +33,3 @@ rm mem.tmp
 
 #ecpbram -i ../sys.cfg -o sys.cfg -f old.hex -t mem.hex
 #ecppack sys.cfg ../sys.bit
-
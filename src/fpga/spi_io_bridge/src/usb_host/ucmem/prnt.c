@@ -1,4 +1,5 @@
 #include "sys.h"
+#include "log.h"
 #include "usb.h"
 
 #ifndef NOPRINT
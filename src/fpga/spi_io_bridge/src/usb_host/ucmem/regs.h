@@ -56,8 +56,17 @@
 #define SIE_IDLE    0x10000000
 
 // HID output register numbers
+// page 0 (words 0x00-0x0F) holds the global status, pages 1..HID_SLOTS hold
+// one register set per connected HID device
 
-#define REG_HID_OUTPUT_STATUS       0x00
+#define HID_SLOTS                   4
+#define HID_SLOT_NONE               0xFF
+
+#define REG_HID_OUTPUT_STATUS       0x00 // global, bit 31 = busy
+
+#define REG_HID_OUTPUT_SLOT(n)      (((n) + 1) << 4)
+
+#define REG_HID_OUTPUT_SLOT_STATUS  0x00 // bit 0 = keyboard, bit 1 = mouse
 #define REG_HID_OUTPUT_REG_KEYS_1   0x01 // 0xMSKBKBKB
 #define REG_HID_OUTPUT_REG_KEYS_2   0x02 // 0xKBKBKBKB
 #define REG_HID_OUTPUT_MOUSE_X      0x03 //int32_t integral x
@@ -65,3 +74,6 @@
 #define REG_HID_OUTPUT_MOUSE_WHEEL  0x05 //int32_t integral wheel
 
 #define HID_STATUS_BUSY 0x80000000
+
+#define HID_SLOT_STATUS_KEYBOARD    0x01
+#define HID_SLOT_STATUS_MOUSE       0x02
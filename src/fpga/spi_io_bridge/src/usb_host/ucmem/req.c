@@ -2,10 +2,11 @@
 //
 
 #include "sys.h"
+#include "log.h"
 #include "regs.h"
 #include "usb.h"
 
-extern uint32_t *usbh;
+extern volatile uint32_t *usbh;
 
 static int out_txn(REQ *req, int want_hs)
 {
@@ -189,7 +190,7 @@ void do_request_step(REQ *req)
         return;
 
     default:
-        printf("s=%x\n", req->state);
+        LOG_E(("s=%x\n", req->state));
     }    
 }
 
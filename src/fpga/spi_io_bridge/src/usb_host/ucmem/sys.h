@@ -92,6 +92,7 @@ int    is_sim(void);
 time_t now_ms(void);
 void   wait_ms(time_t);
 void   printf(char *fmt, ...);
+void   trace(uint8_t id, uint32_t arg);
 void*  malloc(uint32_t nbytes);
 void   free(void* ap);
 void   memset(void *dest, uint8_t val, uint32_t len);
@@ -114,3 +115,4 @@ void   drv_hub(TASK *task, uint8_t *data);
 void   free_hub_tasks(TASK *task);
 // hid.c
 void   drv_hid(TASK *task, uint8_t *data);
+void   free_hid_slot(TASK *task);
@@ -3,10 +3,11 @@
 //
 
 #include "sys.h"
+#include "log.h"
 #include "regs.h"
 #include "usb.h"
 
-uint32_t *usbh = (uint32_t *)0x21000000;
+volatile uint32_t *usbh = (volatile uint32_t *)0x21000000;
 int sim;
 
 // Put the root port into reset mode
@@ -48,7 +49,7 @@ TASK *new_task(void)
         if ( (tasks[i].prt_flags & (ROOT_PORT|HUB_PORT)) == 0)
             return &tasks[i];
     }
-    printf("panic: out of tasks\n");
+    LOG_E(("panic: out of tasks\n"));
     return NULL;
 }
 
@@ -58,6 +59,8 @@ TASK *clr_task(TASK *task)
 
     if (task->driver == &drv_hub)
         free_hub_tasks(task);
+    if (task->driver == &drv_hid)
+        free_hid_slot(task);
     if (task->data)
         free(task->data);
     memset(task, 0, sizeof(TASK));
@@ -80,7 +83,8 @@ static void check_root(TASK *task)
     if ((usbh[REG_STAT] & STAT_DETECT) == 0) {
         if (!donotspam)
         {
-            printf("device disconnected, task addr = %d\n", task->addr);
+            LOG_I(("device disconnected, task addr = %d\n", task->addr));
+            TRACE(TRACE_DEV_DISCONNECT, task->addr);
             donotspam = 1;
         }
 
@@ -100,7 +104,8 @@ static void check_root(TASK *task)
         while ((usbh[REG_STAT] & STAT_DETECT) == 0) ;
         task->prt_speed  = (usbh[REG_STAT] & STAT_DP) ? SPEED_FS : SPEED_LS;
         task->prt_flags |= PRT_CONNECT;
-        printf("device connect, speed = %x\n", task->prt_speed);
+        LOG_I(("device connect, speed = %x\n", task->prt_speed));
+        TRACE(TRACE_DEV_CONNECT, task->prt_speed);
         wait_ms(20);
     }
     
@@ -128,7 +133,7 @@ void main()
 {
     TASK *root, *task;
 
-    printf("start %x\n", end - 0x10000000); // keep an eye on code/data size
+    LOG_I(("start %x\n", end - 0x10000000)); // keep an eye on code/data size
     sim = is_sim();
 
     // Initialise the 'tasks' table and set up root task
@@ -0,0 +1,2 @@
+// host build of the esp32 driver sources
+#define IRAM_ATTR
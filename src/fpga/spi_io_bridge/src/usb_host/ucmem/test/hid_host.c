@@ -0,0 +1,130 @@
+// Host side of the hid test: runs drv_hid against stubbed registers and
+// request functions. Built with the firmware headers, so no libc headers
+// here (sys.h brings its own types).
+//
+
+#include "../sys.h"
+#include "../log.h"
+#include "../usb.h"
+#include "../regs.h"
+
+extern volatile uint32_t *hid_output;
+void  drv_hid(TASK *task, uint8_t *config);
+void  free_hid_slot(TASK *task);
+void  set_driver(TASK *task, uint8_t *data);
+void *calloc(unsigned long n, unsigned long size);
+
+enum { hid_init, hid_mouse1, hid_mouse2, hid_keybd1, hid_keybd2, hid_idle };
+
+uint32_t  fw_regs[(HID_SLOTS + 1) << 4];
+uint32_t  fw_trace[64];
+int       fw_trace_count;
+uint32_t  fw_ms;
+int       fw_printf_count;
+
+static TASK     tasks[8];
+static REQ      requests[8];
+static uint8_t *data_buf;
+static uint16_t data_len;
+
+// firmware runtime, lib.c and req.c stand-ins
+//
+time_t now_ms(void)                 { return fw_ms; }
+void   wait_ms(time_t ms)           { fw_ms += ms; }
+void   printf(char *fmt, ...)       { fw_printf_count++; }
+void   free(void *ap)               { }
+void  *malloc(uint32_t nbytes)      { return calloc(1, nbytes); }
+
+void memset(void *dest, uint8_t val, uint32_t len)
+{
+    uint8_t *ptr = dest;
+
+    while (len-- > 0)
+        *ptr++ = val;
+}
+
+// same entry format as lib.c writes to the trace ring
+//
+void trace(uint8_t id, uint32_t arg)
+{
+    if (fw_trace_count < 64)
+        fw_trace[fw_trace_count++] = (id << 24) | ((fw_ms & 0xFF) << 16) | (arg & 0xFFFF);
+}
+
+void data_req(TASK *task, uint8_t ep, uint8_t dir, uint8_t *data, uint16_t len)
+{
+    task->req->ep    = ep;
+    task->req->state = (dir == IN) ? rq_in : rq_out;
+    data_buf = data;
+    data_len = len;
+}
+
+void setup_req(TASK *task, uint8_t typ, uint8_t req, uint16_t val, uint16_t idx, uint16_t len) { }
+void drv_hub(TASK *task, uint8_t *data) { }
+
+// Connect device 'dev' with the given full configuration, as enum_dev does
+// once enumeration finished. Returns the driver state after init.
+//
+int fw_connect(int dev, uint8_t *config)
+{
+    TASK *task = &tasks[dev];
+
+    memset(task, 0, sizeof(TASK));
+    memset(&requests[dev], 0, sizeof(REQ));
+    task->req = &requests[dev];
+    requests[dev].task = task;
+    task->addr = dev + 1;
+
+    set_driver(task, config);
+    if (task->driver != drv_hid)
+        return -1;
+    task->state = dev_init;
+    (*task->driver)(task, config);
+    return task->state;
+}
+
+// Run one poll of the interrupt endpoint with 'report' as device answer,
+// 'report' NULL makes the device NAK
+//
+static int fw_poll(int dev, int state, uint8_t *report, int len)
+{
+    TASK *task = &tasks[dev];
+    int   i;
+
+    task->state = state;
+    drv_hid(task, NULL);
+    if (data_len != len)
+        return -1;
+    if (report) {
+        for (i = 0; i < len; i++)
+            data_buf[i] = report[i];
+        task->req->resp   = REQ_OK;
+        task->req->toggle = 1 - task->req->toggle;
+    } else
+        task->req->resp = PID_NAK;
+    task->req->state = rq_idle;
+    drv_hid(task, NULL);
+    return task->state;
+}
+
+int fw_keyboard_report(int dev, uint8_t *report)
+{
+    return fw_poll(dev, hid_keybd1, report, 8);
+}
+
+int fw_mouse_report(int dev, uint8_t *report)
+{
+    return fw_poll(dev, hid_mouse1, report, 4);
+}
+
+// Unplug: clr_task releases the slot of a hid device
+//
+void fw_disconnect(int dev)
+{
+    free_hid_slot(&tasks[dev]);
+}
+
+void fw_init(void)
+{
+    hid_output = fw_regs;
+}
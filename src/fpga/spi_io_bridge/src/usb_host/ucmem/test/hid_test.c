@@ -0,0 +1,233 @@
+// Host test of the hid driver: drv_hid writes the slot pages, spi_io.sv
+// packs them into the per slot status, fpga_driver merges all slots into
+// one n-key rollover keyboard and one mouse. printf is the firmware stub
+// in this program, so results go through fprintf.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include "fpga_driver.h"
+#include "../regs.h"
+#include "../log.h"
+
+#define SLOTS           HID_SLOTS
+#define STATUS_BYTES    (6*4)
+
+// hid.c states the driver waits in between reports
+#define HID_MOUSE1      1
+#define HID_KEYBD1      3
+#define HID_IDLE        5
+
+extern uint32_t fw_regs[(SLOTS + 1) << 4];
+extern uint32_t fw_trace[64];
+extern int      fw_trace_count;
+extern int      fw_printf_count;
+
+void fw_init(void);
+int  fw_connect(int dev, uint8_t *config);
+int  fw_keyboard_report(int dev, uint8_t *report);
+int  fw_mouse_report(int dev, uint8_t *report);
+void fw_disconnect(int dev);
+
+static uint8_t cfg_kbd[] = {
+    9, 2, 34, 0, 1, 1, 0, 0xa0, 50,
+    9, 4, 0, 0, 1, 3, 1, 1, 0,
+    9, 0x21, 0x11, 1, 0, 1, 0x22, 63, 0,
+    7, 5, 0x81, 3, 8, 0, 10,
+};
+
+static uint8_t cfg_mse[] = {
+    9, 2, 34, 0, 1, 1, 0, 0xa0, 50,
+    9, 4, 0, 0, 1, 3, 1, 2, 0,
+    9, 0x21, 0x11, 1, 0, 1, 0x22, 50, 0,
+    7, 5, 0x83, 3, 4, 0, 10,
+};
+
+static uint8_t cfg_combo[] = {
+    9, 2, 59, 0, 2, 1, 0, 0xa0, 50,
+    9, 4, 0, 0, 1, 3, 1, 1, 0,
+    9, 0x21, 0x11, 1, 0, 1, 0x22, 63, 0,
+    7, 5, 0x81, 3, 8, 0, 10,
+    9, 4, 1, 0, 1, 3, 1, 2, 0,
+    9, 0x21, 0x11, 1, 0, 1, 0x22, 50, 0,
+    7, 5, 0x82, 3, 4, 0, 10,
+};
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { fprintf(stdout, "%s:%d: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+static bool traced(uint8_t id, uint16_t arg)
+{
+    for (int i = 0; i < fw_trace_count; ++i)
+        if (fw_trace[i] >> 24 == id && (fw_trace[i] & 0xFFFF) == arg)
+            return true;
+
+    return false;
+}
+
+static uint32_t page(int slot, int reg)
+{
+    return fw_regs[((slot + 1) << 4) + reg];
+}
+
+static void put32(uint8_t *dst, uint32_t value)
+{
+    dst[0] = value >> 24;
+    dst[1] = value >> 16;
+    dst[2] = value >> 8;
+    dst[3] = value;
+}
+
+// what COMMAND_USB_HID_GET_DEVICE_STATUS returns for every slot, see spi_io.sv
+//
+static void spi_io_status(uint8_t *status)
+{
+    uint8_t keyboards = 0, mice = 0;
+
+    for (int slot = 0; slot < SLOTS; ++slot)
+    {
+        keyboards |= (page(slot, 0) & 1) << slot;
+        mice |= ((page(slot, 0) >> 1) & 1) << slot;
+    }
+
+    for (int slot = 0; slot < SLOTS; ++slot, status += STATUS_BYTES)
+    {
+        put32(status, 0xAB << 24 | keyboards << 16 | mice << 8 | slot);
+        put32(status + 4, page(slot, 1));
+        put32(status + 8, page(slot, 2));
+        put32(status + 12, page(slot, 3));
+        put32(status + 16, page(slot, 4));
+        put32(status + 20, page(slot, 5));
+    }
+}
+
+// same loop as the fpga_driver main task
+//
+static void merge(fpga_driver_hid_merge_t *state, fpga_driver_hid_status_t *merged)
+{
+    uint8_t status[SLOTS*STATUS_BYTES];
+
+    spi_io_status(status);
+    memset(merged, 0, sizeof(*merged));
+
+    uint8_t deviceMask = status[1] | status[2];
+
+    for (int slot = 0; slot < FPGA_DRIVER_HID_MAX_DEVICES; ++slot)
+        fpga_driver_hid_merge_device(state, merged, slot, status + slot * STATUS_BYTES, deviceMask & (1 << slot));
+
+    merged->mouseX = state->mouseX;
+    merged->mouseY = state->mouseY;
+    merged->mouseWheel = state->mouseWheel;
+}
+
+static int key_count(const fpga_driver_hid_status_t *merged)
+{
+    int count = 0;
+
+    for (int i = 0; i < FPGA_DRIVER_HID_MAX_KEYS; ++i)
+        count += merged->keyboardKeys[i] != 0;
+
+    return count;
+}
+
+static bool has_key(const fpga_driver_hid_status_t *merged, uint8_t key)
+{
+    for (int i = 0; i < FPGA_DRIVER_HID_MAX_KEYS; ++i)
+        if (merged->keyboardKeys[i] == key)
+            return true;
+
+    return false;
+}
+
+int main(void)
+{
+    fpga_driver_hid_merge_t state = { 0 };
+    fpga_driver_hid_status_t merged;
+
+    fw_init();
+
+    // a keyboard, a keyboard with a trackpad and a mouse get one slot each
+
+    CHECK(fw_connect(0, cfg_kbd) == HID_KEYBD1);
+    CHECK(fw_connect(1, cfg_combo) == HID_MOUSE1);
+    CHECK(fw_connect(2, cfg_mse) == HID_MOUSE1);
+
+    CHECK(page(0, 0) == HID_SLOT_STATUS_KEYBOARD);
+    CHECK(page(1, 0) == (HID_SLOT_STATUS_KEYBOARD | HID_SLOT_STATUS_MOUSE));
+    CHECK(page(2, 0) == HID_SLOT_STATUS_MOUSE);
+    CHECK(page(3, 0) == 0);
+    CHECK(traced(TRACE_HID_CONNECT, 0x0001) && traced(TRACE_HID_CONNECT, 0x0103) && traced(TRACE_HID_CONNECT, 0x0202));
+
+    merge(&state, &merged);
+    CHECK(merged.keyboardCount == 2 && merged.mouseCount == 2);
+    CHECK(key_count(&merged) == 0 && merged.mouseX == 0);
+
+    int connectPrintfs = fw_printf_count;
+
+    // reports land in the page of their device only
+
+    CHECK(fw_keyboard_report(0, (uint8_t[]) { 0x02, 0, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09 }) == HID_KEYBD1);
+    CHECK(fw_keyboard_report(1, (uint8_t[]) { 0x10, 0, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D }) == HID_MOUSE1);
+    CHECK(fw_mouse_report(1, (uint8_t[]) { 0x01, 5, (uint8_t)-3, 1 }) == HID_KEYBD1);
+    CHECK(fw_mouse_report(2, (uint8_t[]) { 0x02, (uint8_t)-10, 4, 0 }) == HID_MOUSE1);
+    CHECK(fw_mouse_report(2, NULL) == HID_MOUSE1);
+
+    CHECK(page(0, 1) == 0x00020405 && page(0, 2) == 0x06070809);
+    CHECK(page(1, 1) == 0x01100809 && page(1, 2) == 0x0A0B0C0D);
+    CHECK((int32_t)page(1, 3) == 5 && (int32_t)page(1, 4) == -3 && (int32_t)page(1, 5) == 1);
+    CHECK(page(2, 1) == 0x02000000 && page(2, 2) == 0);
+    CHECK((int32_t)page(2, 3) == -10 && (int32_t)page(2, 4) == 4 && (int32_t)page(2, 5) == 0);
+    CHECK(page(0, 3) == 0 && page(0, 4) == 0);
+    CHECK((fw_regs[0] & HID_STATUS_BUSY) == 0);
+
+    // reports go to the trace ring, the uart stays quiet while devices are polled
+
+    CHECK(traced(TRACE_HID_KEYBD, 0x0204) && traced(TRACE_HID_KEYBD, 0x1008));
+    CHECK(traced(TRACE_HID_MOUSE, 0x0101) && traced(TRACE_HID_MOUSE, 0x0202));
+    CHECK(fw_printf_count == connectPrintfs);
+
+    // n-key rollover: 12 keys from two keyboards, 2 shared, merged without duplicates
+
+    merge(&state, &merged);
+    CHECK(merged.keyboardModifiers == 0x12);
+    CHECK(key_count(&merged) == 10);
+    for (uint8_t key = 0x04; key <= 0x0D; ++key)
+        CHECK(has_key(&merged, key));
+    CHECK(merged.mouseKeys == 0x03);
+    CHECK(merged.mouseX == -5 && merged.mouseY == 1 && merged.mouseWheel == 1);
+
+    // rollover error of one keyboard keeps its last valid keys
+
+    CHECK(fw_keyboard_report(0, (uint8_t[]) { 0x02, 0, 0x01, 0x01, 0x01, 0x01, 0x01, 0x01 }) == HID_KEYBD1);
+    merge(&state, &merged);
+    CHECK(key_count(&merged) == 10 && has_key(&merged, 0x04));
+
+    // unplugging clears the page, the cursor does not jump
+
+    fw_disconnect(1);
+    CHECK(page(1, 0) == 0 && page(1, 1) == 0 && page(1, 3) == 0);
+    merge(&state, &merged);
+    CHECK(merged.keyboardCount == 1 && merged.mouseCount == 1);
+    CHECK(key_count(&merged) == 6 && !has_key(&merged, 0x0A));
+    CHECK(merged.mouseX == -5 && merged.mouseY == 1);
+
+    CHECK(fw_mouse_report(2, (uint8_t[]) { 0x00, 3, 0, (uint8_t)-1 }) == HID_MOUSE1);
+    merge(&state, &merged);
+    CHECK(merged.mouseX == -2 && merged.mouseWheel == 0 && merged.mouseKeys == 0);
+
+    // the free slot is reused, a fifth device finds none
+
+    CHECK(fw_connect(1, cfg_mse) == HID_MOUSE1);
+    CHECK(page(1, 0) == HID_SLOT_STATUS_MOUSE);
+    CHECK(fw_connect(3, cfg_kbd) == HID_KEYBD1);
+    CHECK(page(3, 0) == HID_SLOT_STATUS_KEYBOARD);
+    CHECK(fw_connect(4, cfg_kbd) == HID_IDLE);
+
+    merge(&state, &merged);
+    CHECK(merged.keyboardCount == 2 && merged.mouseCount == 2);
+    CHECK(merged.mouseX == -2);
+
+    fprintf(stdout, "%s: %d failures\n", failures ? "FAIL" : "OK", failures);
+    return failures ? 1 : 0;
+}
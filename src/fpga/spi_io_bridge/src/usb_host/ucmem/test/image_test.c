@@ -0,0 +1,540 @@
+// Runs the built image, ../mem.hex, on an RV32I instruction set simulator
+// with the uart/timer, the usb11 SIE at transaction level and the hid output
+// pages. Two setups: a combo keyboard/mouse on the root port, and a 2 port
+// hub with a keyboard and a mouse behind it. Checks the uart lines, which
+// need printf to find its arguments, the enumeration, which needs the packed
+// descriptor structs, and the slot pages after a few scripted reports.
+//
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../regs.h"
+
+#define MEM_WORDS       4096
+#define MEM_BASE        0x10000000
+#define INSTRUCTIONS    8000000
+#define INSTR_PER_MS    2000
+
+static int failures;
+
+#define CHECK(cond) do { if (!(cond)) { fprintf(stdout, "%s:%d: %s\n", __FILE__, __LINE__, #cond); ++failures; } } while (0)
+
+// usb devices
+//
+
+static const uint8_t dev_desc[18] = { 18, 1, 0x10, 1, 0, 0, 0, 8, 0x34, 0x12, 0x78, 0x56, 1, 0, 0, 0, 0, 1 };
+static const uint8_t hub_dev_desc[18] = { 18, 1, 0x10, 1, 9, 0, 0, 8, 0x34, 0x12, 0x79, 0x56, 1, 0, 0, 0, 0, 1 };
+
+static const uint8_t cfg_combo[] = {
+    9, 2, 59, 0, 2, 1, 0, 0xa0, 50,
+    9, 4, 0, 0, 1, 3, 1, 1, 0,
+    9, 0x21, 0x11, 1, 0, 1, 0x22, 63, 0,
+    7, 5, 0x81, 3, 8, 0, 10,
+    9, 4, 1, 0, 1, 3, 1, 2, 0,
+    9, 0x21, 0x11, 1, 0, 1, 0x22, 50, 0,
+    7, 5, 0x82, 3, 4, 0, 10,
+};
+
+static const uint8_t cfg_kbd[] = {
+    9, 2, 34, 0, 1, 1, 0, 0xa0, 50,
+    9, 4, 0, 0, 1, 3, 1, 1, 0,
+    9, 0x21, 0x11, 1, 0, 1, 0x22, 63, 0,
+    7, 5, 0x81, 3, 8, 0, 10,
+};
+
+static const uint8_t cfg_mse[] = {
+    9, 2, 34, 0, 1, 1, 0, 0xa0, 50,
+    9, 4, 0, 0, 1, 3, 1, 2, 0,
+    9, 0x21, 0x11, 1, 0, 1, 0x22, 50, 0,
+    7, 5, 0x82, 3, 4, 0, 10,
+};
+
+static const uint8_t cfg_hub[] = {
+    9, 2, 25, 0, 1, 1, 0, 0xe0, 0,
+    9, 4, 0, 0, 1, 9, 0, 0, 0,
+    7, 5, 0x81, 3, 1, 0, 12,
+};
+
+static const uint8_t hub_desc[9] = { 9, 0x29, 2, 0, 0, 50, 0, 0, 0xff };
+
+typedef struct
+{
+    int present, addr, pending_addr, configured, is_hub;
+    const uint8_t *dev_desc, *cfg_desc;
+    int cfg_len;
+    const uint8_t *ctl_data;
+    int ctl_len, ctl_pos;
+    int toggle[16];
+    uint8_t port_status[4];
+} device_t;
+
+// reports on endpoint 1 (keyboard) and 2 (mouse), each sent once it is due
+typedef struct
+{
+    uint32_t ms;
+    int ep;
+    uint8_t data[8];
+} report_t;
+
+static const report_t reports[] = {
+    { 1600, 1, { 0x02, 0, 0x04, 0, 0, 0, 0, 0 } },                 // shift + a
+    { 1620, 2, { 0x01, 5, (uint8_t)-3, 1 } },                      // left button, dx 5 dy -3 wheel 1
+    { 1640, 1, { 0x02, 0, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09 } },  // 6 keys
+    { 1660, 2, { 0x00, (uint8_t)-7, 2, 0 } },
+    { 1680, 2, { 0x00, 1, 1, (uint8_t)-2 } },
+};
+
+#define REPORTS ((int)(sizeof(reports) / sizeof(reports[0])))
+
+// simulator state
+//
+
+static uint32_t mem[MEM_WORDS];
+static uint32_t x[32], pc;
+static uint64_t icount;
+static int fault;
+
+static device_t devs[3];        // root port, hub ports 1 and 2
+static uint32_t hub_port[3];
+static uint8_t tx_fifo[64], rx_fifo[64];
+static int tx_count, rx_count, rx_pos;
+static uint32_t rx_status, token_reg, ctrl_reg;
+static int report_next[3];
+
+static uint32_t hid_page[(HID_SLOTS + 1) << 4];
+static int trace_count;
+static char uart_out[4096];
+static int uart_len;
+
+static uint32_t now_ms(void)
+{
+    return (uint32_t)(icount / INSTR_PER_MS);
+}
+
+static device_t *find_device(int addr)
+{
+    for (int i = 0; i < 3; i++)
+        if (devs[i].present && devs[i].addr == addr)
+            return &devs[i];
+
+    return NULL;
+}
+
+static void hub_port_feature(int set, int feature, int port)
+{
+    if (port < 1 || port > 2)
+        return;
+
+    if (feature == 8) // power, a device is attached to each port
+        hub_port[port] = set ? 0x101 : 0;
+    else if (feature == 4 && set) // reset
+    {
+        hub_port[port] |= 0x100000 | 0x2;
+        devs[port].present = 1;
+        devs[port].addr = 0;
+        devs[port].configured = 0;
+        memset(devs[port].toggle, 0, sizeof(devs[port].toggle));
+    }
+}
+
+static void setup_token(device_t *d)
+{
+    uint8_t *s = tx_fifo;
+    int len = s[6] | s[7] << 8, value = s[2] | s[3] << 8, index = s[4] | s[5] << 8;
+
+    tx_count = 0;
+    d->toggle[0] = 1;
+    d->ctl_data = NULL;
+    d->ctl_len = d->ctl_pos = 0;
+
+    if (s[0] == 0x00 && s[1] == 5) // set address, takes effect after the status stage
+        d->pending_addr = value;
+    else if (s[0] == 0x00 && s[1] == 9)
+        d->configured = value;
+    else if (s[0] == 0x80 && s[1] == 6 && (value >> 8) == 1)
+        d->ctl_data = d->dev_desc, d->ctl_len = 18;
+    else if (s[0] == 0x80 && s[1] == 6 && (value >> 8) == 2)
+        d->ctl_data = d->cfg_desc, d->ctl_len = d->cfg_len;
+    else if (d->is_hub && s[0] == 0xa0 && s[1] == 6 && (value >> 8) == 0x29)
+        d->ctl_data = hub_desc, d->ctl_len = sizeof(hub_desc);
+    else if (d->is_hub && s[0] == 0xa3 && s[1] == 0)
+    {
+        uint32_t status = index >= 1 && index <= 2 ? hub_port[index] : 0;
+
+        for (int i = 0; i < 4; i++)
+            d->port_status[i] = status >> (8 * i);
+
+        d->ctl_data = d->port_status, d->ctl_len = 4;
+    }
+    else if (d->is_hub && s[0] == 0x23 && (s[1] == 3 || s[1] == 1))
+        hub_port_feature(s[1] == 3, value, index);
+    else
+    {
+        rx_status |= 0x1e << 16; // stall
+        return;
+    }
+
+    if (d->ctl_len > len)
+        d->ctl_len = len;
+
+    rx_status |= 0xd2 << 16; // ack
+}
+
+static void in_token(device_t *d, int ep)
+{
+    if (ep == 0)
+    {
+        int n = d->ctl_data ? d->ctl_len - d->ctl_pos : 0;
+
+        if (n > 8)
+            n = 8;
+
+        memcpy(rx_fifo, d->ctl_data + d->ctl_pos, n);
+        d->ctl_pos += n;
+        rx_count = n;
+        rx_status |= (d->toggle[0] ? 0x4b : 0xc3) << 16 | n;
+        d->toggle[0] ^= 1;
+
+        if (d->ctl_data == NULL && d->pending_addr >= 0)
+        {
+            d->addr = d->pending_addr;
+            d->pending_addr = -1;
+        }
+        return;
+    }
+
+    if (d->configured && !d->is_hub && ep <= 2)
+        for (int i = report_next[ep]; i < REPORTS && reports[i].ms <= now_ms(); i++)
+        {
+            if (reports[i].ep != ep)
+                continue;
+
+            int n = ep == 1 ? 8 : 4;
+
+            memcpy(rx_fifo, reports[i].data, n);
+            rx_count = n;
+            rx_status |= (d->toggle[ep] ? 0x4b : 0xc3) << 16 | n;
+            d->toggle[ep] ^= 1;
+            report_next[ep] = i + 1;
+            return;
+        }
+
+    rx_status |= 0x5a << 16; // nak
+}
+
+static void start_token(uint32_t token)
+{
+    int pid = (token >> 16) & 0xff, addr = (token >> 9) & 0x7f, ep = (token >> 5) & 0xf;
+    device_t *d = find_device(addr);
+
+    rx_count = rx_pos = 0;
+    rx_status = SIE_IDLE;
+
+    if (d == NULL)
+    {
+        rx_status |= RX_TIMEOUT;
+        tx_count = 0;
+    }
+    else if (pid == 0x2d)
+        setup_token(d);
+    else if (pid == 0xe1)
+    {
+        tx_count = 0;
+        rx_status |= (ep == 0 ? 0xd2 : 0x1e) << 16;
+    }
+    else if (pid == 0x69)
+        in_token(d, ep);
+    else
+        rx_status |= RX_TIMEOUT;
+}
+
+static uint32_t mmio_read(uint32_t addr)
+{
+    uint32_t dev = addr >> 24, r = (addr & 0xffffff) >> 2;
+
+    if (dev == 0x20) // uart: tx ready, timer
+        return r == 1 ? 1 : r == 2 ? now_ms() : 0;
+
+    if (dev == 0x21)
+        switch (r)
+        {
+            case REG_CTRL: return ctrl_reg;
+            case REG_STAT: return STAT_DETECT | STAT_DP; // full speed device attached
+            case REG_TOKEN: return token_reg & ~TKN_START;
+            case REG_RXSTS: return rx_status;
+            case REG_DATA: return rx_pos < rx_count ? rx_fifo[rx_pos++] : 0;
+        }
+
+    if (dev == 0x22 && r < sizeof(hid_page) / 4)
+        return hid_page[r];
+
+    return 0;
+}
+
+static void mmio_write(uint32_t addr, uint32_t value)
+{
+    uint32_t dev = addr >> 24, r = (addr & 0xffffff) >> 2;
+
+    if (dev == 0x20 && r == 0)
+    {
+        if (uart_len < (int)sizeof(uart_out) - 1)
+            uart_out[uart_len++] = value;
+    }
+    else if (dev == 0x21)
+    {
+        if (r == REG_CTRL)
+            ctrl_reg = value;
+        else if (r == REG_TOKEN && (token_reg = value) & TKN_START)
+            start_token(value);
+        else if (r == REG_DATA && tx_count < 64)
+            tx_fifo[tx_count++] = value;
+    }
+    else if (dev == 0x22 && r < sizeof(hid_page) / 4)
+        hid_page[r] = value;
+    else if (dev == 0x23)
+        ++trace_count;
+    else if (dev != 0x20 && dev != 0x21)
+    {
+        fprintf(stdout, "write to %08x at pc %08x\n", addr, pc);
+        fault = 1;
+    }
+}
+
+static uint32_t load(uint32_t addr, int size)
+{
+    if ((addr >> 28) == (MEM_BASE >> 28))
+    {
+        uint32_t offset = addr - MEM_BASE;
+
+        if (offset >= MEM_WORDS * 4 || (offset & (size - 1)))
+        {
+            fprintf(stdout, "load from %08x at pc %08x\n", addr, pc);
+            fault = 1;
+            return 0;
+        }
+
+        uint32_t word = mem[offset >> 2] >> ((offset & 3) * 8);
+
+        return size == 4 ? word : size == 2 ? word & 0xffff : word & 0xff;
+    }
+
+    if (size != 4)
+    {
+        fprintf(stdout, "narrow io load from %08x at pc %08x\n", addr, pc);
+        fault = 1;
+    }
+
+    return mmio_read(addr);
+}
+
+static void store(uint32_t addr, uint32_t value, int size)
+{
+    if ((addr >> 28) == (MEM_BASE >> 28))
+    {
+        uint32_t offset = addr - MEM_BASE;
+
+        if (offset >= MEM_WORDS * 4 || (offset & (size - 1)))
+        {
+            fprintf(stdout, "store to %08x at pc %08x\n", addr, pc);
+            fault = 1;
+            return;
+        }
+
+        uint32_t shift = (offset & 3) * 8;
+        uint32_t mask = size == 4 ? 0xffffffff : (size == 2 ? 0xffff : 0xff) << shift;
+
+        mem[offset >> 2] = (mem[offset >> 2] & ~mask) | ((value << shift) & mask);
+        return;
+    }
+
+    if (size != 4)
+    {
+        fprintf(stdout, "narrow io store to %08x at pc %08x\n", addr, pc);
+        fault = 1;
+    }
+
+    mmio_write(addr, value);
+}
+
+static int32_t sign(uint32_t value, int bits)
+{
+    return (int32_t)(value << (32 - bits)) >> (32 - bits);
+}
+
+static void step(void)
+{
+    uint32_t in = load(pc, 4), next = pc + 4;
+    uint32_t op = in & 0x7f, rd = (in >> 7) & 31, f3 = (in >> 12) & 7, f7 = in >> 25;
+    uint32_t a = x[(in >> 15) & 31], b = x[(in >> 20) & 31], shamt = (in >> 20) & 31, r = 0;
+    int32_t imm_i = sign(in >> 20, 12);
+    int32_t imm_s = sign((f7 << 5) | rd, 12);
+    int32_t imm_b = sign(((in >> 31) << 12) | (((in >> 7) & 1) << 11) | (((in >> 25) & 63) << 5) | (((in >> 8) & 15) << 1), 13);
+    int32_t imm_j = sign(((in >> 31) << 20) | (((in >> 12) & 255) << 12) | (((in >> 20) & 1) << 11) | (((in >> 21) & 1023) << 1), 21);
+    int write = 1, taken = 0;
+
+    switch (op)
+    {
+        case 0x37: r = in & 0xfffff000; break;
+        case 0x17: r = pc + (in & 0xfffff000); break;
+        case 0x6f: r = next; next = pc + imm_j; break;
+        case 0x67: r = next; next = (a + imm_i) & ~1u; break;
+        case 0x63:
+            switch (f3)
+            {
+                case 0: taken = a == b; break;
+                case 1: taken = a != b; break;
+                case 4: taken = (int32_t)a < (int32_t)b; break;
+                case 5: taken = (int32_t)a >= (int32_t)b; break;
+                case 6: taken = a < b; break;
+                case 7: taken = a >= b; break;
+                default: goto illegal;
+            }
+            if (taken)
+                next = pc + imm_b;
+            write = 0;
+            break;
+        case 0x03:
+            switch (f3)
+            {
+                case 0: r = sign(load(a + imm_i, 1), 8); break;
+                case 1: r = sign(load(a + imm_i, 2), 16); break;
+                case 2: r = load(a + imm_i, 4); break;
+                case 4: r = load(a + imm_i, 1); break;
+                case 5: r = load(a + imm_i, 2); break;
+                default: goto illegal;
+            }
+            break;
+        case 0x23:
+            if (f3 > 2)
+                goto illegal;
+            store(a + imm_s, b, 1 << f3);
+            write = 0;
+            break;
+        case 0x13:
+            switch (f3)
+            {
+                case 0: r = a + imm_i; break;
+                case 1: r = a << shamt; break;
+                case 2: r = (int32_t)a < imm_i; break;
+                case 3: r = a < (uint32_t)imm_i; break;
+                case 4: r = a ^ imm_i; break;
+                case 5: r = (f7 & 0x20) ? (uint32_t)((int32_t)a >> shamt) : a >> shamt; break;
+                case 6: r = a | imm_i; break;
+                case 7: r = a & imm_i; break;
+            }
+            break;
+        case 0x33:
+            if (f7 & ~0x20u) // no M extension
+                goto illegal;
+            switch (f3)
+            {
+                case 0: r = (f7 & 0x20) ? a - b : a + b; break;
+                case 1: r = a << (b & 31); break;
+                case 2: r = (int32_t)a < (int32_t)b; break;
+                case 3: r = a < b; break;
+                case 4: r = a ^ b; break;
+                case 5: r = (f7 & 0x20) ? (uint32_t)((int32_t)a >> (b & 31)) : a >> (b & 31); break;
+                case 6: r = a | b; break;
+                case 7: r = a & b; break;
+            }
+            break;
+        case 0x0f:
+            write = 0;
+            break;
+        default:
+        illegal:
+            fprintf(stdout, "illegal instruction %08x at pc %08x\n", in, pc);
+            fault = 1;
+            return;
+    }
+
+    if (write && rd)
+        x[rd] = r;
+
+    pc = next;
+    ++icount;
+}
+
+static void run(const char *image, int hub)
+{
+    FILE *file = fopen(image, "r");
+
+    memset(mem, 0, sizeof(mem));
+    CHECK(file != NULL);
+    for (int i = 0; file && i < MEM_WORDS && fscanf(file, "%x", &mem[i]) == 1; i++) ;
+    if (file)
+        fclose(file);
+
+    memset(x, 0, sizeof(x));
+    memset(devs, 0, sizeof(devs));
+    memset(hub_port, 0, sizeof(hub_port));
+    memset(hid_page, 0, sizeof(hid_page));
+    memset(report_next, 0, sizeof(report_next));
+    pc = MEM_BASE;
+    icount = 0;
+    fault = 0;
+    trace_count = 0;
+    uart_len = 0;
+    rx_status = SIE_IDLE;
+
+    for (int i = 0; i < 3; i++)
+        devs[i].pending_addr = -1;
+
+    if (hub)
+    {
+        devs[0] = (device_t){ 1, 0, -1, 0, 1, hub_dev_desc, cfg_hub, sizeof(cfg_hub) };
+        devs[1] = (device_t){ 0, -1, -1, 0, 0, dev_desc, cfg_kbd, sizeof(cfg_kbd) };
+        devs[2] = (device_t){ 0, -1, -1, 0, 0, dev_desc, cfg_mse, sizeof(cfg_mse) };
+    }
+    else
+        devs[0] = (device_t){ 1, 0, -1, 0, 0, dev_desc, cfg_combo, sizeof(cfg_combo) };
+
+    while (icount < INSTRUCTIONS && !fault)
+        step();
+
+    uart_out[uart_len] = 0;
+    fprintf(stdout, "-- %s, %llu instructions, %d trace entries\n%s", hub ? "hub" : "combo", (unsigned long long)icount, trace_count, uart_out);
+
+    CHECK(!fault);
+}
+
+static uint32_t page(int slot, int reg)
+{
+    return hid_page[REG_HID_OUTPUT_SLOT(slot) + reg];
+}
+
+int main(int argc, char **argv)
+{
+    const char *image = argc > 1 ? argv[1] : "../mem.hex";
+
+    // combo device: both interfaces share slot 0
+
+    run(image, 0);
+    CHECK(strstr(uart_out, "device connect, speed = 1\n") != NULL);
+    CHECK(strstr(uart_out, "std keyboard detected (1)\n") != NULL);
+    CHECK(strstr(uart_out, "std mouse detected (2)\n") != NULL);
+    CHECK(page(0, REG_HID_OUTPUT_SLOT_STATUS) == (HID_SLOT_STATUS_KEYBOARD | HID_SLOT_STATUS_MOUSE));
+    CHECK(page(0, REG_HID_OUTPUT_REG_KEYS_1) == 0x00020405 && page(0, REG_HID_OUTPUT_REG_KEYS_2) == 0x06070809);
+    CHECK((int32_t)page(0, REG_HID_OUTPUT_MOUSE_X) == -1);
+    CHECK((int32_t)page(0, REG_HID_OUTPUT_MOUSE_Y) == 0);
+    CHECK((int32_t)page(0, REG_HID_OUTPUT_MOUSE_WHEEL) == -1);
+    CHECK(page(1, REG_HID_OUTPUT_SLOT_STATUS) == 0);
+    CHECK(trace_count > 0);
+
+    // hub: keyboard and mouse behind it get a slot each
+
+    run(image, 1);
+    CHECK(strstr(uart_out, "hub connected\n") != NULL);
+    CHECK(strstr(uart_out, "port 1 connected, status = 100103\n") != NULL);
+    CHECK(strstr(uart_out, "port 2 connected, status = 100103\n") != NULL);
+    CHECK(page(0, REG_HID_OUTPUT_SLOT_STATUS) == HID_SLOT_STATUS_KEYBOARD);
+    CHECK(page(0, REG_HID_OUTPUT_REG_KEYS_1) == 0x00020405 && page(0, REG_HID_OUTPUT_REG_KEYS_2) == 0x06070809);
+    CHECK(page(1, REG_HID_OUTPUT_SLOT_STATUS) == HID_SLOT_STATUS_MOUSE);
+    CHECK((int32_t)page(1, REG_HID_OUTPUT_MOUSE_X) == -1 && (int32_t)page(1, REG_HID_OUTPUT_MOUSE_WHEEL) == -1);
+    CHECK(page(0, REG_HID_OUTPUT_MOUSE_X) == 0);
+
+    fprintf(stdout, "%s: %d failures\n", failures ? "FAIL" : "OK", failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,21 @@
+#!/bin/sh
+# host test of hid.c and the fpga_driver hid merge, then of the built ../mem.hex on an rv32i simulator
+
+cd "$(dirname "$0")"
+
+DRIVER=../../../../../../esp32s3/esp-idf-components/fpga_driver
+
+mkdir -p build
+
+gcc -w -fno-builtin -c ../hid.c     -o build/hid.o   || exit 1
+gcc -w -fno-builtin -c ../enum.c    -o build/enum.o  || exit 1
+gcc -w -fno-builtin -c ../prnt.c    -o build/prnt.o  || exit 1
+gcc -w -fno-builtin -c hid_host.c   -o build/hid_host.o || exit 1
+gcc -Wall -I. -I$DRIVER -c $DRIVER/fpga_driver_hid_merge.c -o build/merge.o || exit 1
+gcc -Wall -I. -I$DRIVER -c hid_test.c -o build/hid_test.o || exit 1
+gcc build/*.o -o build/hid_test || exit 1
+
+gcc -Wall -O2 image_test.c -o build/image_test || exit 1
+
+./build/hid_test || exit 1
+./build/image_test ../mem.hex
@@ -50,7 +50,11 @@
 
 // Descriptor definitions
 //
+#ifdef __GNUC__
+#pragma pack(push, 1)
+#else
 #pragma pack on
+#endif
 
 struct dev_desc
 {
@@ -116,5 +120,9 @@ struct any_desc
 };
 typedef struct any_desc ANY_DESC;
 
+#ifdef __GNUC__
+#pragma pack(pop)
+#else
 #pragma pack off
+#endif
 
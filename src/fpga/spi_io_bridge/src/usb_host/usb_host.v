@@ -2,6 +2,12 @@
 // the USB controller and a UART.
 
 module usb_host
+#(
+    parameter HID_SLOTS = 4,
+    parameter TRACE_ENTRIES = 64,
+    parameter CPU_PIPELINED = 0, // 1: 3-stage RV32I_P3 instead of the 4-cycle RV32I
+    parameter CPU_MUL = 0        // RV32I_P3 only: MUL/MULH/MULHSU/MULHU
+)
 (
     input wire clk_48m,
     input wire clk_cpu_bram_96m,
@@ -14,16 +20,23 @@ module usb_host
     input wire cpu_uart_rx,
 
     input wire hid_read,
+    output reg hid_changed, // set when firmware commits new hid state, cleared when the host starts reading it
 
-    output reg hid_keyboard_connected, hid_mouse_connected,
+    // one entry per HID device slot
+    output reg [HID_SLOTS-1:0] hid_keyboard_connected, hid_mouse_connected,
 
-    output reg [7:0] hid_keyboard_modifiers,
-    output reg [7:0] hid_keyboard_keycodes [0:5],
+    output reg [7:0] hid_keyboard_modifiers [0:HID_SLOTS-1],
+    output reg [7:0] hid_keyboard_keycodes [0:HID_SLOTS-1][0:5],
 
-    output reg [7:0] hid_mouse_buttons,
-    output reg signed [31:0] hid_mouse_x,
-    output reg signed [31:0] hid_mouse_y,
-    output reg signed [31:0] hid_mouse_wheel
+    output reg [7:0] hid_mouse_buttons [0:HID_SLOTS-1],
+    output reg signed [31:0] hid_mouse_x [0:HID_SLOTS-1],
+    output reg signed [31:0] hid_mouse_y [0:HID_SLOTS-1],
+    output reg signed [31:0] hid_mouse_wheel [0:HID_SLOTS-1],
+
+    // firmware trace ring, count is frozen while hid_read is active
+    output reg [31:0] trace_count,
+    input wire [$clog2(TRACE_ENTRIES)-1:0] trace_addr,
+    output wire [31:0] trace_data
 );
 
     reg [3:0]        rstn_sync = 0;
@@ -39,18 +52,36 @@ module usb_host
     wire        cpu_wr = (cpu_md == 2'b01);
     wire        cpu_rd = (cpu_md == 2'b00);
 
-    RV32I cpu (
-        .CLK(clk_48m),
-        .clk_2x(clk_cpu_bram_96m),
-        .RST_X(rstn),
-        
-        .w_mic_addr(cpu_ad),
-        .w_data(cpu_di),
-        .w_mic_wdata(cpu_do),
-        .w_mic_req(cpu_md),
-        .w_mic_ctrl(),
-        .w_stall(1'b0)
-    );
+    generate
+        if (CPU_PIPELINED) begin : gen_cpu_p3
+            RV32I_P3 #(.MUL(CPU_MUL)) cpu (
+                .CLK(clk_48m),
+                .clk_2x(clk_cpu_bram_96m),
+                .RST_X(rstn),
+                
+                .w_mic_addr(cpu_ad),
+                .w_data(cpu_di),
+                .w_mic_wdata(cpu_do),
+                .w_mic_req(cpu_md),
+                .w_mic_ctrl(),
+                .w_stall(1'b0)
+            );
+        end
+        else begin : gen_cpu
+            RV32I cpu (
+                .CLK(clk_48m),
+                .clk_2x(clk_cpu_bram_96m),
+                .RST_X(rstn),
+                
+                .w_mic_addr(cpu_ad),
+                .w_data(cpu_di),
+                .w_mic_wdata(cpu_do),
+                .w_mic_req(cpu_md),
+                .w_mic_ctrl(),
+                .w_stall(1'b0)
+            );
+        end
+    endgenerate
 
     assign cpu_di = sie_sel  ? sie_di  :
                     uart_sel ? uart_di :
@@ -151,46 +182,90 @@ module usb_host
 
     // HID output regs
     //
+    // page 0 (cpu_ad[8:6] == 0) holds the global status register,
+    // pages 1..HID_SLOTS hold one register set per HID device slot
+
+    wire hid_sel = (cpu_ad[31:9] == 23'h110000); // 0x220000xx - 0x220001xx
 
-    wire hid_sel = (cpu_ad[31:8] == 24'h220000);
+    wire [2:0] hid_page = cpu_ad[8:6];
+    wire [2:0] hid_slot = hid_page - 3'd1;
+    wire hid_slot_valid = (hid_page != 3'd0) && (hid_slot < HID_SLOTS);
     
-    reg [31:0] hid_reg_status, hid_reg_keys1, hid_reg_keys2; 
-    reg signed [31:0] hid_reg_mouse_x, hid_reg_mouse_y, hid_reg_mouse_wheel;
+    reg [31:0] hid_reg_status; 
+    reg [31:0] hid_reg_slot_status [0:HID_SLOTS-1];
+    reg [31:0] hid_reg_keys1 [0:HID_SLOTS-1];
+    reg [31:0] hid_reg_keys2 [0:HID_SLOTS-1];
+    reg signed [31:0] hid_reg_mouse_x [0:HID_SLOTS-1];
+    reg signed [31:0] hid_reg_mouse_y [0:HID_SLOTS-1];
+    reg signed [31:0] hid_reg_mouse_wheel [0:HID_SLOTS-1];
 
     reg [1:0] hid_read_sync;
 
+    reg hid_read_prev;
+
     always @(posedge clk_48m)
         hid_read_sync <= {hid_read, hid_read_sync[1]};
 
-    wire [31:0] hid_di = (cpu_ad[5:2] == 4'd0) ? hid_reg_status        :
-                         (cpu_ad[5:2] == 4'd1) ? hid_reg_keys1         :
-                         (cpu_ad[5:2] == 4'd2) ? hid_reg_keys2         :
-                         (cpu_ad[5:2] == 4'd3) ? hid_reg_mouse_x       :
-                         (cpu_ad[5:2] == 4'd4) ? hid_reg_mouse_y       :
-                         (cpu_ad[5:2] == 4'd5) ? hid_reg_mouse_wheel   : 
+    wire hid_commit = hid_sel && cpu_wr && (hid_page == 3'd0) && (cpu_ad[5:2] == 4'd0) && hid_reg_status[31] && !cpu_do[31]; // busy bit released
+
+    always @(posedge clk_48m)
+    begin
+        hid_read_prev <= hid_read_sync[0];
+
+        if (!rstn)
+            hid_changed <= 1'b0;
+        else if (hid_commit)
+            hid_changed <= 1'b1;
+        else if (hid_read_sync[0] && !hid_read_prev)
+            hid_changed <= 1'b0;
+    end
+
+    wire [31:0] hid_di = (hid_page == 3'd0) ? ((cpu_ad[5:2] == 4'd0) ? hid_reg_status : 32'b0) :
+                         !hid_slot_valid    ? 32'b0 :
+                         (cpu_ad[5:2] == 4'd0) ? hid_reg_slot_status[hid_slot] :
+                         (cpu_ad[5:2] == 4'd1) ? hid_reg_keys1[hid_slot]       :
+                         (cpu_ad[5:2] == 4'd2) ? hid_reg_keys2[hid_slot]       :
+                         (cpu_ad[5:2] == 4'd3) ? hid_reg_mouse_x[hid_slot]     :
+                         (cpu_ad[5:2] == 4'd4) ? hid_reg_mouse_y[hid_slot]     :
+                         (cpu_ad[5:2] == 4'd5) ? hid_reg_mouse_wheel[hid_slot] : 
                          32'b0;
+
+    integer i;
         
     always @(posedge clk_48m)
     begin
         if (!rstn)
         begin
-            hid_reg_status <= 31'b0;
-            hid_reg_keys1 <= 31'b0;
-            hid_reg_keys2 <= 31'b0;
-            hid_reg_mouse_x <= 31'b0;
-            hid_reg_mouse_y <= 31'b0;
-            hid_reg_mouse_wheel <= 31'b0;
+            hid_reg_status <= 32'b0;
+
+            for (i = 0; i < HID_SLOTS; i = i + 1)
+            begin
+                hid_reg_slot_status[i] <= 32'b0;
+                hid_reg_keys1[i] <= 32'b0;
+                hid_reg_keys2[i] <= 32'b0;
+                hid_reg_mouse_x[i] <= 32'b0;
+                hid_reg_mouse_y[i] <= 32'b0;
+                hid_reg_mouse_wheel[i] <= 32'b0;
+            end
         end
         else if (hid_sel && cpu_wr)
         begin
-            case (cpu_ad[5:2])
-                4'd0: hid_reg_status      <= cpu_do;
-                4'd1: hid_reg_keys1       <= cpu_do;
-                4'd2: hid_reg_keys2       <= cpu_do;
-                4'd3: hid_reg_mouse_x     <= cpu_do;
-                4'd4: hid_reg_mouse_y     <= cpu_do;
-                4'd5: hid_reg_mouse_wheel <= cpu_do;
-            endcase
+            if (hid_page == 3'd0)
+            begin
+                if (cpu_ad[5:2] == 4'd0)
+                    hid_reg_status <= cpu_do;
+            end
+            else if (hid_slot_valid)
+            begin
+                case (cpu_ad[5:2])
+                    4'd0: hid_reg_slot_status[hid_slot] <= cpu_do;
+                    4'd1: hid_reg_keys1[hid_slot]       <= cpu_do;
+                    4'd2: hid_reg_keys2[hid_slot]       <= cpu_do;
+                    4'd3: hid_reg_mouse_x[hid_slot]     <= cpu_do;
+                    4'd4: hid_reg_mouse_y[hid_slot]     <= cpu_do;
+                    4'd5: hid_reg_mouse_wheel[hid_slot] <= cpu_do;
+                endcase
+            end
         end
     end
 
@@ -198,37 +273,77 @@ module usb_host
     begin
         if (!rstn)
         begin    
-            hid_keyboard_connected <= 1'b0;
-            hid_mouse_connected <= 1'b0;
-            hid_keyboard_modifiers <= 8'b0;
-            hid_keyboard_keycodes <= '{8'b0, 8'b0, 8'b0, 8'b0, 8'b0, 8'b0};
-            hid_mouse_buttons <= 8'b0;
-            hid_mouse_x <= 31'b0;
-            hid_mouse_y <= 31'b0;
-            hid_mouse_wheel <= 31'b0;
+            hid_keyboard_connected <= {HID_SLOTS{1'b0}};
+            hid_mouse_connected <= {HID_SLOTS{1'b0}};
+
+            for (i = 0; i < HID_SLOTS; i = i + 1)
+            begin
+                hid_keyboard_modifiers[i] <= 8'b0;
+                hid_keyboard_keycodes[i] <= '{8'b0, 8'b0, 8'b0, 8'b0, 8'b0, 8'b0};
+                hid_mouse_buttons[i] <= 8'b0;
+                hid_mouse_x[i] <= 32'b0;
+                hid_mouse_y[i] <= 32'b0;
+                hid_mouse_wheel[i] <= 32'b0;
+            end
         end
         else if (!hid_read_sync[0] && !hid_reg_status[31]) //'busy' bit
         begin
-            hid_keyboard_connected <= 1'b0;
-            hid_mouse_connected <= 1'b0;
+            for (i = 0; i < HID_SLOTS; i = i + 1)
+            begin
+                hid_keyboard_connected[i] <= hid_reg_slot_status[i][0];
+                hid_mouse_connected[i] <= hid_reg_slot_status[i][1];
+
+                hid_keyboard_modifiers[i] <= hid_reg_keys1[i][23:16];
+
+                hid_keyboard_keycodes[i] <= '{hid_reg_keys1[i][15:8], 
+                                              hid_reg_keys1[i][7:0], 
+                                              hid_reg_keys2[i][31:24], 
+                                              hid_reg_keys2[i][23:16], 
+                                              hid_reg_keys2[i][15:8], 
+                                              hid_reg_keys2[i][7:0]};
+
+                hid_mouse_buttons[i] <= hid_reg_keys1[i][31:24];
+
+                hid_mouse_x[i] <= hid_reg_mouse_x[i];
+                hid_mouse_y[i] <= hid_reg_mouse_y[i];
+                hid_mouse_wheel[i] <= hid_reg_mouse_wheel[i];
+            end
+        end
+    end
 
-            hid_keyboard_modifiers <= hid_reg_keys1[23:16];
+    // Trace ring
+    //
+    // every firmware write to 0x230000xx stores one event word in the next
+    // ring slot, trace_count is the total number of events written
 
-            hid_keyboard_keycodes <= '{hid_reg_keys1[15:8], 
-                                       hid_reg_keys1[7:0], 
-                                       hid_reg_keys2[31:24], 
-                                       hid_reg_keys2[23:16], 
-                                       hid_reg_keys2[15:8], 
-                                       hid_reg_keys2[7:0]};
+    wire trace_sel = (cpu_ad[31:8] == 24'h230000);
+
+    reg [31:0] trace_ram [0:TRACE_ENTRIES-1];
+    reg [31:0] trace_count_int;
+
+    always @(posedge clk_48m)
+        if (trace_sel && cpu_wr)
+            trace_ram[trace_count_int[$clog2(TRACE_ENTRIES)-1:0]] <= cpu_do;
 
-            hid_mouse_buttons <= hid_reg_keys1[31:24];
+    always @(posedge clk_48m)
+    begin
+        if (!rstn)
+        begin
+            trace_count_int <= 32'b0;
+            trace_count <= 32'b0;
+        end
+        else
+        begin
+            if (trace_sel && cpu_wr)
+                trace_count_int <= trace_count_int + 1;
 
-            hid_mouse_x <= hid_reg_mouse_x;
-            hid_mouse_y <= hid_reg_mouse_y;
-            hid_mouse_wheel <= hid_reg_mouse_wheel;
+            if (!hid_read_sync[0])
+                trace_count <= trace_count_int;
         end
     end
 
+    assign trace_data = trace_ram[trace_addr];
+
 endmodule
 
 // UART